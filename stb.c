@@ -23,6 +23,14 @@
 #include "stb_file.h"
 #include "stb_pixel32.h"
 
+#define STBTT_THREADS
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "stb_truetype.h"
+
+#define STB_DXT_THREADS
+#define STB_DXT_IMPLEMENTATION
+#include "stb_dxt.h"
+
 //#define DEBUG_BLOCK
 #ifdef DEBUG_BLOCK
 #include <conio.h>
@@ -193,7 +201,12 @@ void test_script(void)
 }
 
 #ifdef STB_THREADS
+#ifdef _WIN32
 extern void __stdcall Sleep(unsigned long);
+#else
+#include <unistd.h>
+#define Sleep(ms)   usleep((ms)*1000)
+#endif
 
 void * thread_1(void *x)
 {
@@ -228,14 +241,15 @@ void *thread_3(void *p)
 
 void test_threads(void)
 {
-   volatile int a=0,b=0;
+   // return codes are stored as void *, so these must be pointer-sized
+   volatile void *a=0,*b=0;
    //stb_work_numthreads(2);
-   stb_work(thread_2, (void *) &a, (void *) &b);
+   stb_work(thread_2, (void *) &a, &b);
    while (a==0 || b==0) {
       Sleep(10);
-      //printf("a=%d b=%d\n", a, b);
+      //printf("a=%p b=%p\n", a, b);
    }
-   c(a==2 && b == 3, "stb_thread");
+   c(a==(void *) 2 && b == (void *) 3, "stb_thread");
    stb_work_numthreads(4);
    stest = stb_sem_new(8);
    mutex = stb_mutex_new();
@@ -303,6 +317,10 @@ void *consume1(void *p)
    for(;;) {
       int z;
       stb_threadq_get_block(tq, &z);
+      if (z == 0) { // 0 means quit
+         stb_sync_reach(synch);
+         return NULL;
+      }
       stb_mutex_begin(msum);
       thread_sum += z;
       *q += z;
@@ -311,6 +329,46 @@ void *consume1(void *p)
    }      
 }
 
+// work-stealing: each ws_spawn queues more work from inside a worker
+stb_workqueue *wsq;
+volatile int ws_sum;
+
+void *ws_leaf(void *p)
+{
+   stb_mutex_begin(msum);
+   ws_sum += (int) (size_t) p;
+   stb_mutex_end(msum);
+   return NULL;
+}
+
+void *ws_spawn(void *p)
+{
+   int i;
+   for (i=1; i <= 16; ++i)
+      stb_workq_reach(wsq, ws_leaf, (void *) (size_t) i, NULL, synch);
+   return NULL;
+}
+
+// parallel for: every index is visited exactly once
+volatile int pf_hits[1000];
+
+void pf_mark(void *ctx, int begin, int end)
+{
+   int i;
+   for (i=begin; i < end; ++i)
+      pf_hits[i] += 1;
+}
+
+// task graph: each stage must see the previous stage's result
+volatile int tg_stage[8];
+
+void *tg_step(void *p)
+{
+   volatile int *s = (volatile int *) p;
+   *s += 1;
+   return (void *) (size_t) *s;
+}
+
 void test_threads2(void)
 {
    int array[256],i,n=0;
@@ -340,6 +398,86 @@ void test_threads2(void)
    c(which[0] + which[1] + which[2] + which[3] == n, "stb_threadq 2");
    printf("(Distribution: %d %d %d %d)\n", which[0], which[1], which[2], which[3]);
 
+   // stop the consumers before deleting what they're blocked on
+   stb_sync_set_target(synch, 5);
+   array[0] = 0;
+   for (i=0; i < 4; ++i)
+      stb_threadq_add_block(tq, &array[0]);
+   stb_sync_reach_and_wait(synch);
+
+   wsq = stb_workq_new_stealing(4);
+   ws_sum = 0;
+   stb_sync_set_target(synch, 8*16 + 8 + 1);
+   for (i=0; i < 8; ++i)
+      stb_workq_reach(wsq, ws_spawn, NULL, NULL, synch);
+   stb_sync_reach_and_wait(synch);
+   c(ws_sum == 8*136, "stb_workq_new_stealing");
+   stb_workq_delete(wsq);
+
+   for (i=0; i < 1000; ++i) pf_hits[i] = 0;
+   stb_parallel_for(10, 990, 7, pf_mark, NULL);
+   for (i=0; i < 1000; ++i)
+      if (pf_hits[i] != (i >= 10 && i < 990))
+         break;
+   c(i == 1000, "stb_parallel_for");
+
+   {
+      stb_taskgraph *g = stb_taskgraph_new(NULL);
+      volatile void *last[8];
+      for (i=0; i < 8; ++i) {
+         stb_task *t = stb_task_add(g, tg_step, (void *) &tg_stage[i], NULL);
+         t = stb_task_then(t, tg_step, (void *) &tg_stage[i], NULL);
+         stb_task_then(t, tg_step, (void *) &tg_stage[i], &last[i]);
+      }
+      stb_taskgraph_wait(g);
+      for (i=0; i < 8; ++i)
+         if (tg_stage[i] != 3 || last[i] != (void *) 3)
+            break;
+      c(i == 8, "stb_taskgraph");
+      stb_taskgraph_delete(g);
+   }
+
+   {
+      stb_bgio_desc d = { 0 };
+      stb_bgio_req *r[2];
+      stb_uchar *data;
+      stb_int64 len;
+      d.filename = "stb.h";
+      d.offset = 3;
+      d.len = 3;
+      stb_bgio_submit_batch(&d, 1, &r[0]);
+      d.priority = 1;
+      r[1] = stb_bgio_submit(&d);
+      stb_bgio_cancel(r[1]);
+      c(stb_bgio_wait(r[0], &data, &len) == STB_BGIO_DONE && len == 3 && !memcmp(data, "stb", 3), "stb_bgio_submit");
+      free(data);
+      i = stb_bgio_wait(r[1], &data, &len);
+      if (i == STB_BGIO_DONE) free(data);
+      c(i == STB_BGIO_DONE || (i == STB_BGIO_CANCELLED && data == NULL), "stb_bgio_cancel");
+      stb_bgio_release(r[0]);
+      stb_bgio_release(r[1]);
+   }
+
+   {
+      stbfile *f = stb_open_bgstream("stb.h", 256, 3);
+      stb_bgstream *s = stb_bgstream_open("stb.h", 4096, 2);
+      size_t n;
+      stb_uchar *data, *whole = (stb_uchar *) stb_file("stb.h", &n);
+      int len, pos=0, ok=1;
+      while ((len = stb_bgstream_next(s, &data)) > 0) {
+         if (pos + len > (int) n || memcmp(data, whole+pos, len)) ok = 0;
+         pos += len;
+      }
+      c(ok && len == 0 && pos == (int) n && stb_bgstream_eof(s), "stb_bgstream_next");
+      for (pos=0; (i = stb_getc(f)) >= 0; ++pos)
+         if (pos >= (int) n || i != whole[pos])
+            break;
+      c(i < 0 && pos == (int) n && stb_tell64(f) == n, "stb_open_bgstream");
+      stb_bgstream_close(s);
+      stb_close(f);
+      free(whole);
+   }
+
    stb_sync_delete(synch);
    stb_threadq_delete(tq);
    stb_mutex_delete(msum);
@@ -368,6 +506,74 @@ int test_compression(char *buffer, int length)
    return c_len;
 }
 
+// round-trip through a context with its own settings, or -1
+int test_compression_ctx(char *buffer, int length, int entropy, int level)
+{
+   stb_compress_context ctx;
+   char *storage2;
+   int c_len, dc_len;
+   stb_compress_context_init(&ctx);
+   ctx.entropy = entropy;
+   ctx.level = level;
+   c_len = stb_compress_ctx(&ctx, storage1, buffer, length);
+   storage2 = malloc(length);
+   dc_len = stb_decompress(storage2, storage1, c_len);
+   if (dc_len != length || memcmp(buffer, storage2, length) != 0) c_len = -1;
+   free(storage2);
+   return c_len;
+}
+
+#ifdef STB_THREADS
+// stb_compress_parallel always writes the byte format, whatever the entropy
+// setting, including when it falls back to stb_compress with one thread
+int test_parallel_compression(char *buffer, int length, int threads, int prime)
+{
+   char *storage2;
+   int c_len = stb_compress_parallel(storage1, buffer, length, threads, 65536, prime);
+   int dc_len;
+   if (storage1[4] != 0 || storage1[5] != 0) return -1;
+   storage2 = malloc(length);
+   dc_len = stb_decompress(storage2, storage1, c_len);
+   if (dc_len != length || memcmp(buffer, storage2, length) != 0) c_len = -1;
+   free(storage2);
+   return c_len;
+}
+#endif
+
+static char *stream_out;
+static int test_stream_out(void *userdata, stb_uchar *data, stb_uint len)
+{
+   memcpy(stb_arr_addn(stream_out, len), data, len);
+   return 1;
+}
+
+// round-trip through stb_arith_encode_byte; returns the coded size, or -1
+static int test_arith_bytes(char *buffer, int length, int order)
+{
+   unsigned char *coded = NULL;
+   stbfile *f = stb_open_outbuffer(&coded);
+   stb_arith a;
+   int i, ok = 1;
+   stb_arith_init_encode(&a, f);
+   stb_arith_byte_order(&a, order);
+   for (i=0; i < length; ++i)
+      stb_arith_encode_byte(&a, (unsigned char) buffer[i]);
+   stb_arith_encode_close(&a);
+   stb_close(f);
+
+   f = stb_open_inbuffer(coded, stb_arr_len(coded));
+   stb_arith_init_decode(&a, f);
+   stb_arith_byte_order(&a, order);
+   for (i=0; i < length; ++i)
+      if (stb_arith_decode_byte(&a) != (unsigned char) buffer[i])
+         ok = 0;
+   stb_arith_decode_close(&a);
+   stb_close(f);
+   i = stb_arr_len(coded);
+   stb_arr_free(coded);
+   return ok ? i : -1;
+}
+
 #if 0
 int test_en_compression(char *buffer, int length)
 {
@@ -432,6 +638,9 @@ char *args[8];
 
 void do_compressor(int,char**);
 void test_sha1(void);
+void test_truetype_bake(void);
+void test_truetype_paths(void);
+void test_dxt(void);
 
 int alloc_num, alloc_size;
 void dumpfunc(void *ptr, int sz, char *file, int line)
@@ -1085,6 +1294,9 @@ int main(int argc, char **argv)
    c(stb_wildmatch("*foo*;*bar*", "foboar")  == 0, "stb_wildmatch 5e");
 
    test_sha1();
+   test_truetype_bake();
+   test_truetype_paths();
+   test_dxt();
 
    n = sizeof(args_raw)/sizeof(args_raw[0]);
    memcpy(args, args_raw, sizeof(args_raw));
@@ -1357,6 +1569,36 @@ int main(int argc, char **argv)
       free(p);
       stb_fgets(buf, sizeof(buf), f);
       c(strcmp(buf, str3)==0, "stb_fgets()3");
+      fclose(f);
+
+      {
+         stbfile *sf = stb_openf(fopen("data/stb.test", "rb"));
+         int i, ok = 1;
+         for (i=0; i < (int) sizeof(buffer)-1; ++i)
+            if (stb_getc(sf) != (unsigned char) buffer[i])
+               ok = 0;
+         c(ok, "stb_getc()");
+         c(stb_getc(sf) == -1, "stb_getc() eof");
+         c(stb_tell64(sf) == sizeof(buffer)-1, "stb_tell64()");
+         c(stb_size64(sf) == sizeof(buffer)-1, "stb_size64()");
+         stb_close(sf);
+      }
+
+      {
+         // reads right after writes must see the written data flushed
+         static char big[5000];
+         stbfile *sf = stb_openf(fopen("data/stb.test2", "w+b"));
+         FILE *g;
+         stb_putc(sf, 'x');
+         c(stb_tell64(sf) == 1, "stb_tell64() after stb_putc()");
+         c(stb_getc(sf) == -1, "stb_getc() after stb_tell64()");
+         stb_putdata(sf, big, sizeof(big));
+         c(stb_getc(sf) == -1, "stb_getc() after stb_putdata()");
+         stb_close(sf);
+         g = fopen("data/stb.test2", "rb");
+         c(g && stb_filelen(g) == 1+sizeof(big), "stbfile read/write length");
+         if (g) fclose(g);
+      }
    }
 
    c( stb_prefix("foobar", "foo"), "stb_prefix() 1");
@@ -1415,6 +1657,10 @@ int main(int argc, char **argv)
       uint32 z = stb_adler32_old(1, p, len2);
       uint32 x = stb_adler32    (1, p, len2);
       c(z == x, "stb_adler32() 1");
+      c(stb_adler32_combine(stb_adler32(1, p, 1000), stb_adler32(1, p+1000, len2-1000), len2-1000) == x, "stb_adler32_combine()");
+      z = stb_crc32(p, len2);
+      c(stb_crc32_block(stb_crc32(p, 1000), p+1000, len2-1000) == z, "stb_crc32() 1");
+      c(stb_crc32_combine(stb_crc32(p, 1000), stb_crc32(p+1000, len2-1000), len2-1000) == z, "stb_crc32_combine()");
       memset(p,0xff,len2);
       z = stb_adler32_old((65520<<16) + 65520, p, len2);
       x = stb_adler32    ((65520<<16) + 65520, p, len2);
@@ -1544,6 +1790,17 @@ int main(int argc, char **argv)
          if (len2 == len3)
             c(!memcmp(p,q,len2), "stb_compress_stream 3");
          if (q) free(q);
+
+         f = fopen("data/stb_h.z", "rb");
+         if (f) {
+            stb_arr_free(stream_out);
+            c(stb_decompress_file_stream(f, test_stream_out, NULL), "stb_decompress_file_stream 1");
+            c(stb_arr_len(stream_out) == len2, "stb_decompress_file_stream 2");
+            if (stb_arr_len(stream_out) == len2)
+               c(!memcmp(p,stream_out,len2), "stb_decompress_file_stream 3");
+            stb_arr_free(stream_out);
+            fclose(f);
+         }
       } else {
          c(0, "stb_compress_stream 1");
       }
@@ -1556,6 +1813,31 @@ int main(int argc, char **argv)
    if (p) {
       n = test_compression(p, len2);
       c(n >= 0, "stb_compress()/stb_decompress() 2");
+      stb_compress_entropy(1);
+      n = test_compression(p, len2);
+      c(n >= 0, "stb_compress()/stb_decompress() entropy-coded");
+      stb_compress_level(9);
+      n = test_compression(p, len2);
+      c(n >= 0, "stb_compress()/stb_decompress() entropy-coded level 9");
+      stb_compress_entropy(0);
+      n = test_compression(p, len2);
+      c(n >= 0, "stb_compress()/stb_decompress() level 9");
+      stb_compress_level(1);
+      c(test_compression_ctx(p, len2, 1, 5) >= 0, "stb_compress_ctx() entropy-coded");
+      c(test_compression_ctx(p, len2, 0, 9) >= 0, "stb_compress_ctx()");
+      #ifdef STB_THREADS
+      for (i=0; i < 8; ++i) {
+         stb_compress_entropy((i >> 1) & 1);
+         c(test_parallel_compression(p, len2, i < 4 ? 4 : 1, i & 1) >= 0, "stb_compress_parallel()");
+      }
+      stb_compress_entropy(0);
+      #endif
+      n = test_arith_bytes(p, len2, 0);
+      c(n >= 0 && n < len2, "stb_arith_encode_byte() order 0");
+      {
+         int n1 = test_arith_bytes(p, len2, 1);
+         c(n1 >= 0 && n1 < n, "stb_arith_encode_byte() order 1");
+      }
       #if 0
       n = test_en_compression(p, len2);
       c(n >= 0, "stb_en_compress()/stb_en_decompress() 2");
@@ -2229,6 +2511,385 @@ struct
    "a757ead499a6ec3d8ab9814f839117354ae563c8"
 };
 
+#ifndef STB_TEST_FONT
+#define STB_TEST_FONT "c:/windows/fonts/arial.ttf"
+#endif
+
+// a bitmap too small for even the first glyph (so 'A', not ' ') must bake
+// nothing, and mustn't write outside the bitmap; chardata starts out as
+// boxes that would overflow it, in case they get used without being laid out
+void test_truetype_bake(void)
+{
+   static unsigned char ttf[1<<20];
+   unsigned char pixels[3*3 + 64];
+   stbtt_bakedchar cdata[96];
+   FILE *f = fopen(STB_TEST_FONT, "rb");
+   int i, r;
+   if (f == NULL) return;
+   fread(ttf, 1, sizeof(ttf), f);
+   fclose(f);
+   for (i=0; i < 96; ++i) {
+      cdata[i].x0 = cdata[i].y0 = 0;
+      cdata[i].x1 = cdata[i].y1 = 8;
+   }
+
+   memset(pixels, 0xcd, sizeof(pixels));
+   r = stbtt_BakeFontBitmap(ttf, 0, 32.0, pixels, 3,3, 'A',26, cdata);
+   for (i=9; i < (int) sizeof(pixels); ++i)
+      if (pixels[i] != 0xcd)
+         break;
+   c(r <= 0 && i == (int) sizeof(pixels), "stbtt_BakeFontBitmap too small");
+
+   for (i=0; i < 96; ++i) {
+      cdata[i].x0 = cdata[i].y0 = 0;
+      cdata[i].x1 = cdata[i].y1 = 8;
+   }
+   memset(pixels, 0xcd, sizeof(pixels));
+   r = stbtt_BakeFontBitmapParallel(ttf, 0, 32.0, pixels, 3,3, 'A',26, cdata, 4);
+   for (i=9; i < (int) sizeof(pixels); ++i)
+      if (pixels[i] != 0xcd)
+         break;
+   c(r <= 0 && i == (int) sizeof(pixels), "stbtt_BakeFontBitmapParallel too small");
+}
+
+#ifndef STB_TEST_FONTS
+#define STB_TEST_FONTS  STB_TEST_FONT, "c:/windows/fonts/times.ttf", "c:/windows/fonts/cour.ttf"
+#endif
+
+// stb_truetype's optional fast paths must give the same results as the
+// plain ones, for a few fonts
+static void test_truetype_font(const char *filename)
+{
+   static unsigned char ttf[1<<22];
+   static unsigned char bm[2][64*512*3], sum[64*512];
+   static const char *text = "AVAWAY To, Ty. fjord \xc3\xa9t\xc3\xa9 \xe2\x82\xac";
+   stbtt_fontinfo slow, fast;
+   stbtt_runglyph run[64];
+   stbtt_vertex *v0, *v1;
+   FILE *f = fopen(filename, "rb");
+   float scale, width, x;
+   int i, j, k, n, n0, n1, a0,b0, a1,b1, x0,y0,x1,y1, ok, kerned;
+   if (f == NULL) return;
+   fread(ttf, 1, sizeof(ttf), f);
+   fclose(f);
+   if (!stbtt_InitFont(&slow, ttf, stbtt_GetFontOffsetForIndex(ttf, 0))) {
+      c(0, "stbtt_InitFont");
+      return;
+   }
+   scale = stbtt_ScaleForPixelHeight(&slow, 24);
+
+   // lookup tables
+   fast = slow;
+   c(stbtt_InitFontAccel(&fast), "stbtt_InitFontAccel");
+   ok = 1;
+   for (i=0; i < 0x20000; ++i)
+      ok &= stbtt_FindGlyphIndex(&slow, i) == stbtt_FindGlyphIndex(&fast, i);
+   c(ok, "stbtt_InitFontAccel cmap");
+   ok = 1;
+   for (i=0; i < slow.numGlyphs; ++i) {
+      stbtt_GetGlyphHMetrics(&slow, i, &a0, &b0);
+      stbtt_GetGlyphHMetrics(&fast, i, &a1, &b1);
+      ok &= a0 == a1 && b0 == b1;
+   }
+   c(ok, "stbtt_InitFontAccel hmtx");
+   ok = 1;
+   kerned = 0;
+   for (i=32; i < 256; ++i)
+      for (j=32; j < 256; ++j) {
+         k = stbtt_GetCodepointKernAdvance(&slow, i, j);
+         ok &= k == stbtt_GetCodepointKernAdvance(&fast, i, j);
+         kerned |= k != 0;
+      }
+   c(ok && (kerned || !slow.kern), "stbtt_InitFontAccel kern");
+   stbtt_FreeFontAccel(&fast);
+
+   // run layout: glyph by glyph, with kerning between neighbors
+   n = stbtt_LayoutRunUTF8(&slow, scale, text, -1, run, 64, &width);
+   c(n == 26 && run[21].codepoint == 0xe9 && run[25].codepoint == 0x20ac, "stbtt_LayoutRunUTF8 utf8");
+   ok = 1;
+   x = 0;
+   for (i=0; i < n; ++i) {
+      ok &= run[i].glyph == stbtt_FindGlyphIndex(&slow, run[i].codepoint);
+      stbtt_GetGlyphHMetrics(&slow, run[i].glyph, &a0, NULL);
+      k = i+1 < n ? stbtt_GetGlyphKernAdvance(&slow, run[i].glyph, run[i+1].glyph) : 0;
+      ok &= fabs(run[i].x - x) < 0.01f && fabs(run[i].advance - scale*(a0+k)) < 0.01f;
+      x += scale*(a0+k);
+   }
+   c(ok && fabs(width - x) < 0.01f, "stbtt_LayoutRunUTF8");
+
+   // run rendering: a run of one glyph is that glyph, and a longer run
+   // covers at least what each glyph does and at most their sum
+   ok = 1;
+   for (i=0; i < n; ++i) {
+      stbtt_GetRunBitmapBox(&slow, run+i, 1, scale, scale, 0.25f, 0, &x0,&y0,&x1,&y1);
+      stbtt_GetGlyphBitmapBoxSubpixel(&slow, run[i].glyph, scale, scale, 0.25f + run[i].x, 0, &a0,&b0,&a1,&b1);
+      if (x1 == x0) continue; // e.g. space
+      ok &= x0 == a0 && y0 == b0 && x1 == a1 && y1 == b1;
+      stbtt_MakeRunBitmap(&slow, bm[0], x1-x0, y1-y0, 512, scale, scale, 0.25f, 0, run+i, 1);
+      stbtt_MakeGlyphBitmapSubpixel(&slow, bm[1], x1-x0, y1-y0, 512, scale, scale, 0.25f + run[i].x, 0, run[i].glyph);
+      for (j=0; j < y1-y0; ++j)
+         ok &= !memcmp(bm[0] + j*512, bm[1] + j*512, x1-x0);
+   }
+   c(ok, "stbtt_MakeRunBitmap one glyph");
+   stbtt_GetRunBitmapBox(&slow, run, n, scale, scale, 0.25f, 0, &x0,&y0,&x1,&y1);
+   ok = x1-x0 <= 512 && y1-y0 <= 64;
+   if (ok) {
+      stbtt_MakeRunBitmap(&slow, bm[0], x1-x0, y1-y0, 512, scale, scale, 0.25f, 0, run, n);
+      memset(sum, 0, sizeof(sum));
+      for (i=0; i < n; ++i) {
+         stbtt_GetGlyphBitmapBoxSubpixel(&slow, run[i].glyph, scale, scale, 0.25f + run[i].x, 0, &a0,&b0,&a1,&b1);
+         if (a1 == a0) continue;
+         if (b1-b0 < 8) {
+            // sampled more finely on their own, so don't check around them
+            for (j=0; j < b1-b0; ++j)
+               memset(sum + (j+b0-y0)*512 + a0-x0, 255, a1-a0);
+            continue;
+         }
+         stbtt_MakeGlyphBitmapSubpixel(&slow, bm[1], a1-a0, b1-b0, 512, scale, scale, 0.25f + run[i].x, 0, run[i].glyph);
+         for (j=0; j < b1-b0; ++j)
+            for (k=0; k < a1-a0; ++k) {
+               unsigned char *s = &sum[(j+b0-y0)*512 + k+a0-x0], g = bm[1][j*512+k];
+               // both are rounded separately, so allow a little slop
+               ok &= bm[0][(j+b0-y0)*512 + k+a0-x0] + 2 >= g;
+               *s = (unsigned char) stb_min(255, *s + g);
+            }
+      }
+      for (j=0; j < y1-y0; ++j)
+         for (k=0; k < x1-x0; ++k)
+            ok &= bm[0][j*512+k] <= sum[j*512+k] + 2;
+   }
+   c(ok, "stbtt_MakeRunBitmap");
+
+   // shape cache: the same outlines, so exactly the same bitmaps
+   fast = slow;
+   c(stbtt_InitShapeCache(&fast, 0), "stbtt_InitShapeCache");
+   ok = 1;
+   for (i=0; i < slow.numGlyphs; ++i) {
+      n0 = stbtt_GetGlyphShape(&slow, i, &v0);
+      n1 = stbtt_GetGlyphShape(&fast, i, &v1);
+      ok &= n0 == n1;
+      for (j=0; j < n0 && j < n1; ++j)
+         ok &= v0[j].x == v1[j].x && v0[j].y == v1[j].y && v0[j].cx == v1[j].cx && v0[j].cy == v1[j].cy && v0[j].type == v1[j].type;
+      if (n0) stbtt_FreeShape(&slow, v0);
+      if (n1) stbtt_FreeShape(&fast, v1);
+      if (i % 7 == 0) {
+         stbtt_GetGlyphBitmapBoxSubpixel(&slow, i, scale, scale, 0.5f, 0, &x0,&y0,&x1,&y1);
+         if (x1-x0 > 512 || y1-y0 > 64) continue;
+         stbtt_MakeGlyphBitmapSubpixel(&slow, bm[0], x1-x0, y1-y0, 512, scale, scale, 0.5f, 0, i);
+         stbtt_MakeGlyphBitmapSubpixel(&fast, bm[1], x1-x0, y1-y0, 512, scale, scale, 0.5f, 0, i);
+         for (j=0; j < y1-y0; ++j)
+            ok &= !memcmp(bm[0] + j*512, bm[1] + j*512, x1-x0);
+      }
+   }
+   c(ok, "stbtt_InitShapeCache");
+   stbtt_FreeShapeCache(&fast);
+
+   // LCD: the 3x-wide glyph through the documented filter
+   ok = 1;
+   for (i=0; i < n; ++i) {
+      static const int filter[5] = { 0x08, 0x4D, 0x56, 0x4D, 0x08 };
+      stbtt_GetGlyphBitmapBoxLCD(&slow, run[i].glyph, scale, scale, 0.25f, 0, &x0,&y0,&x1,&y1);
+      stbtt_GetGlyphBitmapBoxSubpixel(&slow, run[i].glyph, scale*3, scale, 0.75f, 0, &a0,&b0,&a1,&b1);
+      if ((x1-x0)*3 > 512 || y1-y0 > 64 || b0 != y0 || a0 < x0*3) { ok = 0; continue; }
+      memset(sum, 0, sizeof(sum));
+      stbtt_MakeGlyphBitmapSubpixel(&slow, sum + a0-x0*3, stb_min(a1-a0, (x1-x0)*3 - (a0-x0*3)), y1-y0, 512, scale*3, scale, 0.75f, 0, run[i].glyph);
+      stbtt_MakeGlyphBitmapLCD(&slow, bm[0], x1-x0, y1-y0, 512*3, scale, scale, 0.25f, 0, run[i].glyph, 0);
+      stbtt_MakeGlyphBitmapLCD(&slow, bm[1], x1-x0, y1-y0, 512*3, scale, scale, 0.25f, 0, run[i].glyph, 1);
+      for (j=0; j < y1-y0; ++j)
+         for (k=0; k < (x1-x0)*3; ++k) {
+            int d, s = 0;
+            for (d=-2; d <= 2; ++d)
+               if (k+d >= 0 && k+d < (x1-x0)*3)
+                  s += filter[d+2] * sum[j*512 + k+d];
+            ok &= bm[0][j*512*3 + k] == (s >> 8);
+            ok &= bm[1][j*512*3 + k/3*3 + 2 - k%3] == bm[0][j*512*3 + k];
+         }
+   }
+   c(ok, "stbtt_MakeGlyphBitmapLCD");
+}
+
+void test_truetype_paths(void)
+{
+   static const char *fonts[] = { STB_TEST_FONTS };
+   int i;
+   for (i=0; i < (int) (sizeof(fonts)/sizeof(fonts[0])); ++i)
+      test_truetype_font(fonts[i]);
+}
+
+static void test_dxt_getblock(unsigned char *block, unsigned char *img, int w, int h, int stride, int bx, int by)
+{
+   int x,y;
+   for (y=0; y < 4; ++y)
+      for (x=0; x < 4; ++x)
+         memcpy(block + y*16 + x*4, img + stb_min(by*4+y, h-1)*stride + stb_min(bx*4+x, w-1)*4, 4);
+}
+
+void test_dxt(void)
+{
+   #define TDXT_W  37   // not a multiple of 4 either way, to test the padding
+   #define TDXT_H  23
+   #define TDXT_STRIDE  (TDXT_W*4 + 12)
+   #define TDXT_BLOCKS  (((TDXT_W+3)/4) * ((TDXT_H+3)/4))
+   static unsigned char img[TDXT_H*TDXT_STRIDE], out[TDXT_BLOCKS*16], ref[TDXT_BLOCKS*16];
+   static unsigned char dec[TDXT_H*TDXT_W*4];
+   unsigned char block[64], two[32], bc[16], bc2[16], vals[32];
+   int i, j, x, y, format, mode, ok;
+   double err, psnr;
+
+   // gradients plus noise, so there are smooth and noisy blocks
+   for (y=0; y < TDXT_H; ++y)
+      for (x=0; x < TDXT_STRIDE; ++x)
+         img[y*TDXT_STRIDE+x] = (unsigned char) (x*3 + y*5 + (y > TDXT_H/2 ? stb_rand() & 63 : 0));
+
+   // the image API must give the same blocks as stb_compress_dxt_block
+   for (format=0; format < 2; ++format) {
+      int size = format ? 16 : 8;
+      for (mode=0; mode < 4; ++mode) {
+         for (y=0; y < (TDXT_H+3)/4; ++y)
+            for (x=0; x < (TDXT_W+3)/4; ++x) {
+               test_dxt_getblock(block, img, TDXT_W, TDXT_H, TDXT_STRIDE, x, y);
+               stb_compress_dxt_block(ref + (y*((TDXT_W+3)/4)+x)*size, block, format, mode);
+            }
+         memset(out, 0, sizeof(out));
+         stb_compress_dxt_image(out, img, TDXT_W, TDXT_H, TDXT_STRIDE, format, mode);
+         c(!memcmp(out, ref, TDXT_BLOCKS*size), "stb_compress_dxt_image");
+         #ifdef STB_DXT_THREADS
+         memset(out, 0, sizeof(out));
+         stb_compress_dxt_image_parallel(out, img, TDXT_W, TDXT_H, TDXT_STRIDE, format, mode, 3);
+         c(!memcmp(out, ref, TDXT_BLOCKS*size), "stb_compress_dxt_image_parallel");
+         #endif
+      }
+   }
+
+   // the SSE2 encoder must match the scalar one exactly
+   if (stb_dxt_simd(1)) {
+      ok = 1;
+      for (i=0; i < 3000 && ok; ++i) {
+         for (j=0; j < 64; ++j)
+            block[j] = (unsigned char) stb_rand();
+         if (i % 3 == 1)  // two colors
+            for (j=8; j < 64; ++j) block[j] = block[j & 7];
+         if (i % 3 == 2)  // low contrast
+            for (j=4; j < 64; ++j) block[j] = block[j & 3] + (block[j] & 7);
+         for (mode=0; mode < 8; ++mode) {
+            stb_dxt_simd(0);
+            stb_compress_dxt_block(bc, block, mode >> 2, mode & 3);
+            stb_dxt_simd(1);
+            stb_compress_dxt_block(bc2, block, mode >> 2, mode & 3);
+            if (memcmp(bc, bc2, (mode >> 2) ? 16 : 8)) ok = 0;
+         }
+      }
+      c(ok, "stb_dxt SSE2 vs scalar");
+   }
+
+   // the constant tables must match what they were computed from
+   ok = 1;
+   for (i=0; i < 32; ++i) ok &= stb__Expand5[i] == ((i<<3)|(i>>2));
+   for (i=0; i < 64; ++i) ok &= stb__Expand6[i] == ((i<<2)|(i>>4));
+   for (i=0; i < 256+16; ++i) {
+      int v = stb_clamp(i-8, 0, 255);
+      ok &= stb__QuantRBTab[i] == stb__Expand5[stb__Mul8Bit(v,31)];
+      ok &= stb__QuantGTab[i]  == stb__Expand6[stb__Mul8Bit(v,63)];
+   }
+   for (j=0; j < 2; ++j) {
+      const unsigned char *expand = j ? stb__Expand6 : stb__Expand5;
+      const unsigned char (*omatch)[2] = j ? stb__OMatch6 : stb__OMatch5;
+      int size = j ? 64 : 32, mn, mx;
+      for (i=0; i < 256; ++i) {
+         int best = 256, bmx=0, bmn=0;
+         for (mn=0; mn < size; ++mn)
+            for (mx=0; mx < size; ++mx) {
+               int e = abs(stb__Lerp13(expand[mx], expand[mn]) - i) + abs(expand[mx] - expand[mn]) * 3 / 100;
+               if (e < best) { best = e; bmx = mx; bmn = mn; }
+            }
+         ok &= omatch[i][0] == bmx && omatch[i][1] == bmn;
+      }
+   }
+   c(ok, "stb_dxt tables");
+
+   // BC4/BC5: the image API against the block functions, BC4 against the
+   // DXT5 alpha block, and BC5 against two BC4 blocks
+   for (format=STB_DXT_BC4; format <= STB_DXT_BC5; ++format) {
+      int size = format == STB_DXT_BC5 ? 16 : 8;
+      for (y=0; y < (TDXT_H+3)/4; ++y)
+         for (x=0; x < (TDXT_W+3)/4; ++x) {
+            unsigned char *dest = ref + (y*((TDXT_W+3)/4)+x)*size;
+            test_dxt_getblock(block, img, TDXT_W, TDXT_H, TDXT_STRIDE, x, y);
+            for (i=0; i < 16; ++i)
+               two[i*2+0] = block[i*4+0], two[i*2+1] = block[i*4+1];
+            if (format == STB_DXT_BC4) {
+               for (i=0; i < 16; ++i) vals[i] = block[i*4];
+               stb_compress_bc4_block(dest, vals);
+            } else
+               stb_compress_bc5_block(dest, two);
+         }
+      memset(out, 0, sizeof(out));
+      stb_compress_dxt_image(out, img, TDXT_W, TDXT_H, TDXT_STRIDE, format, 0);
+      c(!memcmp(out, ref, TDXT_BLOCKS*size), "stb_compress_dxt_image BC4/BC5");
+   }
+   ok = 1;
+   for (i=0; i < 1000; ++i) {
+      for (j=0; j < 64; ++j)
+         block[j] = (unsigned char) (i & 1 ? stb_rand() : 100 + (stb_rand() % 20));
+      for (j=0; j < 16; ++j)
+         vals[j] = block[j*4+3], two[j*2] = block[j*4+0], two[j*2+1] = block[j*4+1];
+      stb_compress_dxt_block(bc, block, 1, 0);
+      stb_compress_bc4_block(bc2, vals);
+      if (memcmp(bc, bc2, 8)) ok = 0;
+      stb_compress_bc5_block(bc, two);
+      for (j=0; j < 16; ++j) vals[j] = two[j*2];
+      stb_compress_bc4_block(bc2, vals);
+      for (j=0; j < 16; ++j) vals[j] = two[j*2+1];
+      stb_compress_bc4_block(bc2+8, vals);
+      if (memcmp(bc, bc2, 16)) ok = 0;
+   }
+   c(ok, "stb_compress_bc4_block/bc5_block");
+
+   // BC4 (so each half of BC5) always uses the block's min and max as
+   // endpoints, with six values in between, so decoding can't be off by
+   // more than half a step, plus rounding
+   ok = 1;
+   for (i=0; i < 1000; ++i) {
+      int mn=255, mx=0;
+      for (j=0; j < 32; ++j)
+         vals[j] = (unsigned char) (i & 1 ? stb_rand() : 100 + (stb_rand() % 20));
+      for (j=0; j < 32; ++j)
+         mn = stb_min(mn, vals[j]), mx = stb_max(mx, vals[j]);
+      stb_compress_bc5_block(bc, vals);
+      stb_decompress_bc5_block(two, bc);
+      for (j=0; j < 32; ++j)
+         if (abs(two[j] - vals[j]) > (mx-mn)/14 + 1) ok = 0;
+   }
+   c(ok, "stb_decompress_bc5_block error bound");
+
+   // stb_dxt_image_error must agree with the decoded image
+   for (format=STB_DXT_BC1; format <= STB_DXT_BC5; ++format) {
+      int channels = format == STB_DXT_BC1 ? 3 : format == STB_DXT_BC3 ? 4 : format == STB_DXT_BC4 ? 1 : 2;
+      double sse = 0, mse;
+      stb_compress_dxt_image(out, img, TDXT_W, TDXT_H, TDXT_STRIDE, format, 0);
+      stb_decompress_dxt_image(dec, out, TDXT_W, TDXT_H, TDXT_W*4, format);
+      for (y=0; y < TDXT_H; ++y)
+         for (x=0; x < TDXT_W; ++x)
+            for (i=0; i < channels; ++i) {
+               int d = img[y*TDXT_STRIDE + x*4 + i] - dec[(y*TDXT_W + x)*4 + i];
+               sse += d*d;
+            }
+      mse = sse / (TDXT_W*TDXT_H*channels);
+      err = stb_dxt_image_error(img, TDXT_W, TDXT_H, TDXT_STRIDE, out, format, &psnr);
+      c(mse > 0 && fabs(err - sqrt(mse)) < 1e-9 && fabs(psnr - 10*log10(255.0*255.0/mse)) < 1e-9, "stb_dxt_image_error");
+      #ifdef STB_DXT_THREADS
+      {
+         double psnr2, err2 = stb_dxt_image_error_parallel(img, TDXT_W, TDXT_H, TDXT_STRIDE, out, format, &psnr2, 3);
+         c(err2 == err && psnr2 == psnr, "stb_dxt_image_error_parallel");
+      }
+      #endif
+   }
+   memset(img, 77, sizeof(img));
+   stb_compress_dxt_image(out, img, TDXT_W, TDXT_H, TDXT_STRIDE, STB_DXT_BC4, 0);
+   err = stb_dxt_image_error(img, TDXT_W, TDXT_H, TDXT_STRIDE, out, STB_DXT_BC4, &psnr);
+   c(err == 0 && psnr == 999, "stb_dxt_image_error exact");
+}
+
 void test_sha1(void)
 {
    unsigned char buffer[4000];
@@ -2265,11 +2926,17 @@ void test_sha1(void)
          if (!f) stb_fatal("Couldn't write to test.bin");
          fwrite(buffer, len, 1, f);
          fclose(f);
-         #ifdef _WIN32
          z = stb_sha1_file(fdig, "data/test.bin");
          if (!z) stb_fatal("Couldn't digest test.bin");
          c(memcmp(digest, fdig, 20)==0, "stb_sh1_file");
-         #endif
+      }
+      {
+         stb_sha1_context sc;
+         stb_sha1_init(&sc);
+         for (h=0; h < len; h += 7)
+            stb_sha1_update(&sc, buffer+h, len-h < 7 ? len-h : 7);
+         stb_sha1_final(&sc, fdig);
+         c(memcmp(digest, fdig, 20)==0, "stb_sha1_update");
       }
    }
 }
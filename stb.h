@@ -1,4 +1,4 @@
-/* stb-2.23 - Sean's Tool Box -- public domain -- http://nothings.org/stb.h
+/* stb-2.38 - Sean's Tool Box -- public domain -- http://nothings.org/stb.h
           no warranty is offered or implied; use this code at your own risk
 
    This is a single header file with a bunch of useful utilities
@@ -28,6 +28,26 @@
 
 Version History
 
+   2.38   stb_bgstream: readahead streaming reader on stb_bgio, also as an stbfile
+   2.37   stb_bgio_submit et al: 64-bit offsets, priorities, callbacks, cancel,
+          unbounded queue; io_uring for FILE reads on Linux
+   2.36   stb_parallel_for, stb_taskgraph (tasks with dependencies and continuations)
+   2.35   lock-free ring for fixed-size stb_threadqueue (Vyukov bounded MPMC)
+   2.34   stb_workq_new_stealing (Chase-Lev work-stealing deques); stb_workq_delete
+          stops its threads
+   2.33   POSIX threads (pthreads, futex semaphores on Linux), stb_bgio_stat on POSIX
+   2.32   stb_arith_encode_byte/decode_byte (adaptive order-0, or order-1 with
+          context mixing); Fenwick-tree stb_arith_symstate models
+   2.31   buffered stbfile with inline stb_getc/stb_putc; stb_tell64, stb_size64
+   2.30   streaming stb_sha1_init/update/final, SHA-NI, stb_sha1_update_multi;
+          stb_sha1_file on all platforms
+   2.29   slicing-by-8 and PCLMUL stb_crc32, SSSE3 stb_adler32, _combine for both
+   2.28   faster stb_decompress (copies 8-16 bytes at a time away from buffer ends)
+   2.27   stb_compress_level: hash-chain and binary-tree match finders, lazy matching
+   2.26   streaming stb_decompress with bounded memory (stb_decompress_stream)
+   2.25   stb_compress is re-entrant (stb_compress_context); stb_compress_parallel
+   2.24   entropy-coded stb_compress format; fix stb_arith carries, add
+          stb_arith_init_decode and adaptive binary models
    2.23   fix 2.22
    2.22   64-bit fixes from '!='; fix stb_sdict_copy() to have preferred name
    2.21   utf-8 decoder rejects "overlong" encodings; attempted 64-bit improvements
@@ -6070,9 +6090,20 @@ stb_dirtree2 *stb_dirtree2_from_files(char **filelist, int count)
 //
 //                 Checksums: CRC-32, ADLER32, SHA-1
 //
-//    CRC-32 and ADLER32 allow streaming blocks
+//    CRC-32 and ADLER32 allow streaming blocks, and _combine joins the
+//          checksums of two blocks computed separately (e.g. on
+//          different threads) into the checksum of both in order
 //    SHA-1 requires either a complete buffer, max size 2^32 - 73
 //          or it can checksum directly from a file, max 2^61
+//
+//          stb_sha1_init/update/final hash a stream fed in pieces, and
+//          stb_sha1_update_multi advances several streams at once
+//
+//    On x86 with gcc, clang or MSVC, CRC-32 uses carry-less multiply,
+//    ADLER32 uses SSSE3, SHA-1 uses the SHA extensions, and
+//    stb_sha1_update_multi hashes four streams at a time with SSE2, if the
+//    CPU has them (checked at runtime); #define STB_NO_SIMD to always use
+//    the portable versions.
 
 #define STB_ADLER32_SEED   1
 #define STB_CRC32_SEED     0    // note that we logical NOT this in the code
@@ -6082,28 +6113,464 @@ STB_EXTERN stb_uint
 STB_EXTERN stb_uint 
   stb_crc32_block(stb_uint crc32, stb_uchar *buffer, stb_uint len);
 STB_EXTERN stb_uint stb_crc32(unsigned char *buffer, stb_uint len);
+STB_EXTERN stb_uint stb_adler32_combine(stb_uint adler1, stb_uint adler2, stb_uint len2);
+STB_EXTERN stb_uint stb_crc32_combine(stb_uint crc1, stb_uint crc2, stb_uint len2);
 
 STB_EXTERN void stb_sha1(
   unsigned char output[20], unsigned char *buffer, unsigned int len);
 STB_EXTERN int stb_sha1_file(unsigned char output[20], char *file);
 
+typedef struct
+{
+   stb_uint   h[5];
+   stb_uint64 length;      // bytes so far
+   stb_uchar  buffer[64];  // the partial block, length % 64 bytes
+} stb_sha1_context;
+
+STB_EXTERN void stb_sha1_init  (stb_sha1_context *c);
+STB_EXTERN void stb_sha1_update(stb_sha1_context *c, void *data, size_t len);
+STB_EXTERN void stb_sha1_final (stb_sha1_context *c, unsigned char output[20]);
+// same as calling stb_sha1_update(c[i], data[i], len[i]) for each i < count;
+// the contexts must all be different
+STB_EXTERN void stb_sha1_update_multi(stb_sha1_context **c, void **data, size_t *len, int count);
+
 STB_EXTERN void stb_sha1_readable(char display[27], unsigned char sha[20]);
 
 #ifdef STB_DEFINE
+
+#if !defined(STB_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+   #if defined(_MSC_VER)
+      #define STB__X86_SIMD
+      #define STB__TARGET(x)
+      #include <intrin.h>
+   #elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+      #define STB__X86_SIMD
+      #define STB__TARGET(x)  __attribute__((target(x)))
+      #include <immintrin.h>
+      #include <cpuid.h>
+   #endif
+#endif
+
+#ifdef STB__X86_SIMD
+#define STB__CPU_SSSE3    1
+#define STB__CPU_PCLMUL   2
+#define STB__CPU_SSE2     4
+#define STB__CPU_SHA      8   // with SSSE3 and SSE4.1, which SHA-NI code needs
+
+// threads may race to fill this in, but they all write the same value
+static int stb__cpu_features = -1;
+
+static int stb__cpu_has(int feature)
+{
+   if (stb__cpu_features < 0) {
+      unsigned int ecx = 0, edx = 0, ebx7 = 0;
+      #ifdef _MSC_VER
+      int r[4];
+      __cpuid(r, 0);
+      if (r[0] >= 7) {
+         __cpuidex(r, 7, 0);
+         ebx7 = r[1];
+      }
+      __cpuid(r, 1);
+      ecx = r[2];
+      edx = r[3];
+      #else
+      unsigned int eax, ebx;
+      if (__get_cpuid_max(0, NULL) >= 7) {
+         __cpuid_count(7, 0, eax, ebx7, ecx, edx);
+      }
+      if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+         ecx = edx = 0;
+      #endif
+      stb__cpu_features = ((ecx >>  9) & 1 ? STB__CPU_SSSE3  : 0)
+                        | ((ecx >>  1) & 1 ? STB__CPU_PCLMUL : 0)
+                        | ((edx >> 26) & 1 ? STB__CPU_SSE2   : 0);
+      if (((ebx7 >> 29) & 1) && ((ecx >> 9) & 1) && ((ecx >> 19) & 1))
+         stb__cpu_features |= STB__CPU_SHA;
+   }
+   return stb__cpu_features & feature;
+}
+#endif
+
+// stb__crc32_table[0] is the usual byte-at-a-time table; [k] advances a
+// byte's contribution past k more bytes, so 8 bytes can be done at once
+static const stb_uint stb__crc32_table[8][256] =
+{
+   {
+      0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
+      0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+      0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+      0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+      0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
+      0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+      0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
+      0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+      0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+      0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+      0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
+      0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+      0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
+      0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+      0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+      0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+      0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
+      0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+      0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
+      0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+      0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+      0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+      0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
+      0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+      0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
+      0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+      0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+      0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+      0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
+      0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+      0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
+      0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+   },
+   {
+      0x00000000, 0x191b3141, 0x32366282, 0x2b2d53c3, 0x646cc504, 0x7d77f445, 0x565aa786, 0x4f4196c7,
+      0xc8d98a08, 0xd1c2bb49, 0xfaefe88a, 0xe3f4d9cb, 0xacb54f0c, 0xb5ae7e4d, 0x9e832d8e, 0x87981ccf,
+      0x4ac21251, 0x53d92310, 0x78f470d3, 0x61ef4192, 0x2eaed755, 0x37b5e614, 0x1c98b5d7, 0x05838496,
+      0x821b9859, 0x9b00a918, 0xb02dfadb, 0xa936cb9a, 0xe6775d5d, 0xff6c6c1c, 0xd4413fdf, 0xcd5a0e9e,
+      0x958424a2, 0x8c9f15e3, 0xa7b24620, 0xbea97761, 0xf1e8e1a6, 0xe8f3d0e7, 0xc3de8324, 0xdac5b265,
+      0x5d5daeaa, 0x44469feb, 0x6f6bcc28, 0x7670fd69, 0x39316bae, 0x202a5aef, 0x0b07092c, 0x121c386d,
+      0xdf4636f3, 0xc65d07b2, 0xed705471, 0xf46b6530, 0xbb2af3f7, 0xa231c2b6, 0x891c9175, 0x9007a034,
+      0x179fbcfb, 0x0e848dba, 0x25a9de79, 0x3cb2ef38, 0x73f379ff, 0x6ae848be, 0x41c51b7d, 0x58de2a3c,
+      0xf0794f05, 0xe9627e44, 0xc24f2d87, 0xdb541cc6, 0x94158a01, 0x8d0ebb40, 0xa623e883, 0xbf38d9c2,
+      0x38a0c50d, 0x21bbf44c, 0x0a96a78f, 0x138d96ce, 0x5ccc0009, 0x45d73148, 0x6efa628b, 0x77e153ca,
+      0xbabb5d54, 0xa3a06c15, 0x888d3fd6, 0x91960e97, 0xded79850, 0xc7cca911, 0xece1fad2, 0xf5facb93,
+      0x7262d75c, 0x6b79e61d, 0x4054b5de, 0x594f849f, 0x160e1258, 0x0f152319, 0x243870da, 0x3d23419b,
+      0x65fd6ba7, 0x7ce65ae6, 0x57cb0925, 0x4ed03864, 0x0191aea3, 0x188a9fe2, 0x33a7cc21, 0x2abcfd60,
+      0xad24e1af, 0xb43fd0ee, 0x9f12832d, 0x8609b26c, 0xc94824ab, 0xd05315ea, 0xfb7e4629, 0xe2657768,
+      0x2f3f79f6, 0x362448b7, 0x1d091b74, 0x04122a35, 0x4b53bcf2, 0x52488db3, 0x7965de70, 0x607eef31,
+      0xe7e6f3fe, 0xfefdc2bf, 0xd5d0917c, 0xcccba03d, 0x838a36fa, 0x9a9107bb, 0xb1bc5478, 0xa8a76539,
+      0x3b83984b, 0x2298a90a, 0x09b5fac9, 0x10aecb88, 0x5fef5d4f, 0x46f46c0e, 0x6dd93fcd, 0x74c20e8c,
+      0xf35a1243, 0xea412302, 0xc16c70c1, 0xd8774180, 0x9736d747, 0x8e2de606, 0xa500b5c5, 0xbc1b8484,
+      0x71418a1a, 0x685abb5b, 0x4377e898, 0x5a6cd9d9, 0x152d4f1e, 0x0c367e5f, 0x271b2d9c, 0x3e001cdd,
+      0xb9980012, 0xa0833153, 0x8bae6290, 0x92b553d1, 0xddf4c516, 0xc4eff457, 0xefc2a794, 0xf6d996d5,
+      0xae07bce9, 0xb71c8da8, 0x9c31de6b, 0x852aef2a, 0xca6b79ed, 0xd37048ac, 0xf85d1b6f, 0xe1462a2e,
+      0x66de36e1, 0x7fc507a0, 0x54e85463, 0x4df36522, 0x02b2f3e5, 0x1ba9c2a4, 0x30849167, 0x299fa026,
+      0xe4c5aeb8, 0xfdde9ff9, 0xd6f3cc3a, 0xcfe8fd7b, 0x80a96bbc, 0x99b25afd, 0xb29f093e, 0xab84387f,
+      0x2c1c24b0, 0x350715f1, 0x1e2a4632, 0x07317773, 0x4870e1b4, 0x516bd0f5, 0x7a468336, 0x635db277,
+      0xcbfad74e, 0xd2e1e60f, 0xf9ccb5cc, 0xe0d7848d, 0xaf96124a, 0xb68d230b, 0x9da070c8, 0x84bb4189,
+      0x03235d46, 0x1a386c07, 0x31153fc4, 0x280e0e85, 0x674f9842, 0x7e54a903, 0x5579fac0, 0x4c62cb81,
+      0x8138c51f, 0x9823f45e, 0xb30ea79d, 0xaa1596dc, 0xe554001b, 0xfc4f315a, 0xd7626299, 0xce7953d8,
+      0x49e14f17, 0x50fa7e56, 0x7bd72d95, 0x62cc1cd4, 0x2d8d8a13, 0x3496bb52, 0x1fbbe891, 0x06a0d9d0,
+      0x5e7ef3ec, 0x4765c2ad, 0x6c48916e, 0x7553a02f, 0x3a1236e8, 0x230907a9, 0x0824546a, 0x113f652b,
+      0x96a779e4, 0x8fbc48a5, 0xa4911b66, 0xbd8a2a27, 0xf2cbbce0, 0xebd08da1, 0xc0fdde62, 0xd9e6ef23,
+      0x14bce1bd, 0x0da7d0fc, 0x268a833f, 0x3f91b27e, 0x70d024b9, 0x69cb15f8, 0x42e6463b, 0x5bfd777a,
+      0xdc656bb5, 0xc57e5af4, 0xee530937, 0xf7483876, 0xb809aeb1, 0xa1129ff0, 0x8a3fcc33, 0x9324fd72,
+   },
+   {
+      0x00000000, 0x01c26a37, 0x0384d46e, 0x0246be59, 0x0709a8dc, 0x06cbc2eb, 0x048d7cb2, 0x054f1685,
+      0x0e1351b8, 0x0fd13b8f, 0x0d9785d6, 0x0c55efe1, 0x091af964, 0x08d89353, 0x0a9e2d0a, 0x0b5c473d,
+      0x1c26a370, 0x1de4c947, 0x1fa2771e, 0x1e601d29, 0x1b2f0bac, 0x1aed619b, 0x18abdfc2, 0x1969b5f5,
+      0x1235f2c8, 0x13f798ff, 0x11b126a6, 0x10734c91, 0x153c5a14, 0x14fe3023, 0x16b88e7a, 0x177ae44d,
+      0x384d46e0, 0x398f2cd7, 0x3bc9928e, 0x3a0bf8b9, 0x3f44ee3c, 0x3e86840b, 0x3cc03a52, 0x3d025065,
+      0x365e1758, 0x379c7d6f, 0x35dac336, 0x3418a901, 0x3157bf84, 0x3095d5b3, 0x32d36bea, 0x331101dd,
+      0x246be590, 0x25a98fa7, 0x27ef31fe, 0x262d5bc9, 0x23624d4c, 0x22a0277b, 0x20e69922, 0x2124f315,
+      0x2a78b428, 0x2bbade1f, 0x29fc6046, 0x283e0a71, 0x2d711cf4, 0x2cb376c3, 0x2ef5c89a, 0x2f37a2ad,
+      0x709a8dc0, 0x7158e7f7, 0x731e59ae, 0x72dc3399, 0x7793251c, 0x76514f2b, 0x7417f172, 0x75d59b45,
+      0x7e89dc78, 0x7f4bb64f, 0x7d0d0816, 0x7ccf6221, 0x798074a4, 0x78421e93, 0x7a04a0ca, 0x7bc6cafd,
+      0x6cbc2eb0, 0x6d7e4487, 0x6f38fade, 0x6efa90e9, 0x6bb5866c, 0x6a77ec5b, 0x68315202, 0x69f33835,
+      0x62af7f08, 0x636d153f, 0x612bab66, 0x60e9c151, 0x65a6d7d4, 0x6464bde3, 0x662203ba, 0x67e0698d,
+      0x48d7cb20, 0x4915a117, 0x4b531f4e, 0x4a917579, 0x4fde63fc, 0x4e1c09cb, 0x4c5ab792, 0x4d98dda5,
+      0x46c49a98, 0x4706f0af, 0x45404ef6, 0x448224c1, 0x41cd3244, 0x400f5873, 0x4249e62a, 0x438b8c1d,
+      0x54f16850, 0x55330267, 0x5775bc3e, 0x56b7d609, 0x53f8c08c, 0x523aaabb, 0x507c14e2, 0x51be7ed5,
+      0x5ae239e8, 0x5b2053df, 0x5966ed86, 0x58a487b1, 0x5deb9134, 0x5c29fb03, 0x5e6f455a, 0x5fad2f6d,
+      0xe1351b80, 0xe0f771b7, 0xe2b1cfee, 0xe373a5d9, 0xe63cb35c, 0xe7fed96b, 0xe5b86732, 0xe47a0d05,
+      0xef264a38, 0xeee4200f, 0xeca29e56, 0xed60f461, 0xe82fe2e4, 0xe9ed88d3, 0xebab368a, 0xea695cbd,
+      0xfd13b8f0, 0xfcd1d2c7, 0xfe976c9e, 0xff5506a9, 0xfa1a102c, 0xfbd87a1b, 0xf99ec442, 0xf85cae75,
+      0xf300e948, 0xf2c2837f, 0xf0843d26, 0xf1465711, 0xf4094194, 0xf5cb2ba3, 0xf78d95fa, 0xf64fffcd,
+      0xd9785d60, 0xd8ba3757, 0xdafc890e, 0xdb3ee339, 0xde71f5bc, 0xdfb39f8b, 0xddf521d2, 0xdc374be5,
+      0xd76b0cd8, 0xd6a966ef, 0xd4efd8b6, 0xd52db281, 0xd062a404, 0xd1a0ce33, 0xd3e6706a, 0xd2241a5d,
+      0xc55efe10, 0xc49c9427, 0xc6da2a7e, 0xc7184049, 0xc25756cc, 0xc3953cfb, 0xc1d382a2, 0xc011e895,
+      0xcb4dafa8, 0xca8fc59f, 0xc8c97bc6, 0xc90b11f1, 0xcc440774, 0xcd866d43, 0xcfc0d31a, 0xce02b92d,
+      0x91af9640, 0x906dfc77, 0x922b422e, 0x93e92819, 0x96a63e9c, 0x976454ab, 0x9522eaf2, 0x94e080c5,
+      0x9fbcc7f8, 0x9e7eadcf, 0x9c381396, 0x9dfa79a1, 0x98b56f24, 0x99770513, 0x9b31bb4a, 0x9af3d17d,
+      0x8d893530, 0x8c4b5f07, 0x8e0de15e, 0x8fcf8b69, 0x8a809dec, 0x8b42f7db, 0x89044982, 0x88c623b5,
+      0x839a6488, 0x82580ebf, 0x801eb0e6, 0x81dcdad1, 0x8493cc54, 0x8551a663, 0x8717183a, 0x86d5720d,
+      0xa9e2d0a0, 0xa820ba97, 0xaa6604ce, 0xaba46ef9, 0xaeeb787c, 0xaf29124b, 0xad6fac12, 0xacadc625,
+      0xa7f18118, 0xa633eb2f, 0xa4755576, 0xa5b73f41, 0xa0f829c4, 0xa13a43f3, 0xa37cfdaa, 0xa2be979d,
+      0xb5c473d0, 0xb40619e7, 0xb640a7be, 0xb782cd89, 0xb2cddb0c, 0xb30fb13b, 0xb1490f62, 0xb08b6555,
+      0xbbd72268, 0xba15485f, 0xb853f606, 0xb9919c31, 0xbcde8ab4, 0xbd1ce083, 0xbf5a5eda, 0xbe9834ed,
+   },
+   {
+      0x00000000, 0xb8bc6765, 0xaa09c88b, 0x12b5afee, 0x8f629757, 0x37def032, 0x256b5fdc, 0x9dd738b9,
+      0xc5b428ef, 0x7d084f8a, 0x6fbde064, 0xd7018701, 0x4ad6bfb8, 0xf26ad8dd, 0xe0df7733, 0x58631056,
+      0x5019579f, 0xe8a530fa, 0xfa109f14, 0x42acf871, 0xdf7bc0c8, 0x67c7a7ad, 0x75720843, 0xcdce6f26,
+      0x95ad7f70, 0x2d111815, 0x3fa4b7fb, 0x8718d09e, 0x1acfe827, 0xa2738f42, 0xb0c620ac, 0x087a47c9,
+      0xa032af3e, 0x188ec85b, 0x0a3b67b5, 0xb28700d0, 0x2f503869, 0x97ec5f0c, 0x8559f0e2, 0x3de59787,
+      0x658687d1, 0xdd3ae0b4, 0xcf8f4f5a, 0x7733283f, 0xeae41086, 0x525877e3, 0x40edd80d, 0xf851bf68,
+      0xf02bf8a1, 0x48979fc4, 0x5a22302a, 0xe29e574f, 0x7f496ff6, 0xc7f50893, 0xd540a77d, 0x6dfcc018,
+      0x359fd04e, 0x8d23b72b, 0x9f9618c5, 0x272a7fa0, 0xbafd4719, 0x0241207c, 0x10f48f92, 0xa848e8f7,
+      0x9b14583d, 0x23a83f58, 0x311d90b6, 0x89a1f7d3, 0x1476cf6a, 0xaccaa80f, 0xbe7f07e1, 0x06c36084,
+      0x5ea070d2, 0xe61c17b7, 0xf4a9b859, 0x4c15df3c, 0xd1c2e785, 0x697e80e0, 0x7bcb2f0e, 0xc377486b,
+      0xcb0d0fa2, 0x73b168c7, 0x6104c729, 0xd9b8a04c, 0x446f98f5, 0xfcd3ff90, 0xee66507e, 0x56da371b,
+      0x0eb9274d, 0xb6054028, 0xa4b0efc6, 0x1c0c88a3, 0x81dbb01a, 0x3967d77f, 0x2bd27891, 0x936e1ff4,
+      0x3b26f703, 0x839a9066, 0x912f3f88, 0x299358ed, 0xb4446054, 0x0cf80731, 0x1e4da8df, 0xa6f1cfba,
+      0xfe92dfec, 0x462eb889, 0x549b1767, 0xec277002, 0x71f048bb, 0xc94c2fde, 0xdbf98030, 0x6345e755,
+      0x6b3fa09c, 0xd383c7f9, 0xc1366817, 0x798a0f72, 0xe45d37cb, 0x5ce150ae, 0x4e54ff40, 0xf6e89825,
+      0xae8b8873, 0x1637ef16, 0x048240f8, 0xbc3e279d, 0x21e91f24, 0x99557841, 0x8be0d7af, 0x335cb0ca,
+      0xed59b63b, 0x55e5d15e, 0x47507eb0, 0xffec19d5, 0x623b216c, 0xda874609, 0xc832e9e7, 0x708e8e82,
+      0x28ed9ed4, 0x9051f9b1, 0x82e4565f, 0x3a58313a, 0xa78f0983, 0x1f336ee6, 0x0d86c108, 0xb53aa66d,
+      0xbd40e1a4, 0x05fc86c1, 0x1749292f, 0xaff54e4a, 0x322276f3, 0x8a9e1196, 0x982bbe78, 0x2097d91d,
+      0x78f4c94b, 0xc048ae2e, 0xd2fd01c0, 0x6a4166a5, 0xf7965e1c, 0x4f2a3979, 0x5d9f9697, 0xe523f1f2,
+      0x4d6b1905, 0xf5d77e60, 0xe762d18e, 0x5fdeb6eb, 0xc2098e52, 0x7ab5e937, 0x680046d9, 0xd0bc21bc,
+      0x88df31ea, 0x3063568f, 0x22d6f961, 0x9a6a9e04, 0x07bda6bd, 0xbf01c1d8, 0xadb46e36, 0x15080953,
+      0x1d724e9a, 0xa5ce29ff, 0xb77b8611, 0x0fc7e174, 0x9210d9cd, 0x2aacbea8, 0x38191146, 0x80a57623,
+      0xd8c66675, 0x607a0110, 0x72cfaefe, 0xca73c99b, 0x57a4f122, 0xef189647, 0xfdad39a9, 0x45115ecc,
+      0x764dee06, 0xcef18963, 0xdc44268d, 0x64f841e8, 0xf92f7951, 0x41931e34, 0x5326b1da, 0xeb9ad6bf,
+      0xb3f9c6e9, 0x0b45a18c, 0x19f00e62, 0xa14c6907, 0x3c9b51be, 0x842736db, 0x96929935, 0x2e2efe50,
+      0x2654b999, 0x9ee8defc, 0x8c5d7112, 0x34e11677, 0xa9362ece, 0x118a49ab, 0x033fe645, 0xbb838120,
+      0xe3e09176, 0x5b5cf613, 0x49e959fd, 0xf1553e98, 0x6c820621, 0xd43e6144, 0xc68bceaa, 0x7e37a9cf,
+      0xd67f4138, 0x6ec3265d, 0x7c7689b3, 0xc4caeed6, 0x591dd66f, 0xe1a1b10a, 0xf3141ee4, 0x4ba87981,
+      0x13cb69d7, 0xab770eb2, 0xb9c2a15c, 0x017ec639, 0x9ca9fe80, 0x241599e5, 0x36a0360b, 0x8e1c516e,
+      0x866616a7, 0x3eda71c2, 0x2c6fde2c, 0x94d3b949, 0x090481f0, 0xb1b8e695, 0xa30d497b, 0x1bb12e1e,
+      0x43d23e48, 0xfb6e592d, 0xe9dbf6c3, 0x516791a6, 0xccb0a91f, 0x740cce7a, 0x66b96194, 0xde0506f1,
+   },
+   {
+      0x00000000, 0x3d6029b0, 0x7ac05360, 0x47a07ad0, 0xf580a6c0, 0xc8e08f70, 0x8f40f5a0, 0xb220dc10,
+      0x30704bc1, 0x0d106271, 0x4ab018a1, 0x77d03111, 0xc5f0ed01, 0xf890c4b1, 0xbf30be61, 0x825097d1,
+      0x60e09782, 0x5d80be32, 0x1a20c4e2, 0x2740ed52, 0x95603142, 0xa80018f2, 0xefa06222, 0xd2c04b92,
+      0x5090dc43, 0x6df0f5f3, 0x2a508f23, 0x1730a693, 0xa5107a83, 0x98705333, 0xdfd029e3, 0xe2b00053,
+      0xc1c12f04, 0xfca106b4, 0xbb017c64, 0x866155d4, 0x344189c4, 0x0921a074, 0x4e81daa4, 0x73e1f314,
+      0xf1b164c5, 0xccd14d75, 0x8b7137a5, 0xb6111e15, 0x0431c205, 0x3951ebb5, 0x7ef19165, 0x4391b8d5,
+      0xa121b886, 0x9c419136, 0xdbe1ebe6, 0xe681c256, 0x54a11e46, 0x69c137f6, 0x2e614d26, 0x13016496,
+      0x9151f347, 0xac31daf7, 0xeb91a027, 0xd6f18997, 0x64d15587, 0x59b17c37, 0x1e1106e7, 0x23712f57,
+      0x58f35849, 0x659371f9, 0x22330b29, 0x1f532299, 0xad73fe89, 0x9013d739, 0xd7b3ade9, 0xead38459,
+      0x68831388, 0x55e33a38, 0x124340e8, 0x2f236958, 0x9d03b548, 0xa0639cf8, 0xe7c3e628, 0xdaa3cf98,
+      0x3813cfcb, 0x0573e67b, 0x42d39cab, 0x7fb3b51b, 0xcd93690b, 0xf0f340bb, 0xb7533a6b, 0x8a3313db,
+      0x0863840a, 0x3503adba, 0x72a3d76a, 0x4fc3feda, 0xfde322ca, 0xc0830b7a, 0x872371aa, 0xba43581a,
+      0x9932774d, 0xa4525efd, 0xe3f2242d, 0xde920d9d, 0x6cb2d18d, 0x51d2f83d, 0x167282ed, 0x2b12ab5d,
+      0xa9423c8c, 0x9422153c, 0xd3826fec, 0xeee2465c, 0x5cc29a4c, 0x61a2b3fc, 0x2602c92c, 0x1b62e09c,
+      0xf9d2e0cf, 0xc4b2c97f, 0x8312b3af, 0xbe729a1f, 0x0c52460f, 0x31326fbf, 0x7692156f, 0x4bf23cdf,
+      0xc9a2ab0e, 0xf4c282be, 0xb362f86e, 0x8e02d1de, 0x3c220dce, 0x0142247e, 0x46e25eae, 0x7b82771e,
+      0xb1e6b092, 0x8c869922, 0xcb26e3f2, 0xf646ca42, 0x44661652, 0x79063fe2, 0x3ea64532, 0x03c66c82,
+      0x8196fb53, 0xbcf6d2e3, 0xfb56a833, 0xc6368183, 0x74165d93, 0x49767423, 0x0ed60ef3, 0x33b62743,
+      0xd1062710, 0xec660ea0, 0xabc67470, 0x96a65dc0, 0x248681d0, 0x19e6a860, 0x5e46d2b0, 0x6326fb00,
+      0xe1766cd1, 0xdc164561, 0x9bb63fb1, 0xa6d61601, 0x14f6ca11, 0x2996e3a1, 0x6e369971, 0x5356b0c1,
+      0x70279f96, 0x4d47b626, 0x0ae7ccf6, 0x3787e546, 0x85a73956, 0xb8c710e6, 0xff676a36, 0xc2074386,
+      0x4057d457, 0x7d37fde7, 0x3a978737, 0x07f7ae87, 0xb5d77297, 0x88b75b27, 0xcf1721f7, 0xf2770847,
+      0x10c70814, 0x2da721a4, 0x6a075b74, 0x576772c4, 0xe547aed4, 0xd8278764, 0x9f87fdb4, 0xa2e7d404,
+      0x20b743d5, 0x1dd76a65, 0x5a7710b5, 0x67173905, 0xd537e515, 0xe857cca5, 0xaff7b675, 0x92979fc5,
+      0xe915e8db, 0xd475c16b, 0x93d5bbbb, 0xaeb5920b, 0x1c954e1b, 0x21f567ab, 0x66551d7b, 0x5b3534cb,
+      0xd965a31a, 0xe4058aaa, 0xa3a5f07a, 0x9ec5d9ca, 0x2ce505da, 0x11852c6a, 0x562556ba, 0x6b457f0a,
+      0x89f57f59, 0xb49556e9, 0xf3352c39, 0xce550589, 0x7c75d999, 0x4115f029, 0x06b58af9, 0x3bd5a349,
+      0xb9853498, 0x84e51d28, 0xc34567f8, 0xfe254e48, 0x4c059258, 0x7165bbe8, 0x36c5c138, 0x0ba5e888,
+      0x28d4c7df, 0x15b4ee6f, 0x521494bf, 0x6f74bd0f, 0xdd54611f, 0xe03448af, 0xa794327f, 0x9af41bcf,
+      0x18a48c1e, 0x25c4a5ae, 0x6264df7e, 0x5f04f6ce, 0xed242ade, 0xd044036e, 0x97e479be, 0xaa84500e,
+      0x4834505d, 0x755479ed, 0x32f4033d, 0x0f942a8d, 0xbdb4f69d, 0x80d4df2d, 0xc774a5fd, 0xfa148c4d,
+      0x78441b9c, 0x4524322c, 0x028448fc, 0x3fe4614c, 0x8dc4bd5c, 0xb0a494ec, 0xf704ee3c, 0xca64c78c,
+   },
+   {
+      0x00000000, 0xcb5cd3a5, 0x4dc8a10b, 0x869472ae, 0x9b914216, 0x50cd91b3, 0xd659e31d, 0x1d0530b8,
+      0xec53826d, 0x270f51c8, 0xa19b2366, 0x6ac7f0c3, 0x77c2c07b, 0xbc9e13de, 0x3a0a6170, 0xf156b2d5,
+      0x03d6029b, 0xc88ad13e, 0x4e1ea390, 0x85427035, 0x9847408d, 0x531b9328, 0xd58fe186, 0x1ed33223,
+      0xef8580f6, 0x24d95353, 0xa24d21fd, 0x6911f258, 0x7414c2e0, 0xbf481145, 0x39dc63eb, 0xf280b04e,
+      0x07ac0536, 0xccf0d693, 0x4a64a43d, 0x81387798, 0x9c3d4720, 0x57619485, 0xd1f5e62b, 0x1aa9358e,
+      0xebff875b, 0x20a354fe, 0xa6372650, 0x6d6bf5f5, 0x706ec54d, 0xbb3216e8, 0x3da66446, 0xf6fab7e3,
+      0x047a07ad, 0xcf26d408, 0x49b2a6a6, 0x82ee7503, 0x9feb45bb, 0x54b7961e, 0xd223e4b0, 0x197f3715,
+      0xe82985c0, 0x23755665, 0xa5e124cb, 0x6ebdf76e, 0x73b8c7d6, 0xb8e41473, 0x3e7066dd, 0xf52cb578,
+      0x0f580a6c, 0xc404d9c9, 0x4290ab67, 0x89cc78c2, 0x94c9487a, 0x5f959bdf, 0xd901e971, 0x125d3ad4,
+      0xe30b8801, 0x28575ba4, 0xaec3290a, 0x659ffaaf, 0x789aca17, 0xb3c619b2, 0x35526b1c, 0xfe0eb8b9,
+      0x0c8e08f7, 0xc7d2db52, 0x4146a9fc, 0x8a1a7a59, 0x971f4ae1, 0x5c439944, 0xdad7ebea, 0x118b384f,
+      0xe0dd8a9a, 0x2b81593f, 0xad152b91, 0x6649f834, 0x7b4cc88c, 0xb0101b29, 0x36846987, 0xfdd8ba22,
+      0x08f40f5a, 0xc3a8dcff, 0x453cae51, 0x8e607df4, 0x93654d4c, 0x58399ee9, 0xdeadec47, 0x15f13fe2,
+      0xe4a78d37, 0x2ffb5e92, 0xa96f2c3c, 0x6233ff99, 0x7f36cf21, 0xb46a1c84, 0x32fe6e2a, 0xf9a2bd8f,
+      0x0b220dc1, 0xc07ede64, 0x46eaacca, 0x8db67f6f, 0x90b34fd7, 0x5bef9c72, 0xdd7beedc, 0x16273d79,
+      0xe7718fac, 0x2c2d5c09, 0xaab92ea7, 0x61e5fd02, 0x7ce0cdba, 0xb7bc1e1f, 0x31286cb1, 0xfa74bf14,
+      0x1eb014d8, 0xd5ecc77d, 0x5378b5d3, 0x98246676, 0x852156ce, 0x4e7d856b, 0xc8e9f7c5, 0x03b52460,
+      0xf2e396b5, 0x39bf4510, 0xbf2b37be, 0x7477e41b, 0x6972d4a3, 0xa22e0706, 0x24ba75a8, 0xefe6a60d,
+      0x1d661643, 0xd63ac5e6, 0x50aeb748, 0x9bf264ed, 0x86f75455, 0x4dab87f0, 0xcb3ff55e, 0x006326fb,
+      0xf135942e, 0x3a69478b, 0xbcfd3525, 0x77a1e680, 0x6aa4d638, 0xa1f8059d, 0x276c7733, 0xec30a496,
+      0x191c11ee, 0xd240c24b, 0x54d4b0e5, 0x9f886340, 0x828d53f8, 0x49d1805d, 0xcf45f2f3, 0x04192156,
+      0xf54f9383, 0x3e134026, 0xb8873288, 0x73dbe12d, 0x6eded195, 0xa5820230, 0x2316709e, 0xe84aa33b,
+      0x1aca1375, 0xd196c0d0, 0x5702b27e, 0x9c5e61db, 0x815b5163, 0x4a0782c6, 0xcc93f068, 0x07cf23cd,
+      0xf6999118, 0x3dc542bd, 0xbb513013, 0x700de3b6, 0x6d08d30e, 0xa65400ab, 0x20c07205, 0xeb9ca1a0,
+      0x11e81eb4, 0xdab4cd11, 0x5c20bfbf, 0x977c6c1a, 0x8a795ca2, 0x41258f07, 0xc7b1fda9, 0x0ced2e0c,
+      0xfdbb9cd9, 0x36e74f7c, 0xb0733dd2, 0x7b2fee77, 0x662adecf, 0xad760d6a, 0x2be27fc4, 0xe0beac61,
+      0x123e1c2f, 0xd962cf8a, 0x5ff6bd24, 0x94aa6e81, 0x89af5e39, 0x42f38d9c, 0xc467ff32, 0x0f3b2c97,
+      0xfe6d9e42, 0x35314de7, 0xb3a53f49, 0x78f9ecec, 0x65fcdc54, 0xaea00ff1, 0x28347d5f, 0xe368aefa,
+      0x16441b82, 0xdd18c827, 0x5b8cba89, 0x90d0692c, 0x8dd55994, 0x46898a31, 0xc01df89f, 0x0b412b3a,
+      0xfa1799ef, 0x314b4a4a, 0xb7df38e4, 0x7c83eb41, 0x6186dbf9, 0xaada085c, 0x2c4e7af2, 0xe712a957,
+      0x15921919, 0xdececabc, 0x585ab812, 0x93066bb7, 0x8e035b0f, 0x455f88aa, 0xc3cbfa04, 0x089729a1,
+      0xf9c19b74, 0x329d48d1, 0xb4093a7f, 0x7f55e9da, 0x6250d962, 0xa90c0ac7, 0x2f987869, 0xe4c4abcc,
+   },
+   {
+      0x00000000, 0xa6770bb4, 0x979f1129, 0x31e81a9d, 0xf44f2413, 0x52382fa7, 0x63d0353a, 0xc5a73e8e,
+      0x33ef4e67, 0x959845d3, 0xa4705f4e, 0x020754fa, 0xc7a06a74, 0x61d761c0, 0x503f7b5d, 0xf64870e9,
+      0x67de9cce, 0xc1a9977a, 0xf0418de7, 0x56368653, 0x9391b8dd, 0x35e6b369, 0x040ea9f4, 0xa279a240,
+      0x5431d2a9, 0xf246d91d, 0xc3aec380, 0x65d9c834, 0xa07ef6ba, 0x0609fd0e, 0x37e1e793, 0x9196ec27,
+      0xcfbd399c, 0x69ca3228, 0x582228b5, 0xfe552301, 0x3bf21d8f, 0x9d85163b, 0xac6d0ca6, 0x0a1a0712,
+      0xfc5277fb, 0x5a257c4f, 0x6bcd66d2, 0xcdba6d66, 0x081d53e8, 0xae6a585c, 0x9f8242c1, 0x39f54975,
+      0xa863a552, 0x0e14aee6, 0x3ffcb47b, 0x998bbfcf, 0x5c2c8141, 0xfa5b8af5, 0xcbb39068, 0x6dc49bdc,
+      0x9b8ceb35, 0x3dfbe081, 0x0c13fa1c, 0xaa64f1a8, 0x6fc3cf26, 0xc9b4c492, 0xf85cde0f, 0x5e2bd5bb,
+      0x440b7579, 0xe27c7ecd, 0xd3946450, 0x75e36fe4, 0xb044516a, 0x16335ade, 0x27db4043, 0x81ac4bf7,
+      0x77e43b1e, 0xd19330aa, 0xe07b2a37, 0x460c2183, 0x83ab1f0d, 0x25dc14b9, 0x14340e24, 0xb2430590,
+      0x23d5e9b7, 0x85a2e203, 0xb44af89e, 0x123df32a, 0xd79acda4, 0x71edc610, 0x4005dc8d, 0xe672d739,
+      0x103aa7d0, 0xb64dac64, 0x87a5b6f9, 0x21d2bd4d, 0xe47583c3, 0x42028877, 0x73ea92ea, 0xd59d995e,
+      0x8bb64ce5, 0x2dc14751, 0x1c295dcc, 0xba5e5678, 0x7ff968f6, 0xd98e6342, 0xe86679df, 0x4e11726b,
+      0xb8590282, 0x1e2e0936, 0x2fc613ab, 0x89b1181f, 0x4c162691, 0xea612d25, 0xdb8937b8, 0x7dfe3c0c,
+      0xec68d02b, 0x4a1fdb9f, 0x7bf7c102, 0xdd80cab6, 0x1827f438, 0xbe50ff8c, 0x8fb8e511, 0x29cfeea5,
+      0xdf879e4c, 0x79f095f8, 0x48188f65, 0xee6f84d1, 0x2bc8ba5f, 0x8dbfb1eb, 0xbc57ab76, 0x1a20a0c2,
+      0x8816eaf2, 0x2e61e146, 0x1f89fbdb, 0xb9fef06f, 0x7c59cee1, 0xda2ec555, 0xebc6dfc8, 0x4db1d47c,
+      0xbbf9a495, 0x1d8eaf21, 0x2c66b5bc, 0x8a11be08, 0x4fb68086, 0xe9c18b32, 0xd82991af, 0x7e5e9a1b,
+      0xefc8763c, 0x49bf7d88, 0x78576715, 0xde206ca1, 0x1b87522f, 0xbdf0599b, 0x8c184306, 0x2a6f48b2,
+      0xdc27385b, 0x7a5033ef, 0x4bb82972, 0xedcf22c6, 0x28681c48, 0x8e1f17fc, 0xbff70d61, 0x198006d5,
+      0x47abd36e, 0xe1dcd8da, 0xd034c247, 0x7643c9f3, 0xb3e4f77d, 0x1593fcc9, 0x247be654, 0x820cede0,
+      0x74449d09, 0xd23396bd, 0xe3db8c20, 0x45ac8794, 0x800bb91a, 0x267cb2ae, 0x1794a833, 0xb1e3a387,
+      0x20754fa0, 0x86024414, 0xb7ea5e89, 0x119d553d, 0xd43a6bb3, 0x724d6007, 0x43a57a9a, 0xe5d2712e,
+      0x139a01c7, 0xb5ed0a73, 0x840510ee, 0x22721b5a, 0xe7d525d4, 0x41a22e60, 0x704a34fd, 0xd63d3f49,
+      0xcc1d9f8b, 0x6a6a943f, 0x5b828ea2, 0xfdf58516, 0x3852bb98, 0x9e25b02c, 0xafcdaab1, 0x09baa105,
+      0xfff2d1ec, 0x5985da58, 0x686dc0c5, 0xce1acb71, 0x0bbdf5ff, 0xadcafe4b, 0x9c22e4d6, 0x3a55ef62,
+      0xabc30345, 0x0db408f1, 0x3c5c126c, 0x9a2b19d8, 0x5f8c2756, 0xf9fb2ce2, 0xc813367f, 0x6e643dcb,
+      0x982c4d22, 0x3e5b4696, 0x0fb35c0b, 0xa9c457bf, 0x6c636931, 0xca146285, 0xfbfc7818, 0x5d8b73ac,
+      0x03a0a617, 0xa5d7ada3, 0x943fb73e, 0x3248bc8a, 0xf7ef8204, 0x519889b0, 0x6070932d, 0xc6079899,
+      0x304fe870, 0x9638e3c4, 0xa7d0f959, 0x01a7f2ed, 0xc400cc63, 0x6277c7d7, 0x539fdd4a, 0xf5e8d6fe,
+      0x647e3ad9, 0xc209316d, 0xf3e12bf0, 0x55962044, 0x90311eca, 0x3646157e, 0x07ae0fe3, 0xa1d90457,
+      0x579174be, 0xf1e67f0a, 0xc00e6597, 0x66796e23, 0xa3de50ad, 0x05a95b19, 0x34414184, 0x92364a30,
+   },
+   {
+      0x00000000, 0xccaa009e, 0x4225077d, 0x8e8f07e3, 0x844a0efa, 0x48e00e64, 0xc66f0987, 0x0ac50919,
+      0xd3e51bb5, 0x1f4f1b2b, 0x91c01cc8, 0x5d6a1c56, 0x57af154f, 0x9b0515d1, 0x158a1232, 0xd92012ac,
+      0x7cbb312b, 0xb01131b5, 0x3e9e3656, 0xf23436c8, 0xf8f13fd1, 0x345b3f4f, 0xbad438ac, 0x767e3832,
+      0xaf5e2a9e, 0x63f42a00, 0xed7b2de3, 0x21d12d7d, 0x2b142464, 0xe7be24fa, 0x69312319, 0xa59b2387,
+      0xf9766256, 0x35dc62c8, 0xbb53652b, 0x77f965b5, 0x7d3c6cac, 0xb1966c32, 0x3f196bd1, 0xf3b36b4f,
+      0x2a9379e3, 0xe639797d, 0x68b67e9e, 0xa41c7e00, 0xaed97719, 0x62737787, 0xecfc7064, 0x205670fa,
+      0x85cd537d, 0x496753e3, 0xc7e85400, 0x0b42549e, 0x01875d87, 0xcd2d5d19, 0x43a25afa, 0x8f085a64,
+      0x562848c8, 0x9a824856, 0x140d4fb5, 0xd8a74f2b, 0xd2624632, 0x1ec846ac, 0x9047414f, 0x5ced41d1,
+      0x299dc2ed, 0xe537c273, 0x6bb8c590, 0xa712c50e, 0xadd7cc17, 0x617dcc89, 0xeff2cb6a, 0x2358cbf4,
+      0xfa78d958, 0x36d2d9c6, 0xb85dde25, 0x74f7debb, 0x7e32d7a2, 0xb298d73c, 0x3c17d0df, 0xf0bdd041,
+      0x5526f3c6, 0x998cf358, 0x1703f4bb, 0xdba9f425, 0xd16cfd3c, 0x1dc6fda2, 0x9349fa41, 0x5fe3fadf,
+      0x86c3e873, 0x4a69e8ed, 0xc4e6ef0e, 0x084cef90, 0x0289e689, 0xce23e617, 0x40ace1f4, 0x8c06e16a,
+      0xd0eba0bb, 0x1c41a025, 0x92cea7c6, 0x5e64a758, 0x54a1ae41, 0x980baedf, 0x1684a93c, 0xda2ea9a2,
+      0x030ebb0e, 0xcfa4bb90, 0x412bbc73, 0x8d81bced, 0x8744b5f4, 0x4beeb56a, 0xc561b289, 0x09cbb217,
+      0xac509190, 0x60fa910e, 0xee7596ed, 0x22df9673, 0x281a9f6a, 0xe4b09ff4, 0x6a3f9817, 0xa6959889,
+      0x7fb58a25, 0xb31f8abb, 0x3d908d58, 0xf13a8dc6, 0xfbff84df, 0x37558441, 0xb9da83a2, 0x7570833c,
+      0x533b85da, 0x9f918544, 0x111e82a7, 0xddb48239, 0xd7718b20, 0x1bdb8bbe, 0x95548c5d, 0x59fe8cc3,
+      0x80de9e6f, 0x4c749ef1, 0xc2fb9912, 0x0e51998c, 0x04949095, 0xc83e900b, 0x46b197e8, 0x8a1b9776,
+      0x2f80b4f1, 0xe32ab46f, 0x6da5b38c, 0xa10fb312, 0xabcaba0b, 0x6760ba95, 0xe9efbd76, 0x2545bde8,
+      0xfc65af44, 0x30cfafda, 0xbe40a839, 0x72eaa8a7, 0x782fa1be, 0xb485a120, 0x3a0aa6c3, 0xf6a0a65d,
+      0xaa4de78c, 0x66e7e712, 0xe868e0f1, 0x24c2e06f, 0x2e07e976, 0xe2ade9e8, 0x6c22ee0b, 0xa088ee95,
+      0x79a8fc39, 0xb502fca7, 0x3b8dfb44, 0xf727fbda, 0xfde2f2c3, 0x3148f25d, 0xbfc7f5be, 0x736df520,
+      0xd6f6d6a7, 0x1a5cd639, 0x94d3d1da, 0x5879d144, 0x52bcd85d, 0x9e16d8c3, 0x1099df20, 0xdc33dfbe,
+      0x0513cd12, 0xc9b9cd8c, 0x4736ca6f, 0x8b9ccaf1, 0x8159c3e8, 0x4df3c376, 0xc37cc495, 0x0fd6c40b,
+      0x7aa64737, 0xb60c47a9, 0x3883404a, 0xf42940d4, 0xfeec49cd, 0x32464953, 0xbcc94eb0, 0x70634e2e,
+      0xa9435c82, 0x65e95c1c, 0xeb665bff, 0x27cc5b61, 0x2d095278, 0xe1a352e6, 0x6f2c5505, 0xa386559b,
+      0x061d761c, 0xcab77682, 0x44387161, 0x889271ff, 0x825778e6, 0x4efd7878, 0xc0727f9b, 0x0cd87f05,
+      0xd5f86da9, 0x19526d37, 0x97dd6ad4, 0x5b776a4a, 0x51b26353, 0x9d1863cd, 0x1397642e, 0xdf3d64b0,
+      0x83d02561, 0x4f7a25ff, 0xc1f5221c, 0x0d5f2282, 0x079a2b9b, 0xcb302b05, 0x45bf2ce6, 0x89152c78,
+      0x50353ed4, 0x9c9f3e4a, 0x121039a9, 0xdeba3937, 0xd47f302e, 0x18d530b0, 0x965a3753, 0x5af037cd,
+      0xff6b144a, 0x33c114d4, 0xbd4e1337, 0x71e413a9, 0x7b211ab0, 0xb78b1a2e, 0x39041dcd, 0xf5ae1d53,
+      0x2c8e0fff, 0xe0240f61, 0x6eab0882, 0xa201081c, 0xa8c40105, 0x646e019b, 0xeae10678, 0x264b06e6,
+   },
+};
+
+#ifdef STB__X86_SIMD
+// fold 64 bytes at a time with carry-less multiplies, then reduce to 32 bits
+// (Intel, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ").
+// len must be a multiple of 16, and at least 64; crc is not inverted
+STB__TARGET("pclmul")
+static stb_uint stb__crc32_pclmul(stb_uint crc, stb_uchar *buffer, stb_uint len)
+{
+   __m128i x1, x2, x3, x4, x5, x6, x7, x8, mask32;
+   __m128i k1k2 = _mm_set_epi32(0x00000001, 0xc6e41596, 0x00000001, 0x54442bd4);
+   __m128i k3k4 = _mm_set_epi32(0x00000000, 0xccaa009e, 0x00000001, 0x751997d0);
+   __m128i k5   = _mm_set_epi32(0x00000000, 0x00000000, 0x00000001, 0x63cd6124);
+   __m128i poly = _mm_set_epi32(0x00000001, 0xf7011641, 0x00000001, 0xdb710641);
+
+   x1 = _mm_loadu_si128((__m128i *) (buffer +  0));
+   x2 = _mm_loadu_si128((__m128i *) (buffer + 16));
+   x3 = _mm_loadu_si128((__m128i *) (buffer + 32));
+   x4 = _mm_loadu_si128((__m128i *) (buffer + 48));
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+   buffer += 64;
+   len    -= 64;
+
+   // four independent 128-bit folds, 64 bytes apart
+   while (len >= 64) {
+      x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((__m128i *) (buffer +  0)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((__m128i *) (buffer + 16)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((__m128i *) (buffer + 32)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((__m128i *) (buffer + 48)));
+      buffer += 64;
+      len    -= 64;
+   }
+
+   // fold the four into one, then fold in any remaining 16-byte blocks
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+   while (len >= 16) {
+      x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((__m128i *) buffer)), x5);
+      buffer += 16;
+      len    -= 16;
+   }
+
+   // 128 bits to 64
+   mask32 = _mm_set_epi32(0, -1, 0, -1);
+   x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+   x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_and_si128(x1, mask32);
+   x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   // Barrett reduction to 32
+   x2 = _mm_and_si128(x1, mask32);
+   x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+   x2 = _mm_and_si128(x2, mask32);
+   x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+   return (stb_uint) _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif
+
 stb_uint stb_crc32_block(stb_uint crc, unsigned char *buffer, stb_uint len)
 {
-   static stb_uint crc_table[256];
-   stb_uint i,j,s;
+   const stb_uint (*t)[256] = stb__crc32_table;
    crc = ~crc;
 
-   if (crc_table[1] == 0)
-      for(i=0; i < 256; i++) {
-         for (s=i, j=0; j < 8; ++j)
-            s = (s >> 1) ^ (s & 1 ? 0xedb88320 : 0);
-         crc_table[i] = s;
-      }
-   for (i=0; i < len; ++i)
-      crc = (crc >> 8) ^ crc_table[buffer[i] ^ (crc & 0xff)];
+   #ifdef STB__X86_SIMD
+   if (len >= 64 && stb__cpu_has(STB__CPU_PCLMUL)) {
+      stb_uint n = len & ~15;
+      crc = stb__crc32_pclmul(crc, buffer, n);
+      buffer += n;
+      len    -= n;
+   }
+   #endif
+
+   // slicing-by-8
+   while (len >= 8) {
+      stb_uint lo = crc ^ (buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((stb_uint) buffer[3] << 24));
+      stb_uint hi =        buffer[4] | (buffer[5] << 8) | (buffer[6] << 16) | ((stb_uint) buffer[7] << 24);
+      crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+          ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+      buffer += 8;
+      len    -= 8;
+   }
+   while (len--)
+      crc = (crc >> 8) ^ t[0][(crc ^ *buffer++) & 0xff];
    return ~crc;
 }
 
@@ -6112,12 +6579,105 @@ stb_uint stb_crc32(unsigned char *buffer, stb_uint len)
    return stb_crc32_block(0, buffer, len);
 }
 
+// multiply a 32-bit vector by a 32x32 matrix over GF(2)
+static stb_uint stb__gf2_times(stb_uint *mat, stb_uint vec)
+{
+   stb_uint sum = 0;
+   for (; vec; vec >>= 1, ++mat)
+      if (vec & 1)
+         sum ^= *mat;
+   return sum;
+}
+
+static void stb__gf2_square(stb_uint *square, stb_uint *mat)
+{
+   int n;
+   for (n=0; n < 32; ++n)
+      square[n] = stb__gf2_times(mat, mat[n]);
+}
+
+// the same approach as zlib: apply len2 zero bytes to crc1 by repeatedly
+// squaring the operator for one zero bit, then xor in crc2
+stb_uint stb_crc32_combine(stb_uint crc1, stb_uint crc2, stb_uint len2)
+{
+   stb_uint even[32], odd[32], row = 1;
+   int n;
+
+   if (len2 == 0)
+      return crc1;
+
+   odd[0] = 0xedb88320; // operator for one zero bit
+   for (n=1; n < 32; ++n, row <<= 1)
+      odd[n] = row;
+   stb__gf2_square(even, odd); // two zero bits
+   stb__gf2_square(odd, even); // four zero bits
+
+   do {
+      stb__gf2_square(even, odd);
+      if (len2 & 1) crc1 = stb__gf2_times(even, crc1);
+      len2 >>= 1;
+      if (len2 == 0) break;
+      stb__gf2_square(odd, even);
+      if (len2 & 1) crc1 = stb__gf2_times(odd, crc1);
+      len2 >>= 1;
+   } while (len2);
+
+   return crc1 ^ crc2;
+}
+
+#ifdef STB__X86_SIMD
+// 32 bytes per iteration: s1 sums come from psadbw, and s2 from weighting
+// each byte by its distance from the end of the block with pmaddubsw
+STB__TARGET("ssse3")
+static void stb__adler32_ssse3(unsigned long *s1, unsigned long *s2, stb_uchar *buffer, stb_uint blocks)
+{
+   const __m128i tap1 = _mm_setr_epi8(32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17);
+   const __m128i tap2 = _mm_setr_epi8(16,15,14,13,12,11,10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i ones = _mm_set1_epi16(1);
+
+   while (blocks) {
+      stb_uint n = blocks < 5552/32 ? blocks : 5552/32, t[4];
+      __m128i v_ps = _mm_cvtsi32_si128((int) (*s1 * n));
+      __m128i v_s1 = zero;
+      __m128i v_s2 = _mm_cvtsi32_si128((int) *s2);
+      blocks -= n;
+      do {
+         __m128i b1 = _mm_loadu_si128((__m128i *) buffer);
+         __m128i b2 = _mm_loadu_si128((__m128i *) (buffer + 16));
+         v_ps = _mm_add_epi32(v_ps, v_s1);
+         v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b1, zero));
+         v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b1, tap1), ones));
+         v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(b2, zero));
+         v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(b2, tap2), ones));
+         buffer += 32;
+      } while (--n);
+      v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+      _mm_storeu_si128((__m128i *) t, v_s1);
+      *s1 += t[0] + t[1] + t[2] + t[3];
+      _mm_storeu_si128((__m128i *) t, v_s2);
+      *s2  = t[0] + t[1] + t[2] + t[3];
+      *s1 %= 65521;
+      *s2 %= 65521;
+   }
+}
+#endif
+
 stb_uint stb_adler32(stb_uint adler32, stb_uchar *buffer, stb_uint buflen)
 {
    const unsigned long ADLER_MOD = 65521;
    unsigned long s1 = adler32 & 0xffff, s2 = adler32 >> 16;
    unsigned long blocklen, i;
 
+   #ifdef STB__X86_SIMD
+   if (buflen >= 64 && stb__cpu_has(STB__CPU_SSSE3)) {
+      stb__adler32_ssse3(&s1, &s2, buffer, buflen / 32);
+      buffer += buflen & ~31;
+      buflen &= 31;
+   }
+   #endif
+
    blocklen = buflen % 5552;
    while (buflen) {
       for (i=0; i + 7 < blocklen; i += 8) {
@@ -6143,19 +6703,48 @@ stb_uint stb_adler32(stb_uint adler32, stb_uchar *buffer, stb_uint buflen)
    return (s2 << 16) + s1;
 }
 
+// adler32 of A followed by B, from adler32(A), adler32(B), and B's length
+stb_uint stb_adler32_combine(stb_uint adler1, stb_uint adler2, stb_uint len2)
+{
+   const unsigned long ADLER_MOD = 65521;
+   unsigned long rem  = len2 % ADLER_MOD;
+   unsigned long sum1 = adler1 & 0xffff;
+   unsigned long sum2 = (rem * sum1) % ADLER_MOD;
+   sum1 += (adler2 & 0xffff) + ADLER_MOD - 1;
+   sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_MOD - rem;
+   if (sum1 >= ADLER_MOD)   sum1 -= ADLER_MOD;
+   if (sum1 >= ADLER_MOD)   sum1 -= ADLER_MOD;
+   if (sum2 >= ADLER_MOD*2) sum2 -= ADLER_MOD*2;
+   if (sum2 >= ADLER_MOD)   sum2 -= ADLER_MOD;
+   return (stb_uint) (sum1 | (sum2 << 16));
+}
+
+#define stb__rol(x,n)   (((x) << (n)) | ((x) >> (32-(n))))
+
+// one round of SHA-1, with the roles of a..e rotated by the caller instead
+// of shuffling the variables
+#define STB__SHA1_R(a,b,c,d,e,f,k,x) \
+   e += stb__rol(a,5) + (f) + (k) + (x), b = stb__rol(b,30)
+
+#define STB__SHA1_F1(b,c,d)   (d ^ (b & (c ^ d)))
+#define STB__SHA1_F2(b,c,d)   (b ^ c ^ d)
+#define STB__SHA1_F3(b,c,d)   ((b & c) + (d & (b ^ c)))
+
+// the message schedule, kept in a 16-word ring
+#define STB__SHA1_W0(i)   (w[i] = stb_big32(&chunk[(i)*4]))
+#define STB__SHA1_W(i)    (w[(i)&15] = stb__rol(w[((i)-3)&15] ^ w[((i)-8)&15] ^ w[((i)-14)&15] ^ w[(i)&15], 1))
+
+#define STB__SHA1_5(F,k,W,i)                                       \
+   STB__SHA1_R(a,b,c,d,e, F(b,c,d), k, W(i  ));                     \
+   STB__SHA1_R(e,a,b,c,d, F(a,b,c), k, W(i+1));                     \
+   STB__SHA1_R(d,e,a,b,c, F(e,a,b), k, W(i+2));                     \
+   STB__SHA1_R(c,d,e,a,b, F(d,e,a), k, W(i+3));                     \
+   STB__SHA1_R(b,c,d,e,a, F(c,d,e), k, W(i+4))
+
 static void stb__sha1(stb_uchar *chunk, stb_uint h[5])
 {
-   int i;
    stb_uint a,b,c,d,e;
-   stb_uint w[80];
-
-   for (i=0; i < 16; ++i)
-      w[i] = stb_big32(&chunk[i*4]);
-   for (i=16; i < 80; ++i) {
-      stb_uint t;
-      t = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
-      w[i] = (t + t) | (t >> 31);
-   }
+   stb_uint w[16];
 
    a = h[0];
    b = h[1];
@@ -6163,23 +6752,26 @@ static void stb__sha1(stb_uchar *chunk, stb_uint h[5])
    d = h[3];
    e = h[4];
 
-   #define STB__SHA1(k,f)                                            \
-   {                                                                 \
-      stb_uint temp = (a << 5) + (a >> 27) + (f) + e + (k) + w[i];  \
-      e = d;                                                       \
-      d = c;                                                     \
-      c = (b << 30) + (b >> 2);                               \
-      b = a;                                              \
-      a = temp;                                    \
-   }
-
-   i=0;
-   for (; i < 20; ++i) STB__SHA1(0x5a827999, d ^ (b & (c ^ d))       );
-   for (; i < 40; ++i) STB__SHA1(0x6ed9eba1, b ^ c ^ d               );
-   for (; i < 60; ++i) STB__SHA1(0x8f1bbcdc, (b & c) + (d & (b ^ c)) );
-   for (; i < 80; ++i) STB__SHA1(0xca62c1d6, b ^ c ^ d               );
-
-   #undef STB__SHA1
+   STB__SHA1_5(STB__SHA1_F1, 0x5a827999, STB__SHA1_W0,  0);
+   STB__SHA1_5(STB__SHA1_F1, 0x5a827999, STB__SHA1_W0,  5);
+   STB__SHA1_5(STB__SHA1_F1, 0x5a827999, STB__SHA1_W0, 10);
+   STB__SHA1_R(a,b,c,d,e, STB__SHA1_F1(b,c,d), 0x5a827999, STB__SHA1_W0(15));
+   STB__SHA1_R(e,a,b,c,d, STB__SHA1_F1(a,b,c), 0x5a827999, STB__SHA1_W (16));
+   STB__SHA1_R(d,e,a,b,c, STB__SHA1_F1(e,a,b), 0x5a827999, STB__SHA1_W (17));
+   STB__SHA1_R(c,d,e,a,b, STB__SHA1_F1(d,e,a), 0x5a827999, STB__SHA1_W (18));
+   STB__SHA1_R(b,c,d,e,a, STB__SHA1_F1(c,d,e), 0x5a827999, STB__SHA1_W (19));
+   STB__SHA1_5(STB__SHA1_F2, 0x6ed9eba1, STB__SHA1_W,  20);
+   STB__SHA1_5(STB__SHA1_F2, 0x6ed9eba1, STB__SHA1_W,  25);
+   STB__SHA1_5(STB__SHA1_F2, 0x6ed9eba1, STB__SHA1_W,  30);
+   STB__SHA1_5(STB__SHA1_F2, 0x6ed9eba1, STB__SHA1_W,  35);
+   STB__SHA1_5(STB__SHA1_F3, 0x8f1bbcdc, STB__SHA1_W,  40);
+   STB__SHA1_5(STB__SHA1_F3, 0x8f1bbcdc, STB__SHA1_W,  45);
+   STB__SHA1_5(STB__SHA1_F3, 0x8f1bbcdc, STB__SHA1_W,  50);
+   STB__SHA1_5(STB__SHA1_F3, 0x8f1bbcdc, STB__SHA1_W,  55);
+   STB__SHA1_5(STB__SHA1_F2, 0xca62c1d6, STB__SHA1_W,  60);
+   STB__SHA1_5(STB__SHA1_F2, 0xca62c1d6, STB__SHA1_W,  65);
+   STB__SHA1_5(STB__SHA1_F2, 0xca62c1d6, STB__SHA1_W,  70);
+   STB__SHA1_5(STB__SHA1_F2, 0xca62c1d6, STB__SHA1_W,  75);
 
    h[0] += a;
    h[1] += b;
@@ -6188,139 +6780,310 @@ static void stb__sha1(stb_uchar *chunk, stb_uint h[5])
    h[4] += e;
 }
 
-void stb_sha1(stb_uchar output[20], stb_uchar *buffer, stb_uint len)
-{
-   unsigned char final_block[128];
-   stb_uint end_start, final_len, j;
-   int i;
-
-   stb_uint h[5];
-
-   h[0] = 0x67452301;
-   h[1] = 0xefcdab89;
-   h[2] = 0x98badcfe;
-   h[3] = 0x10325476;
-   h[4] = 0xc3d2e1f0;
-
-   // we need to write padding to the last one or two
-   // blocks, so build those first into 'final_block'
+#ifdef STB__X86_SIMD
+// the SHA extensions do four rounds per instruction; this is the standard
+// arrangement from Intel's documentation, with rounds 16-79 in a macro
+#define STB__SHA1NI_4(E0,E1,M0,M1,M2,M3,k)                  \
+   E0   = _mm_sha1nexte_epu32(E0, M0);                       \
+   E1   = abcd;                                              \
+   M1   = _mm_sha1msg2_epu32(M1, M0);                        \
+   abcd = _mm_sha1rnds4_epu32(abcd, E0, k);                  \
+   M3   = _mm_sha1msg1_epu32(M3, M0);                        \
+   M2   = _mm_xor_si128(M2, M0)
+
+STB__TARGET("sha,ssse3,sse4.1")
+static void stb__sha1_ni(stb_uint h[5], stb_uchar *data, size_t blocks)
+{
+   const __m128i bswap = _mm_set_epi8(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15);
+   __m128i abcd, e0, e1, abcd_save, e_save, m0, m1, m2, m3;
+
+   abcd = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *) h), 0x1b);
+   e0   = _mm_set_epi32((int) h[4], 0, 0, 0);
+
+   for (; blocks; --blocks, data += 64) {
+      abcd_save = abcd;
+      e_save    = e0;
+
+      // rounds 0-15 load the message
+      m0   = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (data +  0)), bswap);
+      e0   = _mm_add_epi32(e0, m0);
+      e1   = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+      m1   = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (data + 16)), bswap);
+      e1   = _mm_sha1nexte_epu32(e1, m1);
+      e0   = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+      m0   = _mm_sha1msg1_epu32(m0, m1);
+
+      m2   = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (data + 32)), bswap);
+      e0   = _mm_sha1nexte_epu32(e0, m2);
+      e1   = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+      m1   = _mm_sha1msg1_epu32(m1, m2);
+      m0   = _mm_xor_si128(m0, m2);
+
+      m3   = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (data + 48)), bswap);
+      e1   = _mm_sha1nexte_epu32(e1, m3);
+      e0   = abcd;
+      m0   = _mm_sha1msg2_epu32(m0, m3);
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+      m2   = _mm_sha1msg1_epu32(m2, m3);
+      m1   = _mm_xor_si128(m1, m3);
+
+      STB__SHA1NI_4(e0,e1, m0,m1,m2,m3, 0); // 16-19
+      STB__SHA1NI_4(e1,e0, m1,m2,m3,m0, 1); // 20-23
+      STB__SHA1NI_4(e0,e1, m2,m3,m0,m1, 1);
+      STB__SHA1NI_4(e1,e0, m3,m0,m1,m2, 1);
+      STB__SHA1NI_4(e0,e1, m0,m1,m2,m3, 1);
+      STB__SHA1NI_4(e1,e0, m1,m2,m3,m0, 1);
+      STB__SHA1NI_4(e0,e1, m2,m3,m0,m1, 2); // 40-43
+      STB__SHA1NI_4(e1,e0, m3,m0,m1,m2, 2);
+      STB__SHA1NI_4(e0,e1, m0,m1,m2,m3, 2);
+      STB__SHA1NI_4(e1,e0, m1,m2,m3,m0, 2);
+      STB__SHA1NI_4(e0,e1, m2,m3,m0,m1, 2);
+      STB__SHA1NI_4(e1,e0, m3,m0,m1,m2, 3); // 60-63
+      STB__SHA1NI_4(e0,e1, m0,m1,m2,m3, 3);
+      STB__SHA1NI_4(e1,e0, m1,m2,m3,m0, 3);
+      STB__SHA1NI_4(e0,e1, m2,m3,m0,m1, 3); // 72-75, the last to need m's
+      e1   = _mm_sha1nexte_epu32(e1, m3);    // 76-79
+      e0   = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+      e0   = _mm_sha1nexte_epu32(e0, e_save);
+      abcd = _mm_add_epi32(abcd, abcd_save);
+   }
+
+   _mm_storeu_si128((__m128i *) h, _mm_shuffle_epi32(abcd, 0x1b));
+   h[4] = (stb_uint) _mm_extract_epi32(e0, 3);
+}
+#endif
 
-   // we have to write one special byte, plus the 8-byte length
+static void stb__sha1_blocks(stb_uint h[5], stb_uchar *data, size_t blocks)
+{
+   #ifdef STB__X86_SIMD
+   if (stb__cpu_has(STB__CPU_SHA)) {
+      stb__sha1_ni(h, data, blocks);
+      return;
+   }
+   #endif
+   for (; blocks; --blocks, data += 64)
+      stb__sha1(data, h);
+}
 
-   // compute the block where the data runs out
-   end_start = len & ~63;
+void stb_sha1_init(stb_sha1_context *c)
+{
+   c->h[0] = 0x67452301;
+   c->h[1] = 0xefcdab89;
+   c->h[2] = 0x98badcfe;
+   c->h[3] = 0x10325476;
+   c->h[4] = 0xc3d2e1f0;
+   c->length = 0;
+}
 
-   // compute the earliest we can encode the length
-   if (((len+9) & ~63) == end_start) {
-      // it all fits in one block, so fill a second-to-last block
-      end_start -= 64;
+// top up a partial block; returns the bytes of data used
+static size_t stb__sha1_fill(stb_sha1_context *c, stb_uchar *data, size_t len)
+{
+   size_t have = (size_t) (c->length & 63), n = 0;
+   if (have) {
+      n = 64 - have < len ? 64 - have : len;
+      memcpy(c->buffer + have, data, n);
+      c->length += n;
+      if (have + n == 64)
+         stb__sha1_blocks(c->h, c->buffer, 1);
    }
+   return n;
+}
 
-   final_len = end_start + 128;
-
-   // now we need to copy the data in
-   assert(end_start + 128 >= len+9);
-   assert(end_start < len || len < 64-9);
+// after the whole blocks are done, keep the tail
+static void stb__sha1_tail(stb_sha1_context *c, stb_uchar *data, size_t len)
+{
+   memcpy(c->buffer, data, len);
+   c->length += len;
+}
 
-   j = 0;
-   if (end_start > len)
-      j = (stb_uint) - (int) end_start;
+void stb_sha1_update(stb_sha1_context *c, void *data, size_t len)
+{
+   stb_uchar *p = (stb_uchar *) data;
+   size_t n = stb__sha1_fill(c, p, len);
+   p   += n;
+   len -= n;
+   if (len >= 64) {
+      stb__sha1_blocks(c->h, p, len >> 6);
+      c->length += len & ~(size_t) 63;
+      p   += len & ~(size_t) 63;
+      len &= 63;
+   }
+   stb__sha1_tail(c, p, len);
+}
 
-   for (; end_start + j < len; ++j)
-      final_block[j] = buffer[end_start + j];
-   final_block[j++] = 0x80;
-   while (j < 128-5) // 5 byte length, so write 4 extra padding bytes
-      final_block[j++] = 0;
-   // big-endian size
-   final_block[j++] = len >> 29;
-   final_block[j++] = len >> 21;
-   final_block[j++] = len >> 13;
-   final_block[j++] = len >>  5;
-   final_block[j++] = len <<  3;
-   assert(j == 128 && end_start + j == final_len);
+void stb_sha1_final(stb_sha1_context *c, stb_uchar output[20])
+{
+   stb_uchar pad[72];
+   stb_uint64 bits = c->length << 3;
+   size_t n = 64 - (size_t) ((c->length + 8) & 63); // 1..64 bytes of 0x80, 0...
+   int i;
 
-   for (j=0; j < final_len; j += 64) { // 512-bit chunks
-      if (j+64 >= end_start+64)
-         stb__sha1(&final_block[j - end_start], h);
-      else
-         stb__sha1(&buffer[j], h);
-   }
+   memset(pad, 0, sizeof(pad));
+   pad[0] = 0x80;
+   for (i=0; i < 8; ++i)
+      pad[n+i] = (stb_uchar) (bits >> (56 - i*8));
+   stb_sha1_update(c, pad, n+8);
+   assert((c->length & 63) == 0);
 
    for (i=0; i < 5; ++i) {
-      output[i*4 + 0] = h[i] >> 24;
-      output[i*4 + 1] = h[i] >> 16;
-      output[i*4 + 2] = h[i] >>  8;
-      output[i*4 + 3] = h[i] >>  0;
+      output[i*4 + 0] = c->h[i] >> 24;
+      output[i*4 + 1] = c->h[i] >> 16;
+      output[i*4 + 2] = c->h[i] >>  8;
+      output[i*4 + 3] = c->h[i] >>  0;
    }
 }
 
-#ifdef _MSC_VER
-int stb_sha1_file(stb_uchar output[20], char *file)
+void stb_sha1(stb_uchar output[20], stb_uchar *buffer, stb_uint len)
 {
-   int i;
-   stb_uint64 length=0;
-   unsigned char buffer[128];
+   stb_sha1_context c;
+   stb_sha1_init(&c);
+   stb_sha1_update(&c, buffer, len);
+   stb_sha1_final(&c, output);
+}
 
+int stb_sha1_file(stb_uchar output[20], char *file)
+{
+   stb_uchar buffer[16384];
+   stb_sha1_context c;
+   size_t n;
    FILE *f = stb__fopen(file, "rb");
-   stb_uint h[5];
-
    if (f == NULL) return 0; // file not found
 
-   h[0] = 0x67452301;
-   h[1] = 0xefcdab89;
-   h[2] = 0x98badcfe;
-   h[3] = 0x10325476;
-   h[4] = 0xc3d2e1f0;
+   stb_sha1_init(&c);
+   while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+      stb_sha1_update(&c, buffer, n);
+   fclose(f);
+   stb_sha1_final(&c, output);
+   return 1;
+}
 
-   for(;;) {
-      int n = fread(buffer, 1, 64, f);
-      if (n == 64) {
-         stb__sha1(buffer, h);
-         length += n;
-      } else {
-         int block = 64;
-
-         length += n;
-
-         buffer[n++] = 0x80;
-
-         // if there isn't enough room for the length, double the block
-         if (n + 8 > 64) 
-            block = 128;
-
-         // pad to end
-         memset(buffer+n, 0, block-8-n);
-
-         i = block - 8;
-         buffer[i++] = (stb_uchar) (length >> 53);
-         buffer[i++] = (stb_uchar) (length >> 45);
-         buffer[i++] = (stb_uchar) (length >> 37);
-         buffer[i++] = (stb_uchar) (length >> 29);
-         buffer[i++] = (stb_uchar) (length >> 21);
-         buffer[i++] = (stb_uchar) (length >> 13);
-         buffer[i++] = (stb_uchar) (length >>  5);
-         buffer[i++] = (stb_uchar) (length <<  3);
-         assert(i == block);
-         stb__sha1(buffer, h);
-         if (block == 128)
-            stb__sha1(buffer+64, h);
-         else
-            assert(block == 64);
-         break;
+#ifdef STB__X86_SIMD
+// four independent streams in the four 32-bit lanes of SSE2 registers, each
+// with its own data pointer and block count; lanes that run out of blocks
+// keep running on a dummy block, and their results are masked out
+#define stb__rol4(x,n)  _mm_or_si128(_mm_slli_epi32(x,n), _mm_srli_epi32(x,32-(n)))
+
+#define STB__SHA1X4_R(a,b,c,d,e,f,k,x) \
+   e = _mm_add_epi32(_mm_add_epi32(e, stb__rol4(a,5)), _mm_add_epi32(_mm_add_epi32(f, k), x)), b = stb__rol4(b,30)
+
+#define STB__SHA1X4_F1(b,c,d)  _mm_xor_si128(d, _mm_and_si128(b, _mm_xor_si128(c, d)))
+#define STB__SHA1X4_F2(b,c,d)  _mm_xor_si128(_mm_xor_si128(b, c), d)
+#define STB__SHA1X4_F3(b,c,d)  _mm_add_epi32(_mm_and_si128(b, c), _mm_and_si128(d, _mm_xor_si128(b, c)))
+
+#define STB__SHA1X4_W0(i)  (w[i] = _mm_set_epi32((int) stb_big32(p[3]+(i)*4), (int) stb_big32(p[2]+(i)*4), \
+                                                 (int) stb_big32(p[1]+(i)*4), (int) stb_big32(p[0]+(i)*4)))
+#define STB__SHA1X4_W(i)   (w[(i)&15] = stb__rol4(_mm_xor_si128(_mm_xor_si128(w[((i)-3)&15], w[((i)-8)&15]), \
+                                                                _mm_xor_si128(w[((i)-14)&15], w[(i)&15])), 1))
+
+STB__TARGET("sse2")
+static void stb__sha1_x4(stb_uint *h[4], stb_uchar *data[4], size_t blocks[4])
+{
+   static stb_uchar dummy[64];
+   stb_uint state[5][4];
+   __m128i hv[5], a,b,c,d,e, w[16], k;
+   size_t t, most = 0;
+   int i, j;
+
+   for (j=0; j < 4; ++j) {
+      for (i=0; i < 5; ++i)
+         state[i][j] = h[j][i];
+      if (blocks[j] > most) most = blocks[j];
+   }
+   for (i=0; i < 5; ++i)
+      hv[i] = _mm_loadu_si128((__m128i *) state[i]);
+
+   for (t=0; t < most; ++t) {
+      stb_uchar *p[4];
+      __m128i live;
+      for (j=0; j < 4; ++j)
+         p[j] = t < blocks[j] ? data[j] + t*64 : dummy;
+      live = _mm_set_epi32(t < blocks[3] ? -1 : 0, t < blocks[2] ? -1 : 0,
+                           t < blocks[1] ? -1 : 0, t < blocks[0] ? -1 : 0);
+
+      a = hv[0], b = hv[1], c = hv[2], d = hv[3], e = hv[4];
+      k = _mm_set1_epi32(0x5a827999);
+      for (i=0; i < 15; i += 5) {
+         STB__SHA1X4_R(a,b,c,d,e, STB__SHA1X4_F1(b,c,d), k, STB__SHA1X4_W0(i  ));
+         STB__SHA1X4_R(e,a,b,c,d, STB__SHA1X4_F1(a,b,c), k, STB__SHA1X4_W0(i+1));
+         STB__SHA1X4_R(d,e,a,b,c, STB__SHA1X4_F1(e,a,b), k, STB__SHA1X4_W0(i+2));
+         STB__SHA1X4_R(c,d,e,a,b, STB__SHA1X4_F1(d,e,a), k, STB__SHA1X4_W0(i+3));
+         STB__SHA1X4_R(b,c,d,e,a, STB__SHA1X4_F1(c,d,e), k, STB__SHA1X4_W0(i+4));
+      }
+      STB__SHA1X4_R(a,b,c,d,e, STB__SHA1X4_F1(b,c,d), k, STB__SHA1X4_W0(15));
+      STB__SHA1X4_R(e,a,b,c,d, STB__SHA1X4_F1(a,b,c), k, STB__SHA1X4_W (16));
+      STB__SHA1X4_R(d,e,a,b,c, STB__SHA1X4_F1(e,a,b), k, STB__SHA1X4_W (17));
+      STB__SHA1X4_R(c,d,e,a,b, STB__SHA1X4_F1(d,e,a), k, STB__SHA1X4_W (18));
+      STB__SHA1X4_R(b,c,d,e,a, STB__SHA1X4_F1(c,d,e), k, STB__SHA1X4_W (19));
+      for (i=20; i < 80; i += 5) {
+         if (i == 20) k = _mm_set1_epi32(0x6ed9eba1);
+         if (i == 40) k = _mm_set1_epi32((int) 0x8f1bbcdc);
+         if (i == 60) k = _mm_set1_epi32((int) 0xca62c1d6);
+         if (i < 40 || i >= 60) {
+            STB__SHA1X4_R(a,b,c,d,e, STB__SHA1X4_F2(b,c,d), k, STB__SHA1X4_W(i  ));
+            STB__SHA1X4_R(e,a,b,c,d, STB__SHA1X4_F2(a,b,c), k, STB__SHA1X4_W(i+1));
+            STB__SHA1X4_R(d,e,a,b,c, STB__SHA1X4_F2(e,a,b), k, STB__SHA1X4_W(i+2));
+            STB__SHA1X4_R(c,d,e,a,b, STB__SHA1X4_F2(d,e,a), k, STB__SHA1X4_W(i+3));
+            STB__SHA1X4_R(b,c,d,e,a, STB__SHA1X4_F2(c,d,e), k, STB__SHA1X4_W(i+4));
+         } else {
+            STB__SHA1X4_R(a,b,c,d,e, STB__SHA1X4_F3(b,c,d), k, STB__SHA1X4_W(i  ));
+            STB__SHA1X4_R(e,a,b,c,d, STB__SHA1X4_F3(a,b,c), k, STB__SHA1X4_W(i+1));
+            STB__SHA1X4_R(d,e,a,b,c, STB__SHA1X4_F3(e,a,b), k, STB__SHA1X4_W(i+2));
+            STB__SHA1X4_R(c,d,e,a,b, STB__SHA1X4_F3(d,e,a), k, STB__SHA1X4_W(i+3));
+            STB__SHA1X4_R(b,c,d,e,a, STB__SHA1X4_F3(c,d,e), k, STB__SHA1X4_W(i+4));
+         }
       }
-   }
-   fclose(f);
 
-   for (i=0; i < 5; ++i) {
-      output[i*4 + 0] = h[i] >> 24;
-      output[i*4 + 1] = h[i] >> 16;
-      output[i*4 + 2] = h[i] >>  8;
-      output[i*4 + 3] = h[i] >>  0;
+      hv[0] = _mm_add_epi32(hv[0], _mm_and_si128(a, live));
+      hv[1] = _mm_add_epi32(hv[1], _mm_and_si128(b, live));
+      hv[2] = _mm_add_epi32(hv[2], _mm_and_si128(c, live));
+      hv[3] = _mm_add_epi32(hv[3], _mm_and_si128(d, live));
+      hv[4] = _mm_add_epi32(hv[4], _mm_and_si128(e, live));
    }
 
-   return 1;
+   for (i=0; i < 5; ++i)
+      _mm_storeu_si128((__m128i *) state[i], hv[i]);
+   for (j=0; j < 4; ++j)
+      for (i=0; i < 5; ++i)
+         h[j][i] = state[i][j];
+}
+#endif
+
+void stb_sha1_update_multi(stb_sha1_context **c, void **data, size_t *len, int count)
+{
+   int i = 0;
+   #ifdef STB__X86_SIMD
+   // with the SHA extensions, one stream at a time is faster
+   if (!stb__cpu_has(STB__CPU_SHA) && stb__cpu_has(STB__CPU_SSE2)) {
+      for (; i+4 <= count; i += 4) {
+         stb_uint *h[4];
+         stb_uchar *p[4];
+         size_t n[4], blocks[4];
+         int j;
+         for (j=0; j < 4; ++j) {
+            stb_sha1_context *z = c[i+j];
+            size_t used = stb__sha1_fill(z, (stb_uchar *) data[i+j], len[i+j]);
+            p[j] = (stb_uchar *) data[i+j] + used;
+            n[j] = len[i+j] - used;
+            blocks[j] = n[j] >> 6;
+            h[j] = z->h;
+         }
+         stb__sha1_x4(h, p, blocks);
+         for (j=0; j < 4; ++j) {
+            c[i+j]->length += blocks[j] << 6;
+            stb__sha1_tail(c[i+j], p[j] + (blocks[j] << 6), n[j] & 63);
+         }
+      }
+   }
+   #endif
+   for (; i < count; ++i)
+      stb_sha1_update(c[i], data[i], len[i]);
 }
-#endif // _MSC_VER
 
 // client can truncate this wherever they like
 void stb_sha1_readable(char display[27], unsigned char sha[20])
@@ -9907,10 +10670,11 @@ void stb__introspect(char *filename)
 //
 //  This uses a DEFLATE-style sliding window, but no bitwise entropy.
 //  Everything is on byte boundaries, so you could then apply a byte-wise
-//  entropy code, though that's nowhere near as effective.
+//  entropy code, though that's nowhere near as effective. There's also an
+//  entropy-coded version of the format, see below.
 //
 //  An STB-C stream begins with a 16-byte header:
-//      4 bytes: 0x57 0xBC 0x00 0x00
+//      4 bytes: 0x57 0xBC 0x00 0x00 (0x00 0x01 for the entropy-coded format)
 //      8 bytes: big-endian size of decompressed data, 64-bits
 //      4 bytes: big-endian size of window (how far back decompressor may need)
 //
@@ -9933,6 +10697,17 @@ void stb__introspect(char *filename)
 //      zzzzzzzz: num literals - 1
 //      cccccccc: adler32 checksum of decompressed data
 //   (all big-endian)
+//
+//  The entropy-coded format (see stb_compress_entropy) finds matches the
+//  same way, but codes literals, lengths and distances with adaptive models
+//  through stb_arith, followed by the big-endian adler32 of the data. It's
+//  typically 25-40% smaller, and decodes several times slower.
+//
+//  stb_compress_level trades compression time for size without changing
+//  either format. Level 1 probes four hash buckets per byte and takes the
+//  first good match; levels 2-7 search hash chains of increasing depth, with
+//  lazy matching from level 4; levels 8-9 search a binary tree. Levels above 1
+//  also need 4 or 8 bytes per byte of window while compressing.
 
 
 STB_EXTERN stb_uint stb_decompress_length(stb_uchar *input);
@@ -9940,6 +10715,8 @@ STB_EXTERN stb_uint stb_decompress(stb_uchar *out,stb_uchar *in,stb_uint len);
 STB_EXTERN stb_uint stb_compress  (stb_uchar *out,stb_uchar *in,stb_uint len);
 STB_EXTERN void stb_compress_window(int z);
 STB_EXTERN void stb_compress_hashsize(unsigned int z);
+STB_EXTERN void stb_compress_entropy(int z); // 1 = write the entropy-coded format
+STB_EXTERN void stb_compress_level(int z);   // 1 = fastest (default) ... 9 = smallest
 
 STB_EXTERN int stb_compress_tofile(char *filename, char *in,  stb_uint  len);
 STB_EXTERN int stb_compress_intofile(FILE *f, char *input,    stb_uint  len);
@@ -9949,6 +10726,43 @@ STB_EXTERN int stb_compress_stream_start(FILE *f);
 STB_EXTERN void stb_compress_stream_end(int close);
 STB_EXTERN void stb_write(char *data, int data_len);
 
+// re-entrant versions: everything a compression needs is in the context, so
+// separate contexts can compress on separate threads at once. _init copies
+// the current stb_compress_window/hashsize/entropy/level settings; change
+// the fields afterwards to override them for this context
+typedef struct
+{
+   int      window;
+   stb_uint hashsize; // in pointers, must be a power of two
+   int      entropy;
+   int      level;
+
+   // private
+   stb_uchar  *out;
+   FILE       *outfile;
+   stb_uint    outbytes;
+   stb_uint32  running_adler;
+   struct stb__arith_lz *arith;
+   struct stb__compress_stream *stream;
+   struct stb__matchfind *mf;
+} stb_compress_context;
+
+STB_EXTERN void     stb_compress_context_init(stb_compress_context *c);
+STB_EXTERN stb_uint stb_compress_ctx(stb_compress_context *c, stb_uchar *out, stb_uchar *in, stb_uint len);
+STB_EXTERN int      stb_compress_stream_start_ctx(stb_compress_context *c, FILE *f);
+STB_EXTERN void     stb_compress_stream_end_ctx(stb_compress_context *c, int close);
+STB_EXTERN void     stb_write_ctx(stb_compress_context *c, char *data, int data_len);
+
+#ifdef STB_THREADS
+// splits the input into 'block_size' blocks (0 = 1MB) and compresses them
+// on up to 'num_threads' threads, producing an ordinary byte-format stream
+// (the entropy-coded setting is ignored). with 'prime', each block can match
+// back into the window before it, at the cost of hashing that window again;
+// without it, blocks compress as if they were separate files.
+// 'out' needs room for len + len/8 + 64 bytes.
+STB_EXTERN stb_uint stb_compress_parallel(stb_uchar *out, stb_uchar *in, stb_uint len, int num_threads, stb_uint block_size, int prime);
+#endif
+
 #ifdef STB_DEFINE
 
 stb_uint stb_decompress_length(stb_uchar *input)
@@ -9960,71 +10774,131 @@ stb_uint stb_decompress_length(stb_uchar *input)
 
 // simple implementation that just writes whole thing into big block
 
-static unsigned char *stb__barrier;
-static unsigned char *stb__barrier2;
-static unsigned char *stb__barrier3;
-static unsigned char *stb__barrier4;
+typedef struct
+{
+   stb_uchar *dout;
+   stb_uchar *barrier;  // end of output
+   stb_uchar *barrier2; // start of input
+   stb_uchar *barrier3; // end of input
+   stb_uchar *barrier4; // start of output
+} stb__dstate;
 
-static stb_uchar *stb__dout;
-static void stb__match(stb_uchar *data, stb_uint length)
+static void stb__match(stb__dstate *d, stb_uchar *data, stb_uint length)
 {
    // INVERSE of memmove... write each byte before copying the next...
-   assert (stb__dout + length <= stb__barrier);
-   if (stb__dout + length > stb__barrier) { stb__dout += length; return; }
-   if (data < stb__barrier4) { stb__dout = stb__barrier+1; return; }
-   while (length--) *stb__dout++ = *data++;
+   assert (d->dout + length <= d->barrier);
+   if (d->dout + length > d->barrier) { d->dout += length; return; }
+   if (data < d->barrier4) { d->dout = d->barrier+1; return; }
+   while (length--) *d->dout++ = *data++;
 }
 
-static void stb__lit(stb_uchar *data, stb_uint length)
+static void stb__lit(stb__dstate *d, stb_uchar *data, stb_uint length)
 {
-   assert (stb__dout + length <= stb__barrier);
-   if (stb__dout + length > stb__barrier) { stb__dout += length; return; }
-   if (data < stb__barrier2) { stb__dout = stb__barrier+1; return; }
-   memcpy(stb__dout, data, length);
-   stb__dout += length;
+   assert (d->dout + length <= d->barrier);
+   if (d->dout + length > d->barrier) { d->dout += length; return; }
+   if (data < d->barrier2 || data + length > d->barrier3) { d->dout = d->barrier+1; return; }
+   memcpy(d->dout, data, length);
+   d->dout += length;
 }
 
 #define stb__in2(x)   ((i[x] << 8) + i[(x)+1])
 #define stb__in3(x)   ((i[x] << 16) + stb__in2((x)+1))
 #define stb__in4(x)   ((i[x] << 24) + stb__in3((x)+1))
 
-static stb_uchar *stb_decompress_token(stb_uchar *i)
+// fast copies for tokens that are at least STB__DMARGIN bytes from the end
+// of both buffers: they move 8 or 16 bytes at a time (fixed-size memcpys,
+// which compile to single loads and stores) and may write up to 15 bytes
+// past the end of the token, which the next tokens overwrite
+
+#define STB__DMARGIN   16
+
+static void stb__lit_fast(stb_uchar *o, stb_uchar *s, stb_uint length)
+{
+   stb_uchar *e = o + length;
+   do { memcpy(o, s, 16); o += 16; s += 16; } while (o < e);
+}
+
+static void stb__match_fast(stb_uchar *o, stb_uint dist, stb_uint length)
+{
+   stb_uchar *e = o + length, *s = o - dist;
+   if (dist >= 16) {
+      do { memcpy(o, s, 16); o += 16; s += 16; } while (o < e);
+      return;
+   }
+   if (dist < 8) {
+      // write the pattern a byte at a time until it's repeated to at least
+      // 8 bytes, then copy from a multiple of dist back, 8 bytes at a time
+      stb_uint k, n = (8 + dist-1) / dist * dist;
+      for (k=0; k < n; ++k)
+         o[k] = s[k];
+      s = o;
+      o += n;
+   }
+   while (o < e) { memcpy(o, s, 8); o += 8; s += 8; }
+}
+
+static stb_uchar *stb_decompress_token(stb__dstate *d, stb_uchar *i)
 {
+   stb_uint len, dist, size; // dist 0 = 'len' literals follow the token
    if (*i >= 0x20) { // use fewer if's for cases that expand small
-      if (*i >= 0x80)       stb__match(stb__dout-i[1]-1, i[0] - 0x80 + 1), i += 2;
-      else if (*i >= 0x40)  stb__match(stb__dout-(stb__in2(0) - 0x4000 + 1), i[2]+1), i += 3;
-      else /* *i >= 0x20 */ stb__lit(i+1, i[0] - 0x20 + 1), i += 1 + (i[0] - 0x20 + 1);
+      if (*i >= 0x80)       len = i[0] - 0x80 + 1,        dist = i[1]+1,                     size = 2;
+      else if (*i >= 0x40)  len = i[2]+1,                 dist = stb__in2(0) - 0x4000 + 1,   size = 3;
+      else /* *i >= 0x20 */ len = i[0] - 0x20 + 1,        dist = 0,                          size = 1;
    } else { // more ifs for cases that expand large, since overhead is amortized
-      if (*i >= 0x18)       stb__match(stb__dout-(stb__in3(0) - 0x180000 + 1), i[3]+1), i += 4;
-      else if (*i >= 0x10)  stb__match(stb__dout-(stb__in3(0) - 0x100000 + 1), stb__in2(3)+1), i += 5;
-      else if (*i >= 0x08)  stb__lit(i+2, stb__in2(0) - 0x0800 + 1), i += 2 + (stb__in2(0) - 0x0800 + 1);
-      else if (*i == 0x07)  stb__lit(i+3, stb__in2(1) + 1), i += 3 + (stb__in2(1) + 1);
-      else if (*i == 0x06)  stb__match(stb__dout-(stb__in3(1)+1), i[4]+1), i += 5;
-      else if (*i == 0x04)  stb__match(stb__dout-(stb__in3(1)+1), stb__in2(4)+1), i += 6;
+      if (*i >= 0x18)       len = i[3]+1,                 dist = stb__in3(0) - 0x180000 + 1, size = 4;
+      else if (*i >= 0x10)  len = stb__in2(3)+1,          dist = stb__in3(0) - 0x100000 + 1, size = 5;
+      else if (*i >= 0x08)  len = stb__in2(0) - 0x0800 + 1, dist = 0,                       size = 2;
+      else if (*i == 0x07)  len = stb__in2(1) + 1,        dist = 0,                          size = 3;
+      else if (*i == 0x06)  len = i[4]+1,                 dist = stb__in3(1)+1,              size = 5;
+      else if (*i == 0x04)  len = stb__in2(4)+1,          dist = stb__in3(1)+1,              size = 6;
+      else return i;
+   }
+
+   // one bounds check covers the whole token, including the overrun
+   if (d->dout + len + STB__DMARGIN <= d->barrier) {
+      if (dist == 0) {
+         if (i + size + len + STB__DMARGIN <= d->barrier3) {
+            stb__lit_fast(d->dout, i+size, len);
+            d->dout += len;
+            return i + size + len;
+         }
+      } else if (dist <= (stb_uint) (d->dout - d->barrier4)) {
+         stb__match_fast(d->dout, dist, len);
+         d->dout += len;
+         return i + size;
+      }
    }
+
+   if (dist == 0) stb__lit(d, i+size, len), i += size + len;
+   else           stb__match(d, d->dout-dist, len), i += size;
    return i;
 }
 
+static stb_uint stb__decompress_arith(stb_uchar *output, stb_uchar *i, stb_uint length);
+
 stb_uint stb_decompress(stb_uchar *output, stb_uchar *i, stb_uint length)
 {
+   stb__dstate d;
    stb_uint olen;
+   if (stb__in4(0) == 0x57bC0001) return stb__decompress_arith(output, i, length);
    if (stb__in4(0) != 0x57bC0000) return 0;
    if (stb__in4(4) != 0)          return 0; // error! stream is > 4GB
    olen = stb_decompress_length(i);
-   stb__barrier2 = i;
-   stb__barrier3 = i+length;
-   stb__barrier = output + olen;
-   stb__barrier4 = output;
+   d.barrier2 = i;
+   d.barrier3 = i+length;
+   d.barrier = output + olen;
+   d.barrier4 = output;
    i += 16;
 
-   stb__dout = output;
+   d.dout = output;
    while (1) {
       stb_uchar *old_i = i;
-      i = stb_decompress_token(i);
+      if (i + 6 > d.barrier3) return 0; // no room for the end token and checksum
+      i = stb_decompress_token(&d, i);
       if (i == old_i) {
          if (*i == 0x05 && i[1] == 0xfa) {
-            assert(stb__dout == output + olen);
-            if (stb__dout != output + olen) return 0;
+            assert(d.dout == output + olen);
+            if (d.dout != output + olen) return 0;
             if (stb_adler32(1, output, olen) != (stb_uint) stb__in4(2))
                return 0;
             return olen;
@@ -10033,8 +10907,8 @@ stb_uint stb_decompress(stb_uchar *output, stb_uchar *i, stb_uint length)
             return 0;
          }
       }
-      assert(stb__dout <= output + olen); 
-      if (stb__dout > output + olen)
+      assert(d.dout <= output + olen); 
+      if (d.dout > output + olen)
          return 0;
    }
 }
@@ -10052,7 +10926,7 @@ char *stb_decompress_fromfile(char *filename, unsigned int *len)
    fread(p, 1, n, f);
    fclose(f);
    if (p == NULL) return NULL;
-   if (p[0] != 0x57 || p[1] != 0xBc || p[2] || p[3]) { free(p); return NULL; }
+   if (p[0] != 0x57 || p[1] != 0xBc || p[2] || p[3] > 1) { free(p); return NULL; }
    q = (char *) malloc(stb_decompress_length(p)+1);
    if (!q) { free(p); free(p); return NULL; }
    *len = stb_decompress((unsigned char *) q, p, n);
@@ -10061,73 +10935,6 @@ char *stb_decompress_fromfile(char *filename, unsigned int *len)
    return q;
 }
 
-#if 0
-//  streaming decompressor
-
-static struct
-{
-   stb__uchar *in_buffer;
-   stb__uchar *match;
-
-   stb__uint pending_literals;
-   stb__uint pending_match;
-} xx;
-
-
-
-static void stb__match(stb_uchar *data, stb_uint length)
-{
-   // INVERSE of memmove... write each byte before copying the next...
-   assert (stb__dout + length <= stb__barrier);
-   if (stb__dout + length > stb__barrier) { stb__dout += length; return; }
-   if (data < stb__barrier2) { stb__dout = stb__barrier+1; return; }
-   while (length--) *stb__dout++ = *data++;
-}
-
-static void stb__lit(stb_uchar *data, stb_uint length)
-{
-   assert (stb__dout + length <= stb__barrier);
-   if (stb__dout + length > stb__barrier) { stb__dout += length; return; }
-   if (data < stb__barrier2) { stb__dout = stb__barrier+1; return; }
-   memcpy(stb__dout, data, length);
-   stb__dout += length;
-}
-
-static void sx_match(stb_uchar *data, stb_uint length)
-{
-   xx.match = data;
-   xx.pending_match = length;
-}
-
-static void sx_lit(stb_uchar *data, stb_uint length)
-{
-   xx.pending_lit = length;
-}
-
-static int stb_decompress_token_state(void)
-{
-   stb__uchar *i = xx.in_buffer;
-
-   if (*i >= 0x20) { // use fewer if's for cases that expand small
-      if (*i >= 0x80)       sx_match(stb__dout-i[1]-1, i[0] - 0x80 + 1), i += 2;
-      else if (*i >= 0x40)  sx_match(stb__dout-(stb__in2(0) - 0x4000 + 1), i[2]+1), i += 3;
-      else /* *i >= 0x20 */ sx_lit(i+1, i[0] - 0x20 + 1), i += 1;
-   } else { // more ifs for cases that expand large, since overhead is amortized
-      if (*i >= 0x18)       sx_match(stb__dout-(stb__in3(0) - 0x180000 + 1), i[3]+1), i += 4;
-      else if (*i >= 0x10)  sx_match(stb__dout-(stb__in3(0) - 0x100000 + 1), stb__in2(3)+1), i += 5;
-      else if (*i >= 0x08)  sx_lit(i+2, stb__in2(0) - 0x0800 + 1), i += 2;
-      else if (*i == 0x07)  sx_lit(i+3, stb__in2(1) + 1), i += 3;
-      else if (*i == 0x06)  sx_match(stb__dout-(stb__in3(1)+1), i[4]+1), i += 5;
-      else if (*i == 0x04)  sx_match(stb__dout-(stb__in3(1)+1), stb__in2(4)+1), i += 6;
-      else return 0;
-   }
-   xx.in_buffer = i;
-   return 1;
-}
-#endif
-
-
-
 ////////////////////           compressor         ///////////////////////
 
 static unsigned int stb_matchlen(stb_uchar *m1, stb_uchar *m2, stb_uint maxlen)
@@ -10140,48 +10947,67 @@ static unsigned int stb_matchlen(stb_uchar *m1, stb_uchar *m2, stb_uint maxlen)
 
 // simple implementation that just takes the source data in a big block
 
-static stb_uchar *stb__out;
-static FILE      *stb__outfile;
-static stb_uint   stb__outbytes;
-
-static void stb__write(unsigned char v)
+static void stb__write(stb_compress_context *c, unsigned char v)
 {
-   fputc(v, stb__outfile);
-   ++stb__outbytes;
+   fputc(v, c->outfile);
+   ++c->outbytes;
 }
 
-#define stb_out(v)    (stb__out ? *stb__out++ = (stb_uchar) (v) : stb__write((stb_uchar) (v)))
+#define stb_out(c,v)    ((c)->out ? *(c)->out++ = (stb_uchar) (v) : stb__write(c, (stb_uchar) (v)))
+
+// entropy-coded output; c->arith is NULL when writing the byte format
+static int  stb__arith_start(stb_compress_context *c);
+static void stb__arith_end(stb_compress_context *c);
+static void stb__arith_literals(stb_compress_context *c, stb_uchar *in, int numlit);
+static void stb__arith_match(stb_compress_context *c, stb_uchar *q, int len, int dist);
+static int  stb__arith_repdist(stb_compress_context *c);
+
+// a match's cost is mostly the bits of its distance; literals cost
+// 4-6 bits each, so short far matches don't pay for themselves
+static int stb__arith_not_crap(int best, int dist)
+{
+   return   ((best > 2  &&  dist <= 0x00100)
+          || (best > 3  &&  dist <= 0x04000)
+          || (best > 4  &&  dist <= 0x200000)
+          ||  best > 5);
+}
 
-static void stb_out2(stb_uint v)
+static void stb_out2(stb_compress_context *c, stb_uint v)
 {
-   stb_out(v >> 8);
-   stb_out(v);
+   stb_out(c, v >> 8);
+   stb_out(c, v);
 }
 
-static void stb_out3(stb_uint v) { stb_out(v >> 16); stb_out(v >> 8); stb_out(v); }
-static void stb_out4(stb_uint v) { stb_out(v >> 24); stb_out(v >> 16);
-                                   stb_out(v >> 8 ); stb_out(v);                  }
+static void stb_out3(stb_compress_context *c, stb_uint v) { stb_out(c, v >> 16); stb_out(c, v >> 8); stb_out(c, v); }
+static void stb_out4(stb_compress_context *c, stb_uint v) { stb_out(c, v >> 24); stb_out(c, v >> 16);
+                                                            stb_out(c, v >> 8 ); stb_out(c, v);       }
 
-static void outliterals(stb_uchar *in, int numlit)
+static void outliterals(stb_compress_context *c, stb_uchar *in, int numlit)
 {
+   if (c->arith) {
+      stb__arith_literals(c, in, numlit);
+      return;
+   }
+
    while (numlit > 65536) {
-      outliterals(in,65536);
+      outliterals(c, in,65536);
       in     += 65536;
       numlit -= 65536;
    }
 
    if      (numlit ==     0)    ;
-   else if (numlit <=    32)    stb_out (0x000020 + numlit-1);
-   else if (numlit <=  2048)    stb_out2(0x000800 + numlit-1);
-   else /*  numlit <= 65536) */ stb_out3(0x070000 + numlit-1);
+   else if (numlit <=    32)    stb_out (c, 0x000020 + numlit-1);
+   else if (numlit <=  2048)    stb_out2(c, 0x000800 + numlit-1);
+   else /*  numlit <= 65536) */ stb_out3(c, 0x070000 + numlit-1);
 
-   if (stb__out) {
-      memcpy(stb__out,in,numlit);
-      stb__out += numlit;
+   if (c->out) {
+      memcpy(c->out,in,numlit);
+      c->out += numlit;
    } else
-      fwrite(in, 1, numlit, stb__outfile);
+      fwrite(in, 1, numlit, c->outfile);
 }
 
+// these set the defaults that stb_compress_context_init copies
 static int stb__window = 0x40000; // 256K
 void stb_compress_window(int z)
 {
@@ -10192,11 +11018,17 @@ void stb_compress_window(int z)
 
 static int stb_not_crap(int best, int dist)
 {
-   return   ((best > 2  &&  dist <= 0x00100)     
+   return   ((best > 2  &&  dist <= 0x00100)
           || (best > 5  &&  dist <= 0x04000)
           || (best > 7  &&  dist <= 0x80000));
 }
 
+// is a match of length b at distance d worth coding?
+static int stb__nc(stb_compress_context *c, int b, int d)
+{
+   return d <= c->window && (b > 9 || (c->arith ? stb__arith_not_crap(b,d) : stb_not_crap(b,d)));
+}
+
 static  stb_uint stb__hashsize = 32768;
 void stb_compress_hashsize(unsigned int y)
 {
@@ -10205,56 +11037,374 @@ void stb_compress_hashsize(unsigned int y)
    stb__hashsize = z >> 2;   // pass in bytes, store #pointers
 }
 
+static int stb__compress_entropy;
+void stb_compress_entropy(int z)
+{
+   stb__compress_entropy = z;
+}
+
+static int stb__compress_level = 1;
+void stb_compress_level(int z)
+{
+   stb__compress_level = z;
+}
+
+void stb_compress_context_init(stb_compress_context *c)
+{
+   memset(c, 0, sizeof(*c));
+   c->window   = stb__window;
+   c->hashsize = stb__hashsize;
+   c->entropy  = stb__compress_entropy;
+   c->level    = stb__compress_level;
+}
+
 // note that you can play with the hashing functions all you
 // want without needing to change the decompressor
 #define stb__hc(q,h,c)      (((h) << 7) + ((h) >> 25) + q[c])
 #define stb__hc2(q,h,c,d)   (((h) << 14) + ((h) >> 18) + (q[c] << 7) + q[d])
 #define stb__hc3(q,c,d,e)   ((q[c] << 14) + (q[d] << 7) + q[e])
 
-static stb_uint32 stb__running_adler;
+#define STB__SCRAMBLE(h)   (((h) + ((h) >> 16)) & mask)
+
+// for the entropy-coded format: repeating the previous match's distance is
+// nearly free, so take that if it's about as long as the best match found.
+// returns the length to code at q (updating *dist), or 0 for a literal
+static int stb__arith_choose(stb_compress_context *c, stb_uchar *history, stb_uchar *q,
+                             stb_uint match_max, int best, int *dist)
+{
+   int rep = stb__arith_repdist(c), replen = 0;
+   if (rep && q - rep >= history)
+      replen = stb_matchlen(q - rep, q, match_max);
+   if (replen >= 2 && replen + 1 >= best) {
+      *dist = rep;
+      return replen;
+   }
+   return best < 3 ? 0 : best;
+}
+
+// write the literals from lit_start to q, then a match of 'best' bytes at
+// distance 'dist'. returns the number of bytes coded, or 0 if the byte
+// format has no balanced way to code it (nothing is written then)
+static int stb__out_match(stb_compress_context *c, stb_uchar *lit_start, stb_uchar *q, int best, int dist)
+{
+   if (c->arith) {
+      outliterals(c, lit_start, q-lit_start);
+      stb__arith_match(c, q, best, dist);
+      return best;
+   }
+
+   if (best > 2  &&  best <= 0x80    &&  dist <= 0x100) {
+      outliterals(c, lit_start, q-lit_start);
+      stb_out(c, 0x80 + best-1);
+      stb_out(c, dist-1);
+   } else if (best > 5  &&  best <= 0x100   &&  dist <= 0x4000) {
+      outliterals(c, lit_start, q-lit_start);
+      stb_out2(c, 0x4000 + dist-1);
+      stb_out(c, best-1);
+   } else if (best > 7  &&  best <= 0x100   &&  dist <= 0x80000) {
+      outliterals(c, lit_start, q-lit_start);
+      stb_out3(c, 0x180000 + dist-1);
+      stb_out(c, best-1);
+   } else if (best > 8  &&  best <= 0x10000 &&  dist <= 0x80000) {
+      outliterals(c, lit_start, q-lit_start);
+      stb_out3(c, 0x100000 + dist-1);
+      stb_out2(c, best-1);
+   } else if (best > 9                      &&  dist <= 0x1000000) {
+      if (best > 65536) best = 65536;
+      outliterals(c, lit_start, q-lit_start);
+      if (best <= 0x100) {
+         stb_out(c, 0x06);
+         stb_out3(c, dist-1);
+         stb_out(c, best-1);
+      } else {
+         stb_out(c, 0x04);
+         stb_out3(c, dist-1);
+         stb_out2(c, best-1);
+      }
+   } else {  // no match was a balanced tradeoff
+      return 0;
+   }
+   return best;
+}
 
-static int stb_compress_chunk(stb_uchar *history,
-                              stb_uchar *start,
-                              stb_uchar *end,
-                              int length,
-                              int *pending_literals,
-                              stb_uchar **chash,
-                              stb_uint mask)
+//////////////////////      level 2+ match finders     //////////////////////
+//
+// Hash chains and binary trees over the window, in the style of zlib and
+// LZMA. Positions are stream offsets plus window+1, so 0 is always out of
+// range and means "none"; 'base' is the position of 'history' in
+// stb_compress_chunk, which the streaming compressor advances when it
+// slides its buffer.
+
+struct stb__matchfind
+{
+   stb_uint *head;       // most recent position with each hash
+   stb_uint *link;       // per position: previous position with the same
+                         // hash, or (tree) the two subtrees
+   stb_uint  link_mask;  // link holds a power of two > window positions
+   stb_uint  base;
+   int depth, nice, lazy, tree;
+};
+
+static struct { short depth, nice; char lazy, tree; } stb__compress_levels[8] =
 {
-   int window = stb__window;
-   stb_uint match_max;
-   stb_uchar *lit_start = start - *pending_literals;
-   stb_uchar *q = start;
+   {    4,   16, 0, 0 },  // 2
+   {    8,   32, 0, 0 },  // 3
+   {   16,   32, 1, 0 },  // 4
+   {   32,   64, 1, 0 },  // 5
+   {   64,  128, 1, 0 },  // 6
+   {  128,  258, 1, 0 },  // 7
+   {   32,  128, 1, 1 },  // 8
+   {  256,  273, 1, 1 },  // 9
+};
 
-   #define STB__SCRAMBLE(h)   (((h) + ((h) >> 16)) & mask)
+// returns 0 if out of memory; does nothing below level 2
+static int stb__mf_start(stb_compress_context *c)
+{
+   struct stb__matchfind *f;
+   stb_uint size = 1;
+   int level = c->level > 9 ? 9 : c->level;
+   c->mf = NULL;
+   if (level < 2) return 1;
 
-   // stop short of the end so we don't scan off the end doing
-   // the hashing; this means we won't compress the last few bytes
-   // unless they were part of something longer
-   while (q < start+length && q+12 < end) {
-      int m;
-      stb_uint h1,h2,h3,h4, h;
-      stb_uchar *t;
-      int best = 2, dist=0;
+   while (size <= (stb_uint) c->window) size <<= 1;
+   f = (struct stb__matchfind *) malloc(sizeof(*f));
+   if (f == NULL) return 0;
+   f->depth = stb__compress_levels[level-2].depth;
+   f->nice  = stb__compress_levels[level-2].nice;
+   f->lazy  = stb__compress_levels[level-2].lazy;
+   f->tree  = stb__compress_levels[level-2].tree;
+   f->head  = (stb_uint *) calloc(c->hashsize, sizeof(stb_uint));
+   f->link  = (stb_uint *) malloc(size * (f->tree ? 2 : 1) * sizeof(stb_uint));
+   if (f->head == NULL || f->link == NULL) {
+      free(f->head);
+      free(f->link);
+      free(f);
+      return 0;
+   }
+   f->link_mask = size-1;
+   f->base = c->window + 1;
+   c->mf = f;
+   return 1;
+}
 
-      if (q+65536 > end)
-         match_max = end-q;
-      else
-         match_max = 65536;
+static void stb__mf_end(stb_compress_context *c)
+{
+   if (c->mf) {
+      free(c->mf->head);
+      free(c->mf->link);
+      free(c->mf);
+      c->mf = NULL;
+   }
+}
 
-      #define stb__nc(b,d)  ((d) <= window && ((b) > 9 || stb_not_crap(b,d)))
+// find the best match for q (reading no further than 'end'), and insert q.
+// returns its length, or 2 if there isn't one worth coding. for the tree,
+// dist can be NULL to only insert
+static int stb__mf_find(stb_compress_context *c, stb_uchar *history, stb_uchar *q, stb_uchar *end, int *dist)
+{
+   struct stb__matchfind *f = c->mf;
+   stb_uint mask = c->hashsize-1;
+   stb_uint cur = f->base + (q - history), low = f->base, p, h;
+   stb_uint match_max = end - q, limit;
+   int best = 2, depth = f->depth;
 
-      #define STB__TRY(t,p)  /* avoid retrying a match we already tried */ \
-                      if (p ? dist != q-t : 1)                             \
-                      if ((m = stb_matchlen(t, q, match_max)) > best)     \
-                      if (stb__nc(m,q-(t)))                                \
-                          best = m, dist = q - (t)
+   if (cur - low > (stb_uint) c->window) low = cur - c->window;
+   if (match_max > 65536) match_max = 65536;
+   limit = match_max < (stb_uint) f->nice ? match_max : (stb_uint) f->nice;
 
-      // rather than search for all matches, only try 4 candidate locations,
-      // chosen based on 4 different hash functions of different lengths.
-      // this strategy is inspired by LZO; hashing is unrolled here using the
-      // 'hc' macro
-      h = stb__hc3(q,0, 1, 2); h1 = STB__SCRAMBLE(h);
+   h = stb__hc3(q,0,1,2); h = STB__SCRAMBLE(h);
+   p = f->head[h];
+   f->head[h] = cur;
+
+   if (!f->tree) {
+      f->link[cur & f->link_mask] = p;
+      for (; p >= low && p < cur && depth--; p = f->link[p & f->link_mask]) {
+         stb_uchar *t = history + (p - f->base);
+         if (t[best] == q[best]) { // cheap test that it could beat 'best'
+            int m = stb_matchlen(t, q, match_max);
+            if (m > best && stb__nc(c, m, cur-p)) {
+               best = m, *dist = cur-p;
+               if ((stb_uint) m >= limit) break;
+            }
+         }
+      }
+   } else {
+      // binary tree of the positions with this hash, ordered by the bytes
+      // that follow them; q becomes the root, and the old tree is split
+      // into its two subtrees as we walk down
+      stb_uint *left  = &f->link[2*(cur & f->link_mask)];
+      stb_uint *right = left + 1;
+      stb_uint left_len = 0, right_len = 0;
+      for (;;) {
+         stb_uint *pair, m;
+         stb_uchar *t;
+         if (p < low || p >= cur || depth-- == 0) {
+            *left = *right = 0;
+            break;
+         }
+         pair = &f->link[2*(p & f->link_mask)];
+         t = history + (p - f->base);
+         m = left_len < right_len ? left_len : right_len;
+         m += stb_matchlen(t+m, q+m, limit-m);
+         if (dist && (int) m > best && stb__nc(c, m, cur-p))
+            best = m, *dist = cur-p;
+         if (m == limit) {
+            // p is as good as q, so q replaces it
+            *left  = pair[0];
+            *right = pair[1];
+            break;
+         }
+         if (t[m] < q[m]) {
+            *left = p;
+            left = pair+1;
+            p = *left;
+            left_len = m;
+         } else {
+            *right = p;
+            right = pair;
+            p = *right;
+            right_len = m;
+         }
+      }
+      if (dist && (stb_uint) best == limit) // the tree only compares up to 'nice'
+         best = stb_matchlen(q - *dist, q, match_max);
+   }
+   return best;
+}
+
+// insert the n positions starting at q without searching
+static void stb__mf_insert(stb_compress_context *c, stb_uchar *history, stb_uchar *q, stb_uchar *end, int n)
+{
+   struct stb__matchfind *f = c->mf;
+   stb_uint mask = c->hashsize-1;
+   for (; n > 0 && q+3 < end; --n, ++q) {
+      if (f->tree) {
+         stb__mf_find(c, history, q, end, NULL);
+      } else {
+         stb_uint h = stb__hc3(q,0,1,2), cur = f->base + (q - history);
+         h = STB__SCRAMBLE(h);
+         f->link[cur & f->link_mask] = f->head[h];
+         f->head[h] = cur;
+      }
+   }
+}
+
+// skip over the n positions after a match. inserting into the tree costs
+// up to 'nice' compares, so in long matches (which are usually runs or
+// repeats) only the first 'nice' positions go in
+static void stb__mf_skip(stb_compress_context *c, stb_uchar *history, stb_uchar *q, stb_uchar *end, int n)
+{
+   if (c->mf->tree && n > c->mf->nice)
+      n = c->mf->nice;
+   stb__mf_insert(c, history, q, end, n);
+}
+
+// rough size saved by a match, in quarter-bytes: a longer match is better
+// unless it's much further away
+static int stb__match_gain(int len, int dist)
+{
+   return len ? len*4 - stb_log2_floor(dist) : 0;
+}
+
+// stb_compress_chunk for level 2+: search every position, and with 'lazy',
+// only take a match if the one starting at the next byte isn't longer
+static int stb__compress_chunk_search(stb_compress_context *c,
+                                      stb_uchar *history,
+                                      stb_uchar *start,
+                                      stb_uchar *end,
+                                      int length,
+                                      int *pending_literals)
+{
+   struct stb__matchfind *f = c->mf;
+   stb_uchar *lit_start = start - *pending_literals;
+   stb_uchar *q = start;
+   int prev_len = 0, prev_dist = 0, n;
+
+   while (q < start+length && q+3 < end) {
+      int dist = 0, best = stb__mf_find(c, history, q, end, &dist);
+      if (c->arith)
+         best = stb__arith_choose(c, history, q, end-q < 65536 ? end-q : 65536, best, &dist);
+      else if (best < 3)
+         best = 0;
+
+      if (prev_len) {
+         // the match at q-1 was deferred; take it unless this one's longer
+         if (stb__match_gain(prev_len, prev_dist) + 2 >= stb__match_gain(best, dist)
+             && (n = stb__out_match(c, lit_start, q-1, prev_len, prev_dist))) {
+            stb__mf_skip(c, history, q+1, end, n-2);
+            lit_start = q = q-1 + n;
+            prev_len = 0;
+            continue;
+         }
+         prev_len = 0;
+      }
+
+      if (best && f->lazy && best < f->nice && q+1 < start+length) {
+         prev_len = best, prev_dist = dist;
+         ++q;
+      } else if (best && (n = stb__out_match(c, lit_start, q, best, dist))) {
+         stb__mf_skip(c, history, q+1, end, n-1);
+         lit_start = q = q + n;
+      } else {
+         ++q;
+      }
+   }
+   if (prev_len && (n = stb__out_match(c, lit_start, q-1, prev_len, prev_dist))) {
+      stb__mf_skip(c, history, q+1, end, n-2);
+      lit_start = q = q-1 + n;
+   }
+
+   // if we didn't get all the way, add the rest to literals
+   if (q-start < length)
+      q = start+length;
+
+   *pending_literals = (q - lit_start);
+
+   c->running_adler = stb_adler32(c->running_adler, start, q - start);
+   return q - start;
+}
+
+static int stb_compress_chunk(stb_compress_context *c,
+                              stb_uchar *history,
+                              stb_uchar *start,
+                              stb_uchar *end,
+                              int length,
+                              int *pending_literals,
+                              stb_uchar **chash,
+                              stb_uint mask)
+{
+   stb_uint match_max;
+   stb_uchar *lit_start = start - *pending_literals;
+   stb_uchar *q = start;
+
+   if (c->mf)
+      return stb__compress_chunk_search(c, history, start, end, length, pending_literals);
+
+   // stop short of the end so we don't scan off the end doing
+   // the hashing; this means we won't compress the last few bytes
+   // unless they were part of something longer
+   while (q < start+length && q+12 < end) {
+      int m;
+      stb_uint h1,h2,h3,h4, h;
+      stb_uchar *t;
+      int best = 2, dist=0, n;
+
+      if (q+65536 > end)
+         match_max = end-q;
+      else
+         match_max = 65536;
+
+      #define STB__TRY(t,p)  /* avoid retrying a match we already tried */ \
+                      if (p ? dist != q-t : 1)                             \
+                      if ((m = stb_matchlen(t, q, match_max)) > best)     \
+                      if (stb__nc(c,m,q-(t)))                              \
+                          best = m, dist = q - (t)
+
+      // rather than search for all matches, only try 4 candidate locations,
+      // chosen based on 4 different hash functions of different lengths.
+      // this strategy is inspired by LZO; hashing is unrolled here using the
+      // 'hc' macro
+      h = stb__hc3(q,0, 1, 2); h1 = STB__SCRAMBLE(h);
                                       t = chash[h1]; if (t) STB__TRY(t,0);
       h = stb__hc2(q,h, 3, 4); h2 = STB__SCRAMBLE(h);
       h = stb__hc2(q,h, 5, 6);        t = chash[h2]; if (t) STB__TRY(t,1);
@@ -10270,40 +11420,16 @@ static int stb_compress_chunk(stb_uchar *history,
       if (best > 2)
          assert(dist > 0);
 
+      if (c->arith)
+         best = stb__arith_choose(c, history, q, match_max, best, &dist);
+      else if (best < 3)
+         best = 0;
+
       // see if our best match qualifies
-      if (best < 3) { // fast path literals
-         ++q;
-      } else if (best > 2  &&  best <= 0x80    &&  dist <= 0x100) {
-         outliterals(lit_start, q-lit_start); lit_start = (q += best);
-         stb_out(0x80 + best-1);
-         stb_out(dist-1);
-      } else if (best > 5  &&  best <= 0x100   &&  dist <= 0x4000) {
-         outliterals(lit_start, q-lit_start); lit_start = (q += best);
-         stb_out2(0x4000 + dist-1);       
-         stb_out(best-1);
-      } else if (best > 7  &&  best <= 0x100   &&  dist <= 0x80000) {
-         outliterals(lit_start, q-lit_start); lit_start = (q += best);
-         stb_out3(0x180000 + dist-1);     
-         stb_out(best-1);
-      } else if (best > 8  &&  best <= 0x10000 &&  dist <= 0x80000) {
-         outliterals(lit_start, q-lit_start); lit_start = (q += best);
-         stb_out3(0x100000 + dist-1);     
-         stb_out2(best-1);
-      } else if (best > 9                      &&  dist <= 0x1000000) {
-         if (best > 65536) best = 65536;
-         outliterals(lit_start, q-lit_start); lit_start = (q += best);
-         if (best <= 0x100) {
-            stb_out(0x06);
-            stb_out3(dist-1);
-            stb_out(best-1);
-         } else {
-            stb_out(0x04);
-            stb_out3(dist-1);
-            stb_out2(best-1);
-         }
-      } else {  // fallback literals if no match was a balanced tradeoff
+      if (best && (n = stb__out_match(c, lit_start, q, best, dist)))
+         lit_start = (q += n);
+      else
          ++q;
-      }
    }
 
    // if we didn't get all the way, add the rest to literals
@@ -10313,114 +11439,201 @@ static int stb_compress_chunk(stb_uchar *history,
    // the literals are everything from lit_start to q
    *pending_literals = (q - lit_start);
 
-   stb__running_adler = stb_adler32(stb__running_adler, start, q - start);
+   c->running_adler = stb_adler32(c->running_adler, start, q - start);
    return q - start;
 }
 
-static int stb_compress_inner(stb_uchar *input, stb_uint length)
+static void stb__compress_header(stb_compress_context *c, stb_uint length)
+{
+   // stream signature
+   stb_out(c, 0x57); stb_out(c, 0xbc);
+   stb_out2(c, c->entropy ? 1 : 0);
+
+   stb_out4(c, 0);       // 64-bit length requires 32-bit leading 0
+   stb_out4(c, length);
+   stb_out4(c, c->window);
+}
+
+static int stb_compress_inner(stb_compress_context *c, stb_uchar *input, stb_uint length)
 {
    int literals = 0;
    stb_uint len,i;
 
    stb_uchar **chash;
-   chash = (stb_uchar**) malloc(stb__hashsize * sizeof(stb_uchar*));
+   chash = (stb_uchar**) malloc(c->hashsize * sizeof(stb_uchar*));
    if (chash == NULL) return 0; // failure
-   for (i=0; i < stb__hashsize; ++i)
+   for (i=0; i < c->hashsize; ++i)
       chash[i] = NULL;
 
-   // stream signature
-   stb_out(0x57); stb_out(0xbc);
-   stb_out2(0);
+   if (!stb__mf_start(c)) {
+      free(chash);
+      return 0;
+   }
 
-   stb_out4(0);       // 64-bit length requires 32-bit leading 0
-   stb_out4(length);
-   stb_out4(stb__window);
+   stb__compress_header(c, length);
 
-   stb__running_adler = 1;
+   c->running_adler = 1;
+
+   if (c->entropy && !stb__arith_start(c)) {
+      stb__mf_end(c);
+      free(chash);
+      return 0;
+   }
 
-   len = stb_compress_chunk(input, input, input+length, length, &literals, chash, stb__hashsize-1);
+   len = stb_compress_chunk(c, input, input, input+length, length, &literals, chash, c->hashsize-1);
    assert(len == length);
 
-   outliterals(input+length - literals, literals);
+   outliterals(c, input+length - literals, literals);
 
+   stb__mf_end(c);
    free(chash);
 
-   stb_out2(0x05fa); // end opcode
+   if (c->arith)
+      stb__arith_end(c);
+   else
+      stb_out2(c, 0x05fa); // end opcode
 
-   stb_out4(stb__running_adler);
+   stb_out4(c, c->running_adler);
 
    return 1; // success
 }
 
-stb_uint stb_compress(stb_uchar *out, stb_uchar *input, stb_uint length)
+stb_uint stb_compress_ctx(stb_compress_context *c, stb_uchar *out, stb_uchar *input, stb_uint length)
 {
-   stb__out = out;
-   stb__outfile = NULL;
+   c->out = out;
+   c->outfile = NULL;
+
+   stb_compress_inner(c, input, length);
 
-   stb_compress_inner(input, length);
+   return c->out - out;
+}
 
-   return stb__out - out;
+stb_uint stb_compress(stb_uchar *out, stb_uchar *input, stb_uint length)
+{
+   stb_compress_context c;
+   stb_compress_context_init(&c);
+   return stb_compress_ctx(&c, out, input, length);
 }
 
 int stb_compress_tofile(char *filename, char *input, unsigned int length)
 {
-   int maxlen = length + 512 + (length >> 2); // total guess
-   char *buffer = (char *) malloc(maxlen);
-   int blen = stb_compress((stb_uchar*)buffer, (stb_uchar*)input, length);
-   
-   stb__out = NULL;
-   stb__outfile = fopen(filename, "wb");
-   if (!stb__outfile) return 0;
+   stb_compress_context c;
+   stb_compress_context_init(&c);
 
-   stb__outbytes = 0;
+   c.outfile = fopen(filename, "wb");
+   if (!c.outfile) return 0;
 
-   if (!stb_compress_inner((stb_uchar*)input, length))
+   if (!stb_compress_inner(&c, (stb_uchar*)input, length)) {
+      fclose(c.outfile);
       return 0;
+   }
 
-   fclose(stb__outfile);
+   fclose(c.outfile);
 
-   return stb__outbytes;
+   return c.outbytes;
 }
 
 int stb_compress_intofile(FILE *f, char *input, unsigned int length)
 {
-   int maxlen = length + 512 + (length >> 2); // total guess
-   //char *buffer = (char*)malloc(maxlen);
-   //int blen = stb_compress((stb_uchar*)buffer, (stb_uchar*)input, length);
-   
-   stb__out = NULL;
-   stb__outfile = f;
-   if (!stb__outfile) return 0;
+   stb_compress_context c;
+   stb_compress_context_init(&c);
 
-   stb__outbytes = 0;
+   c.outfile = f;
+   if (!c.outfile) return 0;
 
-   if (!stb_compress_inner((stb_uchar*)input, length))
+   if (!stb_compress_inner(&c, (stb_uchar*)input, length))
       return 0;
 
-   return stb__outbytes;
+   return c.outbytes;
+}
+
+////////////////////       independent blocks       ///////////////////////
+
+#ifdef STB_THREADS
+
+// insert every position in [p,end) into the hash table, as if we'd
+// compressed it, so the next block can find matches back into it
+static void stb__compress_prime(stb_uchar *p, stb_uchar *end, stb_uchar **chash, stb_uint mask)
+{
+   for (; p < end; ++p) {
+      stb_uint h1,h2,h3,h4, h;
+      h = stb__hc3(p,0, 1, 2); h1 = STB__SCRAMBLE(h);
+      h = stb__hc2(p,h, 3, 4); h2 = STB__SCRAMBLE(h);
+      h = stb__hc2(p,h, 5, 6);
+      h = stb__hc2(p,h, 7, 8); h3 = STB__SCRAMBLE(h);
+      h = stb__hc2(p,h, 9,10);
+      h = stb__hc2(p,h,11,12); h4 = STB__SCRAMBLE(h);
+      chash[h1] = chash[h2] = chash[h3] = chash[h4] = p;
+   }
+}
+
+// compress input[start,end) to byte-format tokens with no header, which
+// can be spliced into a stream right after the tokens for input[0,start).
+// if 'prime' is set, matches may reach back before 'start'. returns the
+// number of bytes written to 'out', which needs room for
+// STB__COMPRESS_BLOCK_BOUND(end-start) bytes, or -1 if out of memory.
+#define STB__COMPRESS_BLOCK_BOUND(n)   ((n) + ((n) >> 3) + 16)
+
+static int stb__compress_block(stb_compress_context *c, stb_uchar *out, stb_uchar *input,
+                               stb_uint start, stb_uint end, int prime)
+{
+   int literals = 0;
+   stb_uint i;
+   stb_uchar **chash = (stb_uchar**) malloc(c->hashsize * sizeof(stb_uchar*));
+   if (chash == NULL) return -1;
+   for (i=0; i < c->hashsize; ++i)
+      chash[i] = NULL;
+   if (!stb__mf_start(c)) {
+      free(chash);
+      return -1;
+   }
+
+   if (prime && start) {
+      stb_uint from = start > (stb_uint) c->window ? start - c->window : 0;
+      stb_uint to   = start;
+      if (to + 12 >= end) // hashing a position reads 13 bytes
+         to = end >= 13 ? end - 13 : 0;
+      if (from < to) {
+         if (c->mf)
+            stb__mf_insert(c, input, input+from, input+end, to-from);
+         else
+            stb__compress_prime(input+from, input+to, chash, c->hashsize-1);
+      }
+   }
+
+   c->out = out;
+   c->outfile = NULL;
+   c->arith = NULL;
+   c->running_adler = 1;
+   stb_compress_chunk(c, input, input+start, input+end, end-start, &literals, chash, c->hashsize-1);
+   outliterals(c, input+end - literals, literals);
+   stb__mf_end(c);
+   free(chash);
+   return c->out - out;
 }
+#endif // STB_THREADS
 
 //////////////////////    streaming I/O version    /////////////////////
 
 
-static stb_uint stb_out_backpatch_id(void)
+static stb_uint stb_out_backpatch_id(stb_compress_context *c)
 {
-   if (stb__out)
-      return (stb_uint) stb__out;
+   if (c->out)
+      return (stb_uint) c->out;
    else
-      return ftell(stb__outfile);
+      return ftell(c->outfile);
 }
 
-static void stb_out_backpatch(stb_uint id, stb_uint value)
+static void stb_out_backpatch(stb_compress_context *c, stb_uint id, stb_uint value)
 {
    stb_uchar data[4] = { value >> 24, value >> 16, value >> 8, value };
-   if (stb__out) {
+   if (c->out) {
       memcpy((void *) id, data, 4);
    } else {
-      stb_uint where = ftell(stb__outfile);
-      fseek(stb__outfile, id, SEEK_SET);
-      fwrite(data, 4, 1, stb__outfile);
-      fseek(stb__outfile, where, SEEK_SET);
+      stb_uint where = ftell(c->outfile);
+      fseek(c->outfile, id, SEEK_SET);
+      fwrite(data, 4, 1, c->outfile);
+      fseek(c->outfile, where, SEEK_SET);
    }
 }
 
@@ -10428,7 +11641,7 @@ static void stb_out_backpatch(stb_uint id, stb_uint value)
 // use a copying-in-place buffer, which lets us share the code.
 // This is way less efficient but it'll do for now.
 
-static struct
+struct stb__compress_stream
 {
    stb_uchar *buffer;
    int size;           // physical size of buffer in bytes
@@ -10446,156 +11659,200 @@ static struct
 
    stb_uchar **chash;
    stb_uint    hashmask;
-} xtb;
+};
 
-static int stb_compress_streaming_start(void)
+static int stb_compress_streaming_start(stb_compress_context *c)
 {
+   struct stb__compress_stream *x;
    stb_uint i;
-   xtb.size = stb__window * 3;
-   xtb.buffer = (stb_uchar*)malloc(xtb.size);
-   if (!xtb.buffer) return 0;
 
-   xtb.chash = (stb_uchar**)malloc(sizeof(*xtb.chash) * stb__hashsize);
-   if (!xtb.chash) {
-      free(xtb.buffer);
+   x = c->stream = (struct stb__compress_stream *) malloc(sizeof(*x));
+   if (!x) return 0;
+   x->size = c->window * 3;
+   x->buffer = (stb_uchar*)malloc(x->size);
+   if (!x->buffer) { free(x); return 0; }
+
+   x->chash = (stb_uchar**)malloc(sizeof(*x->chash) * c->hashsize);
+   if (!x->chash || !stb__mf_start(c)) {
+      free(x->chash);
+      free(x->buffer);
+      free(x);
       return 0;
    }
 
-   for (i=0; i < stb__hashsize; ++i)
-      xtb.chash[i] = NULL;
+   for (i=0; i < c->hashsize; ++i)
+      x->chash[i] = NULL;
 
-   xtb.hashmask = stb__hashsize-1;
+   x->hashmask = c->hashsize-1;
 
-   xtb.valid        = 0;
-   xtb.start        = 0;
-   xtb.window       = stb__window;
-   xtb.fsize        = stb__window;
-   xtb.pending_literals = 0;
-   xtb.total_bytes  = 0;
+   x->valid        = 0;
+   x->start        = 0;
+   x->window       = c->window;
+   x->fsize        = c->window;
+   x->pending_literals = 0;
+   x->total_bytes  = 0;
 
       // stream signature
-   stb_out(0x57); stb_out(0xbc); stb_out2(0);
+   stb_out(c, 0x57); stb_out(c, 0xbc); stb_out2(c, c->entropy ? 1 : 0);
+
+   stb_out4(c, 0);       // 64-bit length requires 32-bit leading 0
 
-   stb_out4(0);       // 64-bit length requires 32-bit leading 0
+   x->length_id = stb_out_backpatch_id(c);
+   stb_out4(c, 0);       // we don't know the output length yet
 
-   xtb.length_id = stb_out_backpatch_id();
-   stb_out4(0);       // we don't know the output length yet
+   stb_out4(c, c->window);
 
-   stb_out4(stb__window);
+   c->running_adler = 1;
 
-   stb__running_adler = 1;
+   if (c->entropy && !stb__arith_start(c)) {
+      stb__mf_end(c);
+      free(x->buffer);
+      free(x->chash);
+      free(x);
+      return 0;
+   }
 
    return 1;
 }
 
-static int stb_compress_streaming_end(void)
+static int stb_compress_streaming_end(stb_compress_context *c)
 {
+   struct stb__compress_stream *x = c->stream;
+
    // flush out any remaining data
-   stb_compress_chunk(xtb.buffer, xtb.buffer+xtb.start, xtb.buffer+xtb.valid,
-                      xtb.valid-xtb.start, &xtb.pending_literals, xtb.chash, xtb.hashmask);
+   stb_compress_chunk(c, x->buffer, x->buffer+x->start, x->buffer+x->valid,
+                      x->valid-x->start, &x->pending_literals, x->chash, x->hashmask);
 
    // write out pending literals
-   outliterals(xtb.buffer + xtb.valid - xtb.pending_literals, xtb.pending_literals);
+   outliterals(c, x->buffer + x->valid - x->pending_literals, x->pending_literals);
 
-   stb_out2(0x05fa); // end opcode
-   stb_out4(stb__running_adler);
+   if (c->arith)
+      stb__arith_end(c);
+   else
+      stb_out2(c, 0x05fa); // end opcode
+   stb_out4(c, c->running_adler);
 
-   stb_out_backpatch(xtb.length_id, xtb.total_bytes);
+   stb_out_backpatch(c, x->length_id, x->total_bytes);
 
-   free(xtb.buffer);
-   free(xtb.chash);
+   stb__mf_end(c);
+   free(x->buffer);
+   free(x->chash);
+   free(x);
+   c->stream = NULL;
    return 1;
 }
 
-void stb_write(char *data, int data_len)
+void stb_write_ctx(stb_compress_context *c, char *data, int data_len)
 {
+   struct stb__compress_stream *x = c->stream;
    stb_uint i;
 
    // @TODO: fast path for filling the buffer and doing nothing else
-   //   if (xtb.valid + data_len < xtb.size)
+   //   if (x->valid + data_len < x->size)
 
-   xtb.total_bytes += data_len;
+   x->total_bytes += data_len;
 
    while (data_len) {
       // fill buffer
-      if (xtb.valid < xtb.size) {
-         int amt = xtb.size - xtb.valid;
+      if (x->valid < x->size) {
+         int amt = x->size - x->valid;
          if (data_len < amt) amt = data_len;
-         memcpy(xtb.buffer + xtb.valid, data, amt);
+         memcpy(x->buffer + x->valid, data, amt);
          data_len -= amt;
          data     += amt;
-         xtb.valid += amt;
+         x->valid += amt;
       }
-      if (xtb.valid < xtb.size)
+      if (x->valid < x->size)
          return;
 
       // at this point, the buffer is full
 
       // if we can process some data, go for it; make sure
       // we leave an 'fsize's worth of data, though
-      if (xtb.start + xtb.fsize < xtb.valid) {
-         int amount = (xtb.valid - xtb.fsize) - xtb.start;
+      if (x->start + x->fsize < x->valid) {
+         int amount = (x->valid - x->fsize) - x->start;
          int n;
          assert(amount > 0);
-         n = stb_compress_chunk(xtb.buffer, xtb.buffer + xtb.start, xtb.buffer + xtb.valid,
-                                amount, &xtb.pending_literals, xtb.chash, xtb.hashmask);
-         xtb.start += n;
+         n = stb_compress_chunk(c, x->buffer, x->buffer + x->start, x->buffer + x->valid,
+                                amount, &x->pending_literals, x->chash, x->hashmask);
+         x->start += n;
       }
 
-      assert(xtb.start + xtb.fsize >= xtb.valid);
+      assert(x->start + x->fsize >= x->valid);
       // at this point, our future size is too small, so we
       // need to flush some history. we, in fact, flush exactly
       // one window's worth of history
 
       {
-         int flush = xtb.window;
-         assert(xtb.start >= flush);
-         assert(xtb.valid >= flush);
+         int flush = x->window;
+         assert(x->start >= flush);
+         assert(x->valid >= flush);
 
          // if 'pending literals' extends back into the shift region,
          // write them out
-         if (xtb.start - xtb.pending_literals < flush) {
-            outliterals(xtb.buffer + xtb.start - xtb.pending_literals, xtb.pending_literals);
-            xtb.pending_literals = 0;
+         if (x->start - x->pending_literals < flush) {
+            outliterals(c, x->buffer + x->start - x->pending_literals, x->pending_literals);
+            x->pending_literals = 0;
          }
 
          // now shift the window
-         memmove(xtb.buffer, xtb.buffer + flush, xtb.valid - flush);
-         xtb.start -= flush;
-         xtb.valid -= flush;
-   
-         for (i=0; i <= xtb.hashmask; ++i)
-            if (xtb.chash[i] < xtb.buffer + flush)
-               xtb.chash[i] = NULL;
+         memmove(x->buffer, x->buffer + flush, x->valid - flush);
+         x->start -= flush;
+         x->valid -= flush;
+
+         for (i=0; i <= x->hashmask; ++i)
+            if (x->chash[i] < x->buffer + flush)
+               x->chash[i] = NULL;
             else
-               xtb.chash[i] -= flush;
+               x->chash[i] -= flush;
+         if (c->mf)
+            c->mf->base += flush;
       }
       // and now that we've made room for more data, go back to the top
    }
 }
 
-int stb_compress_stream_start(FILE *f)
+int stb_compress_stream_start_ctx(stb_compress_context *c, FILE *f)
 {
-   stb__out = NULL;
-   stb__outfile = f;
+   c->out = NULL;
+   c->outfile = f;
 
    if (f == NULL)
       return 0;
 
-   if (!stb_compress_streaming_start())
+   if (!stb_compress_streaming_start(c))
       return 0;
 
    return 1;
 }
 
-void stb_compress_stream_end(int close)
+void stb_compress_stream_end_ctx(stb_compress_context *c, int close)
 {
-   stb_compress_streaming_end();
-   if (close && stb__outfile) {
-      fclose(stb__outfile);
+   stb_compress_streaming_end(c);
+   if (close && c->outfile) {
+      fclose(c->outfile);
    }
 }
 
+// the plain streaming functions share one context
+static stb_compress_context stb__stream_context;
+
+int stb_compress_stream_start(FILE *f)
+{
+   stb_compress_context_init(&stb__stream_context);
+   return stb_compress_stream_start_ctx(&stb__stream_context, f);
+}
+
+void stb_compress_stream_end(int close)
+{
+   stb_compress_stream_end_ctx(&stb__stream_context, close);
+}
+
+void stb_write(char *data, int data_len)
+{
+   stb_write_ctx(&stb__stream_context, data, data_len);
+}
+
 #endif // STB_DEFINE
 
 //////////////////////////////////////////////////////////////////////////////
@@ -10606,40 +11863,51 @@ void stb_compress_stream_end(int close)
 
 typedef struct stbfile
 {
-   int (*getbyte)(struct stbfile *);  // -1 on EOF
+   int (*getbyte)(struct stbfile *);  // -1 on EOF; only called when indata == inend
    unsigned int (*getdata)(struct stbfile *, void *block, unsigned int len);
 
-   int (*putbyte)(struct stbfile *, int byte);
+   int (*putbyte)(struct stbfile *, int byte); // only called when outdata == outend
    unsigned int (*putdata)(struct stbfile *, void *block, unsigned int len);
 
-   unsigned int (*size)(struct stbfile *);
+   stb_uint64 (*size)(struct stbfile *);
 
-   unsigned int (*tell)(struct stbfile *);
-   void (*backpatch)(struct stbfile *, unsigned int tell, void *block, unsigned int len);
+   stb_uint64 (*tell)(struct stbfile *);
+   void (*backpatch)(struct stbfile *, stb_uint64 tell, void *block, unsigned int len);
 
    void (*close)(struct stbfile *);
 
    FILE *f;  // file to fread/fwrite
    unsigned char *buffer; // input/output buffer
-   unsigned char *indata, *inend; // input buffer
+   unsigned char *indata, *inend; // input window; stb_getc reads from here until it's empty
    union {
       int various;
       void *ptr;
    };
+   unsigned char *outdata, *outend; // output window; stb_putc writes here until it's full
 } stbfile;
 
-STB_EXTERN unsigned int stb_getc(stbfile *f); // read
-STB_EXTERN int stb_putc(stbfile *f, int ch); // write
+// stb_getc and stb_putc are macros so the common case is a pointer bump; getbyte
+// and putbyte only run when the window is empty/full, and refill/flush it.
+// 'f' is evaluated more than once. stb_getc returns -1 on EOF.
+#define stb_getc(f)     ((f)->indata  < (f)->inend  ? (int) *(f)->indata++ : (f)->getbyte(f))
+#define stb_putc(f,ch)  ((f)->outdata < (f)->outend ? (*(f)->outdata++ = (unsigned char) (ch), 1) \
+                                                    : (f)->putbyte(f, ch))
+
+STB_EXTERN int (stb_getc)(stbfile *f); // read
+STB_EXTERN int (stb_putc)(stbfile *f, int ch); // write
 STB_EXTERN unsigned int stb_getdata(stbfile *f, void *buffer, unsigned int len); // read
 STB_EXTERN unsigned int stb_putdata(stbfile *f, void *buffer, unsigned int len); // write
 STB_EXTERN unsigned int stb_tell(stbfile *f); // read
 STB_EXTERN unsigned int stb_size(stbfile *f); // read/write
+STB_EXTERN stb_uint64 stb_tell64(stbfile *f); // read
+STB_EXTERN stb_uint64 stb_size64(stbfile *f); // read/write
 STB_EXTERN void stb_backpatch(stbfile *f, unsigned int tell, void *buffer, unsigned int len); // write
+STB_EXTERN void stb_backpatch64(stbfile *f, stb_uint64 tell, void *buffer, unsigned int len); // write
 
 #ifdef STB_DEFINE
 
-unsigned int stb_getc(stbfile *f) { return f->getbyte(f); }
-int stb_putc(stbfile *f, int ch)  { return f->putbyte(f, ch); }
+int (stb_getc)(stbfile *f)         { return stb_getc(f); }
+int (stb_putc)(stbfile *f, int ch) { return stb_putc(f, ch); }
 
 unsigned int stb_getdata(stbfile *f, void *buffer, unsigned int len)
 {
@@ -10654,38 +11922,165 @@ void stb_close(stbfile *f)
    f->close(f);
    free(f);
 }
-unsigned int stb_tell(stbfile *f) { return f->tell(f); }
-unsigned int stb_size(stbfile *f) { return f->size(f); }
+unsigned int stb_tell(stbfile *f) { return (unsigned int) f->tell(f); }
+unsigned int stb_size(stbfile *f) { return (unsigned int) f->size(f); }
+stb_uint64 stb_tell64(stbfile *f) { return f->tell(f); }
+stb_uint64 stb_size64(stbfile *f) { return f->size(f); }
 void stb_backpatch(stbfile *f, unsigned int tell, void *buffer, unsigned int len)
 {
    f->backpatch(f,tell,buffer,len);
 }
+void stb_backpatch64(stbfile *f, stb_uint64 tell, void *buffer, unsigned int len)
+{
+   f->backpatch(f,tell,buffer,len);
+}
+
+// FILE * implementation; reads and writes go through a window on 'buffer',
+// which is allocated along with the stbfile
+#define STB__FBUFSIZE   4096
+
+#if defined(_MSC_VER) && _MSC_VER >= 1400 || defined(__MINGW32__)
+#define stb__ftell64(f)       ((stb_uint64) _ftelli64(f))
+#define stb__fseek64(f,p,w)   _fseeki64(f,p,w)
+#elif defined(_WIN32)
+#define stb__ftell64(f)       ((stb_uint64) ftell(f))
+#define stb__fseek64(f,p,w)   fseek(f,(long) (p),w)
+#else
+#define stb__ftell64(f)       ((stb_uint64) ftello(f))
+#define stb__fseek64(f,p,w)   fseeko(f,(off_t) (p),w)
+#endif
+
+static int stb__fflushout(stbfile *f)
+{
+   int ok = 1;
+   if (f->outdata) {
+      size_t n = f->outdata - f->buffer;
+      ok = fwrite(f->buffer, 1, n, f->f) == n;
+      f->outdata = f->outend = NULL;
+   }
+   return ok;
+}
+
+// C requires a seek or fflush when switching between reading and writing;
+// switching to writing also gives back any unconsumed read-ahead
+static void stb__freading(stbfile *f)
+{
+   if (f->outdata) {
+      stb__fflushout(f);
+      fflush(f->f);
+   }
+}
+
+static void stb__fwriting(stbfile *f)
+{
+   if (f->inend) {
+      stb__fseek64(f->f, -(stb_int64) (f->inend - f->indata), SEEK_CUR);
+      f->indata = f->inend = NULL;
+   }
+}
+
+static int stb__fgetbyte(stbfile *f)
+{
+   size_t n;
+   stb__freading(f);
+   n = fread(f->buffer, 1, STB__FBUFSIZE, f->f);
+   if (n == 0) {
+      f->indata = f->inend = NULL;
+      return -1;
+   }
+   f->indata = f->buffer + 1;
+   f->inend  = f->buffer + n;
+   return f->buffer[0];
+}
+
+static int stb__fputbyte(stbfile *f, int ch)
+{
+   stb__fwriting(f);
+   if (!stb__fflushout(f)) return 0;
+   f->outdata = f->buffer;
+   f->outend  = f->buffer + STB__FBUFSIZE;
+   *f->outdata++ = (unsigned char) ch;
+   return 1;
+}
+
+static unsigned int stb__fgetdata(stbfile *f, void *buffer, unsigned int len)
+{
+   unsigned int n = 0;
+   stb__freading(f);
+   if (f->indata < f->inend) {
+      n = stb_min(len, (unsigned int) (f->inend - f->indata));
+      memcpy(buffer, f->indata, n);
+      f->indata += n;
+   }
+   if (n < len)
+      n += fread((char *) buffer + n, 1, len - n, f->f);
+   return n;
+}
+
+static unsigned int stb__fputdata(stbfile *f, void *buffer, unsigned int len)
+{
+   stb__fwriting(f);
+   if (f->outdata && len <= (unsigned int) (f->outend - f->outdata)) {
+      memcpy(f->outdata, buffer, len);
+      f->outdata += len;
+      return len;
+   }
+   if (!stb__fflushout(f)) return 0;
+   if (len < STB__FBUFSIZE) {
+      f->outdata = f->buffer;
+      f->outend  = f->buffer + STB__FBUFSIZE;
+      memcpy(f->outdata, buffer, len);
+      f->outdata += len;
+      return len;
+   }
+   // leave an empty window so the next read still knows to fflush first
+   f->outdata = f->outend = f->buffer;
+   return fwrite(buffer,1,len,f->f);
+}
+
+static stb_uint64 stb__fsize(stbfile *f)
+{
+   stb_uint64 pos, len;
+   stb__fflushout(f);
+   pos = stb__ftell64(f->f);
+   stb__fseek64(f->f, 0, SEEK_END);
+   len = stb__ftell64(f->f);
+   stb__fseek64(f->f, pos, SEEK_SET);
+   return len;
+}
+
+static stb_uint64 stb__ftell(stbfile *f)
+{
+   // this drops the output window, so fflush now or a later fread would
+   // directly follow the fwrite
+   if (f->outdata) {
+      stb__fflushout(f);
+      fflush(f->f);
+   }
+   return stb__ftell64(f->f) - (f->inend - f->indata);
+}
 
-// FILE * implementation
-static int stb__fgetbyte(stbfile *f) { return fgetc(f->f); }
-static int stb__fputbyte(stbfile *f, int ch) { return fputc(ch, f->f)==0; }
-static unsigned int stb__fgetdata(stbfile *f, void *buffer, unsigned int len) { return fread(buffer,1,len,f->f); }
-static unsigned int stb__fputdata(stbfile *f, void *buffer, unsigned int len) { return fwrite(buffer,1,len,f->f); }
-static unsigned int stb__fsize(stbfile *f) { return stb_filelen(f->f); }
-static unsigned int stb__ftell(stbfile *f) { return ftell(f->f); }
-static void stb__fbackpatch(stbfile *f, unsigned int where, void *buffer, unsigned int len)
+static void stb__fbackpatch(stbfile *f, stb_uint64 where, void *buffer, unsigned int len)
 {
-   fseek(f->f, where, SEEK_SET);
+   stb__fflushout(f);
+   stb__fwriting(f);
+   stb__fseek64(f->f, where, SEEK_SET);
    fwrite(buffer, 1, len, f->f);
-   fseek(f->f, 0, SEEK_END);
+   stb__fseek64(f->f, 0, SEEK_END);
 }
-static void         stb__fclose(stbfile *f) { fclose(f->f); }
+static void         stb__fclose(stbfile *f) { stb__fflushout(f); fclose(f->f); }
 
 stbfile *stb_openf(FILE *f)
 {
    stbfile m = { stb__fgetbyte, stb__fgetdata,
                  stb__fputbyte, stb__fputdata,
                  stb__fsize, stb__ftell, stb__fbackpatch, stb__fclose,
-                 0,0,0, };
-   stbfile *z = (stbfile *) malloc(sizeof(*z));
+                 0,0,0,0, {0}, 0,0 };
+   stbfile *z = (stbfile *) malloc(sizeof(*z) + STB__FBUFSIZE);
    if (z) {
       *z = m;
       z->f = f;
+      z->buffer = (unsigned char *) (z+1);
    }
    return z;
 }
@@ -10694,8 +12089,9 @@ static int stb__nogetbyte(stbfile *f) { assert(0); return -1; }
 static unsigned int stb__nogetdata(stbfile *f, void *buffer, unsigned int len) { assert(0); return 0; }
 static int stb__noputbyte(stbfile *f, int ch) { assert(0); return 0; }
 static unsigned int stb__noputdata(stbfile *f, void *buffer, unsigned int len) { assert(0); return 0; }
-static void stb__nobackpatch(stbfile *f, unsigned int where, void *buffer, unsigned int len) { assert(0); }
+static void stb__nobackpatch(stbfile *f, stb_uint64 where, void *buffer, unsigned int len) { assert(0); }
 
+// the input window is the whole buffer, so this only runs at the end
 static int stb__bgetbyte(stbfile *s)
 {
    if (s->indata < s->inend)
@@ -10712,8 +12108,8 @@ static unsigned int stb__bgetdata(stbfile *s, void *buffer, unsigned int len)
    s->indata += len;
    return len;
 }
-static unsigned int stb__bsize(stbfile *s) { return s->inend - s->buffer; }
-static unsigned int stb__btell(stbfile *s) { return s->indata - s->buffer; }
+static stb_uint64 stb__bsize(stbfile *s) { return s->inend - s->buffer; }
+static stb_uint64 stb__btell(stbfile *s) { return s->indata - s->buffer; }
 
 static void stb__bclose(stbfile *s)
 {
@@ -10725,7 +12121,8 @@ stbfile *stb_open_inbuffer(void *buffer, unsigned int len)
 {
    stbfile m = { stb__bgetbyte, stb__bgetdata,
                  stb__noputbyte, stb__noputdata,
-                 stb__bsize, stb__btell, stb__nobackpatch, stb__bclose };
+                 stb__bsize, stb__btell, stb__nobackpatch, stb__bclose,
+                 0,0,0,0, {0}, 0,0 };
    stbfile *z = (stbfile *) malloc(sizeof(*z));
    if (z) {
       *z = m;
@@ -10749,6 +12146,7 @@ stbfile *stb_open_inbuffer_free(void *buffer, unsigned int len)
 // version of stb_open, without the 'k' flag and utf8 support
 static void stb__fclose2(stbfile *f)
 {
+   stb__fflushout(f);
    fclose(f->f);
 }
 
@@ -10767,6 +12165,7 @@ stbfile *stb_open(char *filename, char *mode)
 // also includes the memory buffer output format implemented with stb_arr
 static void stb__fclose2(stbfile *f)
 {
+   stb__fflushout(f);
    stb_fclose(f->f, f->various);
 }
 
@@ -10793,8 +12192,8 @@ static unsigned int stb__aputdata(stbfile *f, void *data, unsigned int len)
    memcpy(stb_arr_addn(f->buffer, (int) len), data, len);
    return len;
 }
-static unsigned int stb__asize(stbfile *f) { return stb_arr_len(f->buffer); }
-static void stb__abackpatch(stbfile *f, unsigned int where, void *data, unsigned int len)
+static stb_uint64 stb__asize(stbfile *f) { return stb_arr_len(f->buffer); }
+static void stb__abackpatch(stbfile *f, stb_uint64 where, void *data, unsigned int len)
 {
    memcpy(f->buffer+where, data, len);
 }
@@ -10807,11 +12206,12 @@ stbfile *stb_open_outbuffer(unsigned char **update_on_close)
 {
    stbfile m = { stb__nogetbyte, stb__nogetdata,
                  stb__aputbyte, stb__aputdata,
-                 stb__asize, stb__asize, stb__abackpatch, stb__aclose };
+                 stb__asize, stb__asize, stb__abackpatch, stb__aclose,
+                 0,0,0,0, {0}, 0,0 };
    stbfile *z = (stbfile *) malloc(sizeof(*z));
    if (z) {
-      z->ptr = update_on_close;
       *z = m;
+      z->ptr = update_on_close;
    }
    return z;
 }
@@ -10826,12 +12226,15 @@ stbfile *stb_open_outbuffer(unsigned char **update_on_close)
 
 typedef struct
 {
-   unsigned int range_low;
-   unsigned int range_high;
-   unsigned int code, range; // decode
+   unsigned int range_low;   // encode
+   unsigned int range;
+   unsigned int code;        // decode
+   int carry;                // encode: range_low overflowed since the last byte went out
    int buffered_u8;
    int pending_ffs;
    stbfile *output;
+   struct stb_arith_symstate *bytes;   // stb_arith_encode_byte order-0 model
+   struct stb__arith_cm *cm;           // stb_arith_encode_byte order-1 model
 } stb_arith;
 
 STB_EXTERN void stb_arith_init_encode(stb_arith *a, stbfile *out);
@@ -10846,68 +12249,83 @@ STB_EXTERN void stb_arith_decode_advance(stb_arith *a, unsigned int totalfreq, u
 STB_EXTERN unsigned int stb_arith_decode_value_log2(stb_arith *a, unsigned int totalfreq2);
 STB_EXTERN void stb_arith_decode_advance_log2(stb_arith *a, unsigned int totalfreq2, unsigned int freq, unsigned int cumfreq);
 
+// bytes coded through a model owned by the coder (freed by the _close functions).
+// order 0 (the default) is an adaptive frequency model; order 1 codes each bit
+// with an order-0 and an order-1 prediction mixed by an adaptive mixer, which is
+// slower but much better on text. set the same order on both sides, after init.
+STB_EXTERN void stb_arith_byte_order(stb_arith *a, int order);
 STB_EXTERN void stb_arith_encode_byte(stb_arith *a, int byte);
 STB_EXTERN int  stb_arith_decode_byte(stb_arith *a);
 
-// this is a memory-inefficient way of doing things, but it's
-// fast(?) and simple
-typedef struct
-{
-   unsigned short cumfreq;
-   unsigned short samples;
-} stb_arith_symstate_item;
+// adaptive binary model: the probability of a 0 bit, in 1/4096ths. start
+// each one at STB_ARITH_PROB_INIT; it adapts as bits are coded through it
+typedef unsigned short stb_arith_prob;
+#define STB_ARITH_PROB_INIT   2048
 
-typedef struct
+STB_EXTERN void stb_arith_encode_bit(stb_arith *a, stb_arith_prob *p, int bit);
+STB_EXTERN int  stb_arith_decode_bit(stb_arith *a, stb_arith_prob *p);
+
+// adaptive frequency model over num_sym symbols (at most 32767). the
+// cumulative frequencies live in a Fenwick tree, so coding a symbol
+// takes O(log num_sym) rather than a scan over the alphabet
+typedef struct stb_arith_symstate
 {
    int num_sym;
-   unsigned int pow2;
-   int countdown;
-   stb_arith_symstate_item data[1];
+   int top;               // largest power of two <= num_sym
+   unsigned int total;
+   unsigned short *freq;  // [num_sym]
+   unsigned short *tree;  // [num_sym+1], 1-based
 } stb_arith_symstate;
 
+STB_EXTERN stb_arith_symstate *stb_arith_state_create(int num_sym); // free() it
+STB_EXTERN void stb_arith_encode_sym(stb_arith *a, stb_arith_symstate *s, int sym);
+STB_EXTERN int  stb_arith_decode_sym(stb_arith *a, stb_arith_symstate *s);
+
 #ifdef STB_DEFINE
 void stb_arith_init_encode(stb_arith *a, stbfile *out)
 {
    a->range_low = 0;
-   a->range_high = 0xffffffff;
+   a->range = 0xffffffff;
+   a->carry = 0;
    a->pending_ffs = -1; // means no buffered character currently, to speed up normal case
    a->output = out;
+   a->bytes = NULL;
+   a->cm = NULL;
 }
 
-static void stb__arith_carry(stb_arith *a)
+void stb_arith_init_decode(stb_arith *a, stbfile *in)
 {
    int i;
-   assert(a->pending_ffs != -1); // can't carry with no data
-   stb_putc(a->output, a->buffered_u8);
-   for (i=0; i < a->pending_ffs; ++i)
-      stb_putc(a->output, 0);
+   a->range = 0xffffffff;
+   a->code = 0;
+   a->output = in;
+   a->bytes = NULL;
+   a->cm = NULL;
+   for (i=0; i < 4; ++i) {
+      int c = stb_getc(in);
+      a->code = (a->code << 8) + (c >= 0 ? c : 0);
+   }
 }
 
+// bytes leaving the top of range_low may still be changed by a carry, but
+// only the most recent non-0xff byte and the 0xff's after it; so buffer
+// exactly those until a byte arrives that a carry can't get past
 static void stb__arith_putbyte(stb_arith *a, int byte)
 {
-   if (a->pending_ffs) {
-      if (a->pending_ffs == -1) { // means no buffered data; encoded for fast path efficiency
-         if (byte == 0xff)
-            stb_putc(a->output, byte); // just write it immediately
-         else {
-            a->buffered_u8 = byte;
-            a->pending_ffs = 0;
-         }
-      } else if (byte == 0xff) {
-         ++a->pending_ffs;
-      } else {
-         int i;
-         stb_putc(a->output, a->buffered_u8);
-         for (i=0; i < a->pending_ffs; ++i)
-            stb_putc(a->output, 0xff);
-      }
-   } else if (byte == 0xff) {
-      ++a->pending_ffs;
-   } else {
-      // fast path
-      stb_putc(a->output, a->buffered_u8);
+   if (a->pending_ffs < 0) {
+      // first byte; the coded value can't exceed the initial range, so this never carries
       a->buffered_u8 = byte;
-   }
+      a->pending_ffs = 0;
+   } else if (byte != 0xff || a->carry) {
+      int i;
+      stb_putc(a->output, (a->buffered_u8 + a->carry) & 0xff);
+      for (i=0; i < a->pending_ffs; ++i)
+         stb_putc(a->output, (0xff + a->carry) & 0xff);
+      a->buffered_u8 = byte;
+      a->pending_ffs = 0;
+      a->carry = 0;
+   } else
+      ++a->pending_ffs;
 }
 
 static void stb__arith_flush(stb_arith *a)
@@ -10924,38 +12342,37 @@ static void stb__renorm_encoder(stb_arith *a)
 {
    stb__arith_putbyte(a, a->range_low >> 24);
    a->range_low <<= 8;
-   a->range_high = (a->range_high << 8) | 0xff;
+   a->range <<= 8;
 }
 
 static void stb__renorm_decoder(stb_arith *a)
 {
    int c = stb_getc(a->output);
    a->code = (a->code << 8) + (c >= 0 ? c : 0); // if EOF, insert 0
+   a->range <<= 8;
 }
 
 void stb_arith_encode(stb_arith *a, unsigned int totalfreq, unsigned int freq, unsigned int cumfreq)
 {
-   unsigned int range = a->range_high - a->range_low;
+   unsigned int range = a->range / totalfreq;
    unsigned int old = a->range_low;
-   range /= totalfreq;
    a->range_low += range * cumfreq;
-   a->range_high = a->range_low + range*freq;
+   a->range = range*freq;
    if (a->range_low < old)
-      stb__arith_carry(a);
-   while (a->range_high - a->range_low < 0x1000000)
+      a->carry = 1;
+   while (a->range < 0x1000000)
       stb__renorm_encoder(a);
 }
 
 void stb_arith_encode_log2(stb_arith *a, unsigned int totalfreq2, unsigned int freq, unsigned int cumfreq)
 {
-   unsigned int range = a->range_high - a->range_low;
+   unsigned int range = a->range >> totalfreq2;
    unsigned int old = a->range_low;
-   range >>= totalfreq2;
    a->range_low += range * cumfreq;
-   a->range_high = a->range_low + range*freq;
+   a->range = range*freq;
    if (a->range_low < old)
-      stb__arith_carry(a);
-   while (a->range_high - a->range_low < 0x1000000)
+      a->carry = 1;
+   while (a->range < 0x1000000)
       stb__renorm_encoder(a);
 }
 
@@ -10991,123 +12408,844 @@ void stb_arith_decode_advance_log2(stb_arith *a, unsigned int totalfreq2, unsign
       stb__renorm_decoder(a);
 }
 
-stbfile *stb_arith_encode_close(stb_arith *a)
+// binary models split the range directly instead of going through
+// freq/cumfreq, so the 1 side keeps the rounding slop
+#define STB__ARITH_PROB_BITS   12
+#define STB__ARITH_PROB_SHIFT  5    // adaptation rate
+
+// code a bit whose probability of being 0 is p/4096
+static void stb__arith_encode_p(stb_arith *a, unsigned int p, int bit)
 {
-   // put exactly as many bytes as we'll read, so we can turn on/off arithmetic coding in a stream
-   stb__arith_putbyte(a, a->range_low >> 24);
-   stb__arith_putbyte(a, a->range_low >> 16);
-   stb__arith_putbyte(a, a->range_low >>  8);
-   stb__arith_putbyte(a, a->range_low >>  0);
-   stb__arith_flush(a);
-   return a->output;
+   unsigned int bound = (a->range >> STB__ARITH_PROB_BITS) * p;
+   if (!bit)
+      a->range = bound;
+   else {
+      unsigned int old = a->range_low;
+      a->range_low += bound;
+      a->range -= bound;
+      if (a->range_low < old)
+         a->carry = 1;
+   }
+   while (a->range < 0x1000000)
+      stb__renorm_encoder(a);
 }
 
-stbfile *stb_arith_decode_close(stb_arith *a)
+static int stb__arith_decode_p(stb_arith *a, unsigned int p)
 {
-   return a->output;
+   unsigned int bound = (a->range >> STB__ARITH_PROB_BITS) * p;
+   int bit;
+   if (a->code < bound) {
+      a->range = bound;
+      bit = 0;
+   } else {
+      a->code -= bound;
+      a->range -= bound;
+      bit = 1;
+   }
+   while (a->range < 0x1000000)
+      stb__renorm_decoder(a);
+   return bit;
 }
 
-// this is a simple power-of-two based model -- using
-// power of two means we need one divide per decode,
-// not two.
-#define POW2_LIMIT   12
-stb_arith_symstate *stb_arith_state_create(int num_sym)
+#define stb__arith_adapt(p,bit,shift) \
+   (*(p) = (bit) ? *(p) - (*(p) >> (shift)) : *(p) + (((1 << STB__ARITH_PROB_BITS) - *(p)) >> (shift)))
+
+void stb_arith_encode_bit(stb_arith *a, stb_arith_prob *p, int bit)
 {
-   stb_arith_symstate *s = (stb_arith_symstate *) malloc(sizeof(*s) + (num_sym-1) * sizeof(s->data[0])); 
-   if (s) {
-      int i, cf, cf_next, next;
-      int start_freq, extra;
-      s->num_sym = num_sym;
-      s->pow2 = 4;
-      while (s->pow2 < 15 && (1 << s->pow2) < 3*num_sym) {
-         ++s->pow2;
-      }
-      start_freq = (1 << s->pow2) / num_sym;
-      assert(start_freq >= 1);
-      extra = (1 << s->pow2) % num_sym;
-      // now set up the initial stats
+   stb__arith_encode_p(a, *p, bit);
+   stb__arith_adapt(p, bit, STB__ARITH_PROB_SHIFT);
+}
 
-      if (s->pow2 < POW2_LIMIT)
-         next = 0;
-      else
-         next = 1;
+int stb_arith_decode_bit(stb_arith *a, stb_arith_prob *p)
+{
+   int bit = stb__arith_decode_p(a, *p);
+   stb__arith_adapt(p, bit, STB__ARITH_PROB_SHIFT);
+   return bit;
+}
 
-      cf = cf_next = 0;
-      for (i=0; i < extra; ++i) {
-         s->data[i].cumfreq = cf;
-         s->data[i].samples = next;
-         cf += start_freq+1;
-         cf_next += next;
-      }
-      for (; i < num_sym; ++i) {
-         s->data[i].cumfreq = cf;
-         s->data[i].samples = next;
-         cf += start_freq;
-         cf_next += next;
-      }
-      assert(cf == (1 << s->pow2));
-      // now, how long should we go until we have 2 << s->pow2 samples?
-      s->countdown = (2 << s->pow2) - cf - cf_next;
+static void stb__arith_free_models(stb_arith *a)
+{
+   free(a->bytes);
+   free(a->cm);
+   a->bytes = NULL;
+   a->cm = NULL;
+}
+
+stbfile *stb_arith_encode_close(stb_arith *a)
+{
+   // put exactly as many bytes as we'll read, so we can turn on/off arithmetic coding in a stream
+   stb__arith_putbyte(a, (a->range_low >> 24) & 0xff);
+   stb__arith_putbyte(a, (a->range_low >> 16) & 0xff);
+   stb__arith_putbyte(a, (a->range_low >>  8) & 0xff);
+   stb__arith_putbyte(a, (a->range_low >>  0) & 0xff);
+   stb__arith_flush(a);
+   stb__arith_free_models(a);
+   return a->output;
+}
+
+stbfile *stb_arith_decode_close(stb_arith *a)
+{
+   stb__arith_free_models(a);
+   return a->output;
+}
+
+// adaptive frequency models: each coded symbol adds STB__ARITH_SYM_INC to
+// its count, and all counts are halved when the total would pass the limit.
+// the limit keeps totalfreq <= 2^16, so range/totalfreq stays >= 256
+#define STB__ARITH_SYM_INC     24
+#define STB__ARITH_SYM_LIMIT   0xffff
+
+static void stb__arith_sym_build(stb_arith_symstate *s)
+{
+   int i, n = s->num_sym;
+   s->total = 0;
+   for (i=1; i <= n; ++i) {
+      s->tree[i] = s->freq[i-1];
+      s->total += s->freq[i-1];
+   }
+   for (i=1; i <= n; ++i) {
+      int j = i + (i & -i);
+      if (j <= n) s->tree[j] += s->tree[i];
+   }
+}
+
+stb_arith_symstate *stb_arith_state_create(int num_sym)
+{
+   stb_arith_symstate *s;
+   int i;
+   assert(num_sym >= 1 && num_sym <= STB__ARITH_SYM_LIMIT / 2);
+   s = (stb_arith_symstate *) malloc(sizeof(*s) + (2*num_sym+1) * sizeof(unsigned short));
+   if (s) {
+      s->num_sym = num_sym;
+      s->freq = (unsigned short *) (s+1);
+      s->tree = s->freq + num_sym;
+      for (s->top = 1; s->top*2 <= num_sym; s->top *= 2)
+         ;
+      for (i=0; i < num_sym; ++i)
+         s->freq[i] = 1;
+      stb__arith_sym_build(s);
    }
    return s;
 }
 
-static stb_arith_state_rescale(stb_arith_symstate *s)
+static void stb__arith_sym_update(stb_arith_symstate *s, int sym)
 {
-   if (s->pow2 < POW2_LIMIT) {
-      int pcf, cf, cf_next, next, i;
-      ++s->pow2;
-      if (s->pow2 < POW2_LIMIT)
-         next = 0;
-      else
-         next = 1;
-      cf = cf_next = 0;
-      pcf = 0;
-      for (i=0; i < s->num_sym; ++i) {
-         int sample = s->data[i].cumfreq - pcf + s->data[i].samples;
-         s->data[i].cumfreq = cf;
-         cf += sample;
-         s->data[i].samples = next;
-         cf_next += next;
-      }
-      assert(cf == (1 << s->pow2));
-      s->countdown = (2 << s->pow2) - cf - cf_next;
-   } else {
-      int pcf, cf, cf_next, i;
-      cf = cf_next = 0;
-      pcf = 0;
-      for (i=0; i < s->num_sym; ++i) {
-         int sample = (s->data[i].cumfreq - pcf + s->data[i].samples) >> 1;
-         s->data[i].cumfreq = cf;
-         cf += sample;
-         s->data[i].samples = 1;
-         cf_next += 1;
+   int i;
+   if (s->total + STB__ARITH_SYM_INC > STB__ARITH_SYM_LIMIT) {
+      for (i=0; i < s->num_sym; ++i)
+         s->freq[i] = (s->freq[i] + 1) >> 1;
+      stb__arith_sym_build(s);
+   }
+   s->freq[sym] += STB__ARITH_SYM_INC;
+   s->total     += STB__ARITH_SYM_INC;
+   for (i=sym+1; i <= s->num_sym; i += i & -i)
+      s->tree[i] += STB__ARITH_SYM_INC;
+}
+
+void stb_arith_encode_sym(stb_arith *a, stb_arith_symstate *s, int sym)
+{
+   unsigned int cumfreq = 0;
+   int i;
+   assert(sym >= 0 && sym < s->num_sym);
+   for (i=sym; i > 0; i -= i & -i)
+      cumfreq += s->tree[i];
+   stb_arith_encode(a, s->total, s->freq[sym], cumfreq);
+   stb__arith_sym_update(s, sym);
+}
+
+int stb_arith_decode_sym(stb_arith *a, stb_arith_symstate *s)
+{
+   unsigned int v = stb_arith_decode_value(a, s->total), cumfreq = v;
+   int sym = 0, step;
+   // find the last symbol whose cumfreq <= v
+   for (step = s->top; step; step >>= 1)
+      if (sym + step <= s->num_sym && s->tree[sym+step] <= v) {
+         sym += step;
+         v -= s->tree[sym];
       }
-      assert(cf == (1 << s->pow2)); // this isn't necessarily true, due to rounding down!
-      s->countdown = (2 << s->pow2) - cf - cf_next;
+   stb_arith_decode_advance(a, s->total, s->freq[sym], cumfreq - v);
+   stb__arith_sym_update(s, sym);
+   return sym;
+}
+
+// order-1 byte model: each bit, MSB first, gets a prediction from the partial
+// byte so far (order 0) and from that plus the previous byte (order 1). the
+// two are mixed in the logistic domain, with weights learned per partial byte.
+// everything is integer so the encoder and decoder agree exactly.
+#define STB__ARITH_CM_RATE0   5   // adaptation shift for order 0
+#define STB__ARITH_CM_RATE1   4   // ... and order 1, which sees fewer samples
+#define STB__ARITH_CM_LEARN   10  // mixer learning rate, as a shift
+
+typedef struct stb__arith_cm
+{
+   stb_arith_prob o0[256];
+   stb_arith_prob o1[256][256];
+   int weight[256][2];          // 16.16 fixed point
+   short stretch[4096];         // ln(p/(1-p)), scaled by 256
+   int prev;
+} stb__arith_cm;
+
+// inverse of stretch: 4096/(1+e^-(d/256)), interpolated from a table
+static int stb__arith_squash(int d)
+{
+   static short t[33] = {
+      1,2,3,6,10,16,27,45,73,120,194,310,488,747,1101,1546,2047,
+      2549,2994,3348,3607,3785,3901,3975,4024,4050,4068,4079,4085,4089,4092,4093,4094
+   };
+   int w;
+   if (d >  2047) return 4095;
+   if (d < -2047) return 1;
+   w = d & 127;
+   d = (d >> 7) + 16;
+   return (t[d] * (128-w) + t[d+1] * w + 64) >> 7;
+}
+
+static stb__arith_cm *stb__arith_cm_create(void)
+{
+   stb__arith_cm *m = (stb__arith_cm *) malloc(sizeof(*m));
+   if (m) {
+      int i, j, x, pi = 0;
+      for (i=0; i < 256; ++i) {
+         m->o0[i] = STB_ARITH_PROB_INIT;
+         for (j=0; j < 256; ++j)
+            m->o1[i][j] = STB_ARITH_PROB_INIT;
+         m->weight[i][0] = m->weight[i][1] = 1 << 15;
+      }
+      for (x = -2047; x <= 2047; ++x) {
+         int v = stb__arith_squash(x);
+         for (j=pi; j <= v; ++j)
+            m->stretch[j] = x;
+         pi = v+1;
+      }
+      for (j=pi; j < 4096; ++j)
+         m->stretch[j] = 2047;
+      m->prev = 0;
+   }
+   return m;
+}
+
+// returns the mixed probability of a 0 bit at 'node', and the mixer inputs
+static int stb__arith_cm_predict(stb__arith_cm *m, int node, int *st)
+{
+   int p;
+   st[0] = m->stretch[m->o0[node]];
+   st[1] = m->stretch[m->o1[m->prev][node]];
+   p = stb__arith_squash((m->weight[node][0] * st[0] + m->weight[node][1] * st[1]) >> 16);
+   return stb_clamp(p, 1, 4095);
+}
+
+static void stb__arith_cm_update(stb__arith_cm *m, int node, int *st, int p, int bit)
+{
+   int err = ((!bit) << 12) - p, i;
+   for (i=0; i < 2; ++i) {
+      int w = m->weight[node][i] + ((st[i] * err) >> STB__ARITH_CM_LEARN);
+      m->weight[node][i] = stb_clamp(w, -(1 << 19), 1 << 19);
    }
+   stb__arith_adapt(&m->o0[node], bit, STB__ARITH_CM_RATE0);
+   stb__arith_adapt(&m->o1[m->prev][node], bit, STB__ARITH_CM_RATE1);
+}
+
+void stb_arith_byte_order(stb_arith *a, int order)
+{
+   assert(order == 0 || order == 1);
+   stb__arith_free_models(a);
+   if (order == 1)
+      a->cm = stb__arith_cm_create();
 }
 
 void stb_arith_encode_byte(stb_arith *a, int byte)
 {
+   stb__arith_cm *m = a->cm;
+   if (m) {
+      int node = 1, i, st[2];
+      for (i=7; i >= 0; --i) {
+         int bit = (byte >> i) & 1;
+         int p = stb__arith_cm_predict(m, node, st);
+         stb__arith_encode_p(a, p, bit);
+         stb__arith_cm_update(m, node, st, p, bit);
+         node = node*2 + bit;
+      }
+      m->prev = byte & 255;
+   } else {
+      if (a->bytes == NULL && (a->bytes = stb_arith_state_create(256)) == NULL)
+         return;
+      stb_arith_encode_sym(a, a->bytes, byte & 255);
+   }
 }
 
 int  stb_arith_decode_byte(stb_arith *a)
 {
-   return -1;
+   stb__arith_cm *m = a->cm;
+   if (m) {
+      int node = 1, i, st[2];
+      for (i=0; i < 8; ++i) {
+         int p = stb__arith_cm_predict(m, node, st);
+         int bit = stb__arith_decode_p(a, p);
+         stb__arith_cm_update(m, node, st, p, bit);
+         node = node*2 + bit;
+      }
+      return m->prev = node & 255;
+   } else {
+      if (a->bytes == NULL && (a->bytes = stb_arith_state_create(256)) == NULL)
+         return -1;
+      return stb_arith_decode_sym(a, a->bytes);
+   }
 }
 #endif
 
+
 //////////////////////////////////////////////////////////////////////////////
 //
-//                         Threads
+//  stb_compress entropy-coded format
+//
+//  The same LZ77 token stream as the byte format, coded through stb_arith
+//  with adaptive binary models (in the style of LZMA's bit trees):
 //
+//     is_match[state]         0 = literal, 1 = match
+//     is_rep[state]           match reuses the previous match's distance
+//     literal                 8-bit tree, context = top 3 bits of previous byte
+//     length                  len-3 (len-2 for repeats), as a number
+//     distance                dist-1, as a number, slot context = min(len-3,3)
+//
+//  A number v is coded as the bit count of v+1 (5-bit tree), then the bits
+//  below its leading 1: all modeled if there are at most 4 of them, else the
+//  top ones raw and the bottom 4 modeled. 'state' is the previous token's
+//  type. There's no end token; the header has the length.
 
-#ifndef WIN32
-#ifdef STB_THREADS
-#error "threads not implemented except for Windows"
-#endif
-#endif
+#ifdef STB_DEFINE
+
+typedef struct
+{
+   stb_arith_prob slot[4][32];
+   stb_arith_prob low[5][16];
+   stb_arith_prob align[16];
+} stb__arith_number;
+
+typedef struct stb__arith_lz
+{
+   stb_arith a;
+   stbfile out;
+   stb_arith_prob is_match[3], is_rep[3];
+   stb_arith_prob literal[8][256];
+   stb__arith_number len, replen, dist;
+   int state, rep, prev;
+} stb__arith_lz;
+
+static void stb__arith_lz_init(stb__arith_lz *z)
+{
+   stb_arith_prob *p = z->is_match, *end = (stb_arith_prob *) (&z->dist + 1);
+   // every model is a contiguous run of probabilities
+   while (p < end)
+      *p++ = STB_ARITH_PROB_INIT;
+   z->state = z->rep = z->prev = 0;
+}
+
+static void stb__arith_encode_tree(stb_arith *a, stb_arith_prob *probs, int bits, int v)
+{
+   int m = 1;
+   while (bits--) {
+      int b = (v >> bits) & 1;
+      stb_arith_encode_bit(a, &probs[m], b);
+      m = (m << 1) + b;
+   }
+}
+
+static int stb__arith_decode_tree(stb_arith *a, stb_arith_prob *probs, int bits)
+{
+   int i, m = 1;
+   for (i=0; i < bits; ++i)
+      m = (m << 1) + stb_arith_decode_bit(a, &probs[m]);
+   return m - (1 << bits);
+}
+
+static void stb__arith_encode_number(stb_arith *a, stb__arith_number *n, int ctx, stb_uint v)
+{
+   stb_uint x = v+1;
+   int e = 0;
+   while ((x >> e) > 1) ++e;
+   stb__arith_encode_tree(a, n->slot[ctx], 5, e);
+   x -= 1 << e;
+   if (e <= 4)
+      stb__arith_encode_tree(a, n->low[e], e, x);
+   else {
+      int raw = e-4;
+      stb_uint hi = x >> 4;
+      while (raw > 16) {
+         raw -= 16;
+         stb_arith_encode_log2(a, 16, 1, (hi >> raw) & 0xffff);
+      }
+      stb_arith_encode_log2(a, raw, 1, hi & ((1 << raw)-1));
+      stb__arith_encode_tree(a, n->align, 4, x & 15);
+   }
+}
+
+static stb_uint stb__arith_decode_number(stb_arith *a, stb__arith_number *n, int ctx)
+{
+   int e = stb__arith_decode_tree(a, n->slot[ctx], 5);
+   stb_uint x;
+   if (e <= 4)
+      x = stb__arith_decode_tree(a, n->low[e], e);
+   else {
+      int raw = e-4, k;
+      x = 0;
+      while (raw > 0) {
+         int bits = raw > 16 ? 16 : raw;
+         raw -= bits;
+         k = stb_arith_decode_value_log2(a, bits);
+         stb_arith_decode_advance_log2(a, bits, 1, k);
+         x = (x << bits) + k;
+      }
+      x = (x << 4) + stb__arith_decode_tree(a, n->align, 4);
+   }
+   return (((stb_uint) 1 << e) + x) - 1;
+}
+
+static int stb__arith_outbyte(stbfile *f, int ch)
+{
+   stb_compress_context *c = (stb_compress_context *) f->ptr;
+   stb_out(c, ch);
+   return 1;
+}
+
+static int stb__arith_start(stb_compress_context *c)
+{
+   c->arith = (stb__arith_lz *) malloc(sizeof(*c->arith));
+   if (c->arith == NULL) return 0;
+   memset(&c->arith->out, 0, sizeof(c->arith->out));
+   c->arith->out.putbyte = stb__arith_outbyte;
+   c->arith->out.ptr = c;
+   stb_arith_init_encode(&c->arith->a, &c->arith->out);
+   stb__arith_lz_init(c->arith);
+   return 1;
+}
+
+static void stb__arith_end(stb_compress_context *c)
+{
+   stb_arith_encode_close(&c->arith->a);
+   free(c->arith);
+   c->arith = NULL;
+}
+
+static int stb__arith_repdist(stb_compress_context *c)
+{
+   return c->arith->rep;
+}
+
+static void stb__arith_literals(stb_compress_context *c, stb_uchar *in, int numlit)
+{
+   stb__arith_lz *z = c->arith;
+   int i;
+   for (i=0; i < numlit; ++i) {
+      stb_arith_encode_bit(&z->a, &z->is_match[z->state], 0);
+      stb__arith_encode_tree(&z->a, z->literal[z->prev >> 5], 8, in[i]);
+      z->prev = in[i];
+      z->state = 0;
+   }
+}
+
+static void stb__arith_match(stb_compress_context *c, stb_uchar *q, int len, int dist)
+{
+   stb__arith_lz *z = c->arith;
+   stb_arith_encode_bit(&z->a, &z->is_match[z->state], 1);
+   if (dist == z->rep) {
+      stb_arith_encode_bit(&z->a, &z->is_rep[z->state], 1);
+      stb__arith_encode_number(&z->a, &z->replen, 0, len-2);
+      z->state = 2;
+   } else {
+      assert(len >= 3);
+      if (z->rep)
+         stb_arith_encode_bit(&z->a, &z->is_rep[z->state], 0);
+      stb__arith_encode_number(&z->a, &z->len, 0, len-3);
+      stb__arith_encode_number(&z->a, &z->dist, len-3 < 3 ? len-3 : 3, dist-1);
+      z->rep = dist;
+      z->state = 1;
+   }
+   z->prev = q[len-1];
+}
+
+// returns a literal byte, or -1 for a match (the caller must set z->prev
+// to the last byte of the match once it's copied)
+static int stb__arith_decode_token(stb__arith_lz *z, stb_uint *len, stb_uint *dist)
+{
+   if (!stb_arith_decode_bit(&z->a, &z->is_match[z->state])) {
+      z->prev = stb__arith_decode_tree(&z->a, z->literal[z->prev >> 5], 8);
+      z->state = 0;
+      return z->prev;
+   }
+   if (z->rep && stb_arith_decode_bit(&z->a, &z->is_rep[z->state])) {
+      *len  = stb__arith_decode_number(&z->a, &z->replen, 0) + 2;
+      *dist = z->rep;
+      z->state = 2;
+   } else {
+      *len  = stb__arith_decode_number(&z->a, &z->len, 0) + 3;
+      *dist = stb__arith_decode_number(&z->a, &z->dist, *len-3 < 3 ? *len-3 : 3) + 1;
+      z->rep = *dist;
+      z->state = 1;
+   }
+   return -1;
+}
+
+static stb_uint stb__decompress_arith(stb_uchar *output, stb_uchar *i, stb_uint length)
+{
+   stb_uint olen = stb_decompress_length(i), len, dist;
+   stb_uchar *out = output, *end = output + olen;
+   stb__arith_lz *z;
+   stbfile in;
+
+   if (length < 20)      return 0;
+   if (stb__in4(4) != 0) return 0; // error! stream is > 4GB
+   z = (stb__arith_lz *) malloc(sizeof(*z));
+   if (z == NULL)        return 0;
+   stb__arith_lz_init(z);
+
+   memset(&in, 0, sizeof(in));
+   in.getbyte = stb__bgetbyte;
+   in.buffer = in.indata = i + 16;
+   in.inend = i + length;
+   stb_arith_init_decode(&z->a, &in);
+
+   while (out < end) {
+      int lit = stb__arith_decode_token(z, &len, &dist);
+      if (lit >= 0) {
+         *out++ = (stb_uchar) lit;
+         continue;
+      }
+      if (dist > (stb_uint) (out - output) || len > (stb_uint) (end - out) || dist == 0)
+         break; // corrupt
+      while (len--) {
+         *out = out[-(int) dist];
+         ++out;
+      }
+      z->prev = out[-1];
+   }
+   free(z);
+
+   // the decoder read exactly what the encoder wrote, so the checksum is next
+   if (out != end || in.indata + 4 > in.inend)
+      return 0;
+   i = in.indata;
+   if (stb_adler32(1, output, olen) != (stb_uint) stb__in4(0))
+      return 0;
+   return olen;
+}
+
+#endif // STB_DEFINE
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  stb_compress streaming decompressor
+//
+//  Decodes either format from input fed in arbitrary pieces, passing the
+//  output to a callback in pieces. Memory use is two sliding windows (the
+//  window size is in the stream header, 256KB by default) plus whatever
+//  input hasn't been consumed yet, so it works on streams that don't fit in
+//  memory. Entropy-coded streams hold back the last 64 bytes of input until
+//  more arrives or stb_decompress_stream_end is called.
+
+// return 0 to abort decompression
+typedef int stb_decompress_callback(void *userdata, stb_uchar *data, stb_uint len);
+
+typedef struct stb__decompress_stream stb_decompress_stream;
+
+STB_EXTERN stb_decompress_stream *stb_decompress_stream_new(stb_decompress_callback *out, void *userdata);
+// returns 0 if the stream is corrupt or the callback aborted
+STB_EXTERN int stb_decompress_stream_feed(stb_decompress_stream *s, stb_uchar *data, stb_uint len);
+// flushes and frees; returns 1 if the whole stream was decoded and its checksum matched
+STB_EXTERN int stb_decompress_stream_end(stb_decompress_stream *s);
+
+// decompress a whole file through the callback, reading it 64KB at a time
+STB_EXTERN int stb_decompress_file_stream(FILE *f, stb_decompress_callback *out, void *userdata);
+// a stb_decompress_callback that writes to the stbfile passed as the userdata
+STB_EXTERN int stb_decompress_to_stbfile(void *f, stb_uchar *data, stb_uint len);
+
+#ifdef STB_DEFINE
+
+#define STB__DSTREAM_MARGIN   64  // more than an entropy-coded token can read
+
+struct stb__decompress_stream
+{
+   stb_decompress_callback *callback;
+   void *userdata;
+   int failed, done, format; // format is -1 until the header arrives
+
+   stb_uchar *in;            // buffered input
+   stb_uint   in_pos, in_len, in_size;
+
+   stb_uint64 olen, produced;
+   stb_uint   window, adler;
+
+   stb_uchar *win;           // output, with 'window' bytes of history
+   stb_uint   win_pos, win_emitted, win_size;
+
+   stb_uint   lit_pending;   // byte format: literal bytes not yet arrived
+   stb__arith_lz *arith;     // entropy-coded format
+   stbfile    arith_in;
+};
+
+static void stb__dstream_emit(stb_decompress_stream *s)
+{
+   stb_uint n = s->win_pos - s->win_emitted;
+   if (n && !s->failed) {
+      s->adler = stb_adler32(s->adler, s->win + s->win_emitted, n);
+      if (!s->callback(s->userdata, s->win + s->win_emitted, n))
+         s->failed = 1;
+   }
+   s->win_emitted = s->win_pos;
+}
+
+// make room in the window buffer by discarding all but the last 'window' bytes
+static void stb__dstream_slide(stb_decompress_stream *s)
+{
+   stb_uint keep = s->window < s->win_pos ? s->window : s->win_pos;
+   stb__dstream_emit(s);
+   memmove(s->win, s->win + s->win_pos - keep, keep);
+   s->win_pos = s->win_emitted = keep;
+}
+
+static void stb__dstream_literals(stb_decompress_stream *s, stb_uchar *data, stb_uint len)
+{
+   while (len) {
+      stb_uint n;
+      if (s->win_pos == s->win_size) stb__dstream_slide(s);
+      n = s->win_size - s->win_pos;
+      if (n > len) n = len;
+      memcpy(s->win + s->win_pos, data, n);
+      s->win_pos += n;
+      s->produced += n;
+      data += n;
+      len -= n;
+   }
+}
+
+static int stb__dstream_match(stb_decompress_stream *s, stb_uint dist, stb_uint len)
+{
+   if (dist == 0 || dist > s->window || dist > s->produced || len > s->olen - s->produced)
+      return 0;
+   while (len) {
+      stb_uint n;
+      stb_uchar *p;
+      if (s->win_pos == s->win_size) stb__dstream_slide(s);
+      n = s->win_size - s->win_pos;
+      if (n > len) n = len;
+      // forward byte copy, so overlapping matches repeat
+      for (p = s->win + s->win_pos; p < s->win + s->win_pos + n; ++p)
+         *p = p[-(int) dist];
+      s->win_pos += n;
+      s->produced += n;
+      len -= n;
+   }
+   return 1;
+}
+
+static int stb__dstream_getbyte(stbfile *f)
+{
+   stb_decompress_stream *s = (stb_decompress_stream *) f->ptr;
+   return s->in_pos < s->in_len ? s->in[s->in_pos++] : -1;
+}
+
+static int stb__dstream_header(stb_decompress_stream *s)
+{
+   stb_uchar *i = s->in + s->in_pos;
+   if (stb__in4(0) != 0x57bC0000 && stb__in4(0) != 0x57bC0001)
+      return 0;
+   s->format = i[3];
+   s->olen   = ((stb_uint64) (stb_uint) stb__in4(4) << 32) + (stb_uint) stb__in4(8);
+   s->window = stb__in4(12);
+   if (s->window < 0x100 || s->window > 0x1000000)
+      return 0;
+   s->win_size = s->window * 2;
+   s->win = (stb_uchar *) malloc(s->win_size);
+   if (s->win == NULL) return 0;
+   s->in_pos += 16;
+   if (s->format == 1) {
+      s->arith = (stb__arith_lz *) malloc(sizeof(*s->arith));
+      if (s->arith == NULL) return 0;
+      stb__arith_lz_init(s->arith);
+      memset(&s->arith_in, 0, sizeof(s->arith_in));
+      s->arith_in.getbyte = stb__dstream_getbyte;
+      s->arith_in.ptr = s;
+   }
+   return 1;
+}
+
+static int stb__dstream_checksum(stb_decompress_stream *s, stb_uchar *i)
+{
+   stb__dstream_emit(s);
+   s->done = 1;
+   return s->produced == s->olen && s->adler == (stb_uint) stb__in4(0);
+}
+
+// decode as much of the byte format as the buffered input allows
+static int stb__dstream_bytes(stb_decompress_stream *s)
+{
+   while (!s->done) {
+      stb_uchar *i = s->in + s->in_pos;
+      stb_uint avail = s->in_len - s->in_pos, size;
+
+      if (s->lit_pending) {
+         stb_uint n = s->lit_pending < avail ? s->lit_pending : avail;
+         if (n == 0) return 1;
+         stb__dstream_literals(s, i, n);
+         s->in_pos += n;
+         s->lit_pending -= n;
+         continue;
+      }
+
+      if (avail == 0) return 1;
+      if      (*i >= 0x80) size = 2;
+      else if (*i >= 0x40) size = 3;
+      else if (*i >= 0x20) size = 1;
+      else if (*i >= 0x18) size = 4;
+      else if (*i >= 0x10) size = 5;
+      else if (*i >= 0x08) size = 2;
+      else if (*i == 0x07) size = 3;
+      else if (*i == 0x06) size = 5;
+      else if (*i == 0x05 || *i == 0x04) size = 6;
+      else return 0;
+      if (avail < size) return 1;
+      s->in_pos += size;
+
+      if (*i >= 0x20) { // same token layout as stb_decompress_token
+         if (*i >= 0x80)       { if (!stb__dstream_match(s, i[1]+1, i[0] - 0x80 + 1)) return 0; }
+         else if (*i >= 0x40)  { if (!stb__dstream_match(s, stb__in2(0) - 0x4000 + 1, i[2]+1)) return 0; }
+         else /* *i >= 0x20 */ s->lit_pending = i[0] - 0x20 + 1;
+      } else {
+         if (*i >= 0x18)       { if (!stb__dstream_match(s, stb__in3(0) - 0x180000 + 1, i[3]+1)) return 0; }
+         else if (*i >= 0x10)  { if (!stb__dstream_match(s, stb__in3(0) - 0x100000 + 1, stb__in2(3)+1)) return 0; }
+         else if (*i >= 0x08)  s->lit_pending = stb__in2(0) - 0x0800 + 1;
+         else if (*i == 0x07)  s->lit_pending = stb__in2(1) + 1;
+         else if (*i == 0x06)  { if (!stb__dstream_match(s, stb__in3(1)+1, i[4]+1)) return 0; }
+         else if (*i == 0x04)  { if (!stb__dstream_match(s, stb__in3(1)+1, stb__in2(4)+1)) return 0; }
+         else /* 0x05 */ {
+            if (i[1] != 0xfa) return 0;
+            return stb__dstream_checksum(s, i+2);
+         }
+      }
+      if (s->lit_pending > s->olen - s->produced)
+         return 0;
+   }
+   return 1;
+}
+
+// decode entropy-coded tokens while enough input is buffered that no token
+// can run off the end (or all of it, if 'final')
+static int stb__dstream_arith(stb_decompress_stream *s, int final)
+{
+   stb__arith_lz *z = s->arith;
+   stb_uint len, dist;
+
+   if (s->produced == 0 && s->lit_pending == 0) {
+      // the decoder starts by reading 4 bytes; lit_pending marks that it has
+      if (!final && s->in_len - s->in_pos < STB__DSTREAM_MARGIN) return 1;
+      stb_arith_init_decode(&z->a, &s->arith_in);
+      s->lit_pending = 1;
+   }
+   while (s->produced < s->olen) {
+      int lit;
+      if (!final && s->in_len - s->in_pos < STB__DSTREAM_MARGIN) return 1;
+      lit = stb__arith_decode_token(z, &len, &dist);
+      if (lit >= 0) {
+         stb_uchar c = (stb_uchar) lit;
+         stb__dstream_literals(s, &c, 1);
+      } else {
+         if (!stb__dstream_match(s, dist, len)) return 0;
+         z->prev = s->win[s->win_pos-1];
+      }
+   }
+   if (s->in_len - s->in_pos < 4) return !final;
+   s->in_pos += 4;
+   return stb__dstream_checksum(s, s->in + s->in_pos - 4);
+}
+
+static int stb__dstream_run(stb_decompress_stream *s, int final)
+{
+   if (s->format < 0) {
+      if (s->in_len - s->in_pos < 16) return !final;
+      if (!stb__dstream_header(s)) return 0;
+   }
+   if (s->format == 1)
+      return stb__dstream_arith(s, final);
+   else
+      return stb__dstream_bytes(s);
+}
+
+stb_decompress_stream *stb_decompress_stream_new(stb_decompress_callback *out, void *userdata)
+{
+   stb_decompress_stream *s = (stb_decompress_stream *) malloc(sizeof(*s));
+   if (s) {
+      memset(s, 0, sizeof(*s));
+      s->callback = out;
+      s->userdata = userdata;
+      s->format = -1;
+      s->adler = 1;
+   }
+   return s;
+}
+
+int stb_decompress_stream_feed(stb_decompress_stream *s, stb_uchar *data, stb_uint len)
+{
+   if (s->failed) return 0;
+   if (s->done) return len == 0; // trailing garbage
+
+   // drop consumed input, then append the new data
+   if (s->in_pos) {
+      memmove(s->in, s->in + s->in_pos, s->in_len - s->in_pos);
+      s->in_len -= s->in_pos;
+      s->in_pos = 0;
+   }
+   if (s->in_len + len > s->in_size) {
+      stb_uint size = s->in_size ? s->in_size : 4096;
+      stb_uchar *p;
+      while (size < s->in_len + len) size *= 2;
+      p = (stb_uchar *) realloc(s->in, size);
+      if (p == NULL) { s->failed = 1; return 0; }
+      s->in = p;
+      s->in_size = size;
+   }
+   memcpy(s->in + s->in_len, data, len);
+   s->in_len += len;
+
+   if (!stb__dstream_run(s, 0))
+      s->failed = 1;
+   else if (s->win)
+      stb__dstream_emit(s);
+   return !s->failed;
+}
+
+int stb_decompress_stream_end(stb_decompress_stream *s)
+{
+   int ok = !s->failed && stb__dstream_run(s, 1) && s->done && !s->failed;
+   free(s->in);
+   free(s->win);
+   free(s->arith);
+   free(s);
+   return ok;
+}
+
+int stb_decompress_file_stream(FILE *f, stb_decompress_callback *out, void *userdata)
+{
+   stb_uchar buffer[65536];
+   stb_decompress_stream *s = stb_decompress_stream_new(out, userdata);
+   size_t n;
+   if (s == NULL) return 0;
+   while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+      if (!stb_decompress_stream_feed(s, buffer, (stb_uint) n))
+         break;
+   return stb_decompress_stream_end(s);
+}
+
+int stb_decompress_to_stbfile(void *f, stb_uchar *data, stb_uint len)
+{
+   return stb_putdata((stbfile *) f, data, len) == len;
+}
+
+#endif // STB_DEFINE
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//                         Threads
+//
 
 // call this function to free any global variables for memory testing
 STB_EXTERN void stb_thread_cleanup(void);
@@ -11155,12 +13293,50 @@ typedef struct stb__workqueue stb_workqueue;
 
 STB_EXTERN stb_workqueue*stb_workq_new(int numthreads, int max_units);
 STB_EXTERN stb_workqueue*stb_workq_new_flags(int numthreads, int max_units, int no_add_mutex, int no_remove_mutex);
+// work-stealing: each worker has its own deque. work queued from a task running
+// on one of the workers goes on that worker's deque (and runs most-recent-first),
+// other work goes on a shared queue, and idle workers steal from the others.
+// there's no limit on the number of units, and at most 256 threads
+STB_EXTERN stb_workqueue*stb_workq_new_stealing(int numthreads);
 STB_EXTERN void          stb_workq_delete(stb_workqueue *q);
 STB_EXTERN void          stb_workq_numthreads(stb_workqueue *q, int n);
 STB_EXTERN int           stb_workq(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code);
 STB_EXTERN int           stb_workq_reach(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code, stb_sync rel);
 STB_EXTERN int           stb_workq_length(stb_workqueue *q);
 
+// parallel for: calls fn(ctx, i0, i1) on pieces of [begin,end) at most 'grain'
+// long (or a size chosen from the thread count if grain <= 0), using the
+// queue's threads plus the calling thread, and returns when all are done.
+// safe to call from inside work on the same queue
+typedef void (*stb_range_func)(void *ctx, int begin, int end);
+STB_EXTERN void          stb_parallel_for (int begin, int end, int grain, stb_range_func fn, void *ctx);
+STB_EXTERN void          stb_parallel_forq(stb_workqueue *q, int begin, int end, int grain, stb_range_func fn, void *ctx);
+
+// task graphs: tasks run on a workqueue once all the tasks they depend on have
+// finished; the return value of f goes in *return_code if non-NULL, e.g.
+//
+//    for (i=0; i < n; ++i) {
+//       stb_task *t = stb_task_add(g, decode, &img[i], NULL);
+//       t = stb_task_then(t, resize, &img[i], NULL);
+//       stb_task_then(t, compress, &img[i], NULL);
+//    }
+//    stb_taskgraph_wait(g);
+//
+// nothing starts until stb_taskgraph_run or _wait; tasks added after that
+// (including from other tasks) wait for the next call. stb_task_after can
+// only be used on tasks that haven't been started yet. only one thread may
+// wait, and not from a task in the graph; q==NULL uses the stb_work queue
+typedef struct stb__taskgraph stb_taskgraph;
+typedef struct stb__task      stb_task;
+
+STB_EXTERN stb_taskgraph*stb_taskgraph_new(stb_workqueue *q);
+STB_EXTERN void          stb_taskgraph_delete(stb_taskgraph *g);  // waits first
+STB_EXTERN stb_task *    stb_task_add (stb_taskgraph *g, stb_thread_func f, void *d, volatile void **return_code);
+STB_EXTERN void          stb_task_after(stb_task *t, stb_task *dependency);
+STB_EXTERN stb_task *    stb_task_then(stb_task *t, stb_thread_func f, void *d, volatile void **return_code);
+STB_EXTERN void          stb_taskgraph_run (stb_taskgraph *g);
+STB_EXTERN void          stb_taskgraph_wait(stb_taskgraph *g);    // run, and wait for every task
+
 STB_EXTERN stb_thread    stb_create_thread (stb_thread_func f, void *d);
 STB_EXTERN stb_thread    stb_create_thread2(stb_thread_func f, void *d, volatile void **return_code, stb_semaphore rel);
 STB_EXTERN void          stb_destroy_thread(stb_thread t);
@@ -11184,6 +13360,9 @@ STB_EXTERN int           stb_sync_reach(stb_sync s);
 
 typedef struct stb__threadqueue stb_threadqueue;
 #define STB_THREADQ_DYNAMIC   0
+// a fixed-size queue, which holds num_items, is lock-free; with !many_add or
+// !many_remove, only one thread at a time may add or remove, respectively.
+// STB_THREADQ_DYNAMIC uses mutexes
 STB_EXTERN stb_threadqueue *stb_threadq_new(int item_size, int num_items, int many_add, int many_remove);
 STB_EXTERN void             stb_threadq_delete(stb_threadqueue *tq);
 STB_EXTERN int              stb_threadq_get(stb_threadqueue *tq, void *output);
@@ -11203,12 +13382,33 @@ typedef struct
    stb_semaphore sem;
 } stb__thread;
 
-// this is initialized along all possible paths to create threads, therefore
-// it's always initialized before any other threads are create, therefore
-// it's free of races AS LONG AS you only create threads through stb_*
-static stb_mutex stb__threadmutex, stb__workmutex;
-
-static void stb__threadmutex_init(void)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define stb__atomic_add(p,v)     _InterlockedExchangeAdd((long volatile *) (p), (v))
+#define stb__atomic_cas(p,o,n)   (_InterlockedCompareExchange((long volatile *) (p), (long) (n), (long) (o)) == (long) (o))
+#define STB__THREADLOCAL         __declspec(thread)
+#else
+#define stb__atomic_add(p,v)     __sync_fetch_and_add(p,v)
+#define stb__atomic_cas(p,o,n)   __sync_bool_compare_and_swap(p,o,n)
+#define STB__THREADLOCAL         __thread
+#endif
+
+// orders loads and stores for acquire/release handoffs. x86 never reorders
+// those with each other, so it only needs to stop the compiler
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define stb__order()             _ReadWriteBarrier()
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define stb__order()             __asm__ __volatile__("" ::: "memory")
+#else
+#define stb__order()             stb_barrier()
+#endif
+
+// this is initialized along all possible paths to create threads, therefore
+// it's always initialized before any other threads are create, therefore
+// it's free of races AS LONG AS you only create threads through stb_*
+static stb_mutex stb__threadmutex, stb__workmutex;
+
+static void stb__threadmutex_init(void)
 {
    if (stb__threadmutex == STB_SEMAPHORE_NULL) {
       stb__threadmutex = stb_mutex_new();
@@ -11421,6 +13621,264 @@ inline unsigned __int64 _InterlockedCompareExchange64(volatile unsigned __int64
     } 
 #endif // #if 0
 
+#else // !_WIN32
+
+// POSIX: pthreads for threads and mutexes; semaphores are a counter
+// plus a futex on Linux, or a pthread condition variable elsewhere
+#include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+void stb_barrier(void)
+{
+   __sync_synchronize();
+}
+
+static void *stb__thread_run(void *t)
+{
+   void *res;
+   stb__thread info = * (stb__thread *) t;
+   free(t);
+   res = info.f(info.d);
+   if (info.return_val)
+      *info.return_val = res;
+   if (info.sem != STB_SEMAPHORE_NULL)
+      stb_sem_release(info.sem);
+   return NULL;
+}
+
+static stb_thread stb_create_thread_raw(stb_thread_func f, void *d, volatile void **return_code, stb_semaphore rel)
+{
+#if defined(STB_FASTMALLOC) && !defined(STB_FASTMALLOC_ITS_OKAY_I_ONLY_MALLOC_IN_ONE_THREAD)
+   stb_fatal("Error! Cannot use STB_FASTMALLOC with threads.\n");
+   return STB_THREAD_NULL;
+#else
+   pthread_t id;
+   pthread_attr_t attr;
+   int err;
+   stb__thread *data = (stb__thread *) malloc(sizeof(*data));
+   if (!data) return NULL;
+   stb__threadmutex_init();
+   data->f = f;
+   data->d = d;
+   data->return_val = return_code;
+   data->sem = rel;
+   // threads are never joined, same as _beginthread
+   pthread_attr_init(&attr);
+   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+   err = pthread_create(&id, &attr, stb__thread_run, data);
+   pthread_attr_destroy(&attr);
+   if (err) {
+      free(data);
+      return NULL;
+   }
+   return (void *) id;
+#endif
+}
+
+void stb_destroy_thread(stb_thread t) { pthread_cancel((pthread_t) t); }
+
+typedef struct
+{
+   volatile int count; // on Linux, twice the count, plus 1 if there may be sleepers
+   int max;
+#ifdef __linux__
+   volatile int waiters; // only touched by waiters
+#else
+   pthread_mutex_t mutex;
+   pthread_cond_t  cond;
+#endif
+} stb__sem;
+
+stb_semaphore stb_sem_new_extra(int maxv, int start)
+{
+   stb__sem *s = (stb__sem *) malloc(sizeof(*s));
+   if (s) {
+      s->max = maxv;
+      #ifdef __linux__
+      s->count = start*2;
+      s->waiters = 0;
+      #else
+      s->count = start;
+      pthread_mutex_init(&s->mutex, NULL);
+      pthread_cond_init(&s->cond, NULL);
+      #endif
+   }
+   return s;
+}
+
+stb_semaphore stb_sem_new(int maxv) { return stb_sem_new_extra(maxv, 0); }
+
+void stb_sem_delete(stb_semaphore s)
+{
+   if (s != NULL) {
+      #ifndef __linux__
+      pthread_mutex_destroy(&((stb__sem *) s)->mutex);
+      pthread_cond_destroy(&((stb__sem *) s)->cond);
+      #endif
+      free(s);
+   }
+}
+
+#ifdef __linux__
+// the sleepers flag lives in the count word, the way glibc's 32-bit
+// sem_t does it, so stb_sem_release never reads *s after publishing the
+// count: a waiter may take it and stb_sem_delete the semaphore right away
+void stb_sem_waitfor(stb_semaphore p)
+{
+   stb__sem *s = (stb__sem *) p;
+   int c = s->count;
+   while (c >= 2) {
+      if (__sync_bool_compare_and_swap(&s->count, c, c-2))
+         return;
+      c = s->count;
+   }
+   __sync_fetch_and_add(&s->waiters, 1);
+   for(;;) {
+      c = s->count;
+      if (c >= 2) {
+         if (__sync_bool_compare_and_swap(&s->count, c, c-2))
+            break;
+      } else if (c == 1 || __sync_bool_compare_and_swap(&s->count, 0, 1)) {
+         // the kernel only sleeps if the word is still 1, so a release
+         // between the check and the sleep can't be lost
+         syscall(SYS_futex, &s->count, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+      }
+   }
+   // the last waiter out clears the flag; if another waiter arrived in
+   // the meantime, set it again and pass on a wakeup
+   if (s->waiters == 1) {
+      __sync_fetch_and_and(&s->count, ~1);
+      if (__sync_fetch_and_sub(&s->waiters, 1) > 1) {
+         __sync_fetch_and_or(&s->count, 1);
+         syscall(SYS_futex, &s->count, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+      }
+   } else
+      __sync_fetch_and_sub(&s->waiters, 1);
+}
+
+// like ReleaseSemaphore, releasing past the max does nothing
+void stb_sem_release(stb_semaphore p)
+{
+   stb__sem *s = (stb__sem *) p;
+   int max = s->max, c = s->count, prev;
+   for(;;) {
+      if ((c >> 1) >= max)
+         return;
+      prev = __sync_val_compare_and_swap(&s->count, c, c+2);
+      if (prev == c)
+         break;
+      c = prev;
+   }
+   // FUTEX_WAKE only uses the address, so it's harmless if s is gone
+   if (c & 1)
+      syscall(SYS_futex, &s->count, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#else
+void stb_sem_waitfor(stb_semaphore p)
+{
+   stb__sem *s = (stb__sem *) p;
+   pthread_mutex_lock(&s->mutex);
+   while (s->count == 0)
+      pthread_cond_wait(&s->cond, &s->mutex);
+   --s->count;
+   pthread_mutex_unlock(&s->mutex);
+}
+
+void stb_sem_release(stb_semaphore p)
+{
+   stb__sem *s = (stb__sem *) p;
+   pthread_mutex_lock(&s->mutex);
+   if (s->count < s->max) {
+      ++s->count;
+      pthread_cond_signal(&s->cond);
+   }
+   pthread_mutex_unlock(&s->mutex);
+}
+#endif
+
+// like Sleep(0), 0 just gives up the rest of the timeslice
+static void stb__thread_sleep(int ms)
+{
+   struct timespec t;
+   if (ms == 0) { sched_yield(); return; }
+   t.tv_sec  = ms / 1000;
+   t.tv_nsec = (ms % 1000) * 1000000;
+   nanosleep(&t, NULL);
+}
+
+int stb_processor_count(void)
+{
+#ifdef __linux__
+   unsigned long mask[1024 / (8*sizeof(unsigned long))];
+   long i, n = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+   int count = 0;
+   for (i=0; i < n / (long) sizeof(mask[0]); ++i)
+      for (; mask[i]; mask[i] &= mask[i]-1)
+         ++count;
+   if (count > 0)
+      return count;
+#endif
+   return (int) sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+void stb_force_uniprocessor(void)
+{
+#ifdef __linux__
+   unsigned long mask[1024 / (8*sizeof(unsigned long))];
+   long i, n = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+   for (i=0; i < n / (long) sizeof(mask[0]); ++i) {
+      if (mask[i]) {
+         unsigned long bit = mask[i] & (~mask[i] + 1);
+         memset(mask, 0, sizeof(mask));
+         mask[i] = bit;
+         syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+         break;
+      }
+   }
+#endif
+}
+
+// recursive, like a CRITICAL_SECTION; stb__io_init relies on this
+#define STB_MUTEX_NATIVE
+void *stb_mutex_new(void)
+{
+   pthread_mutex_t *p = (pthread_mutex_t *) malloc(sizeof(*p));
+   if (p) {
+      pthread_mutexattr_t attr;
+      pthread_mutexattr_init(&attr);
+      pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+      pthread_mutex_init(p, &attr);
+      pthread_mutexattr_destroy(&attr);
+   }
+   return p;
+}
+
+void stb_mutex_delete(void *p)
+{
+   if (p) {
+      pthread_mutex_destroy((pthread_mutex_t *) p);
+      free(p);
+   }
+}
+
+void stb_mutex_begin(void *p)
+{
+   stb__wait(500);
+   if (p)
+      pthread_mutex_lock((pthread_mutex_t *) p);
+}
+
+void stb_mutex_end(void *p)
+{
+   if (p)
+      pthread_mutex_unlock((pthread_mutex_t *) p);
+   stb__wait(500);
+}
+
 #endif // _WIN32
 
 stb_thread stb_create_thread2(stb_thread_func f, void *d, volatile void **return_code, stb_semaphore rel)
@@ -11466,7 +13924,7 @@ stb_sync stb_sync_new(void)
    s->release = stb_sem_new(1);
    if (s->mutex == STB_MUTEX_NULL || s->release == STB_SEMAPHORE_NULL || s->start == STB_MUTEX_NULL) {
       stb_mutex_delete(s->mutex);
-      stb_mutex_delete(s->mutex);
+      stb_mutex_delete(s->start);
       stb_sem_delete(s->release);
       free(s);
       return NULL;
@@ -11482,7 +13940,8 @@ void stb_sync_delete(stb_sync s)
       assert(0);
    }
    stb_mutex_delete(s->mutex);
-   stb_mutex_delete(s->release);
+   stb_mutex_delete(s->start);
+   stb_sem_delete(s->release);
    free(s);
 }
 
@@ -11555,6 +14014,21 @@ void stb_sync_reach_and_wait(stb_sync s)
 
 struct stb__threadqueue
 {
+   // fixed-size queues are a lock-free ring (Vyukov's bounded MPMC queue):
+   // each slot has a sequence number saying whether it's ready to be written
+   // (seq == pos) or read (seq == pos+1) by whoever claims position 'pos'.
+   // positions are claimed with a CAS, or a plain store if there's only one
+   // adder/remover. threads only block (on the semaphores) when full/empty
+   volatile unsigned int enq;
+   char pad1[60];
+   volatile unsigned int deq;
+   char pad2[60];
+   volatile int get_blockers, add_blockers;
+   unsigned int mask, slot_size;
+   unsigned int capacity;  // num_items; the ring is rounded up to a power of two
+   int lockfree, many_add, many_remove;
+
+   // growable queues use mutexes
    stb_mutex add, remove;
    stb_semaphore nonempty, nonfull;
    int head_blockers;  // number of threads blocking--used to know whether to release(avail)
@@ -11572,9 +14046,96 @@ static int stb__tq_wrap(volatile stb_threadqueue *z, int p)
       return p;
 }
 
+#define stb__tq_slot(tq,pos)   ((tq)->data + ((pos) & (tq)->mask) * (tq)->slot_size)
+#define stb__tq_seq(slot)      (*(volatile unsigned int *) (slot))
+#define STB__TQ_ITEM           8   // offset of the item in a slot
+#define STB__TQ_SPIN           16  // times to yield before blocking
+
+static int stb__threadq_ring_add(stb_threadqueue *tq, void *input)
+{
+   unsigned int pos = tq->enq;
+   char *slot;
+   for(;;) {
+      int dif;
+      slot = stb__tq_slot(tq, pos);
+      dif = (int) (stb__tq_seq(slot) - pos);
+      if (dif == 0) {
+         // deq only grows, so if this says it's full, it was full
+         if (tq->capacity <= tq->mask && pos - tq->deq >= tq->capacity)
+            return STB_FALSE;
+         if (!tq->many_add) { tq->enq = pos+1; break; }
+         if (stb__atomic_cas(&tq->enq, pos, pos+1)) break;
+      } else if (dif < 0)
+         return STB_FALSE; // full
+      pos = tq->enq;
+   }
+   stb__order();
+   memcpy(slot + STB__TQ_ITEM, input, tq->item_size);
+   stb__order();
+   stb__tq_seq(slot) = pos+1;
+   return STB_TRUE;
+}
+
+static int stb__threadq_ring_get(stb_threadqueue *tq, void *output)
+{
+   unsigned int pos = tq->deq;
+   char *slot;
+   for(;;) {
+      int dif;
+      slot = stb__tq_slot(tq, pos);
+      dif = (int) (stb__tq_seq(slot) - (pos+1));
+      if (dif == 0) {
+         if (!tq->many_remove) { tq->deq = pos+1; break; }
+         if (stb__atomic_cas(&tq->deq, pos, pos+1)) break;
+      } else if (dif < 0)
+         return STB_FALSE; // empty
+      pos = tq->deq;
+   }
+   stb__order();
+   memcpy(output, slot + STB__TQ_ITEM, tq->item_size);
+   stb__order();
+   stb__tq_seq(slot) = pos + tq->mask+1;
+   return STB_TRUE;
+}
+
+// 'blockers' counts threads that are, or are about to be, asleep on 'sem'.
+// they bump it and then retry once more before sleeping, and the other side
+// checks it after its operation, with full barriers between, so either the
+// retry succeeds or the other side sees them and wakes one
+static int stb__threadq_ring_op(stb_threadqueue *tq, void *data, int add, int block)
+{
+   volatile int *blockers = add ? &tq->add_blockers : &tq->get_blockers;
+   volatile int *others   = add ? &tq->get_blockers : &tq->add_blockers;
+   stb_semaphore sem      = add ? tq->nonfull : tq->nonempty;
+   int ok, spin = 0;
+   for(;;) {
+      ok = add ? stb__threadq_ring_add(tq, data) : stb__threadq_ring_get(tq, data);
+      if (ok || !block) break;
+      // give the other side a chance before going to sleep, since once
+      // there are blockers every operation has to signal the semaphore
+      if (spin < STB__TQ_SPIN) { ++spin; stb__thread_sleep(0); continue; }
+      stb__atomic_add(blockers, 1);
+      stb_barrier();
+      ok = add ? stb__threadq_ring_add(tq, data) : stb__threadq_ring_get(tq, data);
+      if (!ok)
+         stb_sem_waitfor(sem);
+      stb__atomic_add(blockers, -1);
+      if (ok) break;
+      // the semaphore only counts to 1, so pass the wakeup on
+      if (*blockers) stb_sem_release(sem);
+   }
+   if (ok) {
+      stb_barrier();
+      if (*others)
+         stb_sem_release(add ? tq->nonempty : tq->nonfull);
+   }
+   return ok;
+}
+
 int stb__threadq_get_raw(stb_threadqueue *tq2, void *output, int block)
 {
    volatile stb_threadqueue *tq = (volatile stb_threadqueue *) tq2;
+   if (tq2->lockfree) return stb__threadq_ring_op(tq2, output, STB_FALSE, block);
    if (tq->head == tq->tail && !block) return 0;
 
    stb_mutex_begin(tq->remove);
@@ -11634,6 +14195,7 @@ int stb__threadq_add_raw(stb_threadqueue *tq2, void *input, int block)
 {
    int tail,pos;
    volatile stb_threadqueue *tq = (volatile stb_threadqueue *) tq2;
+   if (tq2->lockfree) return stb__threadq_ring_op(tq2, input, STB_TRUE, block);
    stb_mutex_begin(tq->add);
    for(;;) {
       pos = tq->tail;
@@ -11673,6 +14235,10 @@ int stb_threadq_length(stb_threadqueue *tq2)
 {
    int a,b,n;
    volatile stb_threadqueue *tq = (volatile stb_threadqueue *) tq2;
+   if (tq2->lockfree) {
+      n = (int) (tq->enq - tq->deq);
+      return n < 0 ? 0 : n;
+   }
    stb_mutex_begin(tq->add);
    a = tq->head;
    b = tq->tail;
@@ -11717,7 +14283,6 @@ void stb_threadq_delete(stb_threadqueue *tq)
 #define STB_THREADQUEUE_DYNAMIC   0
 stb_threadqueue *stb_threadq_new(int item_size, int num_items, int many_add, int many_remove)
 {
-   int error=0;
    stb_threadqueue *tq = (stb_threadqueue *) malloc(sizeof(*tq));
    if (tq == NULL) return NULL;
 
@@ -11733,6 +14298,28 @@ stb_threadqueue *stb_threadq_new(int item_size, int num_items, int many_add, int
    tq->add = tq->remove = STB_MUTEX_NULL;
    tq->nonempty = tq->nonfull = STB_SEMAPHORE_NULL;
    tq->data = NULL;
+   tq->lockfree = !tq->growable;
+   tq->many_add = many_add;
+   tq->many_remove = many_remove;
+   tq->get_blockers = tq->add_blockers = 0;
+
+   if (tq->lockfree) {
+      unsigned int i, size = 2;
+      while (size < (unsigned int) num_items)
+         size *= 2;
+      tq->mask = size-1;
+      tq->capacity = num_items;
+      tq->slot_size = (STB__TQ_ITEM + item_size + 7) & ~7;
+      tq->enq = tq->deq = 0;
+      tq->nonempty = stb_sem_new(1); if (tq->nonempty == STB_SEMAPHORE_NULL) goto error;
+      tq->nonfull  = stb_sem_new(1); if (tq->nonfull  == STB_SEMAPHORE_NULL) goto error;
+      tq->data = (char *) malloc(size * tq->slot_size);
+      if (tq->data == NULL) goto error;
+      for (i=0; i < size; ++i)
+         stb__tq_seq(stb__tq_slot(tq, i)) = i;
+      return tq;
+   }
+
    if (many_add)
       { tq->add    = stb_mutex_new(); if (tq->add    == STB_MUTEX_NULL) goto error; }
    if (many_remove || tq->growable)
@@ -11762,201 +14349,1397 @@ typedef struct
 
 //static volatile stb__workinfo *stb__work;
 
+struct stb__wsq;
+
 struct stb__workqueue
 {
    int numthreads;
-   stb_threadqueue *tq;
+   volatile int running;  // threads that haven't exited yet
+   stb_threadqueue *tq;   // work-stealing: work added from outside the workers
+   struct stb__wsq *ws;   // NULL unless work-stealing
 };
 
 static stb_workqueue *stb__work_global;
 
+static void stb__workinfo_run(stb__workinfo *w)
+{
+   void *z = w->f(w->d);
+   if (w->retval) { stb_barrier(); *w->retval = z; }
+   if (w->sync != STB_SYNC_NULL) stb_sync_reach(w->sync);
+}
+
 static void *stb__thread_workloop(void *p)
 {
    volatile stb_workqueue *q = (volatile stb_workqueue *) p;
    for(;;) {
-      void *z;
       stb__workinfo w;
       stb_threadq_get_block(q->tq, &w);
-      if (w.f == NULL) // null work is a signal to end the thread
+      if (w.f == NULL) { // null work is a signal to end the thread
+         stb__atomic_add(&q->running, -1);
          return NULL;
-      z = w.f(w.d);
-      if (w.retval) { stb_barrier(); *w.retval = z; }
-      if (w.sync != STB_SYNC_NULL) stb_sync_reach(w.sync);
+      }
+      stb__workinfo_run(&w);
    }
 }
 
-stb_workqueue *stb_workq_new(int num_threads, int max_units)
+////////////////////////   work-stealing queues   ///////////////////////
+//
+// each worker owns a Chase-Lev deque: the owner pushes and pops at the
+// bottom with no locking, and thieves take from the top with one CAS.
+// top and bottom only ever increase (mod 2^32), so a slot is reused only
+// after a CAS on top has moved past it; a thief that copies a slot while
+// it's being overwritten will always fail its CAS and throw the copy away.
+
+#define STB__WS_MAX_THREADS   256
+#define STB__WS_INITIAL       256   // initial deque size, a power of two
+
+typedef struct
 {
-   return stb_workq_new_flags(num_threads, max_units, 0,0);
-}
+   unsigned int mask;
+   stb__workinfo item[1];
+} stb__wsbuf;
 
-stb_workqueue *stb_workq_new_flags(int numthreads, int max_units, int no_add_mutex, int no_remove_mutex)
+typedef struct
 {
-   stb_workqueue *q = (stb_workqueue *) malloc(sizeof(*q));
-   if (q == NULL) return NULL;
-   q->tq = stb_threadq_new(sizeof(stb__workinfo), max_units, !no_add_mutex, !no_remove_mutex);
-   if (q->tq == NULL) { free(q); return NULL; }
-   q->numthreads = 0;
-   stb_workq_numthreads(q, numthreads);
-   return q;
-}
+   volatile unsigned int top, bottom;
+   stb__wsbuf * volatile buf;
+   stb__wsbuf **retired;   // stb_arr of outgrown buffers; thieves may still be reading them
+   stb_workqueue *q;
+   unsigned int seed;
+} stb__wsworker;
 
-void stb_workq_delete(stb_workqueue *q)
+struct stb__wsq
 {
-   while (stb_workq_length(q) != 0)
-      stb__thread_sleep(1);
-   stb_threadq_delete(q->tq);
-   free(q);
-}
+   stb__wsworker * volatile worker[STB__WS_MAX_THREADS];
+   volatile int num_workers; // workers ever started; exited ones stay to be stolen from
+   volatile int sleepers;
+   stb_semaphore wake;
+};
 
-static int stb__work_maxitems = STB_THREADQUEUE_DYNAMIC;
+static STB__THREADLOCAL stb__wsworker *stb__ws_self;
 
-static void stb_work_init(int num_threads)
+static stb__wsbuf *stb__ws_newbuf(unsigned int size)
 {
-   if (stb__work_global == NULL) {
-      stb__threadmutex_init();
-      stb_mutex_begin(stb__workmutex);
-      stb_barrier();
-      if (*(stb_workqueue * volatile *) &stb__work_global == NULL)
-         stb__work_global = stb_workq_new(num_threads, stb__work_maxitems);
-      stb_mutex_end(stb__workmutex);
-   }
+   stb__wsbuf *a = (stb__wsbuf *) malloc(sizeof(*a) + (size-1) * sizeof(a->item[0]));
+   if (a) a->mask = size-1;
+   return a;
 }
 
-static int stb__work_raw(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code, stb_sync rel)
+// owner only
+static int stb__ws_push(stb__wsworker *me, stb__workinfo *w)
 {
-   stb__workinfo w;
-   if (q == NULL) {
-      stb_work_init(1);
-      q = stb__work_global;
+   unsigned int b = me->bottom, t = me->top;
+   stb__wsbuf *a = me->buf;
+   if (b - t > a->mask) {
+      stb__wsbuf *n = stb__ws_newbuf((a->mask+1) * 2);
+      unsigned int i;
+      if (n == NULL) return STB_FALSE;
+      for (i=t; i != b; ++i)
+         n->item[i & n->mask] = a->item[i & a->mask];
+      stb_arr_push(me->retired, a);
+      stb_barrier();
+      me->buf = a = n;
    }
-   w.f = f;
-   w.d = d;
-   w.retval = return_code;
-   w.sync = rel;
-   return stb_threadq_add(q->tq, &w);
+   a->item[b & a->mask] = *w;
+   stb_barrier();
+   me->bottom = b+1;
+   return STB_TRUE;
 }
 
-int stb_workq_length(stb_workqueue *q)
+// owner only; takes the most recently pushed work
+static int stb__ws_take(stb__wsworker *me, stb__workinfo *w)
 {
-   return stb_threadq_length(q->tq);
+   unsigned int b = me->bottom - 1, t;
+   stb__wsbuf *a = me->buf;
+   int ok = STB_TRUE;
+   me->bottom = b;
+   stb_barrier();
+   t = me->top;
+   if ((int) (b - t) < 0) {
+      me->bottom = t;
+      return STB_FALSE;
+   }
+   *w = a->item[b & a->mask];
+   if (b == t) {
+      // last one, so a thief may be after it too
+      ok = stb__atomic_cas(&me->top, t, t+1);
+      me->bottom = t+1;
+   }
+   return ok;
 }
 
-int stb_workq(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code)
+// any thread; takes the oldest work
+static int stb__ws_steal(stb__wsworker *v, stb__workinfo *w)
 {
-   if (f == NULL) return 0;
-   return stb_workq_reach(q, f, d, return_code, NULL);
+   unsigned int t = v->top, b;
+   stb__wsbuf *a;
+   stb_barrier();
+   b = v->bottom;
+   if ((int) (b - t) <= 0) return STB_FALSE;
+   stb_barrier();
+   a = v->buf;
+   *w = a->item[t & a->mask];
+   return stb__atomic_cas(&v->top, t, t+1);
 }
 
-int stb_workq_reach(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code, stb_sync rel)
+static int stb__ws_find(stb__wsworker *me, stb__workinfo *w)
 {
-   if (f == NULL) return 0;
-   return stb__work_raw(q, f, d, return_code, rel);
+   struct stb__wsq *ws = me->q->ws;
+   int i, n;
+   if (stb__ws_take(me, w)) return STB_TRUE;
+   if (stb_threadq_get(me->q->tq, w)) return STB_TRUE;
+   n = ws->num_workers;
+   me->seed = me->seed * 1664525 + 1013904223;
+   for (i=0; i < n; ++i) {
+      stb__wsworker *v = ws->worker[(i + (me->seed >> 16)) % n];
+      if (v != me && v != NULL && stb__ws_steal(v, w))
+         return STB_TRUE;
+   }
+   return STB_FALSE;
 }
 
-static void stb__workq_numthreads(stb_workqueue *q, int n)
+static void *stb__ws_workloop(void *p)
 {
-   while (q->numthreads < n) {
-      stb_create_thread(stb__thread_workloop, q);
-      ++q->numthreads;
-   }
-   while (q->numthreads > n) {
-      stb__work_raw(q, NULL, NULL, NULL, NULL);
-      --q->numthreads;
+   stb__wsworker *me = (stb__wsworker *) p;
+   struct stb__wsq *ws = me->q->ws;
+   stb__workinfo w;
+   stb__ws_self = me;
+   for(;;) {
+      if (!stb__ws_find(me, &w)) {
+         // announce we're going to sleep, then look once more; anyone adding
+         // work after that will see us and wake someone
+         stb__atomic_add(&ws->sleepers, 1);
+         stb_barrier();
+         if (!stb__ws_find(me, &w)) {
+            stb_sem_waitfor(ws->wake);
+            stb__atomic_add(&ws->sleepers, -1);
+            continue;
+         }
+         stb__atomic_add(&ws->sleepers, -1);
+      }
+      if (w.f == NULL) // null work is a signal to end the thread
+         break;
+      stb__workinfo_run(&w);
    }
+   // nobody else is guaranteed to come back for our own work, so finish it
+   while (stb__ws_take(me, &w))
+      stb__workinfo_run(&w);
+   stb__ws_self = NULL;
+   stb_barrier();
+   stb__atomic_add(&me->q->running, -1);
+   return NULL;
 }
 
-void stb_workq_numthreads(stb_workqueue *q, int n)
+static int stb__ws_add(stb_workqueue *q, stb__workinfo *w)
 {
-   stb_mutex_begin(stb__threadmutex);
+   stb__wsworker *me = stb__ws_self;
+   if (w->f == NULL || me == NULL || me->q != q || !stb__ws_push(me, w))
+      if (!stb_threadq_add(q->tq, w))
+         return STB_FALSE;
+   stb_barrier();
+   if (q->ws->sleepers)
+      stb_sem_release(q->ws->wake);
+   return STB_TRUE;
+}
+
+static void stb__ws_numthreads(stb_workqueue *q, int n)
+{
+   struct stb__wsq *ws = q->ws;
+   while (q->numthreads < n && ws->num_workers < STB__WS_MAX_THREADS) {
+      stb__wsworker *v = (stb__wsworker *) malloc(sizeof(*v));
+      if (v == NULL) break;
+      v->top = v->bottom = 0;
+      v->retired = NULL;
+      v->q = q;
+      v->seed = ws->num_workers;
+      v->buf = stb__ws_newbuf(STB__WS_INITIAL);
+      if (v->buf == NULL) { free(v); break; }
+      stb__atomic_add(&q->running, 1);
+      if (stb_create_thread(stb__ws_workloop, v) == STB_THREAD_NULL) {
+         stb__atomic_add(&q->running, -1);
+         free(v->buf);
+         free(v);
+         break;
+      }
+      ws->worker[ws->num_workers] = v;
+      stb_barrier();
+      ++ws->num_workers;
+      ++q->numthreads;
+   }
+   while (q->numthreads > n) {
+      stb__workinfo w = { 0 };
+      stb__ws_add(q, &w);
+      --q->numthreads;
+   }
+}
+
+static int stb__ws_length(stb_workqueue *q)
+{
+   struct stb__wsq *ws = q->ws;
+   int i, n = stb_threadq_length(q->tq);
+   for (i=0; i < ws->num_workers; ++i) {
+      int k = (int) (ws->worker[i]->bottom - ws->worker[i]->top);
+      if (k > 0) n += k;
+   }
+   return n;
+}
+
+static void stb__ws_delete(stb_workqueue *q)
+{
+   struct stb__wsq *ws = q->ws;
+   int i;
+   for (i=0; i < ws->num_workers; ++i) {
+      stb__wsworker *v = ws->worker[i];
+      int j;
+      for (j=0; j < stb_arr_len(v->retired); ++j)
+         free(v->retired[j]);
+      stb_arr_free(v->retired);
+      free(v->buf);
+      free(v);
+   }
+   stb_sem_delete(ws->wake);
+   free(ws);
+}
+
+stb_workqueue *stb_workq_new_stealing(int numthreads)
+{
+   stb_workqueue *q = (stb_workqueue *) malloc(sizeof(*q));
+   if (q == NULL) return NULL;
+   q->ws = (struct stb__wsq *) malloc(sizeof(*q->ws));
+   q->tq = stb_threadq_new(sizeof(stb__workinfo), STB_THREADQ_DYNAMIC, STB_TRUE, STB_TRUE);
+   if (q->ws) q->ws->wake = stb_sem_new(STB__WS_MAX_THREADS);
+   if (q->ws == NULL || q->tq == NULL || q->ws->wake == STB_SEMAPHORE_NULL) {
+      if (q->ws) stb_sem_delete(q->ws->wake);
+      stb_threadq_delete(q->tq);
+      free(q->ws);
+      free(q);
+      return NULL;
+   }
+   q->ws->num_workers = q->ws->sleepers = 0;
+   q->numthreads = q->running = 0;
+   stb_workq_numthreads(q, numthreads);
+   return q;
+}
+
+stb_workqueue *stb_workq_new(int num_threads, int max_units)
+{
+   return stb_workq_new_flags(num_threads, max_units, 0,0);
+}
+
+stb_workqueue *stb_workq_new_flags(int numthreads, int max_units, int no_add_mutex, int no_remove_mutex)
+{
+   stb_workqueue *q = (stb_workqueue *) malloc(sizeof(*q));
+   if (q == NULL) return NULL;
+   q->tq = stb_threadq_new(sizeof(stb__workinfo), max_units, !no_add_mutex, !no_remove_mutex);
+   if (q->tq == NULL) { free(q); return NULL; }
+   q->ws = NULL;
+   q->numthreads = q->running = 0;
+   stb_workq_numthreads(q, numthreads);
+   return q;
+}
+
+void stb_workq_delete(stb_workqueue *q)
+{
+   while (stb_workq_length(q) != 0)
+      stb__thread_sleep(1);
+   // the workers are blocked on the queue, so stop them before freeing it
+   stb_workq_numthreads(q, 0);
+   while (q->running)
+      stb__thread_sleep(1);
+   if (q->ws)
+      stb__ws_delete(q);
+   stb_threadq_delete(q->tq);
+   free(q);
+}
+
+static int stb__work_maxitems = STB_THREADQUEUE_DYNAMIC;
+
+static void stb_work_init(int num_threads)
+{
+   if (stb__work_global == NULL) {
+      stb__threadmutex_init();
+      stb_mutex_begin(stb__workmutex);
+      stb_barrier();
+      if (*(stb_workqueue * volatile *) &stb__work_global == NULL)
+         stb__work_global = stb_workq_new(num_threads, stb__work_maxitems);
+      stb_mutex_end(stb__workmutex);
+   }
+}
+
+static int stb__work_raw(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code, stb_sync rel)
+{
+   stb__workinfo w;
+   if (q == NULL) {
+      stb_work_init(1);
+      q = stb__work_global;
+   }
+   w.f = f;
+   w.d = d;
+   w.retval = return_code;
+   w.sync = rel;
+   if (q->ws)
+      return stb__ws_add(q, &w);
+   return stb_threadq_add(q->tq, &w);
+}
+
+int stb_workq_length(stb_workqueue *q)
+{
+   if (q->ws)
+      return stb__ws_length(q);
+   return stb_threadq_length(q->tq);
+}
+
+int stb_workq(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code)
+{
+   if (f == NULL) return 0;
+   return stb_workq_reach(q, f, d, return_code, NULL);
+}
+
+int stb_workq_reach(stb_workqueue *q, stb_thread_func f, void *d, volatile void **return_code, stb_sync rel)
+{
+   if (f == NULL) return 0;
+   return stb__work_raw(q, f, d, return_code, rel);
+}
+
+static void stb__workq_numthreads(stb_workqueue *q, int n)
+{
+   if (q->ws) {
+      stb__ws_numthreads(q, n);
+      return;
+   }
+   while (q->numthreads < n) {
+      stb__atomic_add(&q->running, 1);
+      if (stb_create_thread(stb__thread_workloop, q) == STB_THREAD_NULL) {
+         stb__atomic_add(&q->running, -1);
+         break;
+      }
+      ++q->numthreads;
+   }
+   while (q->numthreads > n) {
+      stb__work_raw(q, NULL, NULL, NULL, NULL);
+      --q->numthreads;
+   }
+}
+
+void stb_workq_numthreads(stb_workqueue *q, int n)
+{
+   stb_mutex_begin(stb__threadmutex);
    stb__workq_numthreads(q,n);
    stb_mutex_end(stb__threadmutex);
 }
 
-int stb_work_maxunits(int n)
+int stb_work_maxunits(int n)
+{
+   if (stb__work_global == NULL) {
+      stb__work_maxitems = n;
+      stb_work_init(1);
+   }
+   return stb__work_maxitems;
+}
+
+int stb_work(stb_thread_func f, void *d, volatile void **return_code)
+{
+   return stb_workq(stb__work_global, f,d,return_code);
+}
+
+int stb_work_reach(stb_thread_func f, void *d, volatile void **return_code, stb_sync rel)
+{
+   return stb_workq_reach(stb__work_global, f,d,return_code,rel);
+}
+
+void stb_work_numthreads(int n)
+{
+   if (stb__work_global == NULL)
+      stb_work_init(n);
+   else
+      stb_workq_numthreads(stb__work_global, n);
+}
+
+// parallel for: the range is cut into 'grain'-sized pieces which the caller
+// and up to numthreads helpers claim with an atomic add until none are left.
+// the caller never waits for work that hasn't started, so it can't deadlock
+// when it's a worker itself; helpers that start late find nothing to do.
+// the job is refcounted since they may not run until after the caller returns
+typedef struct
+{
+   stb_range_func fn;
+   void *ctx;
+   int begin, count, grain;
+   volatile int next;   // offset of the first unclaimed piece
+   volatile int left;   // items not yet finished
+   volatile int refs;
+   stb_semaphore done;  // released when 'left' reaches 0
+} stb__pfor;
+
+static void stb__pfor_release(stb__pfor *p)
+{
+   if (stb__atomic_add(&p->refs, -1) == 1) {
+      stb_sem_delete(p->done);
+      free(p);
+   }
+}
+
+static void stb__pfor_loop(stb__pfor *p)
+{
+   while (p->next < p->count) {
+      int i = stb__atomic_add(&p->next, p->grain), k;
+      if (i >= p->count) break;
+      k = stb_min(p->grain, p->count - i);
+      p->fn(p->ctx, p->begin + i, p->begin + i + k);
+      if (stb__atomic_add(&p->left, -k) == k)
+         stb_sem_release(p->done);
+   }
+}
+
+static void *stb__pfor_helper(void *p)
+{
+   stb__pfor_loop((stb__pfor *) p);
+   stb__pfor_release((stb__pfor *) p);
+   return NULL;
+}
+
+void stb_parallel_forq(stb_workqueue *q, int begin, int end, int grain, stb_range_func fn, void *ctx)
+{
+   stb__pfor *p = NULL;
+   int n = end - begin, i, helpers;
+   if (n <= 0) return;
+   if (q == NULL) {
+      stb_work_init(1);
+      q = stb__work_global;
+   }
+   // several pieces per thread, so uneven pieces still balance
+   if (grain <= 0)
+      grain = stb_max(1, n / ((q->numthreads+1) * 8));
+   helpers = stb_min(q->numthreads, (n-1) / grain);
+   if (helpers > 0 && (p = (stb__pfor *) malloc(sizeof(*p))) != NULL)
+      if ((p->done = stb_sem_new(1)) == STB_SEMAPHORE_NULL)
+         { free(p); p = NULL; }
+   if (p == NULL) {
+      for (i=begin; i < end; i += stb_min(grain, end-i))
+         fn(ctx, i, i + stb_min(grain, end-i));
+      return;
+   }
+   p->fn = fn;
+   p->ctx = ctx;
+   p->begin = begin;
+   p->count = p->left = n;
+   p->grain = grain;
+   p->next = 0;
+   p->refs = 1 + helpers;
+   stb_barrier();
+   for (i=0; i < helpers; ++i)
+      if (!stb_workq(q, stb__pfor_helper, p, NULL))
+         stb__pfor_release(p);
+   stb__pfor_loop(p);
+   stb_sem_waitfor(p->done);
+   stb__pfor_release(p);
+}
+
+void stb_parallel_for(int begin, int end, int grain, stb_range_func fn, void *ctx)
+{
+   stb_parallel_forq(stb__work_global, begin, end, grain, fn, ctx);
+}
+
+// task graphs: each task counts its unfinished dependencies, plus one that's
+// dropped when it's started; whoever takes it to zero queues it. all the
+// bookkeeping is under one mutex per graph, which is only held briefly
+struct stb__task
+{
+   stb_thread_func f;
+   void *d;
+   volatile void **retval;
+   stb_taskgraph *g;
+   int waiting_on;
+   int started, finished;
+   stb_task **next;     // stb_arr of tasks that depend on this one
+};
+
+struct stb__taskgraph
+{
+   stb_workqueue *q;
+   stb_mutex mutex;
+   stb_semaphore done;
+   stb_task **tasks;    // stb_arr of all tasks, in the order added
+   int num_started;     // tasks[0..num_started-1] have been started
+   int unfinished;
+   int waiting;
+};
+
+static void *stb__task_run(void *p);
+
+static void stb__task_queue(stb_taskgraph *g, stb_task **ready)
+{
+   int i;
+   for (i=0; i < stb_arr_len(ready); ++i)
+      if (!stb_workq(g->q, stb__task_run, ready[i], NULL))
+         stb__task_run(ready[i]);
+}
+
+static void *stb__task_run(void *p)
+{
+   stb_task *t = (stb_task *) p, **ready = NULL;
+   stb_taskgraph *g = t->g;
+   int i, wake = STB_FALSE;
+   void *z = t->f(t->d);
+   if (t->retval) { stb_barrier(); *t->retval = z; }
+
+   stb_mutex_begin(g->mutex);
+   t->finished = STB_TRUE;
+   for (i=0; i < stb_arr_len(t->next); ++i)
+      if (--t->next[i]->waiting_on == 0)
+         stb_arr_push(ready, t->next[i]);
+   stb_arr_free(t->next);
+   if (--g->unfinished == 0 && g->waiting) {
+      g->waiting = STB_FALSE;
+      wake = STB_TRUE;
+   }
+   stb_mutex_end(g->mutex);
+
+   stb__task_queue(g, ready);
+   stb_arr_free(ready);
+   // the waiter may free the graph as soon as this is released
+   if (wake)
+      stb_sem_release(g->done);
+   return NULL;
+}
+
+stb_taskgraph *stb_taskgraph_new(stb_workqueue *q)
+{
+   stb_taskgraph *g = (stb_taskgraph *) malloc(sizeof(*g));
+   if (g == NULL) return NULL;
+   if (q == NULL) {
+      stb_work_init(1);
+      q = stb__work_global;
+   }
+   g->q = q;
+   g->mutex = stb_mutex_new();
+   g->done  = stb_sem_new(1);
+   if (g->mutex == STB_MUTEX_NULL || g->done == STB_SEMAPHORE_NULL) {
+      stb_mutex_delete(g->mutex);
+      stb_sem_delete(g->done);
+      free(g);
+      return NULL;
+   }
+   g->tasks = NULL;
+   g->num_started = g->unfinished = 0;
+   g->waiting = STB_FALSE;
+   return g;
+}
+
+stb_task *stb_task_add(stb_taskgraph *g, stb_thread_func f, void *d, volatile void **return_code)
+{
+   stb_task *t = (stb_task *) malloc(sizeof(*t));
+   if (t == NULL) return NULL;
+   t->f = f;
+   t->d = d;
+   t->retval = return_code;
+   t->g = g;
+   t->waiting_on = 1;
+   t->started = t->finished = STB_FALSE;
+   t->next = NULL;
+   stb_mutex_begin(g->mutex);
+   stb_arr_push(g->tasks, t);
+   ++g->unfinished;
+   stb_mutex_end(g->mutex);
+   return t;
+}
+
+void stb_task_after(stb_task *t, stb_task *dependency)
+{
+   stb_taskgraph *g = t->g;
+   assert(dependency->g == g);
+   stb_mutex_begin(g->mutex);
+   assert(!t->started);
+   if (!dependency->finished) {
+      ++t->waiting_on;
+      stb_arr_push(dependency->next, t);
+   }
+   stb_mutex_end(g->mutex);
+}
+
+stb_task *stb_task_then(stb_task *t, stb_thread_func f, void *d, volatile void **return_code)
+{
+   stb_task *u;
+   if (t == NULL) return NULL;
+   u = stb_task_add(t->g, f, d, return_code);
+   if (u) stb_task_after(u, t);
+   return u;
+}
+
+void stb_taskgraph_run(stb_taskgraph *g)
+{
+   stb_task **ready = NULL;
+   stb_mutex_begin(g->mutex);
+   for (; g->num_started < stb_arr_len(g->tasks); ++g->num_started) {
+      stb_task *t = g->tasks[g->num_started];
+      t->started = STB_TRUE;
+      if (--t->waiting_on == 0)
+         stb_arr_push(ready, t);
+   }
+   stb_mutex_end(g->mutex);
+   stb__task_queue(g, ready);
+   stb_arr_free(ready);
+}
+
+void stb_taskgraph_wait(stb_taskgraph *g)
+{
+   int wait;
+   stb_taskgraph_run(g);
+   stb_mutex_begin(g->mutex);
+   wait = g->waiting = (g->unfinished != 0);
+   stb_mutex_end(g->mutex);
+   if (wait)
+      stb_sem_waitfor(g->done);
+}
+
+void stb_taskgraph_delete(stb_taskgraph *g)
+{
+   int i;
+   stb_taskgraph_wait(g);
+   for (i=0; i < stb_arr_len(g->tasks); ++i)
+      free(g->tasks[i]);
+   stb_arr_free(g->tasks);
+   stb_mutex_delete(g->mutex);
+   stb_sem_delete(g->done);
+   free(g);
+}
+#endif // STB_DEFINE
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Parallel stb_compress
+//
+
+#ifdef STB_DEFINE
+
+typedef struct
+{
+   stb_compress_context c;
+   stb_uchar *input, *out;
+   stb_uint start, end;
+   int prime, outlen;
+} stb__compress_job;
+
+typedef struct
+{
+   stb__compress_job *jobs;
+   int first, count, step;
+} stb__compress_worker;
+
+static void *stb__compress_worker_run(void *p)
+{
+   stb__compress_worker *w = (stb__compress_worker *) p;
+   int i;
+   for (i=w->first; i < w->count; i += w->step) {
+      stb__compress_job *j = &w->jobs[i];
+      j->outlen = stb__compress_block(&j->c, j->out, j->input, j->start, j->end, j->prime);
+   }
+   return NULL;
+}
+
+stb_uint stb_compress_parallel(stb_uchar *out, stb_uchar *input, stb_uint length, int num_threads, stb_uint block_size, int prime)
+{
+   stb__compress_job *jobs;
+   stb__compress_worker workers[64];
+   stb_semaphore done = STB_SEMAPHORE_NULL;
+   stb_compress_context c;
+   stb_uint adler = 1;
+   int i, n, waits=0, ok=1;
+
+   if (block_size == 0) block_size = 1 << 20;
+   if (block_size < 65536) block_size = 65536;
+   if (num_threads > 64) num_threads = 64;
+
+   n = (length + block_size-1) / block_size;
+   if (num_threads > n) num_threads = n;
+   if (num_threads <= 1 || (jobs = (stb__compress_job *) malloc(n * sizeof(*jobs))) == NULL) {
+      stb_compress_context_init(&c);
+      c.entropy = 0;
+      return stb_compress_ctx(&c, out, input, length);
+   }
+
+   for (i=0; i < n; ++i) {
+      stb__compress_job *j = &jobs[i];
+      stb_compress_context_init(&j->c);
+      j->c.entropy = 0; // the blocks' tokens get concatenated as bytes
+      j->input = input;
+      j->start = i * block_size;
+      j->end   = (i == n-1) ? length : j->start + block_size;
+      j->prime = prime;
+      j->out   = (stb_uchar *) malloc(STB__COMPRESS_BLOCK_BOUND(j->end - j->start));
+      if (j->out == NULL) ok = 0;
+   }
+
+   if (ok) {
+      // each thread takes every num_threads'th block; this thread does worker 0
+      if (num_threads > 1)
+         done = stb_sem_new(num_threads);
+      for (i=0; i < num_threads; ++i) {
+         workers[i].jobs  = jobs;
+         workers[i].first = i;
+         workers[i].count = n;
+         workers[i].step  = num_threads;
+      }
+      for (i=1; i < num_threads; ++i) {
+         if (done != STB_SEMAPHORE_NULL && stb_create_thread2(stb__compress_worker_run, &workers[i], NULL, done) != STB_THREAD_NULL)
+            ++waits;
+         else
+            stb__compress_worker_run(&workers[i]);
+      }
+      stb__compress_worker_run(&workers[0]);
+      while (waits--)
+         stb_sem_waitfor(done);
+      if (done != STB_SEMAPHORE_NULL)
+         stb_sem_delete(done);
+      for (i=0; i < n; ++i)
+         if (jobs[i].outlen < 0)
+            ok = 0;
+   }
+
+   if (ok) {
+      // the blocks' tokens concatenate into one stream
+      stb_compress_context_init(&c);
+      c.entropy = 0;
+      c.out = out;
+      stb__compress_header(&c, length);
+      for (i=0; i < n; ++i) {
+         memcpy(c.out, jobs[i].out, jobs[i].outlen);
+         c.out += jobs[i].outlen;
+         adler = stb_adler32_combine(adler, jobs[i].c.running_adler, jobs[i].end - jobs[i].start);
+      }
+      stb_out2(&c, 0x05fa); // end opcode
+      stb_out4(&c, adler);
+   }
+
+   for (i=0; i < n; ++i)
+      free(jobs[i].out);
+   free(jobs);
+
+   if (!ok) {
+      stb_compress_context_init(&c);
+      c.entropy = 0;
+      return stb_compress_ctx(&c, out, input, length);
+   }
+   return (stb_uint) (c.out - out);
+}
+
+#endif // STB_DEFINE
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Background disk I/O
+//
+//
+
+#define STB_BGIO_READ_ALL   (-1)
+STB_EXTERN int stb_bgio_read    (char *filename, int offset, int len, stb_uchar **result, int *olen);
+STB_EXTERN int stb_bgio_readf   (FILE *f       , int offset, int len, stb_uchar **result, int *olen);
+STB_EXTERN int stb_bgio_read_to (char *filename, int offset, int len, stb_uchar  *buffer, int *olen);
+STB_EXTERN int stb_bgio_readf_to(FILE *f       , int offset, int len, stb_uchar  *buffer, int *olen);
+
+typedef struct
+{
+   int have_data;
+   int is_valid;
+   int is_dir;
+   time_t filetime;
+   stb_int64 filesize;
+} stb_bgstat;
+
+STB_EXTERN int stb_bgio_stat    (char *filename, stb_bgstat *result);
+
+// requests: as above, but with 64-bit offsets, priorities, completion
+// callbacks and cancellation. there's no limit on how many can be queued;
+// higher 'priority' starts first, and equal priorities start in order.
+//
+// on Linux, reads from a FILE go through io_uring if the kernel allows it
+// (define STB_NO_IO_URING to never use it); everything else runs on a pool
+// of I/O threads. only the FILE's descriptor is used, so its buffer and
+// position aren't touched, but it must stay open until the read finishes.
+//
+// 'callback' is called exactly once, from an I/O thread or from a
+// successful stb_bgio_cancel, with the data (NULL unless STB_BGIO_DONE).
+// if 'buffer' is NULL, a buffer is malloc()ed, which you must free.
+// every handle returned must be passed to stb_bgio_release, which doesn't
+// cancel the request or free the data.
+#define STB_BGIO_PENDING     0
+#define STB_BGIO_DONE        1
+#define STB_BGIO_FAILED    (-1)
+#define STB_BGIO_CANCELLED (-2)
+
+typedef struct stb__bgio_req stb_bgio_req;
+typedef void (*stb_bgio_callback)(void *userdata, int status, stb_uchar *data, stb_int64 len);
+
+typedef struct
+{
+   char *filename;      // file to read, or NULL to read from 'f'
+   FILE *f;
+   stb_int64 offset;
+   stb_int64 len;       // or STB_BGIO_READ_ALL
+   stb_uchar *buffer;   // where to read to, or NULL to allocate one
+   int priority;
+   stb_bgio_callback callback;  // may be NULL
+   void *userdata;
+} stb_bgio_desc;
+
+STB_EXTERN stb_bgio_req *stb_bgio_submit(stb_bgio_desc *d);
+// queues several requests at once, and returns how many were queued;
+// 'reqs' may be NULL if you don't want handles
+STB_EXTERN int  stb_bgio_submit_batch(stb_bgio_desc *d, int count, stb_bgio_req **reqs);
+// only requests that haven't started can be cancelled; returns TRUE if it was
+STB_EXTERN int  stb_bgio_cancel (stb_bgio_req *r);
+STB_EXTERN int  stb_bgio_status (stb_bgio_req *r, stb_uchar **data, stb_int64 *len);
+STB_EXTERN int  stb_bgio_wait   (stb_bgio_req *r, stb_uchar **data, stb_int64 *len);
+STB_EXTERN void stb_bgio_release(stb_bgio_req *r);
+
+// streaming reader: reads a file front to back, keeping 'num_blocks' reads of
+// 'block_size' bytes in flight through stb_bgio so parsing overlaps the disk.
+// stb_bgstream_next hands out the filled buffers themselves: it returns the
+// unread part of the current block (or the next one), which stays valid
+// until the next call on the stream. it returns 0 at end of file, -1 on error.
+// the other functions work like their stdio equivalents, and the stbfile
+// version reads straight out of the blocks too. 0 for the sizes means 1MB x 4
+typedef struct stb__bgstream stb_bgstream;
+
+STB_EXTERN stb_bgstream *stb_bgstream_open (char *filename, int block_size, int num_blocks);
+STB_EXTERN stb_bgstream *stb_bgstream_openf(FILE *f, stb_int64 offset, int block_size, int num_blocks);
+STB_EXTERN int       stb_bgstream_next (stb_bgstream *s, stb_uchar **data);
+STB_EXTERN size_t    stb_bgstream_read (void *buffer, size_t size, size_t count, stb_bgstream *s);
+STB_EXTERN int       stb_bgstream_getc (stb_bgstream *s);
+STB_EXTERN int       stb_bgstream_eof  (stb_bgstream *s);
+STB_EXTERN int       stb_bgstream_error(stb_bgstream *s);
+STB_EXTERN stb_int64 stb_bgstream_tell (stb_bgstream *s);
+STB_EXTERN void      stb_bgstream_close(stb_bgstream *s);
+
+STB_EXTERN stbfile  *stb_open_bgstream (char *filename, int block_size, int num_blocks);
+STB_EXTERN stbfile  *stb_openf_bgstream(FILE *f, stb_int64 offset, int block_size, int num_blocks);
+
+#ifdef STB_DEFINE
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+#if defined(__linux__) && !defined(STB_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define STB__IO_URING
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+static stb_workqueue *stb__diskio;
+static stb_mutex stb__diskio_mutex;
+static stb_bgio_req **stb__bgio_heap[2];
+static unsigned int   stb__bgio_seq;
+static void stb__uring_shutdown(void);
+
+void stb_thread_cleanup(void)
+{
+   if (stb__diskio)      stb__uring_shutdown();
+   if (stb__work_global) { stb_workq_delete(stb__work_global); stb__work_global = NULL; }
+   if (stb__threadmutex) { stb_mutex_delete(stb__threadmutex); stb__threadmutex = NULL; }
+   if (stb__workmutex)   { stb_mutex_delete(stb__workmutex);   stb__workmutex   = NULL; }
+   if (stb__diskio)      { stb_workq_delete(stb__diskio);      stb__diskio      = NULL; }
+   if (stb__diskio_mutex){ stb_mutex_delete(stb__diskio_mutex);stb__diskio_mutex= NULL; }
+   stb_arr_free(stb__bgio_heap[0]);
+   stb_arr_free(stb__bgio_heap[1]);
+}
+
+struct stb__bgio_req
+{
+   char *filename;
+   FILE *f;
+   stb_int64 offset;
+   stb_int64 len;
+   stb_uchar *buffer;
+   int priority;
+   stb_bgio_callback callback;
+   void *userdata;
+
+   // outputs for the older functions
+   stb_bgstat *stat_out;
+   stb_uchar **result;
+   int *len_output;
+   int *flag;
+
+   stb_uchar *data;
+   stb_int64 got;          // bytes read so far
+   volatile int status;
+   int refs;               // the handle, plus one until it's finished
+   int heap_index;         // position in its queue, or -1 once started
+   int uring;              // which queue
+   unsigned int seq;
+   stb_semaphore wake;     // only created if someone waits
+#ifdef STB__IO_URING
+   struct iovec iov;
+#endif
+};
+
+// queued requests wait in a heap ordered by priority, then submission order;
+// one heap feeds the thread pool, which gets one work unit per request, and
+// one feeds io_uring. these and the requests are protected by stb__diskio_mutex
+
+static int stb__bgio_before(stb_bgio_req *a, stb_bgio_req *b)
+{
+   if (a->priority != b->priority)
+      return a->priority > b->priority;
+   return (int) (a->seq - b->seq) < 0;
+}
+
+static void stb__bgio_heap_set(stb_bgio_req **h, int i, stb_bgio_req *r)
+{
+   h[i] = r;
+   r->heap_index = i;
+}
+
+static void stb__bgio_heap_fix(stb_bgio_req **h, int i)
+{
+   int n = stb_arr_len(h);
+   stb_bgio_req *r = h[i];
+   while (i > 0 && stb__bgio_before(r, h[(i-1)/2])) {
+      stb__bgio_heap_set(h, i, h[(i-1)/2]);
+      i = (i-1)/2;
+   }
+   for(;;) {
+      int c = i*2+1;
+      if (c >= n) break;
+      if (c+1 < n && stb__bgio_before(h[c+1], h[c])) ++c;
+      if (!stb__bgio_before(h[c], r)) break;
+      stb__bgio_heap_set(h, i, h[c]);
+      i = c;
+   }
+   stb__bgio_heap_set(h, i, r);
+}
+
+static void stb__bgio_heap_push(stb_bgio_req ***h, stb_bgio_req *r)
+{
+   stb_arr_push(*h, r);
+   stb__bgio_heap_fix(*h, stb_arr_len(*h)-1);
+}
+
+static stb_bgio_req *stb__bgio_heap_remove(stb_bgio_req **h, int i)
+{
+   stb_bgio_req *r = h[i], *last = stb_arr_pop(h);
+   if (last != r) {
+      stb__bgio_heap_set(h, i, last);
+      stb__bgio_heap_fix(h, i);
+   }
+   r->heap_index = -1;
+   return r;
+}
+
+static void stb__bgio_free(stb_bgio_req *r)
+{
+   if (--r->refs == 0) {
+      stb_sem_delete(r->wake);
+      free(r->filename);
+      free(r);
+   }
+}
+
+static void stb__bgio_finish(stb_bgio_req *r, int status)
+{
+   stb_semaphore wake;
+   if (status != STB_BGIO_DONE) {
+      if (r->data != r->buffer) free(r->data);
+      r->data = NULL;
+      r->got = 0;
+   }
+   if (r->len_output) *r->len_output = (int) r->got;
+   if (r->result)     *r->result     = r->data;
+   if (r->flag)       *r->flag       = (status == STB_BGIO_DONE ? 1 : -1);
+   if (r->callback)
+      r->callback(r->userdata, status, r->data, r->got);
+   stb_barrier();
+   stb_mutex_begin(stb__diskio_mutex);
+   r->status = status;
+   wake = r->wake;
+   if (wake != STB_SEMAPHORE_NULL)
+      ++r->refs; // keep it alive until the waiter's been released
+   stb__bgio_free(r);
+   stb_mutex_end(stb__diskio_mutex);
+   if (wake != STB_SEMAPHORE_NULL) {
+      stb_sem_release(wake);
+      stb_mutex_begin(stb__diskio_mutex);
+      stb__bgio_free(r);
+      stb_mutex_end(stb__diskio_mutex);
+   }
+}
+
+static void stb__bgio_stat(stb_bgio_req *r)
+{
+   stb_bgstat *st = r->stat_out;
+   #ifdef _WIN32
+   struct _stati64 s;
+   if (!_stati64(r->filename, &s)) {
+      st->filesize = s.st_size;
+      st->filetime = s.st_mtime;
+      st->is_dir = s.st_mode & _S_IFDIR;
+      st->is_valid = (s.st_mode & _S_IFREG) || st->is_dir;
+   } else
+   #else
+   struct stat s;
+   if (!stat(r->filename, &s)) {
+      st->filesize = s.st_size;
+      st->filetime = s.st_mtime;
+      st->is_dir = S_ISDIR(s.st_mode);
+      st->is_valid = S_ISREG(s.st_mode) || st->is_dir;
+   } else
+   #endif
+      st->is_valid = 0;
+   stb_barrier();
+   st->have_data = 1;
+}
+
+// allocates the buffer if needed, once the length is known
+static int stb__bgio_alloc(stb_bgio_req *r, stb_int64 filesize)
+{
+   if (r->data) // already started, e.g. by io_uring before it was given up
+      return STB_TRUE;
+   if (r->len < 0)
+      r->len = stb_max(filesize - r->offset, 0);
+   if (r->buffer)
+      r->data = r->buffer;
+   else {
+      if ((stb_int64) (size_t) r->len != r->len) return STB_FALSE;
+      r->data = (stb_uchar *) malloc((size_t) stb_max(r->len, 1));
+      if (r->data == NULL) return STB_FALSE;
+   }
+   return STB_TRUE;
+}
+
+static void stb__bgio_pool_read(stb_bgio_req *r)
+{
+   stb_int64 size = 0;
+#ifdef _WIN32
+   FILE *f;
+#else
+   int fd;
+   struct stat s;
+#endif
+   if (r->stat_out) {
+      stb__bgio_stat(r);
+      stb__bgio_finish(r, STB_BGIO_DONE);
+      return;
+   }
+#ifdef _WIN32
+   if (r->f)
+      f = _fdopen(_dup(_fileno(r->f)), "rb");
+   else
+      f = fopen(r->filename, "rb");
+   if (!f) {
+      stb__bgio_finish(r, STB_BGIO_FAILED);
+      return;
+   }
+   if (r->len < 0) {
+      stb__fseek64(f, 0, SEEK_END);
+      size = (stb_int64) stb__ftell64(f);
+   }
+   if (stb__fseek64(f, r->offset, SEEK_SET) || !stb__bgio_alloc(r, size)) {
+      fclose(f);
+      stb__bgio_finish(r, STB_BGIO_FAILED);
+      return;
+   }
+   r->got = fread(r->data, 1, (size_t) r->len, f);
+   fclose(f);
+#else
+   // pread doesn't use the file position, which a dup()ed descriptor
+   // would share with the caller and with other reads of the same file
+   fd = r->f ? fileno(r->f) : open(r->filename, O_RDONLY);
+   if (fd < 0) {
+      stb__bgio_finish(r, STB_BGIO_FAILED);
+      return;
+   }
+   if (r->len < 0 && !fstat(fd, &s))
+      size = s.st_size;
+   if (!stb__bgio_alloc(r, size)) {
+      if (!r->f) close(fd);
+      stb__bgio_finish(r, STB_BGIO_FAILED);
+      return;
+   }
+   while (r->got < r->len) {
+      ssize_t n = pread(fd, r->data + r->got, (size_t) (r->len - r->got), (off_t) (r->offset + r->got));
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) {
+         if (!r->f) close(fd);
+         stb__bgio_finish(r, STB_BGIO_FAILED);
+         return;
+      }
+      if (n == 0) break;
+      r->got += n;
+   }
+   if (!r->f) close(fd);
+#endif
+   stb__bgio_finish(r, STB_BGIO_DONE);
+}
+
+// each request queued for the pool adds one of these, which takes whichever
+// request is first at the time; there may be extras after cancellations
+static void *stb__bgio_pool_task(void *p)
 {
-   if (stb__work_global == NULL) {
-      stb__work_maxitems = n;
-      stb_work_init(1);
-   }
-   return stb__work_maxitems;
+   stb_bgio_req *r = NULL;
+   (void) p;
+   stb_mutex_begin(stb__diskio_mutex);
+   if (stb_arr_len(stb__bgio_heap[0]))
+      r = stb__bgio_heap_remove(stb__bgio_heap[0], 0);
+   stb_mutex_end(stb__diskio_mutex);
+   if (r) stb__bgio_pool_read(r);
+   return NULL;
 }
 
-int stb_work(stb_thread_func f, void *d, volatile void **return_code)
+#ifdef STB__IO_URING
+// the io_uring backend: one thread moves queued requests into the
+// submission ring, as many as fit, and waits for completions. short
+// reads are put back on the queue to read the rest
+#define STB__URING_DEPTH   64
+
+static struct
 {
-   return stb_workq(stb__work_global, f,d,return_code);
+   int tried;
+   int live;                // the ring is set up and its thread is running
+   volatile int ok;         // new reads can use it
+   int fd;
+   unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+   unsigned int *cq_head, *cq_tail, *cq_mask;
+   struct io_uring_sqe *sqes;
+   struct io_uring_cqe *cqes;
+   void *sq_ring, *cq_ring;
+   size_t sq_size, cq_size, sqe_size;
+   unsigned int entries;
+   stb_semaphore work;
+   int idle;                // the thread is waiting on 'work'
+   volatile int quit, running;
+} stb__uring;
+
+static void stb__uring_unmap(void)
+{
+   if (stb__uring.sqes && stb__uring.sqes != MAP_FAILED)
+      munmap(stb__uring.sqes, stb__uring.sqe_size);
+   if (stb__uring.cq_ring && stb__uring.cq_ring != MAP_FAILED && stb__uring.cq_ring != stb__uring.sq_ring)
+      munmap(stb__uring.cq_ring, stb__uring.cq_size);
+   if (stb__uring.sq_ring && stb__uring.sq_ring != MAP_FAILED)
+      munmap(stb__uring.sq_ring, stb__uring.sq_size);
+   if (stb__uring.fd >= 0)
+      close(stb__uring.fd);
+   stb__uring.sq_ring = stb__uring.cq_ring = stb__uring.sqes = NULL;
+   stb__uring.fd = -1;
+}
+
+static void *stb__uring_loop(void *p);
+
+static void stb__uring_init(void)
+{
+   struct io_uring_params p;
+   char *sq, *cq;
+   memset(&p, 0, sizeof(p));
+   stb__uring.tried = STB_TRUE;
+   stb__uring.sq_ring = stb__uring.cq_ring = stb__uring.sqes = NULL;
+   stb__uring.fd = (int) syscall(__NR_io_uring_setup, STB__URING_DEPTH, &p);
+   if (stb__uring.fd < 0) return;
+   stb__uring.sq_size  = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+   stb__uring.cq_size  = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+   stb__uring.sqe_size = p.sq_entries * sizeof(struct io_uring_sqe);
+   if (p.features & IORING_FEAT_SINGLE_MMAP)
+      stb__uring.sq_size = stb__uring.cq_size = stb_max(stb__uring.sq_size, stb__uring.cq_size);
+   stb__uring.sq_ring = mmap(0, stb__uring.sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, stb__uring.fd, IORING_OFF_SQ_RING);
+   if (stb__uring.sq_ring == MAP_FAILED) { stb__uring_unmap(); return; }
+   if (p.features & IORING_FEAT_SINGLE_MMAP)
+      stb__uring.cq_ring = stb__uring.sq_ring;
+   else {
+      stb__uring.cq_ring = mmap(0, stb__uring.cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, stb__uring.fd, IORING_OFF_CQ_RING);
+      if (stb__uring.cq_ring == MAP_FAILED) { stb__uring_unmap(); return; }
+   }
+   stb__uring.sqes = (struct io_uring_sqe *) mmap(0, stb__uring.sqe_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, stb__uring.fd, IORING_OFF_SQES);
+   if (stb__uring.sqes == MAP_FAILED) { stb__uring_unmap(); return; }
+   sq = (char *) stb__uring.sq_ring;
+   cq = (char *) stb__uring.cq_ring;
+   stb__uring.sq_head  = (unsigned int *) (sq + p.sq_off.head);
+   stb__uring.sq_tail  = (unsigned int *) (sq + p.sq_off.tail);
+   stb__uring.sq_mask  = (unsigned int *) (sq + p.sq_off.ring_mask);
+   stb__uring.sq_array = (unsigned int *) (sq + p.sq_off.array);
+   stb__uring.cq_head  = (unsigned int *) (cq + p.cq_off.head);
+   stb__uring.cq_tail  = (unsigned int *) (cq + p.cq_off.tail);
+   stb__uring.cq_mask  = (unsigned int *) (cq + p.cq_off.ring_mask);
+   stb__uring.cqes     = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+   stb__uring.entries  = p.sq_entries;
+   stb__uring.idle = stb__uring.quit = 0;
+   stb__uring.work = stb_sem_new(1);
+   stb__uring.running = 1;
+   if (stb__uring.work == STB_SEMAPHORE_NULL || stb_create_thread(stb__uring_loop, NULL) == STB_THREAD_NULL) {
+      stb_sem_delete(stb__uring.work);
+      stb__uring.running = 0;
+      stb__uring_unmap();
+      return;
+   }
+   stb__uring.live = stb__uring.ok = STB_TRUE;
 }
 
-int stb_work_reach(stb_thread_func f, void *d, volatile void **return_code, stb_sync rel)
+// move a read back to the thread pool, e.g. if the kernel doesn't support it
+static void stb__uring_to_pool(stb_bgio_req *r)
 {
-   return stb_workq_reach(stb__work_global, f,d,return_code,rel);
+   r->uring = STB_FALSE;
+   stb_mutex_begin(stb__diskio_mutex);
+   stb__bgio_heap_push(&stb__bgio_heap[0], r);
+   stb_mutex_end(stb__diskio_mutex);
+   if (!stb_workq(stb__diskio, stb__bgio_pool_task, NULL, NULL))
+      stb__bgio_pool_task(NULL);
 }
 
-void stb_work_numthreads(int n)
+// returns FALSE if the request was finished instead
+static int stb__uring_prep(stb_bgio_req *r, struct io_uring_sqe *sqe)
 {
-   if (stb__work_global == NULL)
-      stb_work_init(n);
-   else
-      stb_workq_numthreads(stb__work_global, n);
+   if (r->data == NULL) {
+      struct stat s;
+      if (r->len < 0 && fstat(fileno(r->f), &s)) s.st_size = 0;
+      if (!stb__bgio_alloc(r, r->len < 0 ? (stb_int64) s.st_size : 0)) {
+         stb__bgio_finish(r, STB_BGIO_FAILED);
+         return STB_FALSE;
+      }
+   }
+   if (r->got == r->len) {
+      stb__bgio_finish(r, STB_BGIO_DONE);
+      return STB_FALSE;
+   }
+   r->iov.iov_base = r->data + r->got;
+   r->iov.iov_len  = (size_t) (r->len - r->got);
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode    = IORING_OP_READV;
+   sqe->fd        = fileno(r->f);
+   sqe->off       = r->offset + r->got;
+   sqe->addr      = (size_t) &r->iov;
+   sqe->len       = 1;
+   sqe->user_data = (size_t) r;
+   return STB_TRUE;
 }
-#endif // STB_DEFINE
-
-
-//////////////////////////////////////////////////////////////////////////////
-//
-// Background disk I/O
-//
-//
-
-#define STB_BGIO_READ_ALL   (-1)
-STB_EXTERN int stb_bgio_read    (char *filename, int offset, int len, stb_uchar **result, int *olen);
-STB_EXTERN int stb_bgio_readf   (FILE *f       , int offset, int len, stb_uchar **result, int *olen);
-STB_EXTERN int stb_bgio_read_to (char *filename, int offset, int len, stb_uchar  *buffer, int *olen);
-STB_EXTERN int stb_bgio_readf_to(FILE *f       , int offset, int len, stb_uchar  *buffer, int *olen);
 
-typedef struct
+static void stb__uring_complete(stb_bgio_req *r, int res)
 {
-   int have_data;
-   int is_valid;
-   int is_dir;
-   time_t filetime;
-   stb_int64 filesize;
-} stb_bgstat;
+   if (res == -EINTR || res == -EAGAIN || (res > 0 && r->got + res < r->len)) {
+      if (res > 0) r->got += res;
+      stb_mutex_begin(stb__diskio_mutex);
+      stb__bgio_heap_push(&stb__bgio_heap[1], r);
+      stb_mutex_end(stb__diskio_mutex);
+   } else if (res == -EINVAL || res == -EOPNOTSUPP)
+      stb__uring_to_pool(r);
+   else if (res < 0)
+      stb__bgio_finish(r, STB_BGIO_FAILED);
+   else {
+      r->got += res;
+      stb__bgio_finish(r, STB_BGIO_DONE);
+   }
+}
 
-STB_EXTERN int stb_bgio_stat    (char *filename, stb_bgstat *result);
+static void *stb__uring_loop(void *p)
+{
+   unsigned int inflight = 0, unsubmitted = 0;
+   stb_bgio_req *batch[STB__URING_DEPTH], *flight[STB__URING_DEPTH];
+   (void) p;
+   for(;;) {
+      unsigned int i, n = 0, tail, head;
+      int res;
+
+      stb_mutex_begin(stb__diskio_mutex);
+      while (inflight + unsubmitted + n < stb__uring.entries && stb_arr_len(stb__bgio_heap[1]))
+         batch[n++] = stb__bgio_heap_remove(stb__bgio_heap[1], 0);
+      if (n + inflight + unsubmitted == 0) {
+         if (stb__uring.quit) {
+            stb_mutex_end(stb__diskio_mutex);
+            break;
+         }
+         stb__uring.idle = STB_TRUE;
+         stb_mutex_end(stb__diskio_mutex);
+         stb_sem_waitfor(stb__uring.work);
+         continue;
+      }
+      stb_mutex_end(stb__diskio_mutex);
 
-#ifdef STB_DEFINE
+      if (!stb__uring.ok) {
+         // the ring was closed after these were queued for it
+         for (i=0; i < n; ++i)
+            stb__uring_to_pool(batch[i]);
+         continue;
+      }
 
-static stb_workqueue *stb__diskio;
-static stb_mutex stb__diskio_mutex;
+      tail = *stb__uring.sq_tail;
+      for (i=0; i < n; ++i) {
+         unsigned int k = tail & *stb__uring.sq_mask;
+         if (stb__uring_prep(batch[i], &stb__uring.sqes[k])) {
+            stb__uring.sq_array[k] = k;
+            ++tail;
+            ++unsubmitted;
+         }
+      }
+      stb_barrier();
+      *stb__uring.sq_tail = tail;
+      stb_barrier();
 
-void stb_thread_cleanup(void)
-{
-   if (stb__work_global) stb_workq_delete(stb__work_global); stb__work_global = NULL;
-   if (stb__threadmutex) stb_mutex_delete(stb__threadmutex); stb__threadmutex = NULL;
-   if (stb__workmutex)   stb_mutex_delete(stb__workmutex);   stb__workmutex   = NULL;
-   if (stb__diskio)      stb_workq_delete(stb__diskio);      stb__diskio      = NULL;
-   if (stb__diskio_mutex)stb_mutex_delete(stb__diskio_mutex);stb__diskio_mutex= NULL;
+      if (inflight + unsubmitted == 0) continue;
+      res = (int) syscall(__NR_io_uring_enter, stb__uring.fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+         // the ring is unusable, and retrying would just spin. close it,
+         // which cancels the reads in flight, and give those and the
+         // unsubmitted ones to the thread pool, which carries on from 'got'.
+         // reads queued for the ring later are sent over at the top
+         for (i=0; i < unsubmitted; ++i)
+            flight[inflight++] = (stb_bgio_req *) (size_t) stb__uring.sqes[(tail - unsubmitted + i) & *stb__uring.sq_mask].user_data;
+         stb__uring.ok = STB_FALSE;
+         stb__uring_unmap();
+         for (i=0; i < inflight; ++i)
+            stb__uring_to_pool(flight[i]);
+         inflight = unsubmitted = 0;
+         continue;
+      }
+      // with a transient error we retry, otherwise the result is how many
+      // of the unsubmitted entries went in, oldest first
+      for (i=0; res > 0 && i < (unsigned int) res; ++i)
+         flight[inflight++] = (stb_bgio_req *) (size_t) stb__uring.sqes[(tail - unsubmitted + i) & *stb__uring.sq_mask].user_data;
+      if (res > 0)
+         unsubmitted -= res;
+
+      head = *stb__uring.cq_head;
+      stb_barrier();
+      while (head != *stb__uring.cq_tail) {
+         struct io_uring_cqe *c = &stb__uring.cqes[head & *stb__uring.cq_mask];
+         stb_bgio_req *r = (stb_bgio_req *) (size_t) c->user_data;
+         for (i=0; flight[i] != r; ++i)
+            ;
+         flight[i] = flight[--inflight];
+         stb__uring_complete(r, c->res);
+         ++head;
+      }
+      stb_barrier();
+      *stb__uring.cq_head = head;
+   }
+   stb__uring.running = 0;
+   return NULL;
 }
 
-
-typedef struct
+static void stb__uring_shutdown(void)
 {
-   char *filename;
-   FILE *f;
-   int offset;
-   int len;
-
-   stb_bgstat *stat_out;
-   stb_uchar *output;
-   stb_uchar **result;
-   int *len_output;
-   int *flag;
-} stb__disk_command;
-
-#define STB__MAX_DISK_COMMAND 100
-static stb__disk_command stb__dc_queue[STB__MAX_DISK_COMMAND];
-static int stb__dc_offset;
+   stb__uring.tried = STB_FALSE;
+   if (!stb__uring.live) return;
+   stb_mutex_begin(stb__diskio_mutex);
+   stb__uring.quit = STB_TRUE;
+   if (stb__uring.idle) {
+      stb__uring.idle = STB_FALSE;
+      stb_sem_release(stb__uring.work);
+   }
+   stb_mutex_end(stb__diskio_mutex);
+   while (stb__uring.running)
+      stb__thread_sleep(1);
+   stb_sem_delete(stb__uring.work);
+   stb__uring_unmap();
+   stb__uring.live = stb__uring.ok = STB_FALSE;
+}
+#else
+static void stb__uring_shutdown(void) { }
+#endif
 
 void stb__io_init(void)
 {
@@ -11967,110 +15750,165 @@ void stb__io_init(void)
       if (*(stb_thread * volatile *) &stb__diskio == NULL) {
          stb__diskio_mutex = stb_mutex_new();
          // use many threads so OS can try to schedule seeks
-         stb__diskio = stb_workq_new_flags(16,STB__MAX_DISK_COMMAND,STB_FALSE,STB_FALSE);
+         stb__diskio = stb_workq_new_flags(16,STB_THREADQ_DYNAMIC,STB_FALSE,STB_FALSE);
+         #ifdef STB__IO_URING
+         if (!stb__uring.tried)
+            stb__uring_init();
+         #endif
       }
       stb_mutex_end(stb__threadmutex);
    }
 }
 
-static void * stb__io_error(stb__disk_command *dc)
+static stb_bgio_req *stb__bgio_new(stb_bgio_desc *d)
 {
-   if (dc->len_output) *dc->len_output = 0;
-   if (dc->result) *dc->result = NULL;
-   if (dc->flag) *dc->flag = -1;
-   return NULL;
+   stb_bgio_req *r = (stb_bgio_req *) malloc(sizeof(*r));
+   if (r == NULL) return NULL;
+   r->filename = NULL;
+   if (d->filename && (r->filename = strdup(d->filename)) == NULL) {
+      free(r);
+      return NULL;
+   }
+   r->f = d->filename ? NULL : d->f;
+   r->offset = d->offset;
+   r->len = d->len < 0 ? STB_BGIO_READ_ALL : d->len;
+   r->buffer = d->buffer;
+   r->priority = d->priority;
+   r->callback = d->callback;
+   r->userdata = d->userdata;
+   r->stat_out = NULL;
+   r->result = NULL;
+   r->len_output = NULL;
+   r->flag = NULL;
+   r->data = NULL;
+   r->got = 0;
+   r->status = STB_BGIO_PENDING;
+   r->refs = 1;
+   r->heap_index = -1;
+   r->wake = STB_SEMAPHORE_NULL;
+   #ifdef STB__IO_URING
+   r->uring = (r->f != NULL && stb__uring.ok);
+   #else
+   r->uring = STB_FALSE;
+   #endif
+   return r;
 }
 
-static void * stb__io_task(void *p)
+// queues everything under one lock, and wakes the io_uring thread once
+static int stb__bgio_queue(stb_bgio_req **r, int n)
 {
-   stb__disk_command *dc = (stb__disk_command *) p;
-   int len;
-   FILE *f;
-   stb_uchar *buf;
-
-   if (dc->stat_out) {  
-      struct _stati64 s;
-      if (!_stati64(dc->filename, &s)) {
-         dc->stat_out->filesize = s.st_size;
-         dc->stat_out->filetime = s.st_mtime;
-         dc->stat_out->is_dir = s.st_mode & _S_IFDIR;
-         dc->stat_out->is_valid = (s.st_mode & _S_IFREG) || dc->stat_out->is_dir;
-      } else
-         dc->stat_out->is_valid = 0;
-      stb_barrier();
-      dc->stat_out->have_data = 1;
-      free(dc->filename);
-      return 0;
-   }
-   if (dc->f) {
-      #ifdef WIN32
-      f = _fdopen(_dup(_fileno(dc->f)), "rb");
-      #else
-      f = fdopen(dup(fileno(dc->f)), "rb");
-      #endif
-      if (!f)
-         return stb__io_error(dc);
-   } else {
-      f = fopen(dc->filename, "rb");
-      free(dc->filename);
-      if (!f)
-         return stb__io_error(dc);
+   int i, pool = 0, wake = STB_FALSE, queued = 0;
+   stb_mutex_begin(stb__diskio_mutex);
+   for (i=0; i < n; ++i) {
+      if (r[i] == NULL) continue;
+      r[i]->seq = stb__bgio_seq++;
+      stb__bgio_heap_push(&stb__bgio_heap[r[i]->uring], r[i]);
+      if (r[i]->uring) wake = STB_TRUE; else ++pool;
+      ++queued;
    }
-
-   len = dc->len;
-   if (len < 0) {
-      fseek(f, 0, SEEK_END);
-      len = ftell(f) - dc->offset;
+   #ifdef STB__IO_URING
+   if (wake && stb__uring.idle) {
+      stb__uring.idle = STB_FALSE;
+      stb_sem_release(stb__uring.work);
    }
+   #endif
+   stb_mutex_end(stb__diskio_mutex);
+   for (i=0; i < pool; ++i)
+      if (!stb_workq(stb__diskio, stb__bgio_pool_task, NULL, NULL))
+         stb__bgio_pool_task(NULL);
+   return queued;
+}
 
-   if (fseek(f, dc->offset, SEEK_SET)) { 
-      fclose(f);
-      return stb__io_error(dc);
+int stb_bgio_submit_batch(stb_bgio_desc *d, int count, stb_bgio_req **reqs)
+{
+   stb_bgio_req *local[64], **r = count <= 64 ? local : (stb_bgio_req **) malloc(count * sizeof(*r));
+   int i, n;
+   if (r == NULL) return 0;
+   stb__io_init();
+   for (i=0; i < count; ++i) {
+      r[i] = stb__bgio_new(&d[i]);
+      if (r[i] && reqs) ++r[i]->refs;
+      if (reqs) reqs[i] = r[i];
    }
+   n = stb__bgio_queue(r, count);
+   if (r != local) free(r);
+   return n;
+}
 
-   if (dc->output)
-      buf = dc->output;
-   else {
-      buf = (stb_uchar *) malloc(len);
-      if (buf == NULL) {
-         fclose(f);
-         return stb__io_error(dc);
-      }
-   }
+stb_bgio_req *stb_bgio_submit(stb_bgio_desc *d)
+{
+   stb_bgio_req *r = NULL;
+   stb_bgio_submit_batch(d, 1, &r);
+   return r;
+}
 
-   len = fread(buf, 1, len, f);
-   fclose(f);
-   if (dc->len_output) *dc->len_output = len;
-   if (dc->result) *dc->result = buf;
-   if (dc->flag) *dc->flag = 1;
+int stb_bgio_cancel(stb_bgio_req *r)
+{
+   int queued;
+   stb_mutex_begin(stb__diskio_mutex);
+   queued = (r->heap_index >= 0);
+   if (queued)
+      stb__bgio_heap_remove(stb__bgio_heap[r->uring], r->heap_index);
+   stb_mutex_end(stb__diskio_mutex);
+   if (queued)
+      stb__bgio_finish(r, STB_BGIO_CANCELLED);
+   return queued;
+}
 
-   return NULL;
+int stb_bgio_status(stb_bgio_req *r, stb_uchar **data, stb_int64 *len)
+{
+   int status = r->status;
+   stb_barrier();
+   if (data) *data = status == STB_BGIO_DONE ? r->data : NULL;
+   if (len)  *len  = status == STB_BGIO_DONE ? r->got  : 0;
+   return status;
 }
 
-int stb__io_add(char *fname, FILE *f, int off, int len, stb_uchar *out, stb_uchar **result, int *olen, int *flag, stb_bgstat *stat)
+int stb_bgio_wait(stb_bgio_req *r, stb_uchar **data, stb_int64 *len)
 {
-   int res;
-   stb__io_init();
-   // do memory allocation outside of mutex
-   if (fname) fname = strdup(fname);
+   stb_semaphore wake = STB_SEMAPHORE_NULL;
    stb_mutex_begin(stb__diskio_mutex);
-   {
-      stb__disk_command *dc = &stb__dc_queue[stb__dc_offset];
-      dc->filename = fname;
-      dc->f = f;
-      dc->offset = off;
-      dc->len = len;
-      dc->output = out;
-      dc->result = result;
-      dc->len_output = olen;
-      dc->flag = flag;
-      dc->stat_out = stat;
-      res = stb_workq(stb__diskio, stb__io_task, dc, NULL);
-      if (res)
-         stb__dc_offset = (stb__dc_offset + 1 == STB__MAX_DISK_COMMAND ? 0 : stb__dc_offset+1);
+   if (r->status == STB_BGIO_PENDING) {
+      if (r->wake == STB_SEMAPHORE_NULL)
+         r->wake = stb_sem_new(1);
+      wake = r->wake;
    }
    stb_mutex_end(stb__diskio_mutex);
-   return res;
+   if (wake != STB_SEMAPHORE_NULL)
+      stb_sem_waitfor(wake);
+   else
+      while (r->status == STB_BGIO_PENDING) // out of memory for the semaphore
+         stb__thread_sleep(1);
+   return stb_bgio_status(r, data, len);
+}
+
+void stb_bgio_release(stb_bgio_req *r)
+{
+   if (r == NULL) return;
+   stb_mutex_begin(stb__diskio_mutex);
+   stb__bgio_free(r);
+   stb_mutex_end(stb__diskio_mutex);
+}
+
+int stb__io_add(char *fname, FILE *f, int off, int len, stb_uchar *out, stb_uchar **result, int *olen, int *flag, stb_bgstat *stat)
+{
+   stb_bgio_desc d;
+   stb_bgio_req *r;
+   memset(&d, 0, sizeof(d));
+   d.filename = fname;
+   d.f = f;
+   d.offset = off;
+   d.len = len;
+   d.buffer = out;
+   stb__io_init();
+   r = stb__bgio_new(&d);
+   if (r == NULL) return STB_FALSE;
+   r->result = result;
+   r->len_output = olen;
+   r->flag = flag;
+   r->stat_out = stat;
+   if (stat) r->uring = STB_FALSE;
+   return stb__bgio_queue(&r, 1);
 }
 
 int stb_bgio_read(char *filename, int offset, int len, stb_uchar **result, int *olen)
@@ -12098,6 +15936,261 @@ STB_EXTERN int stb_bgio_stat    (char *filename, stb_bgstat *result)
    result->have_data = 0;
    return stb__io_add(filename,NULL,0,0,0,NULL,0,NULL, result);
 }
+
+// the blocks are a ring of slots, each with its own buffer and request;
+// 'head' is the one being consumed. as soon as the caller moves past a
+// block, its slot is reissued for the next block of the file
+struct stb__bgstream
+{
+   char *filename;
+   FILE *f;
+   int block_size, num_blocks;
+   stb_bgio_req **req;
+   stb_uchar **buf;
+   stb_int64 *offset;   // file offset of each slot's block
+   stb_int64 next;      // file offset of the next block to request
+   int head;            // -1 before the first block
+   stb_uchar *cur, *end;
+   stb_int64 base;      // file offset of 'start'
+   stb_uchar *start;
+   int short_read;      // a block came back short, so stop requesting more
+   int eof, error;
+};
+
+static void stb__bgstream_issue(stb_bgstream *s, int slot)
+{
+   stb_bgio_desc d;
+   memset(&d, 0, sizeof(d));
+   d.filename = s->filename;
+   d.f = s->f;
+   d.offset = s->offset[slot] = s->next;
+   d.len = s->block_size;
+   d.buffer = s->buf[slot];
+   s->req[slot] = stb_bgio_submit(&d);
+   s->next += s->block_size;
+}
+
+static stb_bgstream *stb__bgstream_new(char *filename, FILE *f, stb_int64 offset, int block_size, int num_blocks)
+{
+   stb_bgstream *s;
+   int i;
+   if (block_size <= 0) block_size = 1 << 20;
+   if (num_blocks <= 0) num_blocks = 4;
+   s = (stb_bgstream *) malloc(sizeof(*s) + num_blocks * (sizeof(s->req[0]) + sizeof(s->buf[0]) + sizeof(s->offset[0])));
+   if (s == NULL) return NULL;
+   s->offset = (stb_int64 *) (s+1);
+   s->req = (stb_bgio_req **) (s->offset + num_blocks);
+   s->buf = (stb_uchar **) (s->req + num_blocks);
+   s->buf[0] = (stb_uchar *) malloc((size_t) block_size * num_blocks);
+   s->filename = filename ? strdup(filename) : NULL;
+   if (s->buf[0] == NULL || (filename && s->filename == NULL)) {
+      free(s->buf[0]);
+      free(s->filename);
+      free(s);
+      return NULL;
+   }
+   s->f = f;
+   s->block_size = block_size;
+   s->num_blocks = num_blocks;
+   s->next = offset;
+   s->head = -1;
+   s->cur = s->end = s->start = NULL;
+   s->base = offset;
+   s->short_read = s->eof = s->error = 0;
+   for (i=0; i < num_blocks; ++i) {
+      s->buf[i] = s->buf[0] + (size_t) block_size * i;
+      stb__bgstream_issue(s, i);
+   }
+   return s;
+}
+
+stb_bgstream *stb_bgstream_open(char *filename, int block_size, int num_blocks)
+{
+   return stb__bgstream_new(filename, NULL, 0, block_size, num_blocks);
+}
+
+stb_bgstream *stb_bgstream_openf(FILE *f, stb_int64 offset, int block_size, int num_blocks)
+{
+   return stb__bgstream_new(NULL, f, offset, block_size, num_blocks);
+}
+
+// moves on to the next block; returns FALSE at the end or on error
+static int stb__bgstream_advance(stb_bgstream *s)
+{
+   stb_int64 len;
+   int status;
+   if (s->eof || s->error) return STB_FALSE;
+   s->base += s->cur - s->start;
+   s->cur = s->end = s->start = NULL;
+   if (s->head >= 0 && !s->short_read)
+      stb__bgstream_issue(s, s->head);
+   else if (s->head >= 0)
+      s->req[s->head] = NULL;
+   s->head = (s->head + 1) % s->num_blocks;
+   if (s->req[s->head] == NULL) {
+      // either it was never issued because we're past the end, or out of memory
+      s->error = !s->short_read;
+      s->eof = s->short_read;
+      return STB_FALSE;
+   }
+   status = stb_bgio_wait(s->req[s->head], NULL, &len);
+   stb_bgio_release(s->req[s->head]);
+   s->req[s->head] = NULL;
+   if (status != STB_BGIO_DONE) {
+      s->error = STB_TRUE;
+      return STB_FALSE;
+   }
+   if (len < s->block_size)
+      s->short_read = STB_TRUE;
+   if (len == 0) {
+      s->eof = STB_TRUE;
+      return STB_FALSE;
+   }
+   s->base  = s->offset[s->head];
+   s->start = s->cur = s->buf[s->head];
+   s->end   = s->cur + len;
+   return STB_TRUE;
+}
+
+int stb_bgstream_next(stb_bgstream *s, stb_uchar **data)
+{
+   int n;
+   if (s->cur == s->end && !stb__bgstream_advance(s)) {
+      *data = NULL;
+      return s->error ? -1 : 0;
+   }
+   *data = s->cur;
+   n = (int) (s->end - s->cur);
+   s->cur = s->end;
+   return n;
+}
+
+size_t stb_bgstream_read(void *buffer, size_t size, size_t count, stb_bgstream *s)
+{
+   size_t want = size * count, got = 0;
+   if (size == 0) return 0;
+   while (got < want) {
+      size_t n;
+      if (s->cur == s->end && !stb__bgstream_advance(s))
+         break;
+      n = stb_min(want - got, (size_t) (s->end - s->cur));
+      memcpy((char *) buffer + got, s->cur, n);
+      s->cur += n;
+      got += n;
+   }
+   return got / size;
+}
+
+int stb_bgstream_getc(stb_bgstream *s)
+{
+   if (s->cur == s->end && !stb__bgstream_advance(s))
+      return EOF;
+   return *s->cur++;
+}
+
+int stb_bgstream_eof  (stb_bgstream *s) { return s->eof; }
+int stb_bgstream_error(stb_bgstream *s) { return s->error; }
+
+stb_int64 stb_bgstream_tell(stb_bgstream *s)
+{
+   return s->base + (s->cur - s->start);
+}
+
+void stb_bgstream_close(stb_bgstream *s)
+{
+   int i;
+   // the reads still in flight are writing into our buffers
+   for (i=0; i < s->num_blocks; ++i)
+      if (s->req[i]) {
+         if (!stb_bgio_cancel(s->req[i]))
+            stb_bgio_wait(s->req[i], NULL, NULL);
+         stb_bgio_release(s->req[i]);
+      }
+   free(s->buf[0]);
+   free(s->filename);
+   free(s);
+}
+
+// as an stbfile, the input window is the stream's current block
+static void stb__bgsync(stbfile *f)
+{
+   stb_bgstream *s = (stb_bgstream *) f->ptr;
+   s->cur = f->indata;
+}
+
+static int stb__bggetbyte(stbfile *f)
+{
+   stb_bgstream *s = (stb_bgstream *) f->ptr;
+   int c;
+   stb__bgsync(f);
+   c = stb_bgstream_getc(s);
+   f->indata = s->cur;
+   f->inend  = s->end;
+   return c == EOF ? -1 : c;
+}
+
+static unsigned int stb__bggetdata(stbfile *f, void *buffer, unsigned int len)
+{
+   stb_bgstream *s = (stb_bgstream *) f->ptr;
+   unsigned int n;
+   stb__bgsync(f);
+   n = (unsigned int) stb_bgstream_read(buffer, 1, len, s);
+   f->indata = s->cur;
+   f->inend  = s->end;
+   return n;
+}
+
+static stb_uint64 stb__bgsize(stbfile *f)
+{
+   stb_bgstream *s = (stb_bgstream *) f->ptr;
+#ifdef _WIN32
+   struct _stati64 st;
+   if (s->f ? _fstati64(_fileno(s->f), &st) : _stati64(s->filename, &st)) return 0;
+#else
+   struct stat st;
+   if (s->f ? fstat(fileno(s->f), &st) : stat(s->filename, &st)) return 0;
+#endif
+   return (stb_uint64) st.st_size;
+}
+
+static stb_uint64 stb__bgtell(stbfile *f)
+{
+   stb__bgsync(f);
+   return (stb_uint64) stb_bgstream_tell((stb_bgstream *) f->ptr);
+}
+
+static void stb__bgclose(stbfile *f)
+{
+   stb_bgstream_close((stb_bgstream *) f->ptr);
+}
+
+static stbfile *stb__open_bgstream(stb_bgstream *s)
+{
+   stbfile m = { stb__bggetbyte, stb__bggetdata,
+                 stb__noputbyte, stb__noputdata,
+                 stb__bgsize, stb__bgtell, stb__nobackpatch, stb__bgclose,
+                 0,0,0,0, {0}, 0,0 };
+   stbfile *z;
+   if (s == NULL) return NULL;
+   z = (stbfile *) malloc(sizeof(*z));
+   if (z == NULL) {
+      stb_bgstream_close(s);
+      return NULL;
+   }
+   *z = m;
+   z->ptr = s;
+   return z;
+}
+
+stbfile *stb_open_bgstream(char *filename, int block_size, int num_blocks)
+{
+   return stb__open_bgstream(stb_bgstream_open(filename, block_size, num_blocks));
+}
+
+stbfile *stb_openf_bgstream(FILE *f, stb_int64 offset, int block_size, int num_blocks)
+{
+   return stb__open_bgstream(stb_bgstream_openf(f, offset, block_size, num_blocks));
+}
 #endif
 #endif
 
@@ -1,4 +1,4 @@
-// stb_dxt.h - v1.04 - DXT1/DXT5 compressor - public domain
+// stb_dxt.h - v1.05 - DXT1/DXT5/BC4/BC5 compressor (and decompressor) - public domain
 // original by fabian "ryg" giesen - ported to C by stb
 // use '#define STB_DXT_IMPLEMENTATION' before including to create the implementation
 //
@@ -8,7 +8,17 @@
 //     A is ignored if you specify alpha=0; you can turn on dithering
 //     and "high quality" using mode.
 //
+//   call stb_compress_bc4_block() / stb_compress_bc5_block() for one or two
+//     channel blocks (e.g. roughness, or the X,Y of a normal map)
+//
+//   or call stb_compress_dxt_image() for a whole RGBA surface of any size;
+//     it extracts and pads the blocks for you and writes them out
+//     contiguously, in rows of blocks. define STB_DXT_THREADS to get
+//     stb_compress_dxt_image_parallel() as well.
+//
 // version history:
+//   v1.05  - whole-image compression, SSE2 block encoder, constant lookup tables,
+//            BC4/BC5 (and BC5 normal maps), decoder and error metrics
 //   v1.04  - (ryg) default to no rounding bias for lerped colors (as per S3TC/DX10 spec);
 //            single color match fix (allow for inexact color interpolation);
 //            optimal DXT5 index finder; "high quality" mode that runs multiple refinement steps.
@@ -28,6 +38,65 @@
 void stb_compress_dxt_block(unsigned char *dest, const unsigned char *src, int alpha, int mode);
 #define STB_COMPRESS_DXT_BLOCK
 
+// returns whether the SSE2 block encoder (see STB_DXT_NO_SIMD) is compiled
+// in, and if so turns it on or off; it starts on. the output is the same
+// either way, so this is only for testing. don't call it while compressing
+int stb_dxt_simd(int enable);
+
+// BC4 (a.k.a. ATI1/3Dc+): src is a 4x4 block of 16 single-channel values;
+// writes 8 bytes, encoded the same way as DXT5 alpha
+void stb_compress_bc4_block(unsigned char *dest, const unsigned char *src);
+
+// BC5 (a.k.a. ATI2/3Dc): src is a 4x4 block of 16 two-channel values (32
+// bytes, interleaved); writes 16 bytes, one BC4 block per channel. for
+// normal maps store X,Y here and rebuild Z = sqrt(1-X*X-Y*Y) in the shader;
+// never dither normal maps, which is why this has no mode argument.
+void stb_compress_bc5_block(unsigned char *dest, const unsigned char *src);
+
+// formats for the image functions; 0 and 1 match the 'alpha' argument above
+#define STB_DXT_BC1       0   // DXT1, RGB                    8 bytes/block
+#define STB_DXT_BC3       1   // DXT5, RGB + A               16 bytes/block
+#define STB_DXT_BC4       2   // R only                       8 bytes/block
+#define STB_DXT_BC5       3   // R and G                     16 bytes/block
+#define STB_DXT_NORMALMAP STB_DXT_BC5  // X,Y from R,G; Z (in B) is ignored
+
+// compress a w*h RGBA surface whose rows are 'stride' bytes apart. partial
+// blocks on the right and bottom edges are padded by repeating the last
+// column/row. dest receives ((w+3)/4)*((h+3)/4) blocks, left-to-right,
+// top-to-bottom. format is one of the STB_DXT_BC* values (so 0/1 work like
+// 'alpha' does for stb_compress_dxt_block); mode is ignored for BC4/BC5.
+void stb_compress_dxt_image(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format, int mode);
+
+// the same, but only block rows [first_row, first_row+num_rows); dest still
+// points to the start of the whole output. disjoint ranges can be compressed
+// from different threads at the same time.
+void stb_compress_dxt_image_rows(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format, int mode, int first_row, int num_rows);
+
+// decompression, for validation, thumbnails and CPU-side sampling. colors
+// are interpolated exactly as the encoder assumes (so they follow
+// STB_DXT_USE_ROUNDING_BIAS). blocks decode to 4x4 RGBA in row-major order
+// (64 bytes); DXT1 blocks using the 3-color mode decode index 3 to
+// transparent black. BC4/BC5 blocks decode to 16/32 bytes of channel data.
+void stb_decompress_dxt_block(unsigned char *dest, const unsigned char *src, int alpha);
+void stb_decompress_bc4_block(unsigned char *dest, const unsigned char *src);
+void stb_decompress_bc5_block(unsigned char *dest, const unsigned char *src);
+
+// decode a whole image written by stb_compress_dxt_image to a w*h RGBA
+// surface. BC4 gives (R,0,0,255) and BC5 gives (R,G,0,255).
+void stb_decompress_dxt_image(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format);
+
+// compares the w*h RGBA surface 'orig' to its compressed version, over the
+// channels the format stores (RGB, RGBA, R or RG). returns the RMSE in 8-bit
+// units, and the PSNR in dB in *psnr (if non-NULL; 999 for an exact match).
+double stb_dxt_image_error(const unsigned char *orig, int w, int h, int stride, const unsigned char *compressed, int format, double *psnr);
+
+#ifdef STB_DXT_THREADS
+// stb_compress_dxt_image and stb_dxt_image_error, with the block rows spread
+// over 'num_threads' threads (Windows threads or pthreads). results are identical.
+void stb_compress_dxt_image_parallel(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format, int mode, int num_threads);
+double stb_dxt_image_error_parallel(const unsigned char *orig, int w, int h, int stride, const unsigned char *compressed, int format, double *psnr, int num_threads);
+#endif
+
 #ifdef STB_DXT_IMPLEMENTATION
 
 // configuration options for DXT encoder. set them in the project/makefile or just define
@@ -44,16 +113,233 @@ void stb_compress_dxt_block(unsigned char *dest, const unsigned char *src, int a
 //     you also see "(a*5 + b*3) / 8" on some old GPU designs.
 // #define STB_DXT_USE_ROUNDING_BIAS
 
+// STB_DXT_NO_SIMD
+//     the per-block PCA, color matching and refinement have SSE2 versions that
+//     are used automatically when the compiler targets SSE2; they produce
+//     exactly the same output as the scalar code. define this to disable them
+//     (stb_dxt_simd(0) does it at run time).
+// #define STB_DXT_NO_SIMD
+
 #include <stdlib.h>
 #include <math.h>
 #include <string.h> // memset
 
-static unsigned char stb__Expand5[32];
-static unsigned char stb__Expand6[64];
-static unsigned char stb__OMatch5[256][2];
-static unsigned char stb__OMatch6[256][2];
-static unsigned char stb__QuantRBTab[256+16];
-static unsigned char stb__QuantGTab[256+16];
+#if !defined(STB_DXT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STB_DXT_SSE2
+#include <emmintrin.h>
+static int stb__dxt_simd = 1;
+#endif
+
+int stb_dxt_simd(int enable)
+{
+#ifdef STB_DXT_SSE2
+   stb__dxt_simd = enable;
+   return 1;
+#else
+   (void) enable;
+   return 0;
+#endif
+}
+
+// lookup tables. they're precomputed constant data, so there's no first-use
+// initialization to race on when several threads start compressing at once.
+//
+// stb__Expand5/6[i]   = 5/6-bit value i replicated out to 8 bits
+// stb__QuantRBTab[i]  = stb__Expand5[stb__Mul8Bit(clamp(i-8,0,255),31)]
+// stb__QuantGTab[i]   = stb__Expand6[stb__Mul8Bit(clamp(i-8,0,255),63)]
+// stb__OMatch5/6[i]   = the (max,min) endpoint pair whose 1/3 lerp (see
+//                       stb__Lerp13) best reproduces the constant color i,
+//                       allowing for the 3% interpolation error DX10
+//                       permits; so these depend on STB_DXT_USE_ROUNDING_BIAS
+
+static const unsigned char stb__Expand5[32] = {
+     0,   8,  16,  24,  33,  41,  49,  57,  66,  74,  82,  90,  99, 107, 115, 123,
+   132, 140, 148, 156, 165, 173, 181, 189, 198, 206, 214, 222, 231, 239, 247, 255,
+};
+static const unsigned char stb__Expand6[64] = {
+     0,   4,   8,  12,  16,  20,  24,  28,  32,  36,  40,  44,  48,  52,  56,  60,
+    65,  69,  73,  77,  81,  85,  89,  93,  97, 101, 105, 109, 113, 117, 121, 125,
+   130, 134, 138, 142, 146, 150, 154, 158, 162, 166, 170, 174, 178, 182, 186, 190,
+   195, 199, 203, 207, 211, 215, 219, 223, 227, 231, 235, 239, 243, 247, 251, 255,
+};
+static const unsigned char stb__QuantRBTab[256+16] = {
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   8,   8,   8,
+     8,   8,   8,   8,   8,  16,  16,  16,  16,  16,  16,  16,  16,  24,  24,  24,
+    24,  24,  24,  24,  24,  33,  33,  33,  33,  33,  33,  33,  33,  33,  41,  41,
+    41,  41,  41,  41,  41,  41,  49,  49,  49,  49,  49,  49,  49,  49,  57,  57,
+    57,  57,  57,  57,  57,  57,  66,  66,  66,  66,  66,  66,  66,  66,  74,  74,
+    74,  74,  74,  74,  74,  74,  74,  82,  82,  82,  82,  82,  82,  82,  82,  90,
+    90,  90,  90,  90,  90,  90,  90,  99,  99,  99,  99,  99,  99,  99,  99, 107,
+   107, 107, 107, 107, 107, 107, 107, 107, 115, 115, 115, 115, 115, 115, 115, 115,
+   123, 123, 123, 123, 123, 123, 123, 123, 132, 132, 132, 132, 132, 132, 132, 132,
+   140, 140, 140, 140, 140, 140, 140, 140, 148, 148, 148, 148, 148, 148, 148, 148,
+   148, 156, 156, 156, 156, 156, 156, 156, 156, 165, 165, 165, 165, 165, 165, 165,
+   165, 173, 173, 173, 173, 173, 173, 173, 173, 181, 181, 181, 181, 181, 181, 181,
+   181, 181, 189, 189, 189, 189, 189, 189, 189, 189, 198, 198, 198, 198, 198, 198,
+   198, 198, 206, 206, 206, 206, 206, 206, 206, 206, 214, 214, 214, 214, 214, 214,
+   214, 214, 222, 222, 222, 222, 222, 222, 222, 222, 222, 231, 231, 231, 231, 231,
+   231, 231, 231, 239, 239, 239, 239, 239, 239, 239, 239, 247, 247, 247, 247, 247,
+   247, 247, 247, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+static const unsigned char stb__QuantGTab[256+16] = {
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   4,   4,   4,   4,   8,
+     8,   8,   8,  12,  12,  12,  12,  16,  16,  16,  16,  20,  20,  20,  20,  24,
+    24,  24,  24,  28,  28,  28,  28,  32,  32,  32,  32,  36,  36,  36,  36,  40,
+    40,  40,  40,  44,  44,  44,  44,  48,  48,  48,  48,  52,  52,  52,  52,  56,
+    56,  56,  56,  60,  60,  60,  60,  65,  65,  65,  65,  69,  69,  69,  69,  73,
+    73,  73,  73,  77,  77,  77,  77,  81,  81,  81,  81,  85,  85,  85,  85,  85,
+    89,  89,  89,  89,  93,  93,  93,  93,  97,  97,  97,  97, 101, 101, 101, 101,
+   105, 105, 105, 105, 109, 109, 109, 109, 113, 113, 113, 113, 117, 117, 117, 117,
+   121, 121, 121, 121, 125, 125, 125, 125, 130, 130, 130, 130, 134, 134, 134, 134,
+   138, 138, 138, 138, 142, 142, 142, 142, 146, 146, 146, 146, 150, 150, 150, 150,
+   154, 154, 154, 154, 158, 158, 158, 158, 162, 162, 162, 162, 166, 166, 166, 166,
+   170, 170, 170, 170, 170, 174, 174, 174, 174, 178, 178, 178, 178, 182, 182, 182,
+   182, 186, 186, 186, 186, 190, 190, 190, 190, 195, 195, 195, 195, 199, 199, 199,
+   199, 203, 203, 203, 203, 207, 207, 207, 207, 211, 211, 211, 211, 215, 215, 215,
+   215, 219, 219, 219, 219, 223, 223, 223, 223, 227, 227, 227, 227, 231, 231, 231,
+   231, 235, 235, 235, 235, 239, 239, 239, 239, 243, 243, 243, 243, 247, 247, 247,
+   247, 251, 251, 251, 251, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+};
+
+#ifdef STB_DXT_USE_ROUNDING_BIAS
+static const unsigned char stb__OMatch5[256][2] = {
+   {  0,  0}, {  0,  0}, {  0,  1}, {  0,  1}, {  1,  0}, {  1,  0}, {  1,  0}, {  1,  1},
+   {  1,  1}, {  1,  1}, {  2,  0}, {  2,  0}, {  2,  0}, {  2,  1}, {  2,  1}, {  3,  0},
+   {  3,  0}, {  3,  0}, {  3,  1}, {  3,  1}, {  3,  1}, {  3,  2}, {  4,  0}, {  4,  0},
+   {  3,  3}, {  4,  1}, {  4,  1}, {  4,  2}, {  4,  2}, {  5,  1}, {  5,  1}, {  5,  1},
+   {  3,  6}, {  5,  2}, {  5,  2}, {  5,  3}, {  4,  5}, {  6,  2}, {  6,  2}, {  6,  2},
+   {  6,  3}, {  6,  3}, {  6,  3}, {  7,  2}, {  6,  4}, {  7,  3}, {  7,  3}, {  8,  1},
+   {  7,  4}, {  7,  4}, {  7,  4}, {  7,  5}, {  7,  5}, {  7,  5}, {  7,  6}, {  8,  4},
+   {  8,  4}, {  7,  7}, {  8,  5}, {  8,  5}, {  8,  6}, {  8,  6}, {  9,  5}, {  9,  5},
+   {  9,  5}, {  7, 10}, {  9,  6}, {  9,  6}, {  9,  7}, {  8,  9}, { 10,  6}, { 10,  6},
+   { 10,  6}, { 10,  7}, { 10,  7}, { 10,  7}, { 11,  6}, { 10,  8}, { 11,  7}, { 11,  7},
+   { 12,  5}, { 11,  8}, { 11,  8}, { 11,  8}, { 11,  9}, { 11,  9}, { 11,  9}, { 11, 10},
+   { 12,  8}, { 12,  8}, { 11, 11}, { 12,  9}, { 12,  9}, { 12, 10}, { 12, 10}, { 13,  9},
+   { 13,  9}, { 13,  9}, { 11, 14}, { 13, 10}, { 13, 10}, { 13, 11}, { 12, 13}, { 14, 10},
+   { 14, 10}, { 14, 10}, { 14, 11}, { 14, 11}, { 14, 11}, { 15, 10}, { 14, 12}, { 15, 11},
+   { 15, 11}, { 16,  9}, { 15, 12}, { 15, 12}, { 15, 12}, { 15, 13}, { 15, 13}, { 15, 13},
+   { 15, 14}, { 16, 12}, { 16, 12}, { 15, 15}, { 16, 13}, { 16, 13}, { 16, 14}, { 16, 14},
+   { 17, 13}, { 17, 13}, { 17, 13}, { 15, 18}, { 17, 14}, { 17, 14}, { 17, 15}, { 16, 17},
+   { 18, 14}, { 18, 14}, { 18, 14}, { 18, 15}, { 18, 15}, { 18, 15}, { 19, 14}, { 18, 16},
+   { 19, 15}, { 19, 15}, { 20, 13}, { 19, 16}, { 19, 16}, { 19, 16}, { 19, 17}, { 19, 17},
+   { 19, 17}, { 19, 18}, { 20, 16}, { 20, 16}, { 19, 19}, { 20, 17}, { 20, 17}, { 20, 18},
+   { 20, 18}, { 21, 17}, { 21, 17}, { 21, 17}, { 19, 22}, { 21, 18}, { 21, 18}, { 21, 19},
+   { 20, 21}, { 22, 18}, { 22, 18}, { 22, 18}, { 22, 19}, { 22, 19}, { 22, 19}, { 23, 18},
+   { 22, 20}, { 23, 19}, { 23, 19}, { 24, 17}, { 23, 20}, { 23, 20}, { 23, 20}, { 23, 21},
+   { 23, 21}, { 23, 21}, { 23, 22}, { 24, 20}, { 24, 20}, { 23, 23}, { 24, 21}, { 24, 21},
+   { 24, 22}, { 24, 22}, { 25, 21}, { 25, 21}, { 25, 21}, { 23, 26}, { 25, 22}, { 25, 22},
+   { 25, 23}, { 24, 25}, { 26, 22}, { 26, 22}, { 26, 22}, { 26, 23}, { 26, 23}, { 26, 23},
+   { 27, 22}, { 26, 24}, { 27, 23}, { 27, 23}, { 28, 21}, { 27, 24}, { 27, 24}, { 27, 24},
+   { 27, 25}, { 27, 25}, { 27, 25}, { 27, 26}, { 28, 24}, { 28, 24}, { 27, 27}, { 28, 25},
+   { 28, 25}, { 28, 26}, { 28, 26}, { 29, 25}, { 29, 25}, { 29, 25}, { 27, 30}, { 29, 26},
+   { 29, 26}, { 29, 27}, { 28, 29}, { 30, 26}, { 30, 26}, { 30, 26}, { 30, 27}, { 30, 27},
+   { 30, 27}, { 31, 26}, { 30, 28}, { 31, 27}, { 31, 27}, { 31, 27}, { 31, 28}, { 31, 28},
+   { 31, 28}, { 31, 29}, { 31, 29}, { 31, 29}, { 31, 30}, { 31, 30}, { 31, 31}, { 31, 31},
+};
+static const unsigned char stb__OMatch6[256][2] = {
+   {  0,  0}, {  0,  1}, {  1,  0}, {  1,  0}, {  1,  1}, {  2,  0}, {  2,  0}, {  2,  1},
+   {  3,  0}, {  3,  1}, {  4,  0}, {  4,  0}, {  4,  1}, {  5,  0}, {  5,  0}, {  5,  1},
+   {  6,  0}, {  6,  1}, {  7,  0}, {  7,  0}, {  7,  1}, {  8,  0}, {  8,  0}, {  8,  1},
+   {  8,  2}, {  9,  1}, {  9,  1}, {  9,  2}, {  9,  3}, { 10,  2}, { 10,  2}, { 10,  3},
+   { 10,  4}, { 11,  3}, { 11,  3}, { 11,  4}, { 11,  5}, { 12,  4}, { 12,  4}, { 12,  5},
+   { 12,  6}, { 13,  5}, { 13,  5}, { 13,  6}, { 13,  7}, { 14,  6}, {  9, 16}, { 14,  7},
+   { 14,  8}, { 15,  7}, { 10, 17}, { 15,  8}, { 15,  9}, { 15, 10}, { 16,  8}, { 16,  9},
+   { 15, 12}, { 16, 10}, { 17,  9}, { 17, 10}, { 15, 15}, { 17, 11}, { 18, 10}, { 18, 11},
+   { 15, 18}, { 18, 12}, { 19, 11}, { 19, 12}, { 17, 16}, { 19, 13}, { 20, 12}, { 20, 13},
+   { 18, 17}, { 20, 14}, { 21, 13}, { 21, 14}, { 20, 16}, { 21, 15}, { 22, 14}, { 22, 15},
+   { 21, 17}, { 22, 16}, { 23, 15}, { 26, 10}, { 23, 16}, { 23, 17}, { 24, 16}, { 27, 11},
+   { 24, 17}, { 24, 18}, { 25, 17}, { 28, 12}, { 25, 18}, { 25, 19}, { 26, 18}, { 29, 13},
+   { 26, 19}, { 26, 20}, { 27, 19}, { 30, 14}, { 27, 20}, { 27, 21}, { 28, 20}, { 31, 15},
+   { 28, 21}, { 28, 22}, { 29, 21}, { 29, 21}, { 29, 22}, { 29, 23}, { 30, 22}, { 25, 32},
+   { 30, 23}, { 30, 24}, { 31, 23}, { 26, 33}, { 31, 24}, { 31, 25}, { 31, 26}, { 32, 24},
+   { 32, 25}, { 31, 28}, { 32, 26}, { 33, 25}, { 33, 26}, { 31, 31}, { 33, 27}, { 34, 26},
+   { 34, 27}, { 31, 34}, { 34, 28}, { 35, 27}, { 35, 28}, { 33, 32}, { 35, 29}, { 36, 28},
+   { 36, 29}, { 34, 33}, { 36, 30}, { 37, 29}, { 37, 30}, { 36, 32}, { 37, 31}, { 38, 30},
+   { 38, 31}, { 37, 33}, { 38, 32}, { 39, 31}, { 42, 26}, { 39, 32}, { 39, 33}, { 40, 32},
+   { 43, 27}, { 40, 33}, { 40, 34}, { 41, 33}, { 44, 28}, { 41, 34}, { 41, 35}, { 42, 34},
+   { 45, 29}, { 42, 35}, { 42, 36}, { 43, 35}, { 46, 30}, { 43, 36}, { 43, 37}, { 44, 36},
+   { 47, 31}, { 44, 37}, { 44, 38}, { 45, 37}, { 45, 37}, { 45, 38}, { 45, 39}, { 46, 38},
+   { 41, 48}, { 46, 39}, { 46, 40}, { 47, 39}, { 42, 49}, { 47, 40}, { 47, 41}, { 47, 42},
+   { 48, 40}, { 48, 41}, { 47, 44}, { 48, 42}, { 49, 41}, { 49, 42}, { 47, 47}, { 49, 43},
+   { 50, 42}, { 50, 43}, { 47, 50}, { 50, 44}, { 51, 43}, { 51, 44}, { 49, 48}, { 51, 45},
+   { 52, 44}, { 52, 45}, { 50, 49}, { 52, 46}, { 53, 45}, { 53, 46}, { 52, 48}, { 53, 47},
+   { 54, 46}, { 54, 47}, { 53, 49}, { 54, 48}, { 55, 47}, { 58, 42}, { 55, 48}, { 55, 49},
+   { 56, 48}, { 59, 43}, { 56, 49}, { 56, 50}, { 57, 49}, { 60, 44}, { 57, 50}, { 57, 51},
+   { 58, 50}, { 61, 45}, { 58, 51}, { 58, 52}, { 59, 51}, { 62, 46}, { 59, 52}, { 59, 53},
+   { 60, 52}, { 63, 47}, { 60, 53}, { 60, 54}, { 61, 53}, { 61, 53}, { 61, 54}, { 61, 55},
+   { 62, 54}, { 62, 54}, { 62, 55}, { 62, 56}, { 63, 55}, { 63, 55}, { 63, 56}, { 63, 57},
+   { 63, 58}, { 63, 58}, { 63, 59}, { 63, 60}, { 63, 61}, { 63, 61}, { 63, 62}, { 63, 63},
+};
+#else
+static const unsigned char stb__OMatch5[256][2] = {
+   {  0,  0}, {  0,  0}, {  0,  1}, {  0,  1}, {  1,  0}, {  1,  0}, {  1,  0}, {  1,  1},
+   {  1,  1}, {  2,  0}, {  2,  0}, {  0,  4}, {  2,  1}, {  2,  1}, {  2,  1}, {  3,  0},
+   {  3,  0}, {  3,  0}, {  3,  1}, {  1,  5}, {  3,  2}, {  3,  2}, {  4,  0}, {  4,  0},
+   {  4,  1}, {  4,  1}, {  4,  2}, {  4,  2}, {  4,  2}, {  3,  5}, {  5,  1}, {  5,  1},
+   {  5,  2}, {  4,  4}, {  5,  3}, {  5,  3}, {  5,  3}, {  6,  2}, {  6,  2}, {  6,  2},
+   {  6,  3}, {  5,  5}, {  6,  4}, {  6,  4}, {  4,  8}, {  7,  3}, {  7,  3}, {  7,  3},
+   {  7,  4}, {  7,  4}, {  7,  4}, {  7,  5}, {  5,  9}, {  7,  6}, {  7,  6}, {  8,  4},
+   {  8,  4}, {  8,  5}, {  8,  5}, {  8,  6}, {  8,  6}, {  8,  6}, {  7,  9}, {  9,  5},
+   {  9,  5}, {  9,  6}, {  8,  8}, {  9,  7}, {  9,  7}, {  9,  7}, { 10,  6}, { 10,  6},
+   { 10,  6}, { 10,  7}, {  9,  9}, { 10,  8}, { 10,  8}, {  8, 12}, { 11,  7}, { 11,  7},
+   { 11,  7}, { 11,  8}, { 11,  8}, { 11,  8}, { 11,  9}, {  9, 13}, { 11, 10}, { 11, 10},
+   { 12,  8}, { 12,  8}, { 12,  9}, { 12,  9}, { 12, 10}, { 12, 10}, { 12, 10}, { 11, 13},
+   { 13,  9}, { 13,  9}, { 13, 10}, { 12, 12}, { 13, 11}, { 13, 11}, { 13, 11}, { 14, 10},
+   { 14, 10}, { 14, 10}, { 14, 11}, { 13, 13}, { 14, 12}, { 14, 12}, { 12, 16}, { 15, 11},
+   { 15, 11}, { 15, 11}, { 15, 12}, { 15, 12}, { 15, 12}, { 15, 13}, { 13, 17}, { 15, 14},
+   { 15, 14}, { 16, 12}, { 16, 12}, { 16, 13}, { 16, 13}, { 16, 14}, { 16, 14}, { 16, 14},
+   { 15, 17}, { 17, 13}, { 17, 13}, { 17, 14}, { 16, 16}, { 17, 15}, { 17, 15}, { 17, 15},
+   { 18, 14}, { 18, 14}, { 18, 14}, { 18, 15}, { 17, 17}, { 18, 16}, { 18, 16}, { 16, 20},
+   { 19, 15}, { 19, 15}, { 19, 15}, { 19, 16}, { 19, 16}, { 19, 16}, { 19, 17}, { 17, 21},
+   { 19, 18}, { 19, 18}, { 20, 16}, { 20, 16}, { 20, 17}, { 20, 17}, { 20, 18}, { 20, 18},
+   { 20, 18}, { 19, 21}, { 21, 17}, { 21, 17}, { 21, 18}, { 20, 20}, { 21, 19}, { 21, 19},
+   { 21, 19}, { 22, 18}, { 22, 18}, { 22, 18}, { 22, 19}, { 21, 21}, { 22, 20}, { 22, 20},
+   { 20, 24}, { 23, 19}, { 23, 19}, { 23, 19}, { 23, 20}, { 23, 20}, { 23, 20}, { 23, 21},
+   { 21, 25}, { 23, 22}, { 23, 22}, { 24, 20}, { 24, 20}, { 24, 21}, { 24, 21}, { 24, 22},
+   { 24, 22}, { 24, 22}, { 23, 25}, { 25, 21}, { 25, 21}, { 25, 22}, { 24, 24}, { 25, 23},
+   { 25, 23}, { 25, 23}, { 26, 22}, { 26, 22}, { 26, 22}, { 26, 23}, { 25, 25}, { 26, 24},
+   { 26, 24}, { 24, 28}, { 27, 23}, { 27, 23}, { 27, 23}, { 27, 24}, { 27, 24}, { 27, 24},
+   { 27, 25}, { 25, 29}, { 27, 26}, { 27, 26}, { 28, 24}, { 28, 24}, { 28, 25}, { 28, 25},
+   { 28, 26}, { 28, 26}, { 28, 26}, { 27, 29}, { 29, 25}, { 29, 25}, { 29, 26}, { 28, 28},
+   { 29, 27}, { 29, 27}, { 29, 27}, { 30, 26}, { 30, 26}, { 30, 26}, { 30, 27}, { 29, 29},
+   { 30, 28}, { 30, 28}, { 30, 28}, { 31, 27}, { 31, 27}, { 31, 27}, { 31, 28}, { 31, 28},
+   { 31, 28}, { 31, 29}, { 31, 29}, { 31, 30}, { 31, 30}, { 31, 30}, { 31, 31}, { 31, 31},
+};
+static const unsigned char stb__OMatch6[256][2] = {
+   {  0,  0}, {  0,  1}, {  1,  0}, {  1,  0}, {  1,  1}, {  2,  0}, {  2,  1}, {  3,  0},
+   {  3,  0}, {  3,  1}, {  4,  0}, {  4,  0}, {  4,  1}, {  5,  0}, {  5,  1}, {  6,  0},
+   {  6,  0}, {  6,  1}, {  7,  0}, {  7,  0}, {  7,  1}, {  8,  0}, {  8,  1}, {  8,  1},
+   {  8,  2}, {  9,  1}, {  9,  2}, {  9,  2}, {  9,  3}, { 10,  2}, { 10,  3}, { 10,  3},
+   { 10,  4}, { 11,  3}, { 11,  4}, { 11,  4}, { 11,  5}, { 12,  4}, { 12,  5}, { 12,  5},
+   { 12,  6}, { 13,  5}, { 13,  6}, {  8, 16}, { 13,  7}, { 14,  6}, { 14,  7}, {  9, 17},
+   { 14,  8}, { 15,  7}, { 15,  8}, { 11, 16}, { 15,  9}, { 15, 10}, { 16,  8}, { 16,  9},
+   { 16, 10}, { 15, 13}, { 17,  9}, { 17, 10}, { 17, 11}, { 15, 16}, { 18, 10}, { 18, 11},
+   { 18, 12}, { 16, 16}, { 19, 11}, { 19, 12}, { 19, 13}, { 17, 17}, { 20, 12}, { 20, 13},
+   { 20, 14}, { 19, 16}, { 21, 13}, { 21, 14}, { 21, 15}, { 20, 17}, { 22, 14}, { 22, 15},
+   { 25, 10}, { 22, 16}, { 23, 15}, { 23, 16}, { 26, 11}, { 23, 17}, { 24, 16}, { 24, 17},
+   { 27, 12}, { 24, 18}, { 25, 17}, { 25, 18}, { 28, 13}, { 25, 19}, { 26, 18}, { 26, 19},
+   { 29, 14}, { 26, 20}, { 27, 19}, { 27, 20}, { 30, 15}, { 27, 21}, { 28, 20}, { 28, 21},
+   { 28, 21}, { 28, 22}, { 29, 21}, { 29, 22}, { 24, 32}, { 29, 23}, { 30, 22}, { 30, 23},
+   { 25, 33}, { 30, 24}, { 31, 23}, { 31, 24}, { 27, 32}, { 31, 25}, { 31, 26}, { 32, 24},
+   { 32, 25}, { 32, 26}, { 31, 29}, { 33, 25}, { 33, 26}, { 33, 27}, { 31, 32}, { 34, 26},
+   { 34, 27}, { 34, 28}, { 32, 32}, { 35, 27}, { 35, 28}, { 35, 29}, { 33, 33}, { 36, 28},
+   { 36, 29}, { 36, 30}, { 35, 32}, { 37, 29}, { 37, 30}, { 37, 31}, { 36, 33}, { 38, 30},
+   { 38, 31}, { 41, 26}, { 38, 32}, { 39, 31}, { 39, 32}, { 42, 27}, { 39, 33}, { 40, 32},
+   { 40, 33}, { 43, 28}, { 40, 34}, { 41, 33}, { 41, 34}, { 44, 29}, { 41, 35}, { 42, 34},
+   { 42, 35}, { 45, 30}, { 42, 36}, { 43, 35}, { 43, 36}, { 46, 31}, { 43, 37}, { 44, 36},
+   { 44, 37}, { 44, 37}, { 44, 38}, { 45, 37}, { 45, 38}, { 40, 48}, { 45, 39}, { 46, 38},
+   { 46, 39}, { 41, 49}, { 46, 40}, { 47, 39}, { 47, 40}, { 43, 48}, { 47, 41}, { 47, 42},
+   { 48, 40}, { 48, 41}, { 48, 42}, { 47, 45}, { 49, 41}, { 49, 42}, { 49, 43}, { 47, 48},
+   { 50, 42}, { 50, 43}, { 50, 44}, { 48, 48}, { 51, 43}, { 51, 44}, { 51, 45}, { 49, 49},
+   { 52, 44}, { 52, 45}, { 52, 46}, { 51, 48}, { 53, 45}, { 53, 46}, { 53, 47}, { 52, 49},
+   { 54, 46}, { 54, 47}, { 57, 42}, { 54, 48}, { 55, 47}, { 55, 48}, { 58, 43}, { 55, 49},
+   { 56, 48}, { 56, 49}, { 59, 44}, { 56, 50}, { 57, 49}, { 57, 50}, { 60, 45}, { 57, 51},
+   { 58, 50}, { 58, 51}, { 61, 46}, { 58, 52}, { 59, 51}, { 59, 52}, { 62, 47}, { 59, 53},
+   { 60, 52}, { 60, 53}, { 60, 53}, { 60, 54}, { 61, 53}, { 61, 54}, { 61, 54}, { 61, 55},
+   { 62, 54}, { 62, 55}, { 62, 55}, { 62, 56}, { 63, 55}, { 63, 56}, { 63, 56}, { 63, 57},
+   { 63, 58}, { 63, 59}, { 63, 59}, { 63, 60}, { 63, 61}, { 63, 62}, { 63, 62}, { 63, 63},
+};
+#endif
 
 static int stb__Mul8Bit(int a, int b)
 {
@@ -101,35 +387,6 @@ static void stb__Lerp13RGB(unsigned char *out, unsigned char *p1, unsigned char
 
 /****************************************************************************/
 
-// compute table to reproduce constant colors as accurately as possible
-static void stb__PrepareOptTable(unsigned char *Table,const unsigned char *expand,int size)
-{
-   int i,mn,mx;
-   for (i=0;i<256;i++) {
-      int bestErr = 256;
-      for (mn=0;mn<size;mn++) {
-         for (mx=0;mx<size;mx++) {
-            int mine = expand[mn];
-            int maxe = expand[mx];
-            int err = abs(stb__Lerp13(maxe, mine) - i);
-            
-            // DX10 spec says that interpolation must be within 3% of "correct" result,
-            // add this as error term. (normally we'd expect a random distribution of
-            // +-1.5% error, but nowhere in the spec does it say that the error has to be
-            // unbiased - better safe than sorry).
-            err += abs(maxe - mine) * 3 / 100;
-            
-            if(err < bestErr)
-            { 
-               Table[i*2+0] = mx;
-               Table[i*2+1] = mn;
-               bestErr = err;
-            }
-         }
-      }
-   }
-}
-
 static void stb__EvalColors(unsigned char *color,unsigned short c0,unsigned short c1)
 {
    stb__From16Bit(color+ 0, c0);
@@ -138,6 +395,53 @@ static void stb__EvalColors(unsigned char *color,unsigned short c0,unsigned shor
    stb__Lerp13RGB(color+12, color+4, color+0);
 }
 
+#ifdef STB_DXT_SSE2
+// the 16 pixels of a block widened to 16 bits, two RGBA pixels per register
+static void stb__LoadBlock16(__m128i *px, const unsigned char *block)
+{
+   __m128i zero = _mm_setzero_si128();
+   int i;
+   for (i=0;i<4;i++) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (block + i*16));
+      px[i*2+0] = _mm_unpacklo_epi8(v, zero);
+      px[i*2+1] = _mm_unpackhi_epi8(v, zero);
+   }
+}
+
+// dot product of every pixel with (dr,dg,db); the direction must fit in 16 bits
+static void stb__DotsBlock(int *dots, const __m128i *px, int dr, int dg, int db)
+{
+   __m128i d = _mm_setr_epi16((short) dr,(short) dg,(short) db,0, (short) dr,(short) dg,(short) db,0);
+   int i;
+   for (i=0;i<4;i++) {
+      // each madd gives r*dr+g*dg, b*db for two pixels; add the pairs up
+      __m128 m0 = _mm_castsi128_ps(_mm_madd_epi16(px[i*2+0], d));
+      __m128 m1 = _mm_castsi128_ps(_mm_madd_epi16(px[i*2+1], d));
+      __m128i e = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2,0,2,0)));
+      __m128i o = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(3,1,3,1)));
+      _mm_storeu_si128((__m128i *) (dots + i*4), _mm_add_epi32(e, o));
+   }
+}
+
+// insert a zero bit above each of the low 16 bits of x
+static unsigned int stb__Spread16(unsigned int x)
+{
+   x = (x | (x << 8)) & 0x00ff00ff;
+   x = (x | (x << 4)) & 0x0f0f0f0f;
+   x = (x | (x << 2)) & 0x33333333;
+   x = (x | (x << 1)) & 0x55555555;
+   return x;
+}
+
+static int stb__PopCount16(unsigned int x)
+{
+   x = x - ((x >> 1) & 0x5555);
+   x = (x & 0x3333) + ((x >> 2) & 0x3333);
+   x = (x + (x >> 4)) & 0x0f0f;
+   return (x + (x >> 8)) & 0x1f;
+}
+#endif
+
 // Block dithering function. Simply dithers a block to 565 RGB.
 // (Floyd-Steinberg)
 static void stb__DitherBlock(unsigned char *dest, unsigned char *block)
@@ -148,7 +452,7 @@ static void stb__DitherBlock(unsigned char *dest, unsigned char *block)
   // process channels seperately
   for (ch=0; ch<3; ++ch) {
       unsigned char *bp = block+ch, *dp = dest+ch;
-      unsigned char *quant = (ch == 1) ? stb__QuantGTab+8 : stb__QuantRBTab+8;
+      const unsigned char *quant = (ch == 1) ? stb__QuantGTab+8 : stb__QuantRBTab+8;
       memset(err, 0, sizeof(err));
       for(y=0; y<4; ++y) {
          dp[ 0] = quant[bp[ 0] + ((3*ep2[1] + 5*ep2[0]) >> 4)];
@@ -178,6 +482,13 @@ static unsigned int stb__MatchColorsBlock(unsigned char *block, unsigned char *c
    int i;
    int c0Point, halfPoint, c3Point;
 
+#ifdef STB_DXT_SSE2
+   if (stb__dxt_simd) {
+      __m128i px[8];
+      stb__LoadBlock16(px, block);
+      stb__DotsBlock(dots, px, dirr, dirg, dirb);
+   } else
+#endif
    for(i=0;i<16;i++)
       dots[i] = block[i*4+0]*dirr + block[i*4+1]*dirg + block[i*4+2]*dirb;
 
@@ -197,6 +508,25 @@ static unsigned int stb__MatchColorsBlock(unsigned char *block, unsigned char *c
    c3Point   = (stops[2] + stops[0]) >> 1;
 
    if(!dither) {
+#ifdef STB_DXT_SSE2
+    if (stb__dxt_simd) {
+      // same decision as below: bit 0 of the index is (dot < halfPoint), and bit 1 is
+      // (dot < c0Point) flipped in the bottom half / (dot < c3Point) in the top half
+      __m128i half = _mm_set1_epi32(halfPoint);
+      __m128i c0 = _mm_set1_epi32(c0Point);
+      __m128i c3 = _mm_set1_epi32(c3Point);
+      __m128i bit0[4], bit1[4];
+      for (i=0;i<4;i++) {
+         __m128i d = _mm_loadu_si128((const __m128i *) (dots + i*4));
+         __m128i lth = _mm_cmplt_epi32(d, half);
+         bit0[i] = lth;
+         bit1[i] = _mm_or_si128(_mm_andnot_si128(_mm_cmplt_epi32(d, c0), lth),
+                                _mm_andnot_si128(lth, _mm_cmplt_epi32(d, c3)));
+      }
+      mask  = stb__Spread16(_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(bit0[0],bit0[1]), _mm_packs_epi32(bit0[2],bit0[3]))));
+      mask |= stb__Spread16(_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(bit1[0],bit1[1]), _mm_packs_epi32(bit1[2],bit1[3])))) << 1;
+    } else
+#endif
       // the version without dithering is straightforward
       for (i=15;i>=0;i--) {
          int dot = dots[i];
@@ -277,7 +607,67 @@ static void stb__OptimizeColorsBlock(unsigned char *block, unsigned short *pmax1
   int cov[6];
   int mu[3],min[3],max[3];
   int ch,i,iter;
+#ifdef STB_DXT_SSE2
+  int dots[16];
+  __m128i px[8];
+
+  if (stb__dxt_simd) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *) (block +  0));
+    __m128i v1 = _mm_loadu_si128((const __m128i *) (block + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i *) (block + 32));
+    __m128i v3 = _mm_loadu_si128((const __m128i *) (block + 48));
+    __m128i mn = _mm_min_epu8(_mm_min_epu8(v0,v1), _mm_min_epu8(v2,v3));
+    __m128i mx = _mm_max_epu8(_mm_max_epu8(v0,v1), _mm_max_epu8(v2,v3));
+    __m128i sum = _mm_setzero_si128(), mu16, acc0, acc1;
+    __m128i rgb = _mm_setr_epi16(-1,-1,-1,0, -1,-1,-1,0);
+    int minv, maxv, c0[4], c1[4];
+    short sums[8];
+
+    stb__LoadBlock16(px, block);
+
+    // reduce the 4 pixels in each register down to one
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+    mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+    mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+    minv = _mm_cvtsi128_si32(mn);
+    maxv = _mm_cvtsi128_si32(mx);
+
+    for(i=0;i<8;i++)
+      sum = _mm_add_epi16(sum, px[i]);
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    _mm_storeu_si128((__m128i *) sums, sum);
+
+    for(ch=0;ch<3;ch++)
+    {
+      mu[ch] = (sums[ch] + 8) >> 4;
+      min[ch] = (minv >> (ch*8)) & 255;
+      max[ch] = (maxv >> (ch*8)) & 255;
+    }
 
+    // covariance: (r,g,b)*(r,g,b) gives rr,gg,bb and (r,g,b)*(g,b,r) gives rg,gb,br
+    mu16 = _mm_setr_epi16((short) mu[0],(short) mu[1],(short) mu[2],0, (short) mu[0],(short) mu[1],(short) mu[2],0);
+    acc0 = acc1 = _mm_setzero_si128();
+    for(i=0;i<8;i++)
+    {
+      __m128i c = _mm_and_si128(_mm_sub_epi16(px[i], mu16), rgb);
+      __m128i r = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3,0,2,1)), _MM_SHUFFLE(3,0,2,1));
+      __m128i lo = _mm_mullo_epi16(c, c), hi = _mm_mulhi_epi16(c, c);
+      acc0 = _mm_add_epi32(acc0, _mm_add_epi32(_mm_unpacklo_epi16(lo,hi), _mm_unpackhi_epi16(lo,hi)));
+      lo = _mm_mullo_epi16(c, r); hi = _mm_mulhi_epi16(c, r);
+      acc1 = _mm_add_epi32(acc1, _mm_add_epi32(_mm_unpacklo_epi16(lo,hi), _mm_unpackhi_epi16(lo,hi)));
+    }
+    _mm_storeu_si128((__m128i *) c0, acc0);
+    _mm_storeu_si128((__m128i *) c1, acc1);
+    cov[0] = c0[0];
+    cov[1] = c1[0];
+    cov[2] = c1[2];
+    cov[3] = c0[1];
+    cov[4] = c1[1];
+    cov[5] = c0[2];
+  } else
+#endif
+  {
   for(ch=0;ch<3;ch++)
   {
     const unsigned char *bp = ((const unsigned char *) block) + ch;
@@ -313,6 +703,7 @@ static void stb__OptimizeColorsBlock(unsigned char *block, unsigned short *pmax1
     cov[4] += g*b;
     cov[5] += b*b;
   }
+  }
 
   // convert covariance matrix to float, find principal axis via power iter
   for(i=0;i<6;i++)
@@ -349,9 +740,20 @@ static void stb__OptimizeColorsBlock(unsigned char *block, unsigned short *pmax1
    }
 
    // Pick colors at extreme points
+#ifdef STB_DXT_SSE2
+   if (stb__dxt_simd)
+      stb__DotsBlock(dots, px, v_r, v_g, v_b);
+   else
+      for(i=0;i<16;i++)
+         dots[i] = block[i*4+0]*v_r + block[i*4+1]*v_g + block[i*4+2]*v_b;
+#endif
    for(i=0;i<16;i++)
    {
+#ifdef STB_DXT_SSE2
+      int dot = dots[i];
+#else
       int dot = block[i*4+0]*v_r + block[i*4+1]*v_g + block[i*4+2]*v_b;
+#endif
 
       if (dot < mind) {
          mind = dot;
@@ -412,6 +814,54 @@ static int stb__RefineBlock(unsigned char *block, unsigned short *pmax16, unsign
       max16 = (stb__OMatch5[r][0]<<11) | (stb__OMatch6[g][0]<<5) | stb__OMatch5[b][0];
       min16 = (stb__OMatch5[r][1]<<11) | (stb__OMatch6[g][1]<<5) | stb__OMatch5[b][1];
    } else {
+#ifdef STB_DXT_SSE2
+    if (stb__dxt_simd) {
+      // expand the 2-bit indices to per-pixel weights w1Tab[step], replicated
+      // across the 4 channels, and accumulate w1*color and color in 16 bits
+      static const unsigned char sel[2][16] = {
+         { 1,4,16,64, 1,4,16,64, 1,4,16,64, 1,4,16,64 },
+         { 2,8,32,128, 2,8,32,128, 2,8,32,128, 2,8,32,128 },
+      };
+      __m128i zero = _mm_setzero_si128();
+      __m128i s0 = _mm_loadu_si128((const __m128i *) sel[0]);
+      __m128i s1 = _mm_loadu_si128((const __m128i *) sel[1]);
+      __m128i m = _mm_cvtsi32_si128((int) mask), lo, hi, w1, wp[4];
+      __m128i acc1 = zero, acc2 = zero;
+      int n1,n2,n3, sums[8];
+      m = _mm_unpacklo_epi8(m, m);
+      m = _mm_unpacklo_epi16(m, m); // byte i is mask byte i/4
+      lo = _mm_cmpeq_epi8(_mm_and_si128(m, s0), s0);
+      hi = _mm_cmpeq_epi8(_mm_and_si128(m, s1), s1);
+      // step 0,1,2,3 -> 3,0,2,1
+      w1 = _mm_or_si128(_mm_and_si128(hi, _mm_add_epi8(lo, _mm_set1_epi8(2))),
+                        _mm_andnot_si128(hi, _mm_andnot_si128(lo, _mm_set1_epi8(3))));
+      n3 = stb__PopCount16(_mm_movemask_epi8(_mm_and_si128(lo, hi)));
+      n1 = stb__PopCount16(_mm_movemask_epi8(_mm_andnot_si128(hi, lo)));
+      n2 = stb__PopCount16(_mm_movemask_epi8(_mm_andnot_si128(lo, hi)));
+      akku = (16-n1-n2-n3)*prods[0] + n1*prods[1] + n2*prods[2] + n3*prods[3];
+
+      wp[0] = _mm_unpacklo_epi8(w1, w1);
+      wp[2] = _mm_unpackhi_epi8(w1, w1);
+      wp[1] = _mm_unpackhi_epi16(wp[0], wp[0]);
+      wp[0] = _mm_unpacklo_epi16(wp[0], wp[0]);
+      wp[3] = _mm_unpackhi_epi16(wp[2], wp[2]);
+      wp[2] = _mm_unpacklo_epi16(wp[2], wp[2]);
+      for (i=0;i<4;++i) {
+         __m128i v = _mm_loadu_si128((const __m128i *) (block + i*16));
+         __m128i vl = _mm_unpacklo_epi8(v, zero), vh = _mm_unpackhi_epi8(v, zero);
+         acc1 = _mm_add_epi16(acc1, _mm_mullo_epi16(vl, _mm_unpacklo_epi8(wp[i], zero)));
+         acc1 = _mm_add_epi16(acc1, _mm_mullo_epi16(vh, _mm_unpackhi_epi8(wp[i], zero)));
+         acc2 = _mm_add_epi16(acc2, _mm_add_epi16(vl, vh));
+      }
+      acc1 = _mm_add_epi16(acc1, _mm_srli_si128(acc1, 8));
+      acc2 = _mm_add_epi16(acc2, _mm_srli_si128(acc2, 8));
+      _mm_storeu_si128((__m128i *) sums, _mm_unpacklo_epi16(acc1, zero));
+      At1_r = sums[0]; At1_g = sums[1]; At1_b = sums[2];
+      _mm_storeu_si128((__m128i *) sums, _mm_unpacklo_epi16(acc2, zero));
+      At2_r = sums[0]; At2_g = sums[1]; At2_b = sums[2];
+    } else
+#endif
+    {
       At1_r = At1_g = At1_b = 0;
       At2_r = At2_g = At2_b = 0;
       for (i=0;i<16;++i,cm>>=2) {
@@ -429,6 +879,7 @@ static int stb__RefineBlock(unsigned char *block, unsigned short *pmax16, unsign
          At2_g   += g;
          At2_b   += b;
       }
+    }
 
       At2_r = 3*At2_r - At1_r;
       At2_g = 3*At2_g - At1_g;
@@ -532,18 +983,19 @@ static void stb__CompressColorBlock(unsigned char *dest, unsigned char *block, i
 }
 
 // Alpha block compression (this is easy for a change)
-static void stb__CompressAlphaBlock(unsigned char *dest,unsigned char *src,int mode)
+// also used for BC4/BC5; the 16 values are 'stride' bytes apart
+static void stb__CompressAlphaBlock(unsigned char *dest,unsigned char *src,int stride)
 {
    int i,dist,bias,dist4,dist2,bits,mask;
 
    // find min/max color
    int mn,mx;
-   mn = mx = src[3];
+   mn = mx = src[0];
 
    for (i=1;i<16;i++)
    {
-      if (src[i*4+3] < mn) mn = src[i*4+3];
-      else if (src[i*4+3] > mx) mx = src[i*4+3];
+      if (src[i*stride] < mn) mn = src[i*stride];
+      else if (src[i*stride] > mx) mx = src[i*stride];
    }
 
    // encode them
@@ -562,7 +1014,7 @@ static void stb__CompressAlphaBlock(unsigned char *dest,unsigned char *src,int m
    bits = 0,mask=0;
    
    for (i=0;i<16;i++) {
-      int a = src[i*4+3]*7 + bias;
+      int a = src[i*stride]*7 + bias;
       int ind,t;
 
       // select index. this is a "linear scale" lerp factor between 0 (val=min) and 7 (val=max).
@@ -584,41 +1036,349 @@ static void stb__CompressAlphaBlock(unsigned char *dest,unsigned char *src,int m
    }
 }
 
-static void stb__InitDXT()
+void stb_compress_dxt_block(unsigned char *dest, const unsigned char *src, int alpha, int mode)
 {
-   int i;
-   for(i=0;i<32;i++)
-      stb__Expand5[i] = (i<<3)|(i>>2);
+   if (alpha) {
+      stb__CompressAlphaBlock(dest,(unsigned char*) src+3,4);
+      dest += 8;
+   }
 
-   for(i=0;i<64;i++)
-      stb__Expand6[i] = (i<<2)|(i>>4);
+   stb__CompressColorBlock(dest,(unsigned char*) src,mode);
+}
 
-   for(i=0;i<256+16;i++)
-   {
-      int v = i-8 < 0 ? 0 : i-8 > 255 ? 255 : i-8;
-      stb__QuantRBTab[i] = stb__Expand5[stb__Mul8Bit(v,31)];
-      stb__QuantGTab[i] = stb__Expand6[stb__Mul8Bit(v,63)];
+void stb_compress_bc4_block(unsigned char *dest, const unsigned char *src)
+{
+   stb__CompressAlphaBlock(dest,(unsigned char*) src,1);
+}
+
+void stb_compress_bc5_block(unsigned char *dest, const unsigned char *src)
+{
+   stb__CompressAlphaBlock(dest  ,(unsigned char*) src  ,2);
+   stb__CompressAlphaBlock(dest+8,(unsigned char*) src+1,2);
+}
+
+void stb_compress_dxt_image_rows(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format, int mode, int first_row, int num_rows)
+{
+   unsigned char block[16*4];
+   int bw = (w+3)/4, bh = (h+3)/4;
+   int bx,by,x,y, block_size = (format == STB_DXT_BC3 || format == STB_DXT_BC5) ? 16 : 8;
+
+   if (first_row + num_rows > bh)
+      num_rows = bh - first_row;
+   dest += first_row * bw * block_size;
+
+   for (by=first_row; by < first_row+num_rows; ++by) {
+      for (bx=0; bx < bw; ++bx) {
+         if (bx*4+4 <= w && by*4+4 <= h) {
+            for (y=0; y < 4; ++y)
+               memcpy(block + y*16, src + (by*4+y)*stride + bx*16, 16);
+         } else {
+            // partial edge block; repeat the last valid column/row
+            for (y=0; y < 4; ++y) {
+               int sy = by*4+y < h ? by*4+y : h-1;
+               for (x=0; x < 4; ++x) {
+                  int sx = bx*4+x < w ? bx*4+x : w-1;
+                  memcpy(block + y*16 + x*4, src + sy*stride + sx*4, 4);
+               }
+            }
+         }
+         switch (format) {
+            case STB_DXT_BC4:
+               stb__CompressAlphaBlock(dest, block, 4);
+               break;
+            case STB_DXT_BC5:
+               stb__CompressAlphaBlock(dest  , block  , 4);
+               stb__CompressAlphaBlock(dest+8, block+1, 4);
+               break;
+            default:
+               stb_compress_dxt_block(dest, block, format == STB_DXT_BC3, mode);
+               break;
+         }
+         dest += block_size;
+      }
    }
+}
 
-   stb__PrepareOptTable(&stb__OMatch5[0][0],stb__Expand5,32);
-   stb__PrepareOptTable(&stb__OMatch6[0][0],stb__Expand6,64);
+void stb_compress_dxt_image(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format, int mode)
+{
+   stb_compress_dxt_image_rows(dest, src, w, h, stride, format, mode, 0, (h+3)/4);
 }
 
-void stb_compress_dxt_block(unsigned char *dest, const unsigned char *src, int alpha, int mode)
+/****************************************************************************/
+
+static void stb__DecompressColorBlock(unsigned char *dest, const unsigned char *src, int four_color_only)
 {
-   static int init=1;
-   if (init) {
-      stb__InitDXT();
-      init=0;
+   unsigned char color[4*4];
+   unsigned short c0 = src[0] + (src[1] << 8);
+   unsigned short c1 = src[2] + (src[3] << 8);
+   unsigned int mask = src[4] + (src[5] << 8) + (src[6] << 16) + ((unsigned int) src[7] << 24);
+   int i;
+
+   stb__EvalColors(color, c0, c1);
+   color[3] = color[7] = color[11] = color[15] = 255;
+   if (c0 <= c1 && !four_color_only) {
+      // 3-color mode: midpoint, and transparent black
+      for (i=0;i<3;i++) {
+         color[8+i] = (unsigned char) ((color[i] + color[4+i]) >> 1);
+         color[12+i] = 0;
+      }
+      color[15] = 0;
+   }
+
+   for (i=0;i<16;i++,mask>>=2)
+      memcpy(dest + i*4, color + (mask&3)*4, 4);
+}
+
+// decodes 16 values into dest, 'stride' bytes apart
+static void stb__DecompressAlphaBlock(unsigned char *dest, const unsigned char *src, int stride)
+{
+   unsigned char a[8];
+   unsigned int bits = 0;
+   int i, nbits = 0;
+
+   a[0] = src[0];
+   a[1] = src[1];
+   if (a[0] > a[1]) {
+      for (i=1;i<7;i++)
+         a[i+1] = (unsigned char) (((7-i)*a[0] + i*a[1] + 3) / 7);
+   } else {
+      for (i=1;i<5;i++)
+         a[i+1] = (unsigned char) (((5-i)*a[0] + i*a[1] + 2) / 5);
+      a[6] = 0;
+      a[7] = 255;
+   }
+
+   src += 2;
+   for (i=0;i<16;i++) {
+      if (nbits < 3) {
+         bits |= *src++ << nbits;
+         nbits += 8;
+      }
+      dest[i*stride] = a[bits & 7];
+      bits >>= 3;
+      nbits -= 3;
    }
+}
 
+void stb_decompress_dxt_block(unsigned char *dest, const unsigned char *src, int alpha)
+{
    if (alpha) {
-      stb__CompressAlphaBlock(dest,(unsigned char*) src,mode);
-      dest += 8;
+      stb__DecompressColorBlock(dest, src+8, 1);
+      stb__DecompressAlphaBlock(dest+3, src, 4);
+   } else
+      stb__DecompressColorBlock(dest, src, 0);
+}
+
+void stb_decompress_bc4_block(unsigned char *dest, const unsigned char *src)
+{
+   stb__DecompressAlphaBlock(dest, src, 1);
+}
+
+void stb_decompress_bc5_block(unsigned char *dest, const unsigned char *src)
+{
+   stb__DecompressAlphaBlock(dest  , src  , 2);
+   stb__DecompressAlphaBlock(dest+1, src+8, 2);
+}
+
+static void stb__DecompressBlockRGBA(unsigned char *block, const unsigned char *src, int format)
+{
+   int i;
+   switch (format) {
+      case STB_DXT_BC4:
+      case STB_DXT_BC5:
+         for (i=0;i<16;i++) {
+            block[i*4+1] = block[i*4+2] = 0;
+            block[i*4+3] = 255;
+         }
+         stb__DecompressAlphaBlock(block, src, 4);
+         if (format == STB_DXT_BC5)
+            stb__DecompressAlphaBlock(block+1, src+8, 4);
+         break;
+      default:
+         stb_decompress_dxt_block(block, src, format == STB_DXT_BC3);
+         break;
    }
+}
 
-   stb__CompressColorBlock(dest,(unsigned char*) src,mode);
+void stb_decompress_dxt_image(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format)
+{
+   unsigned char block[16*4];
+   int bw = (w+3)/4, bh = (h+3)/4;
+   int bx,by,y, block_size = (format == STB_DXT_BC3 || format == STB_DXT_BC5) ? 16 : 8;
+
+   for (by=0; by < bh; ++by) {
+      for (bx=0; bx < bw; ++bx) {
+         int cw = w - bx*4 < 4 ? w - bx*4 : 4;
+         stb__DecompressBlockRGBA(block, src, format);
+         for (y=0; y < 4 && by*4+y < h; ++y)
+            memcpy(dest + (by*4+y)*stride + bx*16, block + y*16, cw*4);
+         src += block_size;
+      }
+   }
+}
+
+// sum of squared errors over block rows [first_row, first_row+num_rows)
+static double stb__ImageErrorRows(const unsigned char *orig, int w, int h, int stride, const unsigned char *compressed, int format, int first_row, int num_rows)
+{
+   unsigned char block[16*4];
+   int bw = (w+3)/4;
+   int bx,by,x,y,c, block_size = (format == STB_DXT_BC3 || format == STB_DXT_BC5) ? 16 : 8;
+   int channels = format == STB_DXT_BC1 ? 3 : format == STB_DXT_BC3 ? 4 : format == STB_DXT_BC4 ? 1 : 2;
+   double total = 0;
+
+   compressed += first_row * bw * block_size;
+   for (by=first_row; by < first_row+num_rows; ++by) {
+      for (bx=0; bx < bw; ++bx) {
+         int sum = 0; // at most 16*4*255*255, so a block can't overflow
+         stb__DecompressBlockRGBA(block, compressed, format);
+         for (y=0; y < 4 && by*4+y < h; ++y) {
+            const unsigned char *p = orig + (by*4+y)*stride + bx*16;
+            for (x=0; x < 4 && bx*4+x < w; ++x)
+               for (c=0; c < channels; ++c) {
+                  int d = p[x*4+c] - block[y*16+x*4+c];
+                  sum += d*d;
+               }
+         }
+         total += sum;
+         compressed += block_size;
+      }
+   }
+   return total;
+}
+
+static double stb__ImageErrorFinish(double sse, int w, int h, int format, double *psnr)
+{
+   int channels = format == STB_DXT_BC1 ? 3 : format == STB_DXT_BC3 ? 4 : format == STB_DXT_BC4 ? 1 : 2;
+   double n = (double) w * h * channels;
+   double mse = n > 0 ? sse / n : 0;
+   if (psnr)
+      *psnr = mse > 0 ? 10.0 * log10(255.0*255.0 / mse) : 999.0;
+   return sqrt(mse);
+}
+
+double stb_dxt_image_error(const unsigned char *orig, int w, int h, int stride, const unsigned char *compressed, int format, double *psnr)
+{
+   double sse = stb__ImageErrorRows(orig, w, h, stride, compressed, format, 0, (h+3)/4);
+   return stb__ImageErrorFinish(sse, w, h, format, psnr);
+}
+
+#ifdef STB_DXT_THREADS
+#ifdef _WIN32
+   #ifndef _WINDOWS_
+   #include <windows.h>
+   #endif
+   #define STB__DXT_THREAD_RETURN   DWORD WINAPI
+#else
+   #include <pthread.h>
+   #define STB__DXT_THREAD_RETURN   void *
+#endif
+
+#define STB__DXT_MAX_THREADS  64
+
+typedef struct
+{
+   unsigned char *dest;
+   const unsigned char *src;        // uncompressed image
+   const unsigned char *compressed; // for stb__dxt_error_job
+   int w,h,stride,format,mode;
+   int first_row, num_rows;
+   int op;
+   double sse;
+} stb__dxt_job;
+
+enum { stb__dxt_compress_job, stb__dxt_error_job };
+
+static STB__DXT_THREAD_RETURN stb__dxt_thread(void *p)
+{
+   stb__dxt_job *j = (stb__dxt_job *) p;
+   if (j->op == stb__dxt_compress_job)
+      stb_compress_dxt_image_rows(j->dest, j->src, j->w, j->h, j->stride, j->format, j->mode, j->first_row, j->num_rows);
+   else
+      j->sse = stb__ImageErrorRows(j->src, j->w, j->h, j->stride, j->compressed, j->format, j->first_row, j->num_rows);
+   return 0;
+}
+
+// splits the block rows of 'proto' into contiguous ranges (so each thread
+// streams through memory) and runs them; returns the number of jobs
+static int stb__dxt_run_jobs(stb__dxt_job *jobs, stb__dxt_job *proto, int num_threads)
+{
+   #ifdef _WIN32
+   HANDLE threads[STB__DXT_MAX_THREADS];
+   #else
+   pthread_t threads[STB__DXT_MAX_THREADS];
+   #endif
+   int i, started, bh = (proto->h+3)/4;
+
+   if (num_threads > bh) num_threads = bh;
+   if (num_threads > STB__DXT_MAX_THREADS) num_threads = STB__DXT_MAX_THREADS;
+   if (num_threads < 1) num_threads = 1;
+
+   for (i=0; i < num_threads; ++i) {
+      jobs[i] = *proto;
+      jobs[i].first_row = bh * i / num_threads;
+      jobs[i].num_rows  = bh * (i+1) / num_threads - jobs[i].first_row;
+      jobs[i].sse = 0;
+   }
+
+   // the calling thread does job 0
+   for (started=1; started < num_threads; ++started) {
+      #ifdef _WIN32
+      threads[started] = CreateThread(NULL, 0, stb__dxt_thread, &jobs[started], 0, NULL);
+      if (threads[started] == NULL) break;
+      #else
+      if (pthread_create(&threads[started], NULL, stb__dxt_thread, &jobs[started]) != 0) break;
+      #endif
+   }
+   stb__dxt_thread(&jobs[0]);
+   // any jobs we failed to start get done here
+   for (i=started; i < num_threads; ++i)
+      stb__dxt_thread(&jobs[i]);
+   for (i=1; i < started; ++i) {
+      #ifdef _WIN32
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+      #else
+      pthread_join(threads[i], NULL);
+      #endif
+   }
+   return num_threads;
+}
+
+void stb_compress_dxt_image_parallel(unsigned char *dest, const unsigned char *src, int w, int h, int stride, int format, int mode, int num_threads)
+{
+   stb__dxt_job jobs[STB__DXT_MAX_THREADS], proto;
+   memset(&proto, 0, sizeof(proto));
+   proto.op = stb__dxt_compress_job;
+   proto.dest = dest;
+   proto.src = src;
+   proto.w = w;
+   proto.h = h;
+   proto.stride = stride;
+   proto.format = format;
+   proto.mode = mode;
+   stb__dxt_run_jobs(jobs, &proto, num_threads);
+}
+
+double stb_dxt_image_error_parallel(const unsigned char *orig, int w, int h, int stride, const unsigned char *compressed, int format, double *psnr, int num_threads)
+{
+   stb__dxt_job jobs[STB__DXT_MAX_THREADS], proto;
+   double sse = 0;
+   int i, n;
+   memset(&proto, 0, sizeof(proto));
+   proto.op = stb__dxt_error_job;
+   proto.src = orig;
+   proto.compressed = compressed;
+   proto.w = w;
+   proto.h = h;
+   proto.stride = stride;
+   proto.format = format;
+   n = stb__dxt_run_jobs(jobs, &proto, num_threads);
+   // per-block sums are exact integers, so the total doesn't depend on the split
+   for (i=0; i < n; ++i)
+      sse += jobs[i].sse;
+   return stb__ImageErrorFinish(sse, w, h, format, psnr);
 }
+#endif // STB_DXT_THREADS
 #endif // STB_DXT_IMPLEMENTATION
 
 #endif // STB_INCLUDE_STB_DXT_H
@@ -11,7 +11,6 @@
 //        non-MS cmaps
 //        crashproof on bad data
 //        hinting? (no longer patented)
-//        cleartype-style AA?
 //        optimize: use simple memory allocator for intermediates
 //        optimize: build edge-list directly from curves
 //        optimize: rasterize directly from curves?
@@ -73,12 +72,18 @@
 //   "Load" a font file from a memory buffer (you have to keep the buffer loaded)
 //           stbtt_InitFont()
 //           stbtt_GetFontOffsetForIndex()        -- use for TTC font collections
+//           stbtt_InitFontAccel()                -- optional: faster cmap/metrics/kerning
 //
 //   Render a unicode codepoint to a bitmap
 //           stbtt_GetCodepointBitmap()           -- allocates and returns a bitmap
 //           stbtt_MakeCodepointBitmap()          -- renders into bitmap you provide
 //           stbtt_GetCodepointBitmapBox()        -- how big the bitmap must be
 //
+//   Lay out and render a whole UTF-8 string
+//           stbtt_LayoutRunUTF8()                -- map, measure and kern a string
+//           stbtt_GetRunBitmapBox()              -- how big the bitmap must be
+//           stbtt_MakeRunBitmap()                -- renders into bitmap you provide
+//
 //   Character advance/positioning
 //           stbtt_GetCodepointHMetrics()
 //           stbtt_GetFontVMetrics()
@@ -150,12 +155,23 @@
 //    - Kerning is now supported, and if you're supporting subpixel rendering
 //      then kerning is worth using to give your text a polished look.
 //
+//    - On LCD displays with a known subpixel order, the functions with LCD
+//      at the end give sharper small text than grayscale antialiasing.
+//
 //   Performance:
 //
 //    - Convert Unicode codepoints to glyph indexes and operate on the glyphs;
 //      if you don't do this, stb_truetype is forced to do the conversion on
 //      every call.
 //
+//    - If you lay out a lot of text, call stbtt_InitFontAccel() after
+//      stbtt_InitFont(); it trades some memory for array lookups in
+//      the codepoint, hmetrics and kerning functions.
+//
+//    - If you render the same glyphs at several sizes or subpixel offsets
+//      without caching the bitmaps, call stbtt_InitShapeCache() so each
+//      glyph outline is only decoded once.
+//
 //    - There are a lot of memory allocations. We should modify it to take
 //      a temp buffer and allocate from the temp buffer (without freeing),
 //      should help performance a lot.
@@ -425,6 +441,28 @@ extern int stbtt_BakeFontBitmap(const unsigned char *data, int offset,  // font
 // if return is 0, no characters fit and no rows were used
 // This uses a very crappy packing.
 
+extern int stbtt_BakeFontBitmapLayout(const unsigned char *data, int offset, float pixel_height,
+                                      int pw, int ph, int first_char, int num_chars,
+                                      stbtt_bakedchar *chardata);
+extern void stbtt_BakeFontBitmapGlyphs(const unsigned char *data, int offset, float pixel_height,
+                                       unsigned char *pixels, int pw, int ph, int first_char,
+                                       const stbtt_bakedchar *chardata, int start, int count);
+// stbtt_BakeFontBitmap split in two. Layout does the packing: it fills in
+// chardata and returns the same value, without touching any pixels. Glyphs
+// renders chardata[start..start+count-1] into 'pixels' (which it does not
+// clear first). Every character only writes inside its own rectangle, so
+// disjoint ranges can be rendered from different threads at the same time,
+// and the result is identical to stbtt_BakeFontBitmap.
+
+#ifdef STBTT_THREADS
+extern int stbtt_BakeFontBitmapParallel(const unsigned char *data, int offset, float pixel_height,
+                                        unsigned char *pixels, int pw, int ph,
+                                        int first_char, int num_chars,
+                                        stbtt_bakedchar *chardata, int num_threads);
+// same as stbtt_BakeFontBitmap, but rasterizes on 'num_threads' threads
+// (Windows threads or pthreads). Only available if STBTT_THREADS is defined.
+#endif
+
 typedef struct
 {
    float x0,y0,s0,t0; // top-left
@@ -475,6 +513,9 @@ typedef struct stbtt_fontinfo
    int loca,head,glyf,hhea,hmtx,kern; // table locations as offset from start of .ttf
    int index_map;                     // a cmap mapping for our chosen character encoding
    int indexToLocFormat;              // format needed to map from glyph index to glyph
+
+   struct stbtt__accel *accel;        // optional lookup tables, see stbtt_InitFontAccel
+   struct stbtt__shapecache *shapes;  // optional decoded outlines, see stbtt_InitShapeCache
 } stbtt_fontinfo;
 
 extern int stbtt_InitFont(stbtt_fontinfo *info, const unsigned char *data, int offset);
@@ -484,6 +525,19 @@ extern int stbtt_InitFont(stbtt_fontinfo *info, const unsigned char *data, int o
 // need to do anything special to free it, because the contents are pure
 // value data with no additional data structures. Returns 0 on failure.
 
+extern int stbtt_InitFontAccel(stbtt_fontinfo *info);
+// Optionally call this after stbtt_InitFont to build native-endian lookup
+// tables: a direct-mapped cmap for the BMP (U+0000..U+FFFF), the advance
+// and left side bearing of every glyph, and the kerning pairs. Codepoint
+// lookup, hmetrics and kerning then become array reads instead of walking
+// the big-endian font data. Costs roughly 128KB + 4*numGlyphs + 6*numPairs
+// bytes, allocated with STBTT_malloc(info->userdata). Returns 0 on failure,
+// in which case the font still works without acceleration.
+
+extern void stbtt_FreeFontAccel(stbtt_fontinfo *info);
+// Frees the tables built by stbtt_InitFontAccel. Copies of the stbtt_fontinfo
+// share the same tables, so only free them once.
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -578,6 +632,19 @@ extern int stbtt_GetGlyphShape(const stbtt_fontinfo *info, int glyph_index, stbt
 extern void stbtt_FreeShape(const stbtt_fontinfo *info, stbtt_vertex *vertices);
 // frees the data allocated above
 
+extern int stbtt_InitShapeCache(stbtt_fontinfo *info, int decode_all);
+// Optionally call this after stbtt_InitFont to keep the decoded outline of
+// each glyph around, so rendering the same glyph at several sizes or
+// subpixel offsets (or as a component of compound glyphs) only parses
+// the glyf data once. The bitmap functions then use the cached outlines
+// directly, and stbtt_GetGlyphShape returns a copy of them. Outlines are
+// decoded on first use, which is not thread-safe; if several threads will
+// render with this font, pass decode_all=1 to decode every glyph up front.
+// Returns 0 on failure, in which case nothing is cached.
+
+extern void stbtt_FreeShapeCache(stbtt_fontinfo *info);
+// Frees the outlines cached above.
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // BITMAP RENDERING
@@ -629,6 +696,48 @@ extern void stbtt_MakeGlyphBitmapSubpixel(const stbtt_fontinfo *info, unsigned c
 extern void stbtt_GetGlyphBitmapBox(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, int *ix0, int *iy0, int *ix1, int *iy1);
 extern void stbtt_GetGlyphBitmapBoxSubpixel(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y,float shift_x, float shift_y, int *ix0, int *iy0, int *ix1, int *iy1);
 
+extern void stbtt_GetGlyphBitmapBoxLCD(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, float shift_x, float shift_y, int *ix0, int *iy0, int *ix1, int *iy1);
+extern void stbtt_MakeGlyphBitmapLCD(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int glyph, int bgr);
+extern void stbtt_MakeCodepointBitmapLCD(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int codepoint, int bgr);
+// subpixel rendering for LCD displays ("cleartype-style"). The glyph is
+// rasterized once at 3x horizontal resolution and run through a 5-tap
+// FIR filter to limit color fringing; each output pixel is 3 bytes of
+// per-channel coverage, in R,G,B order (or B,G,R if 'bgr' is non-zero),
+// so out_stride must be at least 3*out_w. The filter spreads coverage
+// into the neighboring pixels, so use stbtt_GetGlyphBitmapBoxLCD (which
+// is one pixel wider on each side) rather than stbtt_GetGlyphBitmapBox.
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// TEXT RUNS
+//
+// Lay out and render a whole UTF-8 string at once: codepoints are mapped to
+// glyphs and kerned in a single pass, and the run is rasterized as a single
+// shape into one bitmap, so overlapping glyphs (e.g. 'lj') combine correctly
+// instead of stomping each other.
+
+typedef struct
+{
+   int glyph;        // glyph index
+   int codepoint;    // unicode codepoint it was mapped from
+   float x;          // pixel offset of the glyph origin from the start of the run
+   float advance;    // scaled advance to the next glyph, including kerning
+} stbtt_runglyph;
+
+extern int stbtt_LayoutRunUTF8(const stbtt_fontinfo *info, float scale, const char *text, int len, stbtt_runglyph *glyphs, int max_glyphs, float *width);
+// decodes up to 'len' bytes of utf8 (len < 0 means nul-terminated) into at
+// most 'max_glyphs' positioned glyphs, laid out horizontally at the given
+// scale. returns the number of glyphs written; *width (if non-NULL) gets
+// the total advance. Invalid utf8 bytes map to U+FFFD.
+
+extern void stbtt_GetRunBitmapBox(const stbtt_fontinfo *info, const stbtt_runglyph *glyphs, int num_glyphs, float scale_x, float scale_y, float shift_x, float shift_y, int *ix0, int *iy0, int *ix1, int *iy1);
+// the union of the bitmap boxes of every glyph in the run, relative to the
+// run origin (see stbtt_GetCodepointBitmapBox)
+
+extern void stbtt_MakeRunBitmap(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, const stbtt_runglyph *glyphs, int num_glyphs);
+// renders the whole run into 'output', which corresponds to the box returned
+// by stbtt_GetRunBitmapBox (as with stbtt_MakeCodepointBitmap). Every pixel
+// of the out_w x out_h area is written.
 
 // @TODO: don't expose this structure
 typedef struct
@@ -830,6 +939,8 @@ int stbtt_InitFont(stbtt_fontinfo *info, const unsigned char *data2, int fontsta
 
    info->data = data;
    info->fontstart = fontstart;
+   info->accel = NULL;
+   info->shapes = NULL;
 
    cmap = stbtt__find_table(data, fontstart, "cmap");       // required
    info->loca = stbtt__find_table(data, fontstart, "loca"); // required
@@ -874,7 +985,7 @@ int stbtt_InitFont(stbtt_fontinfo *info, const unsigned char *data2, int fontsta
    return 1;
 }
 
-int stbtt_FindGlyphIndex(const stbtt_fontinfo *info, int unicode_codepoint)
+static int stbtt__FindGlyphIndexRaw(const stbtt_fontinfo *info, int unicode_codepoint)
 {
    stbtt_uint8 *data = info->data;
    stbtt_uint32 index_map = info->index_map;
@@ -969,6 +1080,92 @@ int stbtt_FindGlyphIndex(const stbtt_fontinfo *info, int unicode_codepoint)
    return 0;
 }
 
+//////////////////////////////////////////////////////////////////////////
+//
+// optional acceleration tables
+//
+// everything is converted to native endianness once, so the lookups
+// below don't have to decode big-endian data on every call
+
+typedef struct stbtt__accel
+{
+   stbtt_uint16 *cmap;         // 65536 entries for the BMP, or NULL if the cmap format isn't handled
+   stbtt_int16  *hmetrics;     // advance,lsb pairs for each glyph
+   stbtt_uint32 *kern_pairs;   // glyph1 << 16 | glyph2, sorted (the kern table requires this)
+   stbtt_int16  *kern_values;
+   int num_hmetrics, num_kern;
+} stbtt__accel;
+
+int stbtt_FindGlyphIndex(const stbtt_fontinfo *info, int unicode_codepoint)
+{
+   if (info->accel && info->accel->cmap && (stbtt_uint32) unicode_codepoint < 0x10000)
+      return info->accel->cmap[unicode_codepoint];
+   return stbtt__FindGlyphIndexRaw(info, unicode_codepoint);
+}
+
+int stbtt_InitFontAccel(stbtt_fontinfo *info)
+{
+   stbtt_uint8 *data = info->data;
+   stbtt__accel *a;
+   stbtt_uint16 format = ttUSHORT(data + info->index_map);
+   int i, num_kern=0, has_cmap, size;
+   int num_hmetrics = info->numGlyphs;
+   stbtt_uint16 numOfLongHorMetrics = ttUSHORT(data+info->hhea + 34);
+
+   // only accept the kern table the kerning code understands
+   if (info->kern) {
+      stbtt_uint8 *k = data + info->kern;
+      if (ttUSHORT(k+2) >= 1 && ttUSHORT(k+8) == 1)
+         num_kern = ttUSHORT(k+10);
+   }
+   // formats the raw lookup would assert on are left to it
+   has_cmap = (format == 0 || format == 4 || format == 6 || format == 12 || format == 13);
+
+   // one allocation for everything; the 32-bit array goes first to keep it aligned
+   size = sizeof(*a) + num_kern * (sizeof(stbtt_uint32) + sizeof(stbtt_int16))
+                     + num_hmetrics * 2 * sizeof(stbtt_int16)
+                     + (has_cmap ? 0x10000 * sizeof(stbtt_uint16) : 0);
+   a = (stbtt__accel *) STBTT_malloc(size, info->userdata);
+   if (a == NULL) return 0;
+
+   a->kern_pairs  = (stbtt_uint32 *) (a+1);
+   a->kern_values = (stbtt_int16 *) (a->kern_pairs + num_kern);
+   a->hmetrics    = a->kern_values + num_kern;
+   a->cmap        = has_cmap ? (stbtt_uint16 *) (a->hmetrics + num_hmetrics*2) : NULL;
+   a->num_kern     = num_kern;
+   a->num_hmetrics = num_hmetrics;
+
+   for (i=0; i < num_kern; ++i) {
+      a->kern_pairs[i]  = ttULONG(data+info->kern+18+(i*6));
+      a->kern_values[i] = ttSHORT(data+info->kern+22+(i*6));
+   }
+
+   for (i=0; i < num_hmetrics; ++i) {
+      if (i < numOfLongHorMetrics) {
+         a->hmetrics[i*2+0] = ttSHORT(data + info->hmtx + 4*i);
+         a->hmetrics[i*2+1] = ttSHORT(data + info->hmtx + 4*i + 2);
+      } else {
+         a->hmetrics[i*2+0] = ttSHORT(data + info->hmtx + 4*(numOfLongHorMetrics-1));
+         a->hmetrics[i*2+1] = ttSHORT(data + info->hmtx + 4*numOfLongHorMetrics + 2*(i - numOfLongHorMetrics));
+      }
+   }
+
+   if (a->cmap)
+      for (i=0; i < 0x10000; ++i)
+         a->cmap[i] = (stbtt_uint16) stbtt__FindGlyphIndexRaw(info, i);
+
+   info->accel = a;
+   return 1;
+}
+
+void stbtt_FreeFontAccel(stbtt_fontinfo *info)
+{
+   if (info->accel) {
+      STBTT_free(info->accel, info->userdata);
+      info->accel = NULL;
+   }
+}
+
 int stbtt_GetCodepointShape(const stbtt_fontinfo *info, int unicode_codepoint, stbtt_vertex **vertices)
 {
    return stbtt_GetGlyphShape(info, stbtt_FindGlyphIndex(info, unicode_codepoint), vertices);
@@ -1043,7 +1240,7 @@ static int stbtt__close_shape(stbtt_vertex *vertices, int num_vertices, int was_
    return num_vertices;
 }
 
-int stbtt_GetGlyphShape(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
+static int stbtt__GetGlyphShapeRaw(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
 {
    stbtt_int16 numberOfContours;
    stbtt_uint8 *endPtsOfContours;
@@ -1269,9 +1466,103 @@ int stbtt_GetGlyphShape(const stbtt_fontinfo *info, int glyph_index, stbtt_verte
    return num_vertices;
 }
 
+//////////////////////////////////////////////////////////////////////////
+//
+// optional outline cache
+//
+
+typedef struct stbtt__shapecache
+{
+   stbtt_vertex **vertices;   // per glyph; NULL for empty glyphs
+   int *num_vertices;         // per glyph; -1 until decoded
+   int num_glyphs;
+} stbtt__shapecache;
+
+// returns a glyph's outline without copying it when it's cached; release
+// it with stbtt__ReleaseGlyphShape, not stbtt_FreeShape
+static int stbtt__GetGlyphShapeRef(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
+{
+   stbtt__shapecache *c = info->shapes;
+   if (c == NULL)
+      return stbtt__GetGlyphShapeRaw(info, glyph_index, pvertices);
+   if ((stbtt_uint32) glyph_index >= (stbtt_uint32) c->num_glyphs) {
+      *pvertices = NULL;
+      return 0;
+   }
+   if (c->num_vertices[glyph_index] < 0)
+      c->num_vertices[glyph_index] = stbtt__GetGlyphShapeRaw(info, glyph_index, &c->vertices[glyph_index]);
+   *pvertices = c->vertices[glyph_index];
+   return c->num_vertices[glyph_index];
+}
+
+static void stbtt__ReleaseGlyphShape(const stbtt_fontinfo *info, stbtt_vertex *vertices)
+{
+   if (info->shapes == NULL)
+      STBTT_free(vertices, info->userdata);
+}
+
+int stbtt_GetGlyphShape(const stbtt_fontinfo *info, int glyph_index, stbtt_vertex **pvertices)
+{
+   stbtt_vertex *v;
+   int n;
+   if (info->shapes == NULL)
+      return stbtt__GetGlyphShapeRaw(info, glyph_index, pvertices);
+
+   // the caller owns (and may modify) the result, so hand out a copy
+   *pvertices = NULL;
+   n = stbtt__GetGlyphShapeRef(info, glyph_index, &v);
+   if (n <= 0)
+      return 0;
+   *pvertices = (stbtt_vertex *) STBTT_malloc(n * sizeof(*v), info->userdata);
+   if (*pvertices == NULL)
+      return 0;
+   STBTT_memcpy(*pvertices, v, n * sizeof(*v));
+   return n;
+}
+
+int stbtt_InitShapeCache(stbtt_fontinfo *info, int decode_all)
+{
+   stbtt__shapecache *c;
+   int i, n = info->numGlyphs;
+   c = (stbtt__shapecache *) STBTT_malloc(sizeof(*c) + n * (sizeof(stbtt_vertex *) + sizeof(int)), info->userdata);
+   if (c == NULL) return 0;
+   c->vertices = (stbtt_vertex **) (c+1);
+   c->num_vertices = (int *) (c->vertices + n);
+   c->num_glyphs = n;
+   for (i=0; i < n; ++i) {
+      c->vertices[i] = NULL;
+      c->num_vertices[i] = -1;
+   }
+   info->shapes = c;
+   if (decode_all) {
+      stbtt_vertex *v;
+      for (i=0; i < n; ++i)
+         stbtt__GetGlyphShapeRef(info, i, &v);
+   }
+   return 1;
+}
+
+void stbtt_FreeShapeCache(stbtt_fontinfo *info)
+{
+   stbtt__shapecache *c = info->shapes;
+   int i;
+   if (c == NULL) return;
+   info->shapes = NULL;
+   for (i=0; i < c->num_glyphs; ++i)
+      if (c->vertices[i])
+         STBTT_free(c->vertices[i], info->userdata);
+   STBTT_free(c, info->userdata);
+}
+
 void stbtt_GetGlyphHMetrics(const stbtt_fontinfo *info, int glyph_index, int *advanceWidth, int *leftSideBearing)
 {
-   stbtt_uint16 numOfLongHorMetrics = ttUSHORT(info->data+info->hhea + 34);
+   stbtt_uint16 numOfLongHorMetrics;
+   if (info->accel && (stbtt_uint32) glyph_index < (stbtt_uint32) info->accel->num_hmetrics) {
+      if (advanceWidth)     *advanceWidth    = info->accel->hmetrics[glyph_index*2+0];
+      if (leftSideBearing)  *leftSideBearing = info->accel->hmetrics[glyph_index*2+1];
+      return;
+   }
+   numOfLongHorMetrics = ttUSHORT(info->data+info->hhea + 34);
    if (glyph_index < numOfLongHorMetrics) {
       if (advanceWidth)     *advanceWidth    = ttSHORT(info->data + info->hmtx + 4*glyph_index);
       if (leftSideBearing)  *leftSideBearing = ttSHORT(info->data + info->hmtx + 4*glyph_index + 2);
@@ -1290,6 +1581,25 @@ int  stbtt_GetGlyphKernAdvance(const stbtt_fontinfo *info, int glyph1, int glyph
    // we only look at the first table. it must be 'horizontal' and format 0.
    if (!info->kern)
       return 0;
+
+   if (info->accel) {
+      // same search as below, on the native-endian copy made by stbtt_InitFontAccel
+      stbtt_uint32 *pairs = info->accel->kern_pairs;
+      needle = glyph1 << 16 | glyph2;
+      l = 0;
+      r = info->accel->num_kern - 1;
+      while (l <= r) {
+         m = (l + r) >> 1;
+         if (needle < pairs[m])
+            r = m - 1;
+         else if (needle > pairs[m])
+            l = m + 1;
+         else
+            return info->accel->kern_values[m];
+      }
+      return 0;
+   }
+
    if (ttUSHORT(data+2) < 1) // number of tables, need at least 1
       return 0;
    if (ttUSHORT(data+8) != 1) // horizontal flag must be set in format
@@ -1583,24 +1893,13 @@ typedef struct
    float x,y;
 } stbtt__point;
 
-static void stbtt__rasterize(stbtt__bitmap *result, stbtt__point *pts, int *wcount, int windings, float scale_x, float scale_y, float shift_x, float shift_y, int off_x, int off_y, int invert, void *userdata)
+// blow out the windings into explicit edge lists; e must have room for
+// one edge per point. returns the number of edges added
+static int stbtt__build_edges(stbtt__edge *e, stbtt__point *pts, int *wcount, int windings, float scale_x, float scale_y, float shift_x, float shift_y, int invert, int vsubsample)
 {
    float y_scale_inv = invert ? -scale_y : scale_y;
-   stbtt__edge *e;
-   int n,i,j,k,m;
-   int vsubsample = result->h < 8 ? 15 : 5;
-   // vsubsample should divide 255 evenly; otherwise we won't reach full opacity
-
-   // now we have to blow out the windings into explicit edge lists
-   n = 0;
-   for (i=0; i < windings; ++i)
-      n += wcount[i];
-
-   e = (stbtt__edge *) STBTT_malloc(sizeof(*e) * (n+1), userdata); // add an extra one as a sentinel
-   if (e == 0) return;
-   n = 0;
+   int n=0,i,j,k,m=0;
 
-   m=0;
    for (i=0; i < windings; ++i) {
       stbtt__point *p = pts + m;
       m += wcount[i];
@@ -1623,6 +1922,24 @@ static void stbtt__rasterize(stbtt__bitmap *result, stbtt__point *pts, int *wcou
          ++n;
       }
    }
+   return n;
+}
+
+static void stbtt__rasterize(stbtt__bitmap *result, stbtt__point *pts, int *wcount, int windings, float scale_x, float scale_y, float shift_x, float shift_y, int off_x, int off_y, int invert, void *userdata)
+{
+   stbtt__edge *e;
+   int n,i;
+   int vsubsample = result->h < 8 ? 15 : 5;
+   // vsubsample should divide 255 evenly; otherwise we won't reach full opacity
+
+   n = 0;
+   for (i=0; i < windings; ++i)
+      n += wcount[i];
+
+   e = (stbtt__edge *) STBTT_malloc(sizeof(*e) * (n+1), userdata); // add an extra one as a sentinel
+   if (e == 0) return;
+
+   n = stbtt__build_edges(e, pts, wcount, windings, scale_x, scale_y, shift_x, shift_y, invert, vsubsample);
 
    // now sort the edges by their highest point (should snap to integer, and then by x)
    STBTT_sort(e, n, sizeof(e[0]), stbtt__edge_compare);
@@ -1753,7 +2070,7 @@ unsigned char *stbtt_GetGlyphBitmapSubpixel(const stbtt_fontinfo *info, float sc
    int ix0,iy0,ix1,iy1;
    stbtt__bitmap gbm;
    stbtt_vertex *vertices;   
-   int num_verts = stbtt_GetGlyphShape(info, glyph, &vertices);
+   int num_verts = stbtt__GetGlyphShapeRef(info, glyph, &vertices);
 
    if (scale_x == 0) scale_x = scale_y;
    if (scale_y == 0) {
@@ -1781,7 +2098,7 @@ unsigned char *stbtt_GetGlyphBitmapSubpixel(const stbtt_fontinfo *info, float sc
          stbtt_Rasterize(&gbm, 0.35f, vertices, num_verts, scale_x, scale_y, shift_x, shift_y, ix0, iy0, 1, info->userdata);
       }
    }
-   STBTT_free(vertices, info->userdata);
+   stbtt__ReleaseGlyphShape(info, vertices);
    return gbm.pixels;
 }   
 
@@ -1794,7 +2111,7 @@ void stbtt_MakeGlyphBitmapSubpixel(const stbtt_fontinfo *info, unsigned char *ou
 {
    int ix0,iy0;
    stbtt_vertex *vertices;
-   int num_verts = stbtt_GetGlyphShape(info, glyph, &vertices);
+   int num_verts = stbtt__GetGlyphShapeRef(info, glyph, &vertices);
    stbtt__bitmap gbm;   
 
    stbtt_GetGlyphBitmapBoxSubpixel(info, glyph, scale_x, scale_y, shift_x, shift_y, &ix0,&iy0,0,0);
@@ -1806,7 +2123,7 @@ void stbtt_MakeGlyphBitmapSubpixel(const stbtt_fontinfo *info, unsigned char *ou
    if (gbm.w && gbm.h)
       stbtt_Rasterize(&gbm, 0.35f, vertices, num_verts, scale_x, scale_y, shift_x, shift_y, ix0,iy0, 1, info->userdata);
 
-   STBTT_free(vertices, info->userdata);
+   stbtt__ReleaseGlyphShape(info, vertices);
 }
 
 void stbtt_MakeGlyphBitmap(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, int glyph)
@@ -1834,23 +2151,230 @@ void stbtt_MakeCodepointBitmap(const stbtt_fontinfo *info, unsigned char *output
    stbtt_MakeCodepointBitmapSubpixel(info, output, out_w, out_h, out_stride, scale_x, scale_y, 0.0f,0.0f, codepoint);
 }
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// LCD subpixel rendering
+//
+
+// FIR weights applied across neighboring subpixels; they sum to 256
+static const unsigned char stbtt__lcd_filter[5] = { 0x08, 0x4D, 0x56, 0x4D, 0x08 };
+
+void stbtt_GetGlyphBitmapBoxLCD(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, float shift_x, float shift_y, int *ix0, int *iy0, int *ix1, int *iy1)
+{
+   int x0,x1;
+   stbtt_GetGlyphBitmapBoxSubpixel(font, glyph, scale_x, scale_y, shift_x, shift_y, &x0,iy0,&x1,iy1);
+   // leave room for the filter to spread into
+   if (ix0) *ix0 = x0 - 1;
+   if (ix1) *ix1 = x1 + 1;
+}
+
+void stbtt_MakeGlyphBitmapLCD(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int glyph, int bgr)
+{
+   int ix0,iy0, i,j,k, w3 = out_w*3;
+   stbtt_vertex *vertices;
+   int num_verts;
+   stbtt__bitmap gbm;
+
+   if (out_w <= 0 || out_h <= 0)
+      return;
+
+   // one coverage sample per subpixel, rasterized in a single pass
+   gbm.pixels = (unsigned char *) STBTT_malloc(w3 * out_h, info->userdata);
+   if (gbm.pixels == NULL)
+      return;
+   gbm.w = w3;
+   gbm.h = out_h;
+   gbm.stride = w3;
+   STBTT_memset(gbm.pixels, 0, w3 * out_h);
+
+   stbtt_GetGlyphBitmapBoxLCD(info, glyph, scale_x, scale_y, shift_x, shift_y, &ix0,&iy0,0,0);
+   num_verts = stbtt__GetGlyphShapeRef(info, glyph, &vertices);
+   stbtt_Rasterize(&gbm, 0.35f, vertices, num_verts, scale_x*3, scale_y, shift_x*3, shift_y, ix0*3,iy0, 1, info->userdata);
+   stbtt__ReleaseGlyphShape(info, vertices);
+
+   for (j=0; j < out_h; ++j) {
+      unsigned char *src = gbm.pixels + j*w3;
+      unsigned char *dest = output + j*out_stride;
+      for (i=0; i < w3; ++i) {
+         int sum = 0;
+         for (k=-2; k <= 2; ++k)
+            if (i+k >= 0 && i+k < w3)
+               sum += stbtt__lcd_filter[k+2] * src[i+k];
+         // i%3 is the channel within the pixel, in display order
+         dest[bgr ? i + 2 - 2*(i%3) : i] = (unsigned char) (sum >> 8);
+      }
+   }
+
+   STBTT_free(gbm.pixels, info->userdata);
+}
+
+void stbtt_MakeCodepointBitmapLCD(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int codepoint, int bgr)
+{
+   stbtt_MakeGlyphBitmapLCD(info, output, out_w, out_h, out_stride, scale_x, scale_y, shift_x, shift_y, stbtt_FindGlyphIndex(info,codepoint), bgr);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// text runs
+//
+
+// returns the codepoint, and advances *s; invalid sequences return 0xfffd
+static int stbtt__utf8_next(const stbtt_uint8 **s, const stbtt_uint8 *end)
+{
+   const stbtt_uint8 *p = *s;
+   stbtt_uint32 c = *p++;
+   int i, n;
+   if      (c < 0x80) n = 0;
+   else if (c < 0xc2) n = -1;
+   else if (c < 0xe0) n = 1, c &= 0x1f;
+   else if (c < 0xf0) n = 2, c &= 0x0f;
+   else if (c < 0xf5) n = 3, c &= 0x07;
+   else               n = -1;
+   if (n < 0 || end - p < n) {
+      *s = p;
+      return 0xfffd;
+   }
+   for (i=0; i < n; ++i) {
+      if ((p[i] & 0xc0) != 0x80) {
+         *s = p;
+         return 0xfffd;
+      }
+      c = (c << 6) + (p[i] & 0x3f);
+   }
+   *s = p + n;
+   // reject overlong encodings, surrogates and out-of-range values
+   if ((n == 2 && c < 0x800) || (n == 3 && (c < 0x10000 || c > 0x10ffff)) || (c >= 0xd800 && c < 0xe000))
+      return 0xfffd;
+   return (int) c;
+}
+
+int stbtt_LayoutRunUTF8(const stbtt_fontinfo *info, float scale, const char *text, int len, stbtt_runglyph *glyphs, int max_glyphs, float *width)
+{
+   const stbtt_uint8 *s = (const stbtt_uint8 *) text;
+   const stbtt_uint8 *end = s + (len < 0 ? (int) STBTT_strlen(text) : len);
+   float x = 0;
+   int n = 0;
+
+   while (s < end && n < max_glyphs) {
+      int advance, c = stbtt__utf8_next(&s, end);
+      glyphs[n].codepoint = c;
+      glyphs[n].glyph = stbtt_FindGlyphIndex(info, c);
+      stbtt_GetGlyphHMetrics(info, glyphs[n].glyph, &advance, NULL);
+      if (n > 0) {
+         // kern against the previous glyph now that we know what follows it
+         float k = scale * stbtt_GetGlyphKernAdvance(info, glyphs[n-1].glyph, glyphs[n].glyph);
+         glyphs[n-1].advance += k;
+         x += k;
+      }
+      glyphs[n].x = x;
+      glyphs[n].advance = scale * advance;
+      x += glyphs[n].advance;
+      ++n;
+   }
+   if (width) *width = x;
+   return n;
+}
+
+void stbtt_GetRunBitmapBox(const stbtt_fontinfo *info, const stbtt_runglyph *glyphs, int num_glyphs, float scale_x, float scale_y, float shift_x, float shift_y, int *ix0, int *iy0, int *ix1, int *iy1)
+{
+   int i, any=0, bx0=0,by0=0,bx1=0,by1=0;
+   for (i=0; i < num_glyphs; ++i) {
+      int x0,y0,x1,y1;
+      if (!stbtt_GetGlyphBox(info, glyphs[i].glyph, 0,0,0,0))
+         continue; // e.g. space character
+      stbtt_GetGlyphBitmapBoxSubpixel(info, glyphs[i].glyph, scale_x, scale_y, shift_x + glyphs[i].x, shift_y, &x0,&y0,&x1,&y1);
+      if (!any || x0 < bx0) bx0 = x0;
+      if (!any || y0 < by0) by0 = y0;
+      if (!any || x1 > bx1) bx1 = x1;
+      if (!any || y1 > by1) by1 = y1;
+      any = 1;
+   }
+   if (ix0) *ix0 = bx0;
+   if (iy0) *iy0 = by0;
+   if (ix1) *ix1 = bx1;
+   if (iy1) *iy1 = by1;
+}
+
+void stbtt_MakeRunBitmap(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, const stbtt_runglyph *glyphs, int num_glyphs)
+{
+   float scale = scale_x > scale_y ? scale_y : scale_x;
+   int vsubsample = out_h < 8 ? 15 : 5;
+   int ix0,iy0, i, n=0, cap=0;
+   stbtt__edge *e = NULL;
+   stbtt__bitmap gbm;
+
+   if (out_w <= 0 || out_h <= 0)
+      return;
+
+   stbtt_GetRunBitmapBox(info, glyphs, num_glyphs, scale_x, scale_y, shift_x, shift_y, &ix0,&iy0,0,0);
+
+   // gather the edges of every glyph into one list, so they're sorted and
+   // swept together
+   for (i=0; i < num_glyphs; ++i) {
+      stbtt_vertex *vertices;
+      int num_verts = stbtt__GetGlyphShapeRef(info, glyphs[i].glyph, &vertices);
+      if (num_verts > 0) {
+         int winding_count, *winding_lengths, k, num_points=0;
+         stbtt__point *windings = stbtt_FlattenCurves(vertices, num_verts, 0.35f / scale, &winding_lengths, &winding_count, info->userdata);
+         if (windings) {
+            for (k=0; k < winding_count; ++k)
+               num_points += winding_lengths[k];
+            if (n + num_points + 1 > cap) { // +1 for the sentinel
+               stbtt__edge *t;
+               cap = cap*2 > n+num_points+1 ? cap*2 : n+num_points+1;
+               t = (stbtt__edge *) STBTT_malloc(sizeof(*t) * cap, info->userdata);
+               if (t == NULL) {
+                  STBTT_free(winding_lengths, info->userdata);
+                  STBTT_free(windings, info->userdata);
+                  stbtt__ReleaseGlyphShape(info, vertices);
+                  if (e) STBTT_free(e, info->userdata);
+                  return;
+               }
+               if (e) {
+                  STBTT_memcpy(t, e, n * sizeof(*e));
+                  STBTT_free(e, info->userdata);
+               }
+               e = t;
+            }
+            n += stbtt__build_edges(e+n, windings, winding_lengths, winding_count, scale_x, scale_y, shift_x + glyphs[i].x, shift_y, 1, vsubsample);
+            STBTT_free(winding_lengths, info->userdata);
+            STBTT_free(windings, info->userdata);
+         }
+      }
+      stbtt__ReleaseGlyphShape(info, vertices);
+   }
+
+   if (e == NULL) {
+      // nothing visible; still clear the output like a rasterized run would
+      for (i=0; i < out_h; ++i)
+         STBTT_memset(output + i*out_stride, 0, out_w);
+      return;
+   }
+
+   gbm.pixels = output;
+   gbm.w = out_w;
+   gbm.h = out_h;
+   gbm.stride = out_stride;
+
+   STBTT_sort(e, n, sizeof(e[0]), stbtt__edge_compare);
+   stbtt__rasterize_sorted_edges(&gbm, e, n, vsubsample, ix0, iy0, info->userdata);
+   STBTT_free(e, info->userdata);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // bitmap baking
 //
 // This is SUPER-CRAPPY packing to keep source code small
 
-extern int stbtt_BakeFontBitmap(const unsigned char *data, int offset,  // font location (use offset=0 for plain .ttf)
-                                float pixel_height,                     // height of font in pixels
-                                unsigned char *pixels, int pw, int ph,  // bitmap to be filled in
-                                int first_char, int num_chars,          // characters to bake
-                                stbtt_bakedchar *chardata)
+int stbtt_BakeFontBitmapLayout(const unsigned char *data, int offset, float pixel_height,
+                               int pw, int ph, int first_char, int num_chars,
+                               stbtt_bakedchar *chardata)
 {
    float scale;
    int x,y,bottom_y, i;
    stbtt_fontinfo f;
    stbtt_InitFont(&f, data, offset);
-   STBTT_memset(pixels, 0, pw*ph); // background of 0 around pixels
    x=y=1;
    bottom_y = 1;
 
@@ -1869,7 +2393,6 @@ extern int stbtt_BakeFontBitmap(const unsigned char *data, int offset,  // font
          return -i;
       STBTT_assert(x+gw < pw);
       STBTT_assert(y+gh < ph);
-      stbtt_MakeGlyphBitmap(&f, pixels+x+y*pw, gw,gh,pw, scale,scale, g);
       chardata[i].x0 = (stbtt_int16) x;
       chardata[i].y0 = (stbtt_int16) y;
       chardata[i].x1 = (stbtt_int16) (x + gw);
@@ -1884,6 +2407,142 @@ extern int stbtt_BakeFontBitmap(const unsigned char *data, int offset,  // font
    return bottom_y;
 }
 
+// render every 'step'th character of chardata[start..start+count-1]
+static void stbtt__bake_glyphs(const stbtt_fontinfo *f, float scale, unsigned char *pixels, int pw,
+                               int first_char, const stbtt_bakedchar *chardata, int start, int count, int step)
+{
+   int i;
+   for (i=start; i < start+count; i += step) {
+      const stbtt_bakedchar *b = &chardata[i];
+      int g = stbtt_FindGlyphIndex(f, first_char + i);
+      stbtt_MakeGlyphBitmap(f, pixels + b->x0 + b->y0*pw, b->x1 - b->x0, b->y1 - b->y0, pw, scale,scale, g);
+   }
+}
+
+void stbtt_BakeFontBitmapGlyphs(const unsigned char *data, int offset, float pixel_height,
+                                unsigned char *pixels, int pw, int ph, int first_char,
+                                const stbtt_bakedchar *chardata, int start, int count)
+{
+   stbtt_fontinfo f;
+   (void) ph;
+   stbtt_InitFont(&f, data, offset);
+   stbtt__bake_glyphs(&f, stbtt_ScaleForPixelHeight(&f, pixel_height), pixels, pw, first_char, chardata, start, count, 1);
+}
+
+extern int stbtt_BakeFontBitmap(const unsigned char *data, int offset,  // font location (use offset=0 for plain .ttf)
+                                float pixel_height,                     // height of font in pixels
+                                unsigned char *pixels, int pw, int ph,  // bitmap to be filled in
+                                int first_char, int num_chars,          // characters to bake
+                                stbtt_bakedchar *chardata)
+{
+   int result = stbtt_BakeFontBitmapLayout(data, offset, pixel_height, pw, ph, first_char, num_chars, chardata);
+   STBTT_memset(pixels, 0, pw*ph); // background of 0 around pixels
+   stbtt_BakeFontBitmapGlyphs(data, offset, pixel_height, pixels, pw, ph, first_char, chardata, 0, result > 0 ? num_chars : -result);
+   return result;
+}
+
+#ifdef STBTT_THREADS
+#ifdef _WIN32
+   #ifndef _WINDOWS_
+   #include <windows.h>
+   #endif
+   #define STBTT__THREAD_RETURN   DWORD WINAPI
+#else
+   #include <pthread.h>
+   #define STBTT__THREAD_RETURN   void *
+#endif
+
+#define STBTT__MAX_BAKE_THREADS  64
+
+typedef struct
+{
+   const stbtt_fontinfo *f;
+   float scale;
+   unsigned char *pixels;
+   int pw, first_char;
+   const stbtt_bakedchar *chardata;
+   int start, count, step;
+} stbtt__bake_job;
+
+static STBTT__THREAD_RETURN stbtt__bake_thread(void *p)
+{
+   stbtt__bake_job *j = (stbtt__bake_job *) p;
+   stbtt__bake_glyphs(j->f, j->scale, j->pixels, j->pw, j->first_char, j->chardata, j->start, j->count, j->step);
+   return 0;
+}
+
+int stbtt_BakeFontBitmapParallel(const unsigned char *data, int offset, float pixel_height,
+                                 unsigned char *pixels, int pw, int ph,
+                                 int first_char, int num_chars,
+                                 stbtt_bakedchar *chardata, int num_threads)
+{
+   stbtt_fontinfo f;
+   stbtt__bake_job *jobs;
+   int i, n, started;
+   float scale;
+   int result = stbtt_BakeFontBitmapLayout(data, offset, pixel_height, pw, ph, first_char, num_chars, chardata);
+   STBTT_memset(pixels, 0, pw*ph); // background of 0 around pixels
+
+   n = result > 0 ? num_chars : -result;
+   if (num_threads > n) num_threads = n;
+   if (num_threads > STBTT__MAX_BAKE_THREADS) num_threads = STBTT__MAX_BAKE_THREADS;
+   stbtt_InitFont(&f, data, offset);
+   f.userdata = NULL;
+   scale = stbtt_ScaleForPixelHeight(&f, pixel_height);
+
+   jobs = num_threads > 1 ? (stbtt__bake_job *) STBTT_malloc(sizeof(*jobs) * num_threads, NULL) : NULL;
+   if (jobs == NULL) {
+      stbtt__bake_glyphs(&f, scale, pixels, pw, first_char, chardata, 0, n, 1);
+      return result;
+   }
+
+   // interleave the characters, since glyph complexity tends to vary by range
+   // (e.g. latin vs. CJK); which thread renders what doesn't affect the output
+   for (i=0; i < num_threads; ++i) {
+      jobs[i].f = &f;
+      jobs[i].scale = scale;
+      jobs[i].pixels = pixels;
+      jobs[i].pw = pw;
+      jobs[i].first_char = first_char;
+      jobs[i].chardata = chardata;
+      jobs[i].start = i;
+      jobs[i].count = n - i;
+      jobs[i].step = num_threads;
+   }
+
+   {
+      #ifdef _WIN32
+      HANDLE threads[STBTT__MAX_BAKE_THREADS];
+      #else
+      pthread_t threads[STBTT__MAX_BAKE_THREADS];
+      #endif
+      // the calling thread does job 0
+      for (started=1; started < num_threads; ++started) {
+         #ifdef _WIN32
+         threads[started] = CreateThread(NULL, 0, stbtt__bake_thread, &jobs[started], 0, NULL);
+         if (threads[started] == NULL) break;
+         #else
+         if (pthread_create(&threads[started], NULL, stbtt__bake_thread, &jobs[started]) != 0) break;
+         #endif
+      }
+      stbtt__bake_thread(&jobs[0]);
+      // any jobs we failed to start get done here
+      for (i=started; i < num_threads; ++i)
+         stbtt__bake_thread(&jobs[i]);
+      for (i=1; i < started; ++i) {
+         #ifdef _WIN32
+         WaitForSingleObject(threads[i], INFINITE);
+         CloseHandle(threads[i]);
+         #else
+         pthread_join(threads[i], NULL);
+         #endif
+      }
+   }
+   STBTT_free(jobs, NULL);
+   return result;
+}
+#endif // STBTT_THREADS
+
 void stbtt_GetBakedQuad(stbtt_bakedchar *chardata, int pw, int ph, int char_index, float *xpos, float *ypos, stbtt_aligned_quad *q, int opengl_fillrule)
 {
    float d3d_bias = opengl_fillrule ? 0 : -0.5f;